@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef CACHE_H
+#define CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* On-disk cache of compiled programs.
+ *
+ * Items are stored under a SHA-1 key in files below $MESA_GLSL_CACHE_DIR,
+ * or $XDG_CACHE_HOME/mesa, or ~/.cache/mesa.  Setting
+ * MESA_GLSL_CACHE_DISABLE makes cache_create() return NULL, and
+ * MESA_GLSL_CACHE_MAX_SIZE (a number of bytes, with an optional K, M or G
+ * suffix) bounds the size of the cache, 1G by default.  Least recently
+ * used items are evicted to stay below that.
+ *
+ * Several processes may use the same cache directory at once.
+ */
+
+typedef uint8_t cache_key[20];
+
+struct program_cache;
+
+#ifdef ENABLE_SHADER_CACHE
+
+/**
+ * Create a new cache object, or return NULL if the cache is disabled or
+ * can't be set up.
+ */
+struct program_cache *
+cache_create(void);
+
+/**
+ * Destroy a cache object, (freeing all associated resources).
+ */
+void
+cache_destroy(struct program_cache *cache);
+
+/**
+ * Store an item in the cache under the name \key.
+ *
+ * The item can be retrieved later with cache_get(), (unless the same key
+ * is replaced in the meantime or it gets evicted to make room for other
+ * items).
+ */
+void
+cache_put(struct program_cache *cache, const cache_key key,
+          const void *data, size_t size);
+
+/**
+ * Retrieve an item previously stored in the cache with the name \key.
+ *
+ * The item must have been stored with a previous call to cache_put().
+ *
+ * If \size is non-NULL, then, on successful return, it will be set to the
+ * size of the object.
+ *
+ * \return A pointer to the stored object, (which should be free()'d by the
+ * caller), or NULL if the object is not in the cache.
+ */
+void *
+cache_get(struct program_cache *cache, const cache_key key, size_t *size);
+
+/**
+ * Record in the cache that \key has been seen, without storing any data.
+ *
+ * Such keys are remembered in a small table shared by all users of the
+ * cache, so cache_has_key() may give a false positive.
+ */
+void
+cache_put_key(struct program_cache *cache, const cache_key key);
+
+/**
+ * Test whether \key was recorded with cache_put_key().
+ */
+bool
+cache_has_key(struct program_cache *cache, const cache_key key);
+
+#else
+
+static inline struct program_cache *
+cache_create(void)
+{
+   return NULL;
+}
+
+static inline void
+cache_destroy(struct program_cache *cache)
+{
+   return;
+}
+
+static inline void
+cache_put(struct program_cache *cache, const cache_key key,
+          const void *data, size_t size)
+{
+   return;
+}
+
+static inline void *
+cache_get(struct program_cache *cache, const cache_key key, size_t *size)
+{
+   return NULL;
+}
+
+static inline void
+cache_put_key(struct program_cache *cache, const cache_key key)
+{
+   return;
+}
+
+static inline bool
+cache_has_key(struct program_cache *cache, const cache_key key)
+{
+   return false;
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CACHE_H */
@@ -1341,8 +1341,14 @@ link_assign_uniform_locations(struct gl_shader_program *prog,
    prog->NumUniformStorage = num_uniforms;
    prog->NumHiddenUniforms = hidden_uniforms;
    prog->UniformStorage = uniforms;
+   prog->NumUniformDataSlots = num_data_slots;
+   prog->UniformDataSlots = data;
 
    link_set_uniform_initializers(prog, boolean_true);
 
+   prog->UniformDataDefaults =
+      ralloc_array(uniforms, union gl_constant_value, num_data_slots);
+   memcpy(prog->UniformDataDefaults, data, num_data_slots * sizeof(*data));
+
    return;
 }
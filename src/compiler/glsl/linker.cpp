@@ -4003,7 +4003,7 @@ link_assign_subroutine_types(struct gl_shader_program *prog)
    }
 }
 
-static void
+void
 split_ubos_and_ssbos(void *mem_ctx,
                      struct gl_uniform_block *blocks,
                      unsigned num_blocks,
@@ -88,6 +88,17 @@ extern void
 link_check_atomic_counter_resources(struct gl_context *ctx,
                                     struct gl_shader_program *prog);
 
+extern void
+split_ubos_and_ssbos(void *mem_ctx,
+                     struct gl_uniform_block *blocks,
+                     unsigned num_blocks,
+                     struct gl_uniform_block ***ubos,
+                     unsigned *num_ubos,
+                     unsigned **ubo_interface_block_indices,
+                     struct gl_uniform_block ***ssbos,
+                     unsigned *num_ssbos,
+                     unsigned **ssbo_interface_block_indices);
+
 /**
  * Class for processing all of the leaf fields of a variable that corresponds
  * to a program resource.
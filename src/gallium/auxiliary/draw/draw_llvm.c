@@ -561,6 +561,8 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
                  variant->shader->variants_cached);
 
    variant->gallivm = gallivm_create(module_name, llvm->context);
+   /* Draw variants are never recompiled. */
+   variant->gallivm->opt_tier = gallivm_get_opt_tier(PIPE_SHADER_VERTEX, 0);
 
    create_jit_types(variant);
 
@@ -628,6 +630,7 @@ generate_vs(struct draw_llvm_variant *variant,
                      NULL,
                      draw_sampler,
                      &llvm->draw->vs.vertex_shader->info,
+                     NULL,
                      NULL);
 
    {
@@ -771,7 +774,7 @@ convert_to_soa(struct gallivm_state *gallivm,
    debug_assert(TGSI_NUM_CHANNELS == 4);
    debug_assert((soa_type.length % TGSI_NUM_CHANNELS) == 0);
 
-   aos_channel_type.length >>= 1;
+   aos_channel_type.length = TGSI_NUM_CHANNELS;
 
    for (i = 0; i < num_attribs; ++i) {
       LLVMValueRef aos_channels[TGSI_NUM_CHANNELS];
@@ -2237,7 +2240,8 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
                      NULL,
                      sampler,
                      &llvm->draw->gs.geometry_shader->info,
-                     (const struct lp_build_tgsi_gs_iface *)&gs_iface);
+                     (const struct lp_build_tgsi_gs_iface *)&gs_iface,
+                     NULL);
 
    sampler->destroy(sampler);
 
@@ -2273,6 +2277,8 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
                  variant->shader->variants_cached);
 
    variant->gallivm = gallivm_create(module_name, llvm->context);
+   /* Draw variants are never recompiled. */
+   variant->gallivm->opt_tier = gallivm_get_opt_tier(PIPE_SHADER_GEOMETRY, 0);
 
    create_gs_jit_types(variant);
 
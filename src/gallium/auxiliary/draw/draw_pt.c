@@ -148,6 +148,9 @@ draw_pt_arrays(struct draw_context *draw,
 
    frontend->run( frontend, start, count );
 
+   if (middle->sync)
+      middle->sync(middle);
+
    return TRUE;
 }
 
@@ -124,6 +124,13 @@ struct draw_pt_middle_end {
 
    int (*get_max_vertex_count)( struct draw_pt_middle_end * );
 
+   /* Finish processing all segments passed to run*() so far, if they
+    * are processed asynchronously.  Called at the end of each draw, since
+    * the vertex buffers and draw parameters are only valid until then.
+    * May be NULL.
+    */
+   void (*sync)( struct draw_pt_middle_end * );
+
    void (*finish)( struct draw_pt_middle_end * );
    void (*destroy)( struct draw_pt_middle_end * );
 };
@@ -25,9 +25,30 @@
  *
  **************************************************************************/
 
+/**
+ * The LLVM middle end: fetch, vertex shade and clip test with generated
+ * code, then run the geometry shader, stream output and either the
+ * pipeline or emit.
+ *
+ * With DRAW_NUM_THREADS=N (N > 1), N-1 worker threads are created.  The
+ * segments vsplit hands us are then queued, and fetched, vertex shaded
+ * and clip tested by the workers.  The generated code only reads state
+ * which is constant for the duration of a draw.  Everything after that,
+ * including geometry shading, stream output and emitting to the render
+ * backend, is still done by the application's thread, one segment at a
+ * time in the order they were queued, so primitive order is preserved.
+ * The application's thread shades the oldest segment itself if no worker
+ * has picked it up yet when it's needed.  All queued segments are emitted
+ * by the end of each draw_pt_arrays() call.
+ */
+
+
+#include "os/os_thread.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_string.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -39,6 +60,41 @@
 #include "gallivm/lp_bld_init.h"
 
 
+/** Max number of threads shading vertices, including the caller's */
+#define LLVM_MAX_THREADS 16
+
+/** Max number of segments queued at once */
+#define LLVM_MAX_SEGMENTS (2 * LLVM_MAX_THREADS)
+
+
+enum llvm_segment_state {
+   SEGMENT_QUEUED,
+   SEGMENT_RUNNING,
+   SEGMENT_DONE
+};
+
+
+/**
+ * A segment queued for vertex shading by the worker threads.  The element
+ * lists are copied, since vsplit reuses its buffers for the next segment.
+ */
+struct llvm_segment {
+   struct draw_fetch_info fetch_info;
+   struct draw_prim_info prim_info;
+   unsigned prim_length;
+
+   unsigned *fetch_elts;
+   unsigned fetch_elts_size;
+   ushort *draw_elts;
+   unsigned draw_elts_size;
+
+   struct draw_vertex_info vert_info;
+   unsigned clipped;
+
+   enum llvm_segment_state state;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -56,6 +112,23 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /*
+    * Segment queue, a ring of LLVM_MAX_SEGMENTS.  The indices are free
+    * running.  Segments [first_segment, next_run) have been picked up for
+    * shading, and [next_run, next_segment) are waiting for a thread.
+    * Only the application's thread changes first_segment and next_segment.
+    */
+   unsigned num_threads;
+   pipe_thread threads[LLVM_MAX_THREADS];
+   pipe_mutex queue_mutex;
+   pipe_condvar queued_cond;   /**< a segment was queued, or exit_flag */
+   pipe_condvar done_cond;     /**< a segment was shaded */
+   struct llvm_segment segments[LLVM_MAX_SEGMENTS];
+   unsigned first_segment;
+   unsigned next_run;
+   unsigned next_segment;
+   boolean exit_flag;
 };
 
 
@@ -336,46 +409,40 @@ emit(struct pt_emit *emit,
 }
 
 
-static void
-llvm_pipeline_generic(struct draw_pt_middle_end *middle,
-                      const struct draw_fetch_info *fetch_info,
-                      const struct draw_prim_info *in_prim_info)
+/**
+ * Allocate the vertex buffer the vertex shader writes to.
+ */
+static boolean
+llvm_alloc_vertices(struct llvm_middle_end *fpme,
+                    struct draw_vertex_info *vert_info,
+                    unsigned count)
 {
-   struct llvm_middle_end *fpme = llvm_middle_end(middle);
-   struct draw_context *draw = fpme->draw;
-   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
-   struct draw_prim_info gs_prim_info;
-   struct draw_vertex_info llvm_vert_info;
-   struct draw_vertex_info gs_vert_info;
-   struct draw_vertex_info *vert_info;
-   struct draw_prim_info ia_prim_info;
-   struct draw_vertex_info ia_vert_info;
-   const struct draw_prim_info *prim_info = in_prim_info;
-   boolean free_prim_info = FALSE;
-   unsigned opt = fpme->opt;
-   unsigned clipped = 0;
-
-   llvm_vert_info.count = fetch_info->count;
-   llvm_vert_info.vertex_size = fpme->vertex_size;
-   llvm_vert_info.stride = fpme->vertex_size;
-   llvm_vert_info.verts = (struct vertex_header *)
+   vert_info->count = count;
+   vert_info->vertex_size = fpme->vertex_size;
+   vert_info->stride = fpme->vertex_size;
+   vert_info->verts = (struct vertex_header *)
       MALLOC(fpme->vertex_size *
-             align(fetch_info->count, lp_native_vector_width / 32));
-   if (!llvm_vert_info.verts) {
-      assert(0);
-      return;
-   }
+             align(count, lp_native_vector_width / 32));
+   return vert_info->verts != NULL;
+}
 
-   if (draw->collect_statistics) {
-      draw->statistics.ia_vertices += prim_info->count;
-      draw->statistics.ia_primitives +=
-         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
-   }
+
+/**
+ * Fetch, vertex shade and clip test with the generated code.
+ * This may be called by the worker threads, so it must only look at
+ * state which doesn't change during a draw.
+ * \return non-zero if any vertex was clipped, or has a non-one edgeflag
+ */
+static unsigned
+llvm_shade_vertices(const struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    struct vertex_header *verts)
+{
+   struct draw_context *draw = fpme->draw;
 
    if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
+      return fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       verts,
                                        draw->pt.user.vbuffer,
                                        fetch_info->start,
                                        fetch_info->count,
@@ -385,8 +452,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                        draw->start_index,
                                        draw->start_instance);
    else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
+      return fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            verts,
                                             draw->pt.user.vbuffer,
                                             fetch_info->elts,
                                             draw->pt.user.eltMax,
@@ -396,11 +463,37 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                             draw->instance_id,
                                             draw->pt.user.eltBias,
                                             draw->start_instance);
+}
 
-   /* Finished with fetch and vs:
-    */
-   fetch_info = NULL;
-   vert_info = &llvm_vert_info;
+
+/**
+ * Run the rest of the pipeline on vertices shaded by
+ * llvm_shade_vertices().  Frees the vertices.
+ */
+static void
+llvm_pipeline_emit(struct llvm_middle_end *fpme,
+                   unsigned fetch_count,
+                   struct draw_vertex_info *llvm_vert_info,
+                   const struct draw_prim_info *in_prim_info,
+                   unsigned clipped)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
+   struct draw_prim_info gs_prim_info;
+   struct draw_vertex_info gs_vert_info;
+   struct draw_vertex_info *vert_info = llvm_vert_info;
+   struct draw_prim_info ia_prim_info;
+   struct draw_vertex_info ia_vert_info;
+   const struct draw_prim_info *prim_info = in_prim_info;
+   boolean free_prim_info = FALSE;
+   unsigned opt = fpme->opt;
+
+   if (draw->collect_statistics) {
+      draw->statistics.ia_vertices += prim_info->count;
+      draw->statistics.ia_primitives +=
+         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
+      draw->statistics.vs_invocations += fetch_count;
+   }
 
    if ((opt & PT_SHADE) && gshader) {
       struct draw_vertex_shader *vshader = draw->vs.vertex_shader;
@@ -474,6 +567,193 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 }
 
 
+static void
+llvm_shade_segment(struct llvm_middle_end *fpme, struct llvm_segment *seg)
+{
+   if (seg->vert_info.verts)
+      seg->clipped = llvm_shade_vertices(fpme, &seg->fetch_info,
+                                         seg->vert_info.verts);
+}
+
+
+static PIPE_THREAD_ROUTINE( llvm_thread_function, init_data )
+{
+   struct llvm_middle_end *fpme = (struct llvm_middle_end *) init_data;
+
+   pipe_thread_setname("draw-vs");
+
+   /* Same as draw_vbo() does for the application's thread */
+   util_fpstate_set_denorms_to_zero(util_fpstate_get());
+
+   pipe_mutex_lock(fpme->queue_mutex);
+
+   while (1) {
+      struct llvm_segment *seg;
+
+      while (!fpme->exit_flag && fpme->next_run == fpme->next_segment)
+         pipe_condvar_wait(fpme->queued_cond, fpme->queue_mutex);
+
+      if (fpme->exit_flag)
+         break;
+
+      seg = &fpme->segments[fpme->next_run++ % LLVM_MAX_SEGMENTS];
+      seg->state = SEGMENT_RUNNING;
+      pipe_mutex_unlock(fpme->queue_mutex);
+
+      llvm_shade_segment(fpme, seg);
+
+      pipe_mutex_lock(fpme->queue_mutex);
+      seg->state = SEGMENT_DONE;
+      pipe_condvar_broadcast(fpme->done_cond);
+   }
+
+   pipe_mutex_unlock(fpme->queue_mutex);
+
+   return 0;
+}
+
+
+/**
+ * Wait for the oldest queued segment to be shaded, shading it ourselves
+ * if no worker has started on it yet, and emit it.
+ */
+static void
+llvm_emit_first_segment(struct llvm_middle_end *fpme)
+{
+   struct llvm_segment *seg =
+      &fpme->segments[fpme->first_segment % LLVM_MAX_SEGMENTS];
+
+   assert(fpme->first_segment != fpme->next_segment);
+
+   pipe_mutex_lock(fpme->queue_mutex);
+   if (fpme->next_run == fpme->first_segment) {
+      fpme->next_run++;
+      seg->state = SEGMENT_RUNNING;
+      pipe_mutex_unlock(fpme->queue_mutex);
+
+      llvm_shade_segment(fpme, seg);
+
+      pipe_mutex_lock(fpme->queue_mutex);
+      seg->state = SEGMENT_DONE;
+   }
+   while (seg->state != SEGMENT_DONE)
+      pipe_condvar_wait(fpme->done_cond, fpme->queue_mutex);
+   pipe_mutex_unlock(fpme->queue_mutex);
+
+   fpme->first_segment++;
+
+   if (seg->vert_info.verts) {
+      llvm_pipeline_emit(fpme, seg->fetch_info.count, &seg->vert_info,
+                         &seg->prim_info, seg->clipped);
+      seg->vert_info.verts = NULL;
+   }
+}
+
+
+/**
+ * Emit all queued segments.
+ */
+static void
+llvm_middle_end_sync(struct draw_pt_middle_end *middle)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+
+   while (fpme->first_segment != fpme->next_segment)
+      llvm_emit_first_segment(fpme);
+}
+
+
+/**
+ * Copy the segment and queue it for the worker threads.
+ */
+static void
+llvm_queue_segment(struct llvm_middle_end *fpme,
+                   const struct draw_fetch_info *fetch_info,
+                   const struct draw_prim_info *prim_info)
+{
+   struct llvm_segment *seg;
+
+   if (fpme->next_segment - fpme->first_segment == LLVM_MAX_SEGMENTS)
+      llvm_emit_first_segment(fpme);
+
+   seg = &fpme->segments[fpme->next_segment % LLVM_MAX_SEGMENTS];
+
+   seg->fetch_info = *fetch_info;
+   seg->prim_info = *prim_info;
+
+   assert(prim_info->primitive_count == 1);
+   seg->prim_length = prim_info->primitive_lengths[0];
+   seg->prim_info.primitive_lengths = &seg->prim_length;
+
+   if (fetch_info->elts) {
+      if (seg->fetch_elts_size < fetch_info->count) {
+         seg->fetch_elts = REALLOC(seg->fetch_elts,
+                                   seg->fetch_elts_size * sizeof(unsigned),
+                                   fetch_info->count * sizeof(unsigned));
+         seg->fetch_elts_size = seg->fetch_elts ? fetch_info->count : 0;
+      }
+      if (seg->fetch_elts)
+         memcpy(seg->fetch_elts, fetch_info->elts,
+                fetch_info->count * sizeof(unsigned));
+      seg->fetch_info.elts = seg->fetch_elts;
+   }
+
+   if (prim_info->elts) {
+      if (seg->draw_elts_size < prim_info->count) {
+         seg->draw_elts = REALLOC(seg->draw_elts,
+                                  seg->draw_elts_size * sizeof(ushort),
+                                  prim_info->count * sizeof(ushort));
+         seg->draw_elts_size = seg->draw_elts ? prim_info->count : 0;
+      }
+      if (seg->draw_elts)
+         memcpy(seg->draw_elts, prim_info->elts,
+                prim_info->count * sizeof(ushort));
+      seg->prim_info.elts = seg->draw_elts;
+   }
+
+   /* On allocation failure the segment is dropped, as in the serial path */
+   if (!llvm_alloc_vertices(fpme, &seg->vert_info, fetch_info->count) ||
+       (fetch_info->elts && !seg->fetch_elts) ||
+       (prim_info->elts && !seg->draw_elts)) {
+      assert(0);
+      FREE(seg->vert_info.verts);
+      seg->vert_info.verts = NULL;
+   }
+
+   pipe_mutex_lock(fpme->queue_mutex);
+   seg->state = SEGMENT_QUEUED;
+   fpme->next_segment++;
+   pipe_condvar_signal(fpme->queued_cond);
+   pipe_mutex_unlock(fpme->queue_mutex);
+}
+
+
+static void
+llvm_pipeline_generic(struct draw_pt_middle_end *middle,
+                      const struct draw_fetch_info *fetch_info,
+                      const struct draw_prim_info *prim_info)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct draw_vertex_info llvm_vert_info;
+   unsigned clipped;
+
+   if (fpme->num_threads) {
+      llvm_queue_segment(fpme, fetch_info, prim_info);
+      return;
+   }
+
+   if (!llvm_alloc_vertices(fpme, &llvm_vert_info, fetch_info->count)) {
+      assert(0);
+      return;
+   }
+
+   clipped = llvm_shade_vertices(fpme, fetch_info, llvm_vert_info.verts);
+
+   llvm_pipeline_emit(fpme, fetch_info->count, &llvm_vert_info,
+                      prim_info, clipped);
+}
+
+
 static inline unsigned
 prim_type(unsigned prim, unsigned flags)
 {
@@ -577,7 +857,60 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
-   /* nothing to do */
+   llvm_middle_end_sync(middle);
+}
+
+
+static void
+llvm_destroy_threads(struct llvm_middle_end *fpme)
+{
+   unsigned i;
+
+   if (!fpme->num_threads)
+      return;
+
+   pipe_mutex_lock(fpme->queue_mutex);
+   fpme->exit_flag = TRUE;
+   pipe_condvar_broadcast(fpme->queued_cond);
+   pipe_mutex_unlock(fpme->queue_mutex);
+
+   for (i = 0; i < fpme->num_threads - 1; i++)
+      pipe_thread_wait(fpme->threads[i]);
+
+   pipe_condvar_destroy(fpme->queued_cond);
+   pipe_condvar_destroy(fpme->done_cond);
+   pipe_mutex_destroy(fpme->queue_mutex);
+
+   for (i = 0; i < LLVM_MAX_SEGMENTS; i++) {
+      FREE(fpme->segments[i].fetch_elts);
+      FREE(fpme->segments[i].draw_elts);
+   }
+
+   fpme->num_threads = 0;
+}
+
+
+/**
+ * Create num_threads - 1 worker threads for vertex shading.
+ */
+static void
+llvm_create_threads(struct llvm_middle_end *fpme, unsigned num_threads)
+{
+   unsigned i;
+
+   num_threads = MIN2(num_threads, LLVM_MAX_THREADS);
+   if (num_threads < 2)
+      return;
+
+   pipe_mutex_init(fpme->queue_mutex);
+   pipe_condvar_init(fpme->queued_cond);
+   pipe_condvar_init(fpme->done_cond);
+
+   for (i = 0; i < num_threads - 1; i++)
+      fpme->threads[i] = pipe_thread_create(llvm_thread_function,
+                                            (void *) fpme);
+
+   fpme->num_threads = num_threads;
 }
 
 
@@ -586,6 +919,8 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   llvm_destroy_threads(fpme);
+
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
 
@@ -619,6 +954,7 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    fpme->base.run             = llvm_middle_end_run;
    fpme->base.run_linear      = llvm_middle_end_linear_run;
    fpme->base.run_linear_elts = llvm_middle_end_linear_run_elts;
+   fpme->base.sync            = llvm_middle_end_sync;
    fpme->base.finish          = llvm_middle_end_finish;
    fpme->base.destroy         = llvm_middle_end_destroy;
 
@@ -646,6 +982,9 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* Threaded vertex shading is off by default */
+   llvm_create_threads(fpme, debug_get_num_option("DRAW_NUM_THREADS", 0));
+
    return &fpme->base;
 
  fail:
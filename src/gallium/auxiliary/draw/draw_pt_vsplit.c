@@ -23,19 +23,32 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_prim.h"
 
 #include "draw/draw_context.h"
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
 #define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+
+/*
+ * The post-transform vertex cache maps the fetch elements of a segment to
+ * draw elements, so that each vertex of the segment is only shaded once.
+ * It's set associative, with FIFO replacement in each set.  With a single
+ * way it's the old direct mapped cache.
+ */
+#define CACHE_SETS     256
+#define CACHE_MAX_WAYS 8
 
 /* The largest possible index withing an index buffer */
 #define MAX_ELT_IDX 0xffffffff
 
+DEBUG_GET_ONCE_NUM_OPTION(draw_vcache_ways, "DRAW_VCACHE_WAYS", 4)
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vcache_stats, "DRAW_VCACHE_STATS", FALSE)
+
 struct vsplit_frontend {
    struct draw_pt_front_end base;
    struct draw_context *draw;
@@ -54,30 +67,73 @@ struct vsplit_frontend {
 
    struct {
       /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      unsigned fetches[CACHE_SETS][CACHE_MAX_WAYS];
+      ushort draws[CACHE_SETS][CACHE_MAX_WAYS];
+      ubyte valid[CACHE_SETS];  /* number of valid ways in each set */
+      ubyte next[CACHE_SETS];   /* next way to replace once the set is full */
+      unsigned ways;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
    } cache;
+
+   /* per draw statistics, see vsplit_run_stats() */
+   struct {
+      unsigned vertices;        /* vertices passed to the middle end */
+      unsigned range_segments;  /* segments fetched as an index range */
+   } stats;
+
+   void (*run)(struct draw_pt_front_end *, unsigned start, unsigned count);
 };
 
 
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   memset(vsplit->cache.valid, 0, sizeof(vsplit->cache.valid));
+   memset(vsplit->cache.next, 0, sizeof(vsplit->cache.next));
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
 
+/**
+ * Pass the segment in the cache to the middle end.
+ *
+ * If the fetch elements all lie in an index range which is smaller than
+ * the number of fetch elements, the cache missed some repeated vertices.
+ * Fetch the whole range instead, with the draw elements rebased to the
+ * start of the range, so that no vertex is shaded twice.
+ */
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   unsigned num_fetch = vsplit->cache.num_fetch_elts;
+   unsigned min_fetch = ~0u, max_fetch = 0;
+   unsigned i;
+
+   for (i = 0; i < num_fetch; i++) {
+      min_fetch = MIN2(min_fetch, vsplit->fetch_elts[i]);
+      max_fetch = MAX2(max_fetch, vsplit->fetch_elts[i]);
+   }
+
+   if (num_fetch && max_fetch != DRAW_MAX_FETCH_IDX &&
+       max_fetch - min_fetch + 1 < num_fetch) {
+      for (i = 0; i < vsplit->cache.num_draw_elts; i++) {
+         vsplit->draw_elts[i] = (ushort)
+            (vsplit->fetch_elts[vsplit->draw_elts[i]] - min_fetch);
+      }
+
+      num_fetch = max_fetch - min_fetch + 1;
+      for (i = 0; i < num_fetch; i++)
+         vsplit->fetch_elts[i] = min_fetch + i;
+
+      vsplit->stats.range_segments++;
+   }
+
+   vsplit->stats.vertices += num_fetch;
+
    vsplit->middle->run(vsplit->middle,
-         vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
+         vsplit->fetch_elts, num_fetch,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
 }
 
@@ -87,23 +143,40 @@ vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch, unsigned ofbias)
 {
-   unsigned hash;
+   const unsigned set = fetch % CACHE_SETS;
+   unsigned valid = vsplit->cache.valid[set];
+   unsigned way;
+
+   /* Look the value up, unless it's an overflow due to the element bias */
+   if (!ofbias) {
+      for (way = 0; way < valid; way++) {
+         if (vsplit->cache.fetches[set][way] == fetch) {
+            vsplit->draw_elts[vsplit->cache.num_draw_elts++] =
+               vsplit->cache.draws[set][way];
+            return;
+         }
+      }
+   }
 
-   hash = fetch % MAP_SIZE;
+   /* replace the oldest way of the set */
+   if (valid < vsplit->cache.ways) {
+      way = valid;
+      vsplit->cache.valid[set] = valid + 1;
+   }
+   else {
+      way = vsplit->cache.next[set];
+      vsplit->cache.next[set] = (way + 1) % vsplit->cache.ways;
+   }
 
-   /* If the value isn't in the cache or it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch || ofbias) {
-      /* update cache */
-      vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
+   vsplit->cache.fetches[set][way] = fetch;
+   vsplit->cache.draws[set][way] = vsplit->cache.num_fetch_elts;
 
-      /* add fetch */
-      assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
-      vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
-   }
+   /* add fetch */
+   assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
+   vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
 
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] =
+      vsplit->cache.draws[set][way];
 }
 
 /**
@@ -191,23 +264,15 @@ vsplit_add_cache_ushort(struct vsplit_frontend *vsplit, const ushort *elts,
 
 /**
  * Add a fetch element and add it to the draw elements.  The fetch element is
- * in full range (uint).
+ * in full range (uint).  Since the cache tracks which entries are valid,
+ * DRAW_MAX_FETCH_IDX needs no special care.
  */
 static inline void
 vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
                       unsigned start, unsigned fetch, int elt_bias)
 {
    struct draw_context *draw = vsplit->draw;
-   unsigned raw_elem_idx = start + fetch + elt_bias;
    VSPLIT_CREATE_IDX(elts, start, fetch, elt_bias);
-
-   /* special care for DRAW_MAX_FETCH_IDX */
-   if (raw_elem_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = fetch % MAP_SIZE;
-      vsplit->cache.fetches[hash] = raw_elem_idx - 1; /* force update */
-      vsplit->cache.has_max_fetch = TRUE;
-   }
-
    vsplit_add_cache(vsplit, elt_idx, ofbias);
 }
 
@@ -231,6 +296,32 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
 #include "draw_pt_vsplit_tmp.h"
 
 
+/**
+ * Run the draw, and print how many vertices were shaded per primitive,
+ * the average cache miss ratio (ACMR).  An ideal cache gets about 0.5 for
+ * a regular triangle mesh, while unindexed triangle lists get 3.
+ */
+static void vsplit_run_stats(struct draw_pt_front_end *frontend,
+                             unsigned start,
+                             unsigned count)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+   unsigned prims = u_decomposed_prims_for_vertices(vsplit->prim, count);
+
+   memset(&vsplit->stats, 0, sizeof(vsplit->stats));
+
+   vsplit->run(frontend, start, count);
+
+   debug_printf("draw: prim %u, %u %s vertices, %u prims, %u shaded, "
+                "%u range segments, ACMR %.3f\n",
+                vsplit->prim, count,
+                vsplit->draw->pt.user.eltSize ? "indexed" : "linear",
+                prims, vsplit->stats.vertices,
+                vsplit->stats.range_segments,
+                prims ? (float) vsplit->stats.vertices / prims : 0.0f);
+}
+
+
 static void vsplit_prepare(struct draw_pt_front_end *frontend,
                            unsigned in_prim,
                            struct draw_pt_middle_end *middle,
@@ -240,22 +331,27 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
 
    switch (vsplit->draw->pt.user.eltSize) {
    case 0:
-      vsplit->base.run = vsplit_run_linear;
+      vsplit->run = vsplit_run_linear;
       break;
    case 1:
-      vsplit->base.run = vsplit_run_ubyte;
+      vsplit->run = vsplit_run_ubyte;
       break;
    case 2:
-      vsplit->base.run = vsplit_run_ushort;
+      vsplit->run = vsplit_run_ushort;
       break;
    case 4:
-      vsplit->base.run = vsplit_run_uint;
+      vsplit->run = vsplit_run_uint;
       break;
    default:
       assert(0);
       break;
    }
 
+   if (debug_get_option_draw_vcache_stats())
+      vsplit->base.run = vsplit_run_stats;
+   else
+      vsplit->base.run = vsplit->run;
+
    /* split only */
    vsplit->prim = in_prim;
 
@@ -297,6 +393,9 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
 
+   vsplit->cache.ways = CLAMP(debug_get_option_draw_vcache_ways(),
+                              1, CACHE_MAX_WAYS);
+
    for (i = 0; i < SEGMENT_SIZE; i++)
       vsplit->identity_draw_elts[i] = i;
 
@@ -118,9 +118,13 @@ CONCAT(vsplit_primitive_, ELT_TYPE)(struct vsplit_frontend *vsplit,
       draw_elts = vsplit->draw_elts;
    }
 
-   return vsplit->middle->run_linear_elts(vsplit->middle,
-                                          fetch_start, fetch_count,
-                                          draw_elts, icount, 0x0);
+   if (!vsplit->middle->run_linear_elts(vsplit->middle,
+                                        fetch_start, fetch_count,
+                                        draw_elts, icount, 0x0))
+      return FALSE;
+
+   vsplit->stats.vertices += fetch_count;
+   return TRUE;
 }
 
 /**
@@ -237,6 +241,7 @@ vsplit_segment_simple_linear(struct vsplit_frontend *vsplit, unsigned flags,
                              unsigned istart, unsigned icount)
 {
    assert(icount <= vsplit->max_vertices);
+   vsplit->stats.vertices += icount;
    vsplit->middle->run_linear(vsplit->middle, istart, icount, flags);
 }
 
@@ -257,10 +262,12 @@ vsplit_segment_loop_linear(struct vsplit_frontend *vsplit, unsigned flags,
          vsplit->fetch_elts[nr] = istart + nr;
       vsplit->fetch_elts[nr++] = i0;
 
+      vsplit->stats.vertices += nr;
       vsplit->middle->run(vsplit->middle, vsplit->fetch_elts, nr,
             vsplit->identity_draw_elts, nr, flags);
    }
    else {
+      vsplit->stats.vertices += icount;
       vsplit->middle->run_linear(vsplit->middle, istart, icount, flags);
    }
 }
@@ -280,10 +287,12 @@ vsplit_segment_fan_linear(struct vsplit_frontend *vsplit, unsigned flags,
       for (i = 1 ; i < icount; i++)
          vsplit->fetch_elts[nr++] = istart + i;
 
+      vsplit->stats.vertices += nr;
       vsplit->middle->run(vsplit->middle, vsplit->fetch_elts, nr,
             vsplit->identity_draw_elts, nr, flags);
    }
    else {
+      vsplit->stats.vertices += icount;
       vsplit->middle->run_linear(vsplit->middle, istart, icount, flags);
    }
 }
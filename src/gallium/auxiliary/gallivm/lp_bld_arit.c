@@ -1651,7 +1651,8 @@ arch_rounding_available(const struct lp_type type)
 {
    if ((util_cpu_caps.has_sse4_1 &&
        (type.length == 1 || type.width*type.length == 128)) ||
-       (util_cpu_caps.has_avx && type.width*type.length == 256))
+       (util_cpu_caps.has_avx && type.width*type.length == 256) ||
+       (util_cpu_caps.has_avx512f && type.width*type.length == 512))
       return TRUE;
    else if ((util_cpu_caps.has_altivec &&
             (type.width == 32 && type.length == 4)))
@@ -1851,12 +1852,57 @@ lp_build_round_altivec(struct lp_build_context *bld,
    return lp_build_intrinsic_unary(builder, intrinsic, bld->vec_type, a);
 }
 
+/**
+ * Helper for AVX-512's VRNDSCALExx instructions.
+ *
+ * There are no x86-specific round intrinsics for 512-bit vectors, but the
+ * generic LLVM ones get lowered to VRNDSCALExx.
+ */
+static inline LLVMValueRef
+lp_build_round_avx512(struct lp_build_context *bld,
+                      LLVMValueRef a,
+                      enum lp_build_round_mode mode)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   const struct lp_type type = bld->type;
+   const char *name = NULL;
+   char intrinsic[32];
+
+   assert(type.floating);
+
+   assert(lp_check_value(type, a));
+   assert(util_cpu_caps.has_avx512f);
+   assert(type.width * type.length == 512);
+
+   switch (mode) {
+   case LP_BUILD_ROUND_NEAREST:
+      name = "nearbyint";
+      break;
+   case LP_BUILD_ROUND_FLOOR:
+      name = "floor";
+      break;
+   case LP_BUILD_ROUND_CEIL:
+      name = "ceil";
+      break;
+   case LP_BUILD_ROUND_TRUNCATE:
+      name = "trunc";
+      break;
+   }
+
+   util_snprintf(intrinsic, sizeof intrinsic, "llvm.%s.v%uf%u",
+                 name, type.length, type.width);
+
+   return lp_build_intrinsic_unary(builder, intrinsic, bld->vec_type, a);
+}
+
 static inline LLVMValueRef
 lp_build_round_arch(struct lp_build_context *bld,
                     LLVMValueRef a,
                     enum lp_build_round_mode mode)
 {
-   if (util_cpu_caps.has_sse4_1)
+   if (util_cpu_caps.has_avx512f && bld->type.width * bld->type.length == 512)
+     return lp_build_round_avx512(bld, a, mode);
+   else if (util_cpu_caps.has_sse4_1)
      return lp_build_round_sse41(bld, a, mode);
    else /* (util_cpu_caps.has_altivec) */
      return lp_build_round_altivec(bld, a, mode);
@@ -78,7 +78,7 @@ lp_build_assert(struct gallivm_state *gallivm,
    function = lp_build_const_func_pointer(gallivm,
                                           func_to_pointer((func_pointer)lp_assert),
                                           ret_type, arg_types, Elements(arg_types),
-                                          "assert");
+                                          "lp_assert");
 
    /* build function call param list */
    args[0] = LLVMBuildZExt(builder, condition, arg_types[0], "");
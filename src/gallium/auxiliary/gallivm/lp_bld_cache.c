@@ -0,0 +1,561 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * On-disk cache of MCJIT object code.
+ *
+ * Optimizing and compiling the IR of a shader variant takes much longer
+ * than building the IR.  When GALLIVM_CACHE_DIR is set, the object code
+ * MCJIT generates for a module is saved to that directory, and later
+ * compiles of an identical module (in this or any other process) load the
+ * object code instead of running the optimization passes and the code
+ * generator.
+ *
+ * The key is a hash of the unoptimized module's bitcode, together with the
+ * LLVM version and the target CPU and features.  Hashing the IR rather
+ * than the shader and variant keys means anything which affects the
+ * generated code is covered.  For the IR to be the same in every process,
+ * the names of the module's functions, which contain global counters, are
+ * canonicalized before hashing, and C functions are called through
+ * symbols rather than addresses (see lp_build_func_pointer()).
+ *
+ * Each object is stored in its own file.  Hits bump the file's modification
+ * time, and when the directory grows beyond GALLIVM_CACHE_SIZE megabytes
+ * the least recently used files are deleted.
+ */
+
+
+#include "pipe/p_config.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "os/os_misc.h"
+#include "os/os_thread.h"
+#include "lp_bld_debug.h"
+#include "lp_bld_misc.h"
+#include "lp_bld_cache.h"
+
+#if defined(HAVE_SHA1) && defined(PIPE_OS_UNIX) && HAVE_LLVM >= 0x0306
+#define LP_BUILD_CACHE 1
+#else
+#define LP_BUILD_CACHE 0
+#endif
+
+#if LP_BUILD_CACHE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <llvm-c/BitWriter.h>
+
+#include "c11/threads.h"
+#include "util/mesa-sha1.h"
+
+
+/**
+ * Bump whenever the way objects are generated changes in a way which isn't
+ * reflected in the IR, e.g. JIT target options.
+ */
+#define LP_BUILD_CACHE_VERSION 2
+
+#define LP_BUILD_CACHE_SUFFIX ".obj"
+
+
+struct lp_build_cache_header
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t size;
+   unsigned char key[LP_BUILD_CACHE_KEY_SIZE];
+};
+
+static const char cache_magic[8] = "GALLIVM";
+
+
+static once_flag cache_once_flag = ONCE_FLAG_INIT;
+pipe_static_mutex(cache_mutex);
+
+static char cache_dir[PATH_MAX];
+static char *target_description;
+static uint64_t cache_max_size;
+static int64_t cache_size = -1;    /**< estimate, -1 until first scanned */
+
+
+DEBUG_GET_ONCE_NUM_OPTION(cache_size_mb, "GALLIVM_CACHE_SIZE", 256)
+
+
+static boolean
+make_dir(const char *path)
+{
+   char tmp[PATH_MAX];
+   char *p;
+
+   util_snprintf(tmp, sizeof tmp, "%s", path);
+
+   for (p = tmp + 1; *p; p++) {
+      if (*p == '/') {
+         *p = '\0';
+         if (mkdir(tmp, 0755) != 0 && errno != EEXIST)
+            return FALSE;
+         *p = '/';
+      }
+   }
+
+   return mkdir(tmp, 0755) == 0 || errno == EEXIST;
+}
+
+
+static void
+cache_init(void)
+{
+   const char *dir = os_get_option("GALLIVM_CACHE_DIR");
+
+   if (!dir || !*dir)
+      return;
+
+   if (!make_dir(dir)) {
+      debug_printf("gallivm: can't create cache directory %s\n", dir);
+      return;
+   }
+
+   target_description = lp_build_target_description();
+   if (!target_description)
+      return;
+
+   cache_max_size = (uint64_t) MAX2(debug_get_option_cache_size_mb(), 1)
+                    * 1024 * 1024;
+
+   util_snprintf(cache_dir, sizeof cache_dir, "%s", dir);
+}
+
+
+/**
+ * Whether object code may be saved to the cache, in which case the IR
+ * mustn't contain addresses.
+ */
+boolean
+lp_build_cache_enabled(void)
+{
+   call_once(&cache_once_flag, cache_init);
+   return cache_dir[0] != '\0';
+}
+
+
+/**
+ * Make the names in the module independent of the process building it.
+ *
+ * Functions are named after shader and variant numbers, which depend on
+ * what the process compiled before.  Digits are dropped from the names of
+ * the functions the module defines, and duplicates get unique names from
+ * LLVM, in module order.  Going through temporary names first makes that
+ * independent of the original names.  Declarations (intrinsics and
+ * lp_build_func_pointer() symbols) are left alone.
+ */
+static void
+canonicalize_names(LLVMModuleRef module)
+{
+   LLVMValueRef func;
+   char **names;
+   unsigned num_funcs = 0, i;
+
+   for (func = LLVMGetFirstFunction(module); func;
+        func = LLVMGetNextFunction(func)) {
+      if (!LLVMIsDeclaration(func))
+         num_funcs++;
+   }
+
+   names = CALLOC(num_funcs, sizeof *names);
+   if (!names)
+      return;
+
+   for (func = LLVMGetFirstFunction(module), i = 0; func;
+        func = LLVMGetNextFunction(func)) {
+      const char *name;
+      char tmp[32], *p;
+
+      if (LLVMIsDeclaration(func))
+         continue;
+
+      name = LLVMGetValueName(func);
+      names[i] = p = MALLOC(strlen(name) + 1);
+      if (p) {
+         for (; *name; name++) {
+            if (*name < '0' || *name > '9')
+               *p++ = *name;
+         }
+         *p = '\0';
+      }
+
+      util_snprintf(tmp, sizeof tmp, "lp_tmp.%u", i);
+      LLVMSetValueName(func, tmp);
+      i++;
+   }
+
+   for (func = LLVMGetFirstFunction(module), i = 0; func;
+        func = LLVMGetNextFunction(func)) {
+      if (LLVMIsDeclaration(func))
+         continue;
+
+      LLVMSetValueName(func, names[i] && names[i][0] ? names[i] : "func");
+      FREE(names[i]);
+      i++;
+   }
+
+   FREE(names);
+
+   /* Written to bitcode, and defaults to the module's name */
+   lp_build_clear_source_file_name(module);
+}
+
+
+static void
+object_path(char path[PATH_MAX],
+            const unsigned char key[LP_BUILD_CACHE_KEY_SIZE])
+{
+   char hex[2 * LP_BUILD_CACHE_KEY_SIZE + 1];
+
+   _mesa_sha1_format(hex, key);
+   util_snprintf(path, PATH_MAX, "%s/%s" LP_BUILD_CACHE_SUFFIX,
+                 cache_dir, hex);
+}
+
+
+static boolean
+read_all(int fd, void *data, size_t size)
+{
+   char *p = data;
+
+   while (size) {
+      ssize_t n = read(fd, p, size);
+      if (n <= 0) {
+         if (n < 0 && errno == EINTR)
+            continue;
+         return FALSE;
+      }
+      p += n;
+      size -= n;
+   }
+
+   return TRUE;
+}
+
+
+static boolean
+write_all(int fd, const void *data, size_t size)
+{
+   const char *p = data;
+
+   while (size) {
+      ssize_t n = write(fd, p, size);
+      if (n <= 0) {
+         if (n < 0 && errno == EINTR)
+            continue;
+         return FALSE;
+      }
+      p += n;
+      size -= n;
+   }
+
+   return TRUE;
+}
+
+
+struct cache_file
+{
+   char name[2 * LP_BUILD_CACHE_KEY_SIZE + sizeof LP_BUILD_CACHE_SUFFIX];
+   time_t mtime;
+   off_t size;
+};
+
+
+static int
+compare_mtime(const void *a, const void *b)
+{
+   const struct cache_file *fa = a, *fb = b;
+
+   if (fa->mtime != fb->mtime)
+      return fa->mtime < fb->mtime ? -1 : 1;
+   return 0;
+}
+
+
+static boolean
+is_object_name(const char *name)
+{
+   size_t len = strlen(name);
+
+   return len == 2 * LP_BUILD_CACHE_KEY_SIZE + strlen(LP_BUILD_CACHE_SUFFIX) &&
+          strcmp(name + 2 * LP_BUILD_CACHE_KEY_SIZE, LP_BUILD_CACHE_SUFFIX) == 0;
+}
+
+
+/**
+ * Compute the size of the cache directory, and if it's over the limit
+ * delete the least recently used objects until it's down to 3/4 of it.
+ * Called with cache_mutex held.
+ */
+static void
+scan_and_evict(void)
+{
+   struct cache_file *files = NULL;
+   unsigned num_files = 0, max_files = 0, i;
+   struct dirent *ent;
+   DIR *dir;
+
+   dir = opendir(cache_dir);
+   if (!dir)
+      return;
+
+   cache_size = 0;
+
+   while ((ent = readdir(dir)) != NULL) {
+      char path[PATH_MAX];
+      struct stat st;
+
+      if (!is_object_name(ent->d_name))
+         continue;
+
+      util_snprintf(path, sizeof path, "%s/%s", cache_dir, ent->d_name);
+      if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+         continue;
+
+      if (num_files == max_files) {
+         unsigned new_max = max_files ? max_files * 2 : 256;
+         struct cache_file *new_files =
+            REALLOC(files, max_files * sizeof *files, new_max * sizeof *files);
+         if (!new_files)
+            break;
+         files = new_files;
+         max_files = new_max;
+      }
+
+      util_snprintf(files[num_files].name, sizeof files[num_files].name,
+                    "%s", ent->d_name);
+      files[num_files].mtime = st.st_mtime;
+      files[num_files].size = st.st_size;
+      num_files++;
+
+      cache_size += st.st_size;
+   }
+
+   closedir(dir);
+
+   if ((uint64_t) cache_size > cache_max_size && num_files) {
+      qsort(files, num_files, sizeof *files, compare_mtime);
+
+      for (i = 0; i < num_files &&
+                  (uint64_t) cache_size > cache_max_size / 4 * 3; i++) {
+         char path[PATH_MAX];
+
+         util_snprintf(path, sizeof path, "%s/%s", cache_dir, files[i].name);
+         if (unlink(path) == 0)
+            cache_size -= files[i].size;
+      }
+   }
+
+   FREE(files);
+}
+
+
+/**
+ * Compute the module's cache key and look it up in the cache.  This
+ * renames the module's functions, see canonicalize_names().
+ *
+ * \param flags  anything else which affects code generation
+ * \return FALSE if caching is disabled, otherwise TRUE with the key set,
+ * and the object code if there was a hit
+ */
+boolean
+lp_build_cache_lookup(LLVMModuleRef module, unsigned flags,
+                      struct lp_build_cache_entry *entry)
+{
+   struct lp_build_cache_header header;
+   struct mesa_sha1 *ctx;
+   LLVMMemoryBufferRef bitcode;
+   char path[PATH_MAX];
+   struct stat st;
+   void *object;
+   int fd;
+
+   entry->object = NULL;
+   entry->object_size = 0;
+
+   if (!lp_build_cache_enabled())
+      return FALSE;
+
+   canonicalize_names(module);
+
+   bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+   if (!bitcode)
+      return FALSE;
+
+   ctx = _mesa_sha1_init();
+   if (!ctx) {
+      LLVMDisposeMemoryBuffer(bitcode);
+      return FALSE;
+   }
+
+   _mesa_sha1_update(ctx, target_description, strlen(target_description));
+   _mesa_sha1_update(ctx, &flags, sizeof flags);
+   _mesa_sha1_update(ctx, LLVMGetBufferStart(bitcode),
+                     LLVMGetBufferSize(bitcode));
+   _mesa_sha1_final(ctx, entry->key);
+
+   LLVMDisposeMemoryBuffer(bitcode);
+
+   object_path(path, entry->key);
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return TRUE;
+
+   if (fstat(fd, &st) != 0 ||
+       !read_all(fd, &header, sizeof header) ||
+       memcmp(header.magic, cache_magic, sizeof header.magic) != 0 ||
+       header.version != LP_BUILD_CACHE_VERSION ||
+       memcmp(header.key, entry->key, sizeof header.key) != 0 ||
+       (off_t) (sizeof header + header.size) != st.st_size) {
+      close(fd);
+      return TRUE;
+   }
+
+   object = MALLOC(header.size);
+   if (!object || !read_all(fd, object, header.size)) {
+      FREE(object);
+      close(fd);
+      return TRUE;
+   }
+
+   close(fd);
+
+   /* Bump the modification time, so that eviction drops the least
+    * recently used objects first.
+    */
+   utime(path, NULL);
+
+   entry->object = object;
+   entry->object_size = header.size;
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF)
+      debug_printf("gallivm: loaded %s from cache\n", lp_get_module_id(module));
+
+   return TRUE;
+}
+
+
+/**
+ * Save the object code generated for a module with the given key.
+ */
+void
+lp_build_cache_store(const unsigned char key[LP_BUILD_CACHE_KEY_SIZE],
+                     const void *object, size_t size)
+{
+   struct lp_build_cache_header header;
+   char path[PATH_MAX], tmp_path[PATH_MAX];
+   boolean ok;
+   int fd;
+
+   if (!lp_build_cache_enabled() || size > UINT32_MAX)
+      return;
+
+   object_path(path, key);
+   util_snprintf(tmp_path, sizeof tmp_path, "%s.%ld.tmp",
+                 path, (long) getpid());
+
+   fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return;
+
+   memset(&header, 0, sizeof header);
+   memcpy(header.magic, cache_magic, sizeof header.magic);
+   header.version = LP_BUILD_CACHE_VERSION;
+   header.size = size;
+   memcpy(header.key, key, sizeof header.key);
+
+   ok = write_all(fd, &header, sizeof header) &&
+        write_all(fd, object, size);
+   ok = close(fd) == 0 && ok;
+
+   /* Other processes either see the complete file or none at all. */
+   if (!ok || rename(tmp_path, path) != 0) {
+      unlink(tmp_path);
+      return;
+   }
+
+   pipe_mutex_lock(cache_mutex);
+   if (cache_size < 0)
+      scan_and_evict();
+   else {
+      cache_size += sizeof header + size;
+      if ((uint64_t) cache_size > cache_max_size)
+         scan_and_evict();
+   }
+   pipe_mutex_unlock(cache_mutex);
+}
+
+
+#else /* !LP_BUILD_CACHE */
+
+
+boolean
+lp_build_cache_enabled(void)
+{
+   return FALSE;
+}
+
+
+boolean
+lp_build_cache_lookup(LLVMModuleRef module, unsigned flags,
+                      struct lp_build_cache_entry *entry)
+{
+   (void) module;
+   (void) flags;
+   entry->object = NULL;
+   entry->object_size = 0;
+   return FALSE;
+}
+
+
+void
+lp_build_cache_store(const unsigned char key[LP_BUILD_CACHE_KEY_SIZE],
+                     const void *object, size_t size)
+{
+   (void) key;
+   (void) object;
+   (void) size;
+}
+
+
+#endif /* !LP_BUILD_CACHE */
@@ -0,0 +1,78 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * On-disk cache of MCJIT object code.
+ */
+
+
+#ifndef LP_BLD_CACHE_H
+#define LP_BLD_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "lp_bld.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define LP_BUILD_CACHE_KEY_SIZE 20
+
+
+/**
+ * A module's cache key, and the object code found in the cache for it,
+ * if any.
+ */
+struct lp_build_cache_entry
+{
+   unsigned char key[LP_BUILD_CACHE_KEY_SIZE];
+   void *object;         /**< MALLOC'd, NULL on a cache miss */
+   size_t object_size;
+};
+
+
+boolean
+lp_build_cache_enabled(void);
+
+boolean
+lp_build_cache_lookup(LLVMModuleRef module, unsigned flags,
+                      struct lp_build_cache_entry *entry);
+
+void
+lp_build_cache_store(const unsigned char key[LP_BUILD_CACHE_KEY_SIZE],
+                     const void *object, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* !LP_BLD_CACHE_H */
@@ -38,10 +38,13 @@
 #include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_half.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
 
 #include "lp_bld_type.h"
 #include "lp_bld_const.h"
 #include "lp_bld_init.h"
+#include "lp_bld_cache.h"
 
 
 unsigned
@@ -457,23 +460,48 @@ lp_build_const_string(struct gallivm_state *gallivm,
 
 
 /**
- * Build a callable function pointer.
+ * Build a callable pointer to a C function.
  *
  * We use function pointer constants instead of LLVMAddGlobalMapping()
  * to work around a bug in LLVM 2.6, and for efficiency/simplicity.
+ *
+ * Except when object code may be saved to the on-disk cache, where an
+ * address is no use to other processes.  Then the function is declared
+ * as an external symbol instead, which the engine maps to the address
+ * (see init_gallivm_engine()).  The symbol is derived from \p name, which
+ * must therefore identify the C function.
  */
 LLVMValueRef
-lp_build_const_func_pointer(struct gallivm_state *gallivm,
-                            const void *ptr,
-                            LLVMTypeRef ret_type,
-                            LLVMTypeRef *arg_types,
-                            unsigned num_args,
-                            const char *name)
+lp_build_func_pointer(struct gallivm_state *gallivm,
+                      const void *ptr,
+                      LLVMTypeRef function_type,
+                      const char *name)
 {
-   LLVMTypeRef function_type;
    LLVMValueRef function;
 
-   function_type = LLVMFunctionType(ret_type, arg_types, num_args, 0);
+   if (lp_build_cache_enabled()) {
+      struct lp_build_func_symbol *symbols;
+      unsigned num_symbols = gallivm->num_func_symbols;
+      char symbol[128];
+
+      util_snprintf(symbol, sizeof symbol, "lp_ext.%s", name);
+
+      function = LLVMGetNamedFunction(gallivm->module, symbol);
+      if (function)
+         return function;
+
+      symbols = REALLOC(gallivm->func_symbols,
+                        num_symbols * sizeof *symbols,
+                        (num_symbols + 1) * sizeof *symbols);
+      if (symbols) {
+         function = LLVMAddFunction(gallivm->module, symbol, function_type);
+         symbols[num_symbols].function = function;
+         symbols[num_symbols].ptr = ptr;
+         gallivm->func_symbols = symbols;
+         gallivm->num_func_symbols = num_symbols + 1;
+         return function;
+      }
+   }
 
    function = lp_build_const_int_pointer(gallivm, ptr);
 
@@ -483,3 +511,19 @@ lp_build_const_func_pointer(struct gallivm_state *gallivm,
 
    return function;
 }
+
+
+LLVMValueRef
+lp_build_const_func_pointer(struct gallivm_state *gallivm,
+                            const void *ptr,
+                            LLVMTypeRef ret_type,
+                            LLVMTypeRef *arg_types,
+                            unsigned num_args,
+                            const char *name)
+{
+   LLVMTypeRef function_type;
+
+   function_type = LLVMFunctionType(ret_type, arg_types, num_args, 0);
+
+   return lp_build_func_pointer(gallivm, ptr, function_type, name);
+}
@@ -156,6 +156,13 @@ lp_build_const_string(struct gallivm_state *gallivm,
                       const char *str);
 
 
+LLVMValueRef
+lp_build_func_pointer(struct gallivm_state *gallivm,
+                      const void *ptr,
+                      LLVMTypeRef function_type,
+                      const char *name);
+
+
 LLVMValueRef
 lp_build_const_func_pointer(struct gallivm_state *gallivm,
                             const void *ptr,
@@ -572,6 +572,7 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
          LLVMTypeRef ret_type;
          LLVMTypeRef arg_types[4];
          LLVMTypeRef function_type;
+         char name[64];
 
          ret_type = LLVMVoidTypeInContext(gallivm->context);
          arg_types[0] = pi8t;
@@ -581,14 +582,12 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
          function_type = LLVMFunctionType(ret_type, arg_types,
                                           Elements(arg_types), 0);
 
-         /* make const pointer for the C fetch_rgba_8unorm function */
-         function = lp_build_const_int_pointer(gallivm,
-            func_to_pointer((func_pointer) format_desc->fetch_rgba_8unorm));
+         util_snprintf(name, sizeof name, "util_format_%s_fetch_rgba_8unorm",
+                       format_desc->short_name);
 
-         /* cast the callee pointer to the function's type */
-         function = LLVMBuildBitCast(builder, function,
-                                     LLVMPointerType(function_type, 0),
-                                     "cast callee");
+         function = lp_build_func_pointer(gallivm,
+            func_to_pointer((func_pointer) format_desc->fetch_rgba_8unorm),
+            function_type, name);
       }
 
       tmp_ptr = lp_build_alloca(gallivm, i32t, "");
@@ -676,6 +675,7 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
           */
          LLVMTypeRef ret_type;
          LLVMTypeRef arg_types[4];
+         char name[64];
 
          ret_type = LLVMVoidTypeInContext(gallivm->context);
          arg_types[0] = pf32t;
@@ -683,11 +683,14 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
          arg_types[2] = i32t;
          arg_types[3] = i32t;
 
+         util_snprintf(name, sizeof name, "util_format_%s_fetch_rgba_float",
+                       format_desc->short_name);
+
          function = lp_build_const_func_pointer(gallivm,
                                                 func_to_pointer((func_pointer) format_desc->fetch_rgba_float),
                                                 ret_type,
                                                 arg_types, Elements(arg_types),
-                                                format_desc->short_name);
+                                                name);
       }
 
       tmp_ptr = lp_build_alloca(gallivm, f32x4t, "");
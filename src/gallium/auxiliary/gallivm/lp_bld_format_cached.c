@@ -33,6 +33,7 @@
 #include "lp_bld_swizzle.h"
 
 #include "util/u_math.h"
+#include "util/u_string.h"
 
 
 /**
@@ -172,6 +173,7 @@ update_cached_block(struct gallivm_state *gallivm,
       LLVMTypeRef ret_type;
       LLVMTypeRef arg_types[4];
       LLVMTypeRef function_type;
+      char name[64];
 
       assert(format_desc->fetch_rgba_8unorm);
 
@@ -183,14 +185,12 @@ update_cached_block(struct gallivm_state *gallivm,
       function_type = LLVMFunctionType(ret_type, arg_types,
                                        Elements(arg_types), 0);
 
-      /* make const pointer for the C fetch_rgba_8unorm function */
-      function = lp_build_const_int_pointer(gallivm,
-         func_to_pointer((func_pointer) format_desc->fetch_rgba_8unorm));
+      util_snprintf(name, sizeof name, "util_format_%s_fetch_rgba_8unorm",
+                    format_desc->short_name);
 
-      /* cast the callee pointer to the function's type */
-      function = LLVMBuildBitCast(builder, function,
-                                  LLVMPointerType(function_type, 0),
-                                  "cast callee");
+      function = lp_build_func_pointer(gallivm,
+         func_to_pointer((func_pointer) format_desc->fetch_rgba_8unorm),
+         function_type, name);
    }
 
    tmp_ptr = lp_build_array_alloca(gallivm, i32x4,
@@ -28,18 +28,25 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
+#include "pipe/p_defines.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
+#include "util/u_string.h"
 #include "util/simple_list.h"
 #include "os/os_time.h"
 #include "lp_bld.h"
+#include "lp_bld_cache.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/Transforms/IPO.h>
+#if HAVE_LLVM >= 0x0303
+#include <llvm-c/Transforms/Vectorize.h>
+#endif
 #include <llvm-c/BitWriter.h>
 
 
@@ -81,6 +88,21 @@ static boolean gallivm_initialized = FALSE;
 unsigned lp_native_vector_width;
 
 
+/**
+ * Per shader stage optimization mode, see GALLIVM_OPT_TIER.
+ */
+enum gallivm_opt_mode
+{
+   GALLIVM_OPT_MODE_FAST = GALLIVM_OPT_FAST,
+   GALLIVM_OPT_MODE_DEFAULT = GALLIVM_OPT_DEFAULT,
+   GALLIVM_OPT_MODE_FULL = GALLIVM_OPT_FULL,
+   GALLIVM_OPT_MODE_TIERED  /**< fast, then full once used a lot */
+};
+
+static enum gallivm_opt_mode gallivm_opt_modes[PIPE_SHADER_TYPES];
+static unsigned gallivm_opt_promote_uses;
+
+
 /*
  * Optimization values are:
  * - 0: None (-O0)
@@ -99,58 +121,41 @@ enum LLVM_CodeGenOpt_Level {
 
 
 /**
- * Create the LLVM (optimization) pass manager and install
- * relevant optimization passes.
+ * Create the LLVM (optimization) pass managers and install the
+ * optimization passes of the gallivm's tier.
  * \return  TRUE for success, FALSE for failure
  */
 static boolean
 create_pass_manager(struct gallivm_state *gallivm)
 {
    assert(!gallivm->passmgr);
+   assert(!gallivm->module_passmgr);
    assert(gallivm->target);
 
    gallivm->passmgr = LLVMCreateFunctionPassManagerForModule(gallivm->module);
    if (!gallivm->passmgr)
       return FALSE;
-   /*
-    * TODO: some per module pass manager with IPO passes might be helpful -
-    * the generated texture functions may benefit from inlining if they are
-    * simple, or constant propagation into them, etc.
-    */
 
 #if HAVE_LLVM < 0x0309
    // Old versions of LLVM get the DataLayout from the pass manager.
    LLVMAddTargetData(gallivm->target, gallivm->passmgr);
 #endif
 
-   /* Setting the module's DataLayout to an empty string will cause the
-    * ExecutionEngine to copy to the DataLayout string from its target
-    * machine to the module.  As of LLVM 3.8 the module and the execution
-    * engine are required to have the same DataLayout.
-    *
-    * TODO: This is just a temporary work-around.  The correct solution is
-    * for gallivm_init_state() to create a TargetMachine and pull the
-    * DataLayout from there.  Currently, the TargetMachine used by llvmpipe
-    * is being implicitly created by the EngineBuilder in
-    * lp_build_create_jit_compiler_for_module()
-    */
-
-#if HAVE_LLVM < 0x0308
-   {
-      char *td_str;
-      // New ones from the Module.
-      td_str = LLVMCopyStringRepOfTargetData(gallivm->target);
-      LLVMSetDataLayout(gallivm->module, td_str);
-      free(td_str);
+   if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      /* We need at least this pass to prevent the backends to fail in
+       * unexpected ways.
+       */
+      LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
    }
-#else
-   LLVMSetDataLayout(gallivm->module, "");
-#endif
-
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   else if (gallivm->opt_tier == GALLIVM_OPT_FAST) {
+      /* Just enough for the code generator not to produce awful code. */
+      LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
+      LLVMAddCFGSimplificationPass(gallivm->passmgr);
+      LLVMAddInstructionCombiningPass(gallivm->passmgr);
+   }
+   else {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
-       * TODO: Add more passes.
        */
       LLVMAddScalarReplAggregatesPass(gallivm->passmgr);
       LLVMAddLICMPass(gallivm->passmgr);
@@ -161,11 +166,35 @@ create_pass_manager(struct gallivm_state *gallivm)
       LLVMAddInstructionCombiningPass(gallivm->passmgr);
       LLVMAddGVNPass(gallivm->passmgr);
    }
-   else {
-      /* We need at least this pass to prevent the backends to fail in
-       * unexpected ways.
+
+   if (gallivm->opt_tier == GALLIVM_OPT_FULL &&
+       (gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+      /*
+       * Module passes, run after the function passes.  The generated
+       * texture sampling functions are private, so they can be inlined
+       * into the shader, get constants propagated into them, and have
+       * their unused arguments removed.  Then clean up after the inliner.
        */
-      LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
+      gallivm->module_passmgr = LLVMCreatePassManager();
+      if (!gallivm->module_passmgr)
+         return FALSE;
+
+#if HAVE_LLVM < 0x0309
+      LLVMAddTargetData(gallivm->target, gallivm->module_passmgr);
+#endif
+
+      LLVMAddIPSCCPPass(gallivm->module_passmgr);
+      LLVMAddDeadArgEliminationPass(gallivm->module_passmgr);
+      LLVMAddFunctionInliningPass(gallivm->module_passmgr);
+      LLVMAddGlobalDCEPass(gallivm->module_passmgr);
+      LLVMAddInstructionCombiningPass(gallivm->module_passmgr);
+      LLVMAddCFGSimplificationPass(gallivm->module_passmgr);
+#if HAVE_LLVM >= 0x0303
+      /* Mostly for TGSI loops over arrays of temporaries or constants. */
+      LLVMAddLoopVectorizePass(gallivm->module_passmgr);
+#endif
+      LLVMAddGVNPass(gallivm->module_passmgr);
+      LLVMAddInstructionCombiningPass(gallivm->module_passmgr);
    }
 
    return TRUE;
@@ -183,6 +212,10 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposePassManager(gallivm->passmgr);
    }
 
+   if (gallivm->module_passmgr) {
+      LLVMDisposePassManager(gallivm->module_passmgr);
+   }
+
    if (gallivm->engine) {
       /* This will already destroy any associated module */
       LLVMDisposeExecutionEngine(gallivm->engine);
@@ -201,14 +234,19 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    if (gallivm->builder)
       LLVMDisposeBuilder(gallivm->builder);
 
+   FREE(gallivm->func_symbols);
+
    /* The LLVMContext should be owned by the parent of gallivm. */
 
    gallivm->engine = NULL;
    gallivm->target = NULL;
    gallivm->module = NULL;
    gallivm->passmgr = NULL;
+   gallivm->module_passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->func_symbols = NULL;
+   gallivm->num_func_symbols = 0;
 }
 
 
@@ -227,8 +265,12 @@ gallivm_free_code(struct gallivm_state *gallivm)
 }
 
 
+/**
+ * \param cache  where to find or put the module's object code, may be NULL
+ */
 static boolean
-init_gallivm_engine(struct gallivm_state *gallivm)
+init_gallivm_engine(struct gallivm_state *gallivm,
+                    struct lp_build_cache_entry *cache)
 {
    if (1) {
       enum LLVM_CodeGenOpt_Level optlevel;
@@ -238,6 +280,12 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
          optlevel = None;
       }
+      else if (gallivm->opt_tier == GALLIVM_OPT_FAST) {
+         optlevel = Less;
+      }
+      else if (gallivm->opt_tier == GALLIVM_OPT_FULL) {
+         optlevel = Aggressive;
+      }
       else {
          optlevel = Default;
       }
@@ -248,6 +296,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     USE_MCJIT,
+                                                    cache,
                                                     &error);
       if (ret) {
          _debug_printf("%s\n", error);
@@ -256,6 +305,17 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       }
    }
 
+   /* Before anything gets compiled or loaded, which resolves symbols */
+   {
+      unsigned i;
+
+      for (i = 0; i < gallivm->num_func_symbols; i++) {
+         LLVMAddGlobalMapping(gallivm->engine,
+                              gallivm->func_symbols[i].function,
+                              (void *) gallivm->func_symbols[i].ptr);
+      }
+   }
+
 #if !USE_MCJIT
    gallivm->target = LLVMGetExecutionEngineTargetData(gallivm->engine);
    if (!gallivm->target)
@@ -327,7 +387,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
     * now.
     */
 #if !USE_MCJIT
-   if (!init_gallivm_engine(gallivm)) {
+   if (!init_gallivm_engine(gallivm, NULL)) {
       goto fail;
    }
 #else
@@ -367,8 +427,31 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    }
 #endif
 
-   if (!create_pass_manager(gallivm))
-      goto fail;
+   /* Setting the module's DataLayout to an empty string will cause the
+    * ExecutionEngine to copy to the DataLayout string from its target
+    * machine to the module.  As of LLVM 3.8 the module and the execution
+    * engine are required to have the same DataLayout.
+    *
+    * TODO: This is just a temporary work-around.  The correct solution is
+    * for gallivm_init_state() to create a TargetMachine and pull the
+    * DataLayout from there.  Currently, the TargetMachine used by llvmpipe
+    * is being implicitly created by the EngineBuilder in
+    * lp_build_create_jit_compiler_for_module()
+    */
+
+#if HAVE_LLVM < 0x0308
+   {
+      char *td_str;
+      // New ones from the Module.
+      td_str = LLVMCopyStringRepOfTargetData(gallivm->target);
+      LLVMSetDataLayout(gallivm->module, td_str);
+      free(td_str);
+   }
+#else
+   LLVMSetDataLayout(gallivm->module, "");
+#endif
+
+   gallivm->opt_tier = GALLIVM_OPT_DEFAULT;
 
    return TRUE;
 
@@ -379,6 +462,91 @@ fail:
 }
 
 
+/**
+ * Parse GALLIVM_OPT_TIER, which is either a single mode for all shader
+ * stages, or a comma separated list of stage=mode pairs, e.g.
+ * "fs=tiered,vs=full".
+ */
+static void
+init_opt_modes(void)
+{
+   static const char *stage_names[PIPE_SHADER_TYPES] = {
+      "vs", "fs", "gs", "tcs", "tes", "cs"
+   };
+   static const char *mode_names[] = {
+      "fast", "default", "full", "tiered"
+   };
+   const char *str = debug_get_option("GALLIVM_OPT_TIER", NULL);
+   unsigned i;
+
+   for (i = 0; i < PIPE_SHADER_TYPES; i++)
+      gallivm_opt_modes[i] = GALLIVM_OPT_MODE_DEFAULT;
+
+   gallivm_opt_promote_uses = debug_get_num_option("GALLIVM_OPT_PROMOTE", 100);
+
+   while (str && *str) {
+      const char *end = strchr(str, ',');
+      size_t len = end ? (size_t)(end - str) : strlen(str);
+      const char *eq = memchr(str, '=', len);
+      const char *mode = eq ? eq + 1 : str;
+      size_t mode_len = len - (mode - str);
+      unsigned m, stage;
+
+      for (m = 0; m < Elements(mode_names); m++) {
+         if (strlen(mode_names[m]) == mode_len &&
+             strncmp(mode, mode_names[m], mode_len) == 0)
+            break;
+      }
+
+      if (m == Elements(mode_names)) {
+         debug_printf("gallivm: invalid GALLIVM_OPT_TIER mode \"%.*s\"\n",
+                      (int) mode_len, mode);
+      }
+      else if (!eq) {
+         for (stage = 0; stage < PIPE_SHADER_TYPES; stage++)
+            gallivm_opt_modes[stage] = (enum gallivm_opt_mode) m;
+      }
+      else {
+         for (stage = 0; stage < PIPE_SHADER_TYPES; stage++) {
+            if (strlen(stage_names[stage]) == (size_t)(eq - str) &&
+                strncmp(str, stage_names[stage], eq - str) == 0) {
+               gallivm_opt_modes[stage] = (enum gallivm_opt_mode) m;
+               break;
+            }
+         }
+      }
+
+      str = end ? end + 1 : NULL;
+   }
+}
+
+
+/**
+ * Return the optimization tier to compile code of the given shader stage
+ * (PIPE_SHADER_x) with, given how many times it was used already.
+ *
+ * Code compiled with a lower tier than what this returns for a higher
+ * use count may be worth recompiling then.  Users which never recompile
+ * code should pass zero.
+ */
+enum gallivm_opt_tier
+gallivm_get_opt_tier(unsigned shader_stage, unsigned uses)
+{
+   enum gallivm_opt_mode mode;
+
+   assert(gallivm_initialized);
+   assert(shader_stage < PIPE_SHADER_TYPES);
+
+   mode = gallivm_opt_modes[shader_stage];
+   if (mode == GALLIVM_OPT_MODE_TIERED) {
+      return uses >= gallivm_opt_promote_uses ? GALLIVM_OPT_FULL
+                                              : GALLIVM_OPT_FAST;
+   }
+
+   return (enum gallivm_opt_tier) mode;
+}
+
+
 boolean
 lp_build_init(void)
 {
@@ -416,9 +584,30 @@ lp_build_init(void)
       lp_native_vector_width = 128;
    }
  
+   /* 512-bit vectors on AVX-512 capable CPUs are opt-in for now
+    * (LP_NATIVE_VECTOR_WIDTH=512), as many of those CPUs lower their clock
+    * while running 512-bit code.
+    */
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   if (lp_native_vector_width > 256 && !util_cpu_caps.has_avx512f) {
+      lp_native_vector_width = 256;
+   }
+
+   init_opt_modes();
+
+   if (lp_native_vector_width <= 256) {
+      /* Hide AVX-512 support, for the same reasons as AVX below. */
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512cd = 0;
+      util_cpu_caps.has_avx512er = 0;
+      util_cpu_caps.has_avx512pf = 0;
+      util_cpu_caps.has_avx512bw = 0;
+      util_cpu_caps.has_avx512dq = 0;
+      util_cpu_caps.has_avx512vl = 0;
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -465,6 +654,7 @@ lp_build_init(void)
    util_cpu_caps.has_avx = 0;
    util_cpu_caps.has_avx2 = 0;
    util_cpu_caps.has_f16c = 0;
+   util_cpu_caps.has_avx512f = 0;
 #endif
 
    return TRUE;
@@ -538,6 +728,10 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 {
    LLVMValueRef func;
    int64_t time_begin = 0;
+#if USE_MCJIT
+   struct lp_build_cache_entry cache_entry;
+   boolean use_cache;
+#endif
 
    assert(!gallivm->compiled);
 
@@ -549,6 +743,22 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
+#if USE_MCJIT
+   /* The key is computed from the unoptimized IR.  On a hit the object code
+    * is loaded by the engine, so there's no point in optimizing the IR.
+    */
+   use_cache = lp_build_cache_lookup(gallivm->module,
+                                     (gallivm_debug & GALLIVM_DEBUG_NO_OPT) |
+                                     (gallivm->opt_tier << 16),
+                                     &cache_entry);
+   if (use_cache && cache_entry.object)
+      goto create_engine;
+#endif
+
+   if (!create_pass_manager(gallivm)) {
+      assert(0);
+   }
+
    /* Run optimization passes */
    LLVMInitializeFunctionPassManager(gallivm->passmgr);
    func = LLVMGetFirstFunction(gallivm->module);
@@ -571,6 +781,10 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    }
    LLVMFinalizeFunctionPassManager(gallivm->passmgr);
 
+   if (gallivm->module_passmgr) {
+      LLVMRunPassManager(gallivm->module_passmgr, gallivm->module);
+   }
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
       int64_t time_end = os_time_get();
       int time_msec = (int)(time_end - time_begin) / 1000;
@@ -586,10 +800,13 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    }
 
 #if USE_MCJIT
+create_engine:
    assert(!gallivm->engine);
-   if (!init_gallivm_engine(gallivm)) {
+   if (!init_gallivm_engine(gallivm, use_cache ? &cache_entry : NULL)) {
       assert(0);
    }
+   if (use_cache)
+      FREE(cache_entry.object);
 #endif
    assert(gallivm->engine);
 
@@ -36,17 +36,44 @@
 #include <llvm-c/ExecutionEngine.h>
 
 
+/**
+ * A C function called by generated code through a symbol, which the JIT
+ * resolves to the function's address.  See lp_build_func_pointer().
+ */
+struct lp_build_func_symbol
+{
+   LLVMValueRef function;
+   const void *ptr;
+};
+
+
+/**
+ * Optimization tiers.  Higher tiers produce faster code, but take longer
+ * to compile.
+ */
+enum gallivm_opt_tier
+{
+   GALLIVM_OPT_FAST,     /**< few function passes, quick code generation */
+   GALLIVM_OPT_DEFAULT,  /**< the usual function passes */
+   GALLIVM_OPT_FULL      /**< plus inlining and other module passes */
+};
+
+
 struct gallivm_state
 {
    LLVMModuleRef module;
    LLVMExecutionEngineRef engine;
    LLVMTargetDataRef target;
    LLVMPassManagerRef passmgr;
+   LLVMPassManagerRef module_passmgr;  /**< NULL unless GALLIVM_OPT_FULL */
    LLVMContextRef context;
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_build_func_symbol *func_symbols;
+   unsigned num_func_symbols;
    unsigned compiled;
+   enum gallivm_opt_tier opt_tier;  /**< may be changed until compiled */
 };
 
 
@@ -70,6 +97,9 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 void
 gallivm_compile_module(struct gallivm_state *gallivm);
 
+enum gallivm_opt_tier
+gallivm_get_opt_tier(unsigned shader_stage, unsigned uses);
+
 func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
@@ -49,6 +49,7 @@
 
 
 #include <stddef.h>
+#include <stdio.h>
 
 // Workaround http://llvm.org/PR23628
 #if HAVE_LLVM >= 0x0307
@@ -70,6 +71,8 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -92,6 +95,9 @@
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 
+#include "util/u_memory.h"
+
+#include "lp_bld_cache.h"
 #include "lp_bld_misc.h"
 
 namespace {
@@ -386,12 +392,21 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
       typedef std::vector<void *> Vec;
       Vec FunctionBody, ExceptionTable;
       BaseMemoryManager *TheMM;
+#if HAVE_LLVM >= 0x0306
+      llvm::ObjectCache *Cache;
+#endif
 
       GeneratedCode(BaseMemoryManager *MM) {
          TheMM = MM;
+#if HAVE_LLVM >= 0x0306
+         Cache = NULL;
+#endif
       }
 
       ~GeneratedCode() {
+#if HAVE_LLVM >= 0x0306
+         delete Cache;
+#endif
          /*
           * Deallocate things as previously requested and
           * free shared manager when no longer used.
@@ -438,6 +453,17 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          delete (GeneratedCode *) code;
       }
 
+#if HAVE_LLVM >= 0x0306
+      /*
+       * The engine may only generate code when the first function pointer
+       * is looked up, so the object cache has to live as long as the code.
+       */
+      static void setObjectCache(struct lp_generated_code *code,
+                                 llvm::ObjectCache *Cache) {
+         ((GeneratedCode *) code)->Cache = Cache;
+      }
+#endif
+
 #if HAVE_LLVM < 0x0304
       virtual void deallocateExceptionTable(void *ET) {
          // remember for later deallocation
@@ -452,6 +478,115 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+/**
+ * The target features to enable/disable in the JIT, based on the features
+ * detected by util_cpu_caps.
+ */
+static void
+get_target_attrs(llvm::SmallVector<std::string, 16> &MAttrs)
+{
+#if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
+   /*
+    * We need to unset attributes because sometimes LLVM mistakenly assumes
+    * certain features are present given the processor name.
+    *
+    * https://bugs.freedesktop.org/show_bug.cgi?id=92214
+    * http://llvm.org/PR25021
+    * http://llvm.org/PR19429
+    * http://llvm.org/PR16721
+    */
+   MAttrs.push_back(util_cpu_caps.has_sse    ? "+sse"    : "-sse"   );
+   MAttrs.push_back(util_cpu_caps.has_sse2   ? "+sse2"   : "-sse2"  );
+   MAttrs.push_back(util_cpu_caps.has_sse3   ? "+sse3"   : "-sse3"  );
+   MAttrs.push_back(util_cpu_caps.has_ssse3  ? "+ssse3"  : "-ssse3" );
+#if HAVE_LLVM >= 0x0304
+   MAttrs.push_back(util_cpu_caps.has_sse4_1 ? "+sse4.1" : "-sse4.1");
+#else
+   MAttrs.push_back(util_cpu_caps.has_sse4_1 ? "+sse41"  : "-sse41" );
+#endif
+#if HAVE_LLVM >= 0x0304
+   MAttrs.push_back(util_cpu_caps.has_sse4_2 ? "+sse4.2" : "-sse4.2");
+#else
+   MAttrs.push_back(util_cpu_caps.has_sse4_2 ? "+sse42"  : "-sse42" );
+#endif
+   /*
+    * AVX feature is not automatically detected from CPUID by the X86 target
+    * yet, because the old (yet default) JIT engine is not capable of
+    * emitting the opcodes. On newer llvm versions it is and at least some
+    * versions (tested with 3.3) will emit avx opcodes without this anyway.
+    */
+   MAttrs.push_back(util_cpu_caps.has_avx  ? "+avx"  : "-avx");
+   MAttrs.push_back(util_cpu_caps.has_f16c ? "+f16c" : "-f16c");
+   MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
+#if HAVE_LLVM >= 0x0304
+   MAttrs.push_back(util_cpu_caps.has_avx512f  ? "+avx512f"  : "-avx512f" );
+   MAttrs.push_back(util_cpu_caps.has_avx512cd ? "+avx512cd" : "-avx512cd");
+   MAttrs.push_back(util_cpu_caps.has_avx512er ? "+avx512er" : "-avx512er");
+   MAttrs.push_back(util_cpu_caps.has_avx512pf ? "+avx512pf" : "-avx512pf");
+#endif
+#if HAVE_LLVM >= 0x0306
+   MAttrs.push_back(util_cpu_caps.has_avx512bw ? "+avx512bw" : "-avx512bw");
+   MAttrs.push_back(util_cpu_caps.has_avx512dq ? "+avx512dq" : "-avx512dq");
+   MAttrs.push_back(util_cpu_caps.has_avx512vl ? "+avx512vl" : "-avx512vl");
+#endif
+#endif
+
+#if defined(PIPE_ARCH_PPC)
+   MAttrs.push_back(util_cpu_caps.has_altivec ? "+altivec" : "-altivec");
+#if HAVE_LLVM >= 0x0304
+   /*
+    * Make sure VSX instructions are disabled
+    * See LLVM bug https://llvm.org/bugs/show_bug.cgi?id=25503#c7
+    */
+   if (util_cpu_caps.has_altivec) {
+      MAttrs.push_back("-vsx");
+   }
+#endif
+#endif
+}
+
+
+#if HAVE_LLVM >= 0x0306
+/*
+ * Hands object code found in the on-disk cache to MCJIT, so that it skips
+ * code generation, or saves newly generated object code to the cache.
+ */
+class ShaderObjectCache : public llvm::ObjectCache {
+
+   unsigned char Key[LP_BUILD_CACHE_KEY_SIZE];
+   void *Object;
+   size_t ObjectSize;
+
+   public:
+
+      ShaderObjectCache(struct lp_build_cache_entry *entry) {
+         memcpy(Key, entry->key, sizeof Key);
+         Object = entry->object;
+         ObjectSize = entry->object_size;
+         entry->object = NULL;
+      }
+
+      virtual ~ShaderObjectCache() {
+         FREE(Object);
+      }
+
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         lp_build_cache_store(Key, Obj.getBufferStart(), Obj.getBufferSize());
+      }
+
+      virtual std::unique_ptr<llvm::MemoryBuffer>
+      getObject(const llvm::Module *M) {
+         if (!Object)
+            return nullptr;
+         return llvm::MemoryBuffer::getMemBufferCopy(
+                   llvm::StringRef((const char *) Object, ObjectSize),
+                   M->getModuleIdentifier());
+      }
+};
+#endif
+
+
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
@@ -470,6 +605,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef CMM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_build_cache_entry *CacheEntry,
                                         char **OutError)
 {
    using namespace llvm;
@@ -528,55 +664,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    }
 
    llvm::SmallVector<std::string, 16> MAttrs;
-
-#if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
-   /*
-    * We need to unset attributes because sometimes LLVM mistakenly assumes
-    * certain features are present given the processor name.
-    *
-    * https://bugs.freedesktop.org/show_bug.cgi?id=92214
-    * http://llvm.org/PR25021
-    * http://llvm.org/PR19429
-    * http://llvm.org/PR16721
-    */
-   MAttrs.push_back(util_cpu_caps.has_sse    ? "+sse"    : "-sse"   );
-   MAttrs.push_back(util_cpu_caps.has_sse2   ? "+sse2"   : "-sse2"  );
-   MAttrs.push_back(util_cpu_caps.has_sse3   ? "+sse3"   : "-sse3"  );
-   MAttrs.push_back(util_cpu_caps.has_ssse3  ? "+ssse3"  : "-ssse3" );
-#if HAVE_LLVM >= 0x0304
-   MAttrs.push_back(util_cpu_caps.has_sse4_1 ? "+sse4.1" : "-sse4.1");
-#else
-   MAttrs.push_back(util_cpu_caps.has_sse4_1 ? "+sse41"  : "-sse41" );
-#endif
-#if HAVE_LLVM >= 0x0304
-   MAttrs.push_back(util_cpu_caps.has_sse4_2 ? "+sse4.2" : "-sse4.2");
-#else
-   MAttrs.push_back(util_cpu_caps.has_sse4_2 ? "+sse42"  : "-sse42" );
-#endif
-   /*
-    * AVX feature is not automatically detected from CPUID by the X86 target
-    * yet, because the old (yet default) JIT engine is not capable of
-    * emitting the opcodes. On newer llvm versions it is and at least some
-    * versions (tested with 3.3) will emit avx opcodes without this anyway.
-    */
-   MAttrs.push_back(util_cpu_caps.has_avx  ? "+avx"  : "-avx");
-   MAttrs.push_back(util_cpu_caps.has_f16c ? "+f16c" : "-f16c");
-   MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
-#endif
-
-#if defined(PIPE_ARCH_PPC)
-   MAttrs.push_back(util_cpu_caps.has_altivec ? "+altivec" : "-altivec");
-#if HAVE_LLVM >= 0x0304
-   /*
-    * Make sure VSX instructions are disabled
-    * See LLVM bug https://llvm.org/bugs/show_bug.cgi?id=25503#c7
-    */
-   if (util_cpu_caps.has_altivec) {
-      MAttrs.push_back("-vsx");
-   }
-#endif
-#endif
-
+   get_target_attrs(MAttrs);
    builder.setMAttrs(MAttrs);
 
 #if HAVE_LLVM >= 0x0305
@@ -626,6 +714,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 
    JIT = builder.create();
    if (JIT) {
+#if HAVE_LLVM >= 0x0306
+      if (CacheEntry && useMCJIT) {
+         ShaderObjectCache *Cache = new ShaderObjectCache(CacheEntry);
+         ShaderMemoryManager::setObjectCache(*OutCode, Cache);
+         JIT->setObjectCache(Cache);
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -637,6 +732,59 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 }
 
 
+/**
+ * Describe the JIT's target (LLVM version, triple, CPU and features), for
+ * keying cached object code.  The caller must free() the string.
+ */
+extern "C"
+char *
+lp_build_target_description(void)
+{
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string Desc;
+   char version[32];
+
+#ifdef MESA_LLVM_VERSION_PATCH
+   snprintf(version, sizeof version, "LLVM %u.%u.%u",
+            HAVE_LLVM >> 8, HAVE_LLVM & 0xff, MESA_LLVM_VERSION_PATCH);
+#else
+   snprintf(version, sizeof version, "LLVM %u.%u",
+            HAVE_LLVM >> 8, HAVE_LLVM & 0xff);
+#endif
+   Desc = version;
+   Desc += " ";
+   Desc += llvm::sys::getProcessTriple();
+#if HAVE_LLVM >= 0x0305
+   Desc += " ";
+   Desc += llvm::sys::getHostCPUName().str();
+#endif
+
+   get_target_attrs(MAttrs);
+   for (unsigned i = 0; i < MAttrs.size(); i++) {
+      Desc += " ";
+      Desc += MAttrs[i];
+   }
+
+   return strdup(Desc.c_str());
+}
+
+
+/**
+ * Clear the name of the source file the module was built from, which is
+ * written to bitcode and defaults to the module identifier.
+ */
+extern "C"
+void
+lp_build_clear_source_file_name(LLVMModuleRef M)
+{
+#if HAVE_LLVM >= 0x0309
+   llvm::unwrap(M)->setSourceFileName("");
+#else
+   (void) M;
+#endif
+}
+
+
 extern "C"
 void
 lp_free_generated_code(struct lp_generated_code *code)
@@ -41,6 +41,7 @@ extern "C" {
 
 
 struct lp_generated_code;
+struct lp_build_cache_entry;
 
 extern void
 gallivm_init_llvm_targets(void);
@@ -66,8 +67,15 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef MM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_build_cache_entry *CacheEntry,
                                         char **OutError);
 
+extern char *
+lp_build_target_description(void);
+
+extern void
+lp_build_clear_source_file_name(LLVMModuleRef M);
+
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
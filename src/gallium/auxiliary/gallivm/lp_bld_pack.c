@@ -325,8 +325,8 @@ lp_build_interleave2(struct gallivm_state *gallivm,
 }
 
 /**
- * Interleave vector elements but with 256 bit,
- * treats it as interleave with 2 concatenated 128 bit vectors.
+ * Interleave vector elements but with 256 (or 512) bit,
+ * treats it as interleave with 2 (or 4) concatenated 128 bit vectors.
  *
  * This differs to lp_build_interleave2 as that function would do the following (for lo):
  * a0 b0 a1 b1 a2 b2 a3 b3, and this does not compile into an AVX unpack instruction.
@@ -354,6 +354,24 @@ lp_build_interleave2_half(struct gallivm_state *gallivm,
    if (type.length * type.width == 256) {
       LLVMValueRef shuffle = lp_build_const_unpack_shuffle_half(gallivm, type.length, lo_hi);
       return LLVMBuildShuffleVector(gallivm->builder, a, b, shuffle, "");
+   } else if (type.length * type.width == 512) {
+      /* do each 256 bit half as above, llvm merges it back into one unpack */
+      struct lp_type half_type = type;
+      LLVMValueRef res[2];
+      unsigned i;
+
+      half_type.length /= 2;
+      for (i = 0; i < 2; i++) {
+         LLVMValueRef a_half = lp_build_extract_range(gallivm, a,
+                                                      i * half_type.length,
+                                                      half_type.length);
+         LLVMValueRef b_half = lp_build_extract_range(gallivm, b,
+                                                      i * half_type.length,
+                                                      half_type.length);
+         res[i] = lp_build_interleave2_half(gallivm, half_type,
+                                            a_half, b_half, lo_hi);
+      }
+      return lp_build_concat(gallivm, res, half_type, 2);
    } else {
       return lp_build_interleave2(gallivm, type, a, b, lo_hi);
    }
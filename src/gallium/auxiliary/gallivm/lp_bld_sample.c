@@ -2073,3 +2073,80 @@ lp_build_sample_offset(struct lp_build_context *bld,
 
    *out_offset = offset;
 }
+
+
+/**
+ * Add the offset of texel (i, j) within its tile to the offset of the tile.
+ *
+ * Tiles are LP_TEXTURE_TILE_SIZE texels square, and i, j the sub-tile texel
+ * coordinates as returned by lp_build_sample_partial_offset().
+ */
+LLVMValueRef
+lp_build_sample_tile_texel_offset(struct lp_build_context *bld,
+                                  const struct util_format_description *format_desc,
+                                  LLVMValueRef offset,
+                                  LLVMValueRef i,
+                                  LLVMValueRef j)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   unsigned texel_size = format_desc->block.bits / 8;
+   LLVMValueRef texel;
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+   /* texel = j * LP_TEXTURE_TILE_SIZE + i */
+   texel = LLVMBuildShl(builder, j,
+                        lp_build_const_int_vec(bld->gallivm, bld->type,
+                                               util_logbase2(LP_TEXTURE_TILE_SIZE)),
+                        "");
+   texel = LLVMBuildOr(builder, texel, i, "");
+   texel = lp_build_mul_imm(bld, texel, texel_size);
+
+   return lp_build_add(bld, offset, texel);
+}
+
+
+/**
+ * Compute the offset of a texel of a tiled texture.
+ *
+ * Same as lp_build_sample_offset(), for textures with static
+ * lp_static_texture_state::tiled set.  The i, j sub-block coordinates are
+ * always zero.
+ */
+void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset,
+                             LLVMValueRef *out_i,
+                             LLVMValueRef *out_j)
+{
+   LLVMValueRef x_stride;
+   LLVMValueRef offset, y_offset;
+   LLVMValueRef i, j;
+
+   assert(y && y_stride);
+
+   x_stride = lp_build_const_vec(bld->gallivm, bld->type,
+                                 LP_TEXTURE_TILE_SIZE * LP_TEXTURE_TILE_SIZE *
+                                 format_desc->block.bits/8);
+
+   lp_build_sample_partial_offset(bld, LP_TEXTURE_TILE_SIZE,
+                                  x, x_stride, &offset, &i);
+   lp_build_sample_partial_offset(bld, LP_TEXTURE_TILE_SIZE,
+                                  y, y_stride, &y_offset, &j);
+   offset = lp_build_add(bld, offset, y_offset);
+   offset = lp_build_sample_tile_texel_offset(bld, format_desc, offset, i, j);
+
+   if (z && z_stride) {
+      offset = lp_build_add(bld, offset, lp_build_mul(bld, z, z_stride));
+   }
+
+   *out_offset = offset;
+   *out_i = bld->zero;
+   *out_j = bld->zero;
+}
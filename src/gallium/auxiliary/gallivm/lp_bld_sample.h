@@ -108,6 +108,16 @@ struct lp_sampler_params
 };
 
 
+/**
+ * Width and height, in texels, of the tiles of tiled textures.
+ *
+ * Tiled textures store each 2D image as rows of square tiles, with the
+ * texels of a tile in row-major order.  Their row stride is the stride
+ * between rows of tiles.
+ */
+#define LP_TEXTURE_TILE_SIZE 4
+
+
 /**
  * Texture static state.
  *
@@ -129,6 +139,7 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned tiled:1;         /**< stored in LP_TEXTURE_TILE_SIZE tiles? */
 };
 
 
@@ -397,6 +408,41 @@ lp_is_simple_wrap_mode(unsigned mode)
 }
 
 
+/**
+ * Width of the pixel blocks the texture offsets are computed for:
+ * the format's blocks, or the tiles of tiled textures.
+ */
+static inline unsigned
+lp_sample_block_width(const struct lp_build_sample_context *bld)
+{
+   return bld->static_texture_state->tiled ? LP_TEXTURE_TILE_SIZE :
+                                             bld->format_desc->block.width;
+}
+
+
+static inline unsigned
+lp_sample_block_height(const struct lp_build_sample_context *bld)
+{
+   return bld->static_texture_state->tiled ? LP_TEXTURE_TILE_SIZE :
+                                             bld->format_desc->block.height;
+}
+
+
+/**
+ * Size in bytes of the pixel blocks, see lp_sample_block_width().
+ */
+static inline unsigned
+lp_sample_block_size(const struct lp_build_sample_context *bld)
+{
+   unsigned size = bld->format_desc->block.bits / 8;
+
+   if (bld->static_texture_state->tiled)
+      size *= LP_TEXTURE_TILE_SIZE * LP_TEXTURE_TILE_SIZE;
+
+   return size;
+}
+
+
 static inline void
 apply_sampler_swizzle(struct lp_build_sample_context *bld,
                       LLVMValueRef *texel)
@@ -582,6 +628,27 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_j);
 
 
+void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset,
+                             LLVMValueRef *out_i,
+                             LLVMValueRef *out_j);
+
+
+LLVMValueRef
+lp_build_sample_tile_texel_offset(struct lp_build_context *bld,
+                                  const struct util_format_description *format_desc,
+                                  LLVMValueRef offset,
+                                  LLVMValueRef i,
+                                  LLVMValueRef j);
+
+
 void
 lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                     const struct lp_static_sampler_state *static_sampler_state,
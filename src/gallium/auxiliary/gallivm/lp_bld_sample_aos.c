@@ -572,6 +572,13 @@ lp_build_sample_fetch_image_nearest(struct lp_build_sample_context *bld,
    lp_build_context_init(&u8n, bld->gallivm, lp_type_unorm(8, bld->vector_width));
    u8n_vec_type = lp_build_vec_type(bld->gallivm, u8n.type);
 
+   if (bld->static_texture_state->tiled) {
+      offset = lp_build_sample_tile_texel_offset(&bld->int_coord_bld,
+                                                 bld->format_desc, offset,
+                                                 x_subcoord, y_subcoord);
+      x_subcoord = y_subcoord = bld->int_coord_bld.zero;
+   }
+
    if (util_format_is_rgba8_variant(bld->format_desc)) {
       /*
        * Given the format is a rgba8, just read the pixels as is,
@@ -674,11 +681,11 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    /* get pixel, row, image strides */
    x_stride = lp_build_const_vec(bld->gallivm,
                                  bld->int_coord_bld.type,
-                                 bld->format_desc->block.bits/8);
+                                 lp_sample_block_size(bld));
 
    /* Do texcoord wrapping, compute texel offset */
    lp_build_sample_wrap_nearest_int(bld,
-                                    bld->format_desc->block.width,
+                                    lp_sample_block_width(bld),
                                     s_ipart, s_float,
                                     width_vec, x_stride, offsets[0],
                                     bld->static_texture_state->pot_width,
@@ -688,7 +695,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    if (dims >= 2) {
       LLVMValueRef y_offset;
       lp_build_sample_wrap_nearest_int(bld,
-                                       bld->format_desc->block.height,
+                                       lp_sample_block_height(bld),
                                        t_ipart, t_float,
                                        height_vec, row_stride_vec, offsets[1],
                                        bld->static_texture_state->pot_height,
@@ -796,13 +803,24 @@ lp_build_sample_image_nearest_afloat(struct lp_build_sample_context *bld,
     * cannot do offset calc with floats, difficult for block-based formats,
     * and not enough precision anyway.
     */
-   lp_build_sample_offset(&bld->int_coord_bld,
-                          bld->format_desc,
-                          x_icoord, y_icoord,
-                          z_icoord,
-                          row_stride_vec, img_stride_vec,
-                          &offset,
-                          &x_subcoord, &y_subcoord);
+   if (bld->static_texture_state->tiled) {
+      lp_build_sample_tiled_offset(&bld->int_coord_bld,
+                                   bld->format_desc,
+                                   x_icoord, y_icoord,
+                                   z_icoord,
+                                   row_stride_vec, img_stride_vec,
+                                   &offset,
+                                   &x_subcoord, &y_subcoord);
+   }
+   else {
+      lp_build_sample_offset(&bld->int_coord_bld,
+                             bld->format_desc,
+                             x_icoord, y_icoord,
+                             z_icoord,
+                             row_stride_vec, img_stride_vec,
+                             &offset,
+                             &x_subcoord, &y_subcoord);
+   }
    if (mipoffsets) {
       offset = lp_build_add(&bld->int_coord_bld, offset, mipoffsets);
    }
@@ -908,6 +926,23 @@ lp_build_sample_fetch_image_linear(struct lp_build_sample_context *bld,
    numj = 1 + (dims >= 2);
    numk = 1 + (dims >= 3);
 
+   if (bld->static_texture_state->tiled) {
+      for (k = 0; k < numk; k++) {
+         for (j = 0; j < numj; j++) {
+            for (i = 0; i < 2; i++) {
+               offset[k][j][i] =
+                  lp_build_sample_tile_texel_offset(&bld->int_coord_bld,
+                                                    bld->format_desc,
+                                                    offset[k][j][i],
+                                                    x_subcoord[i],
+                                                    y_subcoord[j]);
+            }
+         }
+      }
+      x_subcoord[0] = x_subcoord[1] = bld->int_coord_bld.zero;
+      y_subcoord[0] = y_subcoord[1] = bld->int_coord_bld.zero;
+   }
+
    for (k = 0; k < numk; k++) {
       for (j = 0; j < numj; j++) {
          for (i = 0; i < 2; i++) {
@@ -1117,13 +1152,13 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    /* get pixel, row and image strides */
    x_stride = lp_build_const_vec(bld->gallivm, bld->int_coord_bld.type,
-                                 bld->format_desc->block.bits/8);
+                                 lp_sample_block_size(bld));
    y_stride = row_stride_vec;
    z_stride = img_stride_vec;
 
    /* do texcoord wrapping and compute texel offsets */
    lp_build_sample_wrap_linear_int(bld,
-                                   bld->format_desc->block.width,
+                                   lp_sample_block_width(bld),
                                    s_ipart, &s_fpart, s_float,
                                    width_vec, x_stride, offsets[0],
                                    bld->static_texture_state->pot_width,
@@ -1153,7 +1188,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    if (dims >= 2) {
       lp_build_sample_wrap_linear_int(bld,
-                                      bld->format_desc->block.height,
+                                      lp_sample_block_height(bld),
                                       t_ipart, &t_fpart, t_float,
                                       height_vec, y_stride, offsets[1],
                                       bld->static_texture_state->pot_height,
@@ -1245,7 +1280,7 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
 
    /* do texcoord wrapping and compute texel offsets */
    lp_build_sample_wrap_linear_float(bld,
-                                     bld->format_desc->block.width,
+                                     lp_sample_block_width(bld),
                                      s, width_vec, offsets[0],
                                      bld->static_texture_state->pot_width,
                                      bld->static_sampler_state->wrap_s,
@@ -1255,7 +1290,7 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
 
    if (dims >= 2) {
       lp_build_sample_wrap_linear_float(bld,
-                                        bld->format_desc->block.height,
+                                        lp_sample_block_height(bld),
                                         t, height_vec, offsets[1],
                                         bld->static_texture_state->pot_height,
                                         bld->static_sampler_state->wrap_t,
@@ -1282,7 +1317,7 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
    /* get pixel, row and image strides */
    x_stride = lp_build_const_vec(bld->gallivm,
                                  bld->int_coord_bld.type,
-                                 bld->format_desc->block.bits/8);
+                                 lp_sample_block_size(bld));
    y_stride = row_stride_vec;
    z_stride = img_stride_vec;
 
@@ -1292,11 +1327,11 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
     * and not enough precision anyway.
     */
    lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                  bld->format_desc->block.width,
+                                  lp_sample_block_width(bld),
                                   x_icoord0, x_stride,
                                   &x_offset0, &x_subcoord[0]);
    lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                  bld->format_desc->block.width,
+                                  lp_sample_block_width(bld),
                                   x_icoord1, x_stride,
                                   &x_offset1, &x_subcoord[1]);
 
@@ -1322,11 +1357,11 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
 
    if (dims >= 2) {
       lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                     bld->format_desc->block.height,
+                                     lp_sample_block_height(bld),
                                      y_icoord0, y_stride,
                                      &y_offset0, &y_subcoord[0]);
       lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                     bld->format_desc->block.height,
+                                     lp_sample_block_height(bld),
                                      y_icoord1, y_stride,
                                      &y_offset1, &y_subcoord[1]);
       for (z = 0; z < 2; z++) {
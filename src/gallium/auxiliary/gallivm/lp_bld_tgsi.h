@@ -63,6 +63,7 @@ struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
 struct lp_build_tgsi_gs_iface;
+struct lp_build_tgsi_cs_iface;
 
 
 enum lp_build_tex_modifier {
@@ -166,6 +167,10 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef prim_id;
    LLVMValueRef basevertex;
    LLVMValueRef invocation_id;
+   LLVMValueRef thread_id[3];   /**< vectors, block-relative */
+   LLVMValueRef block_id[3];    /**< scalars */
+   LLVMValueRef grid_size[3];   /**< scalars, in blocks */
+   LLVMValueRef block_size[3];  /**< scalars, in threads */
 };
 
 
@@ -233,7 +238,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface);
 
 
 void
@@ -428,6 +434,20 @@ struct lp_build_tgsi_gs_iface
                        LLVMValueRef emitted_prims_vec);
 };
 
+/**
+ * Compute shader code generation interface: shader buffers, shared memory
+ * and barriers.
+ */
+struct lp_build_tgsi_cs_iface
+{
+   LLVMValueRef ssbo_ptr;        /**< array of shader buffer base pointers */
+   LLVMValueRef ssbo_sizes_ptr;  /**< array of shader buffer sizes, in bytes */
+   LLVMValueRef shared_ptr;      /**< the block's shared memory */
+   LLVMValueRef shared_size;     /**< size of the shared memory, in bytes */
+   void (*emit_barrier)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                        struct lp_build_tgsi_context * bld_base);
+};
+
 struct lp_build_tgsi_soa_context
 {
    struct lp_build_tgsi_context bld_base;
@@ -436,6 +456,7 @@ struct lp_build_tgsi_soa_context
    struct lp_build_context elem_bld;
 
    const struct lp_build_tgsi_gs_iface *gs_iface;
+   const struct lp_build_tgsi_cs_iface *cs_iface;
    LLVMValueRef emitted_prims_vec_ptr;
    LLVMValueRef total_emitted_vertices_vec_ptr;
    LLVMValueRef emitted_vertices_vec_ptr;
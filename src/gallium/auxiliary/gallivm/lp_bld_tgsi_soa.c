@@ -1678,6 +1678,36 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_id[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.grid_size[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_size[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -2028,6 +2058,14 @@ emit_store(
    unsigned chan_index;
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    enum tgsi_opcode_type dtype = tgsi_opcode_infer_dst_type(inst->Instruction.Opcode);
+
+   /* STORE writes buffers and shared memory itself */
+   if (inst->Dst[0].Register.File == TGSI_FILE_BUFFER ||
+       inst->Dst[0].Register.File == TGSI_FILE_MEMORY ||
+       inst->Dst[0].Register.File == TGSI_FILE_IMAGE) {
+      return;
+   }
+
    if(info->num_dst) {
       LLVMValueRef pred[TGSI_NUM_CHANNELS];
 
@@ -3536,6 +3574,367 @@ end_primitive(
    }
 }
 
+/*
+ * Shader buffer and shared memory access, for compute shaders.
+ *
+ * The lanes of a vector may access arbitrary addresses, so the accesses
+ * are done one lane at a time.  Lanes which are not active, or whose
+ * access would be out of bounds, are skipped; loads return zero for them.
+ */
+
+static void
+get_mem_resource(struct lp_build_tgsi_soa_context *bld,
+                 unsigned file, unsigned index,
+                 LLVMValueRef *base, LLVMValueRef *size)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   const struct lp_build_tgsi_cs_iface *cs_iface = bld->cs_iface;
+
+   if (file == TGSI_FILE_MEMORY) {
+      *base = cs_iface->shared_ptr;
+      *size = cs_iface->shared_size;
+   }
+   else {
+      LLVMValueRef idx = lp_build_const_int32(gallivm, index);
+
+      assert(file == TGSI_FILE_BUFFER);
+      *base = lp_build_array_get(gallivm, cs_iface->ssbo_ptr, idx);
+      *size = lp_build_array_get(gallivm, cs_iface->ssbo_sizes_ptr, idx);
+   }
+}
+
+/**
+ * Mask of the lanes which do an access of \p bytes bytes at \p offset.
+ */
+static LLVMValueRef
+mem_access_mask(struct lp_build_tgsi_soa_context *bld,
+                LLVMValueRef offset,
+                unsigned bytes,
+                LLVMValueRef size)
+{
+   struct lp_build_context *uint_bld = &bld->bld_base.uint_bld;
+   LLVMBuilderRef builder = bld->bld_base.base.gallivm->builder;
+   LLVMValueRef size_vec = lp_build_broadcast_scalar(uint_bld, size);
+   LLVMValueRef end, in_bounds;
+
+   /* offset < size also catches offset + bytes wrapping around */
+   end = lp_build_add(uint_bld, offset,
+                      lp_build_const_int_vec(uint_bld->gallivm, uint_bld->type,
+                                             bytes));
+   in_bounds = LLVMBuildAnd(builder,
+                            lp_build_cmp(uint_bld, PIPE_FUNC_LESS,
+                                         offset, size_vec),
+                            lp_build_cmp(uint_bld, PIPE_FUNC_LEQUAL,
+                                         end, size_vec), "");
+
+   return LLVMBuildAnd(builder, in_bounds, mask_vec(&bld->bld_base), "");
+}
+
+/**
+ * Begin the code for a single lane, executed if the lane is set in mask.
+ */
+static void
+mem_lane_begin(struct lp_build_tgsi_soa_context *bld,
+               struct lp_build_if_state *ifthen,
+               LLVMValueRef mask,
+               unsigned lane)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef cond;
+
+   cond = LLVMBuildExtractElement(builder, mask,
+                                  lp_build_const_int32(gallivm, lane), "");
+   cond = LLVMBuildICmp(builder, LLVMIntNE, cond,
+                        lp_build_const_int32(gallivm, 0), "");
+   lp_build_if(ifthen, gallivm, cond);
+}
+
+/**
+ * Pointer to the dword of channel \p chan accessed by lane \p lane.
+ */
+static LLVMValueRef
+mem_lane_ptr(struct lp_build_tgsi_soa_context *bld,
+             LLVMValueRef base,
+             LLVMValueRef offset,
+             unsigned lane,
+             unsigned chan)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32_ptr_type =
+      LLVMPointerType(LLVMInt32TypeInContext(gallivm->context), 0);
+   LLVMValueRef lane_offset, ptr;
+
+   lane_offset = LLVMBuildExtractElement(builder, offset,
+                                         lp_build_const_int32(gallivm, lane), "");
+   lane_offset = LLVMBuildAdd(builder, lane_offset,
+                              lp_build_const_int32(gallivm, chan * 4), "");
+   ptr = LLVMBuildGEP(builder, base, &lane_offset, 1, "");
+   return LLVMBuildBitCast(builder, ptr, i32_ptr_type, "");
+}
+
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   unsigned file = inst->Src[0].Register.File;
+   LLVMValueRef res[TGSI_NUM_CHANNELS];
+   LLVMValueRef base, size, offset, mask;
+   unsigned chan, lane, num_chans = 0;
+
+   if (file != TGSI_FILE_BUFFER && file != TGSI_FILE_MEMORY) {
+      /* images aren't supported */
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         emit_data->output[chan] = bld_base->base.zero;
+      }
+      return;
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      res[chan] = lp_build_alloca(gallivm, uint_bld->vec_type, "");
+      num_chans = chan + 1;
+   }
+
+   get_mem_resource(bld, file, inst->Src[0].Register.Index, &base, &size);
+   offset = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   offset = LLVMBuildBitCast(builder, offset, uint_bld->vec_type, "");
+   mask = mem_access_mask(bld, offset, num_chans * 4, size);
+
+   for (lane = 0; lane < uint_bld->type.length; lane++) {
+      LLVMValueRef lane_idx = lp_build_const_int32(gallivm, lane);
+      struct lp_build_if_state ifthen;
+
+      mem_lane_begin(bld, &ifthen, mask, lane);
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         LLVMValueRef ptr = mem_lane_ptr(bld, base, offset, lane, chan);
+         LLVMValueRef val = LLVMBuildLoad(builder, ptr, "");
+         LLVMValueRef vec = LLVMBuildLoad(builder, res[chan], "");
+         vec = LLVMBuildInsertElement(builder, vec, val, lane_idx, "");
+         LLVMBuildStore(builder, vec, res[chan]);
+      }
+      lp_build_endif(&ifthen);
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef vec = LLVMBuildLoad(builder, res[chan], "");
+      emit_data->output[chan] = LLVMBuildBitCast(builder, vec,
+                                                 bld_base->base.vec_type, "");
+   }
+}
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   unsigned file = inst->Dst[0].Register.File;
+   LLVMValueRef values[TGSI_NUM_CHANNELS];
+   LLVMValueRef base, size, offset, mask;
+   unsigned chan, lane, num_chans = 0;
+
+   if (file != TGSI_FILE_BUFFER && file != TGSI_FILE_MEMORY) {
+      /* images aren't supported */
+      return;
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      values[chan] = lp_build_emit_fetch(bld_base, inst, 1, chan);
+      values[chan] = LLVMBuildBitCast(builder, values[chan],
+                                      uint_bld->vec_type, "");
+      num_chans = chan + 1;
+   }
+
+   get_mem_resource(bld, file, inst->Dst[0].Register.Index, &base, &size);
+   offset = lp_build_emit_fetch(bld_base, inst, 0, TGSI_CHAN_X);
+   offset = LLVMBuildBitCast(builder, offset, uint_bld->vec_type, "");
+   mask = mem_access_mask(bld, offset, num_chans * 4, size);
+
+   for (lane = 0; lane < uint_bld->type.length; lane++) {
+      LLVMValueRef lane_idx = lp_build_const_int32(gallivm, lane);
+      struct lp_build_if_state ifthen;
+
+      mem_lane_begin(bld, &ifthen, mask, lane);
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         LLVMValueRef ptr = mem_lane_ptr(bld, base, offset, lane, chan);
+         LLVMValueRef val = LLVMBuildExtractElement(builder, values[chan],
+                                                    lane_idx, "");
+         LLVMBuildStore(builder, val, ptr);
+      }
+      lp_build_endif(&ifthen);
+   }
+}
+
+static void
+atomic_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   unsigned opcode = inst->Instruction.Opcode;
+   unsigned file = inst->Src[0].Register.File;
+   LLVMAtomicRMWBinOp op = LLVMAtomicRMWBinOpAdd;
+   LLVMValueRef base, size, offset, value, compare = NULL, mask, res;
+   unsigned chan, lane;
+
+   if (file != TGSI_FILE_BUFFER && file != TGSI_FILE_MEMORY) {
+      /* images aren't supported */
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         emit_data->output[chan] = bld_base->base.zero;
+      }
+      return;
+   }
+
+   switch (opcode) {
+   case TGSI_OPCODE_ATOMUADD:
+      op = LLVMAtomicRMWBinOpAdd;
+      break;
+   case TGSI_OPCODE_ATOMXCHG:
+      op = LLVMAtomicRMWBinOpXchg;
+      break;
+   case TGSI_OPCODE_ATOMAND:
+      op = LLVMAtomicRMWBinOpAnd;
+      break;
+   case TGSI_OPCODE_ATOMOR:
+      op = LLVMAtomicRMWBinOpOr;
+      break;
+   case TGSI_OPCODE_ATOMXOR:
+      op = LLVMAtomicRMWBinOpXor;
+      break;
+   case TGSI_OPCODE_ATOMUMIN:
+      op = LLVMAtomicRMWBinOpUMin;
+      break;
+   case TGSI_OPCODE_ATOMUMAX:
+      op = LLVMAtomicRMWBinOpUMax;
+      break;
+   case TGSI_OPCODE_ATOMIMIN:
+      op = LLVMAtomicRMWBinOpMin;
+      break;
+   case TGSI_OPCODE_ATOMIMAX:
+      op = LLVMAtomicRMWBinOpMax;
+      break;
+   case TGSI_OPCODE_ATOMCAS:
+      compare = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+      compare = LLVMBuildBitCast(builder, compare, uint_bld->vec_type, "");
+      break;
+   default:
+      assert(0);
+      break;
+   }
+
+   res = lp_build_alloca(gallivm, uint_bld->vec_type, "");
+
+   get_mem_resource(bld, file, inst->Src[0].Register.Index, &base, &size);
+   offset = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   offset = LLVMBuildBitCast(builder, offset, uint_bld->vec_type, "");
+   value = lp_build_emit_fetch(bld_base, inst, compare ? 3 : 2, TGSI_CHAN_X);
+   value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+   mask = mem_access_mask(bld, offset, 4, size);
+
+   for (lane = 0; lane < uint_bld->type.length; lane++) {
+      LLVMValueRef lane_idx = lp_build_const_int32(gallivm, lane);
+      LLVMValueRef ptr, val, old, vec;
+      struct lp_build_if_state ifthen;
+
+      mem_lane_begin(bld, &ifthen, mask, lane);
+      ptr = mem_lane_ptr(bld, base, offset, lane, 0);
+      val = LLVMBuildExtractElement(builder, value, lane_idx, "");
+      if (compare) {
+         LLVMValueRef cmp = LLVMBuildExtractElement(builder, compare,
+                                                    lane_idx, "");
+         old = LLVMBuildAtomicCmpXchg(builder, ptr, cmp, val,
+                                      LLVMAtomicOrderingSequentiallyConsistent,
+                                      LLVMAtomicOrderingSequentiallyConsistent,
+                                      FALSE);
+         old = LLVMBuildExtractValue(builder, old, 0, "");
+      }
+      else {
+         old = LLVMBuildAtomicRMW(builder, op, ptr, val,
+                                  LLVMAtomicOrderingSequentiallyConsistent,
+                                  FALSE);
+      }
+      vec = LLVMBuildLoad(builder, res, "");
+      vec = LLVMBuildInsertElement(builder, vec, old, lane_idx, "");
+      LLVMBuildStore(builder, vec, res);
+      lp_build_endif(&ifthen);
+   }
+
+   res = LLVMBuildLoad(builder, res, "");
+   res = LLVMBuildBitCast(builder, res, bld_base->base.vec_type, "");
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = res;
+   }
+}
+
+static void
+resq_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef res = bld_base->base.zero;
+   unsigned chan;
+
+   if (inst->Src[0].Register.File == TGSI_FILE_BUFFER) {
+      LLVMValueRef base, size;
+
+      get_mem_resource(bld, TGSI_FILE_BUFFER, inst->Src[0].Register.Index,
+                       &base, &size);
+      res = lp_build_broadcast_scalar(&bld_base->uint_bld, size);
+      res = LLVMBuildBitCast(builder, res, bld_base->base.vec_type, "");
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = res;
+   }
+}
+
+static void
+barrier_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   if (bld->cs_iface->emit_barrier) {
+      bld->cs_iface->emit_barrier(bld->cs_iface, bld_base);
+   }
+}
+
+static void
+membar_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   /*
+    * Nothing to do: the invocations of a block all run on the same thread,
+    * and other blocks only need to see the writes once the grid is done.
+    */
+}
+
 static void
 cal_emit(
    const struct lp_build_tgsi_action * action,
@@ -3881,7 +4280,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -4022,6 +4422,27 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                                 max_output_vertices);
    }
 
+   if (cs_iface) {
+      bld.cs_iface = cs_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_RESQ].emit = resq_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUADD].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXCHG].emit = atomic_emit;
+#if HAVE_LLVM >= 0x0309
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMCAS].emit = atomic_emit;
+#endif
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMAND].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_BARRIER].emit = barrier_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_MEMBAR].emit = membar_emit;
+   }
+
    lp_exec_mask_init(&bld.exec_mask, &bld.bld_base.int_bld);
 
    bld.system_values = *system_values;
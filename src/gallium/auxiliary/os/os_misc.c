@@ -47,7 +47,10 @@
 #endif
 
 
-#if defined(PIPE_OS_LINUX) || defined(PIPE_OS_CYGWIN) || defined(PIPE_OS_SOLARIS)
+#if defined(PIPE_OS_LINUX)
+#  include <sched.h>
+#  include <unistd.h>
+#elif defined(PIPE_OS_CYGWIN) || defined(PIPE_OS_SOLARIS)
 #  include <unistd.h>
 #elif defined(PIPE_OS_APPLE) || defined(PIPE_OS_BSD)
 #  include <sys/sysctl.h>
@@ -157,3 +160,81 @@ os_get_total_physical_memory(uint64_t *size)
    return false;
 #endif
 }
+
+
+/**
+ * Return the physical package (socket) a logical CPU belongs to.
+ * \param cpu  logical CPU number, as used by the OS scheduler
+ * \return the package id, or -1 if it can't be determined
+ */
+int
+os_get_cpu_package(unsigned cpu)
+{
+#if defined(PIPE_OS_LINUX)
+   char path[80];
+   FILE *f;
+   int id = -1;
+
+   snprintf(path, sizeof path,
+            "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+   f = fopen(path, "r");
+   if (f) {
+      if (fscanf(f, "%d", &id) != 1)
+         id = -1;
+      fclose(f);
+   }
+   return id;
+#else
+   (void) cpu;
+   return -1;
+#endif
+}
+
+
+/**
+ * Return the logical CPU the calling thread is currently running on,
+ * or -1 if it can't be determined.
+ */
+int
+os_get_current_cpu(void)
+{
+#if defined(PIPE_OS_LINUX) && defined(__GLIBC__)
+   return sched_getcpu();
+#else
+   return -1;
+#endif
+}
+
+
+/**
+ * Get the logical CPUs the calling thread is allowed to run on, in
+ * increasing order.  This skips offline CPUs and those outside of the
+ * process' cpuset.
+ * \param cpus  returns up to max CPU numbers, may be NULL if max is 0
+ * \return the number of allowed CPUs, which may be more than max, or 0 if
+ *         it can't be determined
+ */
+unsigned
+os_get_allowed_cpus(unsigned *cpus, unsigned max)
+{
+#if defined(PIPE_OS_LINUX) && defined(__GLIBC__) && defined(CPU_SETSIZE)
+   cpu_set_t set;
+   unsigned i, n = 0;
+
+   if (sched_getaffinity(0, sizeof set, &set) != 0)
+      return 0;
+
+   for (i = 0; i < CPU_SETSIZE; i++) {
+      if (CPU_ISSET(i, &set)) {
+         if (n < max)
+            cpus[n] = i;
+         n++;
+      }
+   }
+   return n;
+#else
+   (void) cpus;
+   (void) max;
+   return 0;
+#endif
+}
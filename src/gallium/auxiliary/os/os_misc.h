@@ -94,6 +94,27 @@ bool
 os_get_total_physical_memory(uint64_t *size);
 
 
+/*
+ * Get the physical package (socket) of a logical CPU, or -1 if unknown.
+ */
+int
+os_get_cpu_package(unsigned cpu);
+
+
+/*
+ * Get the logical CPU the calling thread runs on, or -1 if unknown.
+ */
+int
+os_get_current_cpu(void);
+
+
+/*
+ * Get the logical CPUs the calling thread may run on, or 0 if unknown.
+ */
+unsigned
+os_get_allowed_cpus(unsigned *cpus, unsigned max);
+
+
 #ifdef	__cplusplus
 }
 #endif
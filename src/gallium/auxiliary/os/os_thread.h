@@ -97,6 +97,29 @@ static inline void pipe_thread_setname( const char *name )
 }
 
 
+/**
+ * Pin the calling thread to the given logical CPU.
+ * \return TRUE on success, FALSE if not supported or on failure
+ */
+static inline boolean pipe_thread_set_affinity( unsigned cpu )
+{
+#if defined(HAVE_PTHREAD) && defined(__linux__) && defined(__GLIBC__) && \
+    defined(CPU_SETSIZE)
+   cpu_set_t set;
+
+   if (cpu >= CPU_SETSIZE)
+      return FALSE;
+
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0;
+#else
+   (void)cpu;
+   return FALSE;
+#endif
+}
+
+
 /* pipe_mutex
  */
 typedef mtx_t pipe_mutex;
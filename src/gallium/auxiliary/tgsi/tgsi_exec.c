@@ -62,6 +62,10 @@
 #include "util/u_memory.h"
 #include "util/u_math.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <xmmintrin.h>
+#endif
+
 
 #define DEBUG_EXECUTION 0
 
@@ -844,6 +848,10 @@ tgsi_check_soa_dependencies(const struct tgsi_full_instruction *inst)
 }
 
 
+static void
+fast_decode_shader(struct tgsi_exec_machine *mach);
+
+
 /**
  * Initialize machine state by expanding tokens to full instructions,
  * allocating temporary storage, setting up constants, etc.
@@ -882,6 +890,9 @@ tgsi_exec_machine_bind_shader(
       mach->Instructions = NULL;
       mach->NumInstructions = 0;
 
+      FREE(mach->FastInstructions);
+      mach->FastInstructions = NULL;
+
       return;
    }
 
@@ -1021,6 +1032,8 @@ tgsi_exec_machine_bind_shader(
    FREE(mach->Instructions);
    mach->Instructions = instructions;
    mach->NumInstructions = numInstructions;
+
+   fast_decode_shader(mach);
 }
 
 
@@ -1039,6 +1052,7 @@ tgsi_exec_machine_create( void )
    mach->Addrs = &mach->Temps[TGSI_EXEC_TEMP_ADDR];
    mach->MaxGeometryShaderOutputs = TGSI_MAX_TOTAL_VERTICES;
    mach->Predicates = &mach->Temps[TGSI_EXEC_TEMP_P0];
+   mach->NoFastPath = debug_get_bool_option("TGSI_EXEC_NO_FAST", FALSE);
 
    mach->Inputs = align_malloc(sizeof(struct tgsi_exec_vector) * PIPE_MAX_SHADER_INPUTS, 16);
    mach->Outputs = align_malloc(sizeof(struct tgsi_exec_vector) * PIPE_MAX_SHADER_OUTPUTS, 16);
@@ -1082,6 +1096,7 @@ tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
       FREE(mach->Instructions);
+      FREE(mach->FastInstructions);
       FREE(mach->Declarations);
 
       align_free(mach->Inputs);
@@ -5176,6 +5191,558 @@ exec_instruction(
  * Run TGSI interpreter.
  * \return bitmask of "alive" quad components
  */
+/*
+ * Fast path.
+ *
+ * When a shader is bound, simple float instructions are pre-decoded into
+ * struct tgsi_exec_fast_inst, with the register addresses of their
+ * operands resolved and a handler specialized for the opcode.  The
+ * handlers skip the generic fetch_source()/store_dest() decoding, and use
+ * SSE when available.  They compute exactly what exec_instruction() does,
+ * in the same order.
+ */
+
+#if defined(PIPE_ARCH_SSE)
+
+static inline void
+fast_micro_add(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   _mm_storeu_ps(dst->f, _mm_add_ps(_mm_loadu_ps(src0->f),
+                                    _mm_loadu_ps(src1->f)));
+}
+
+static inline void
+fast_micro_sub(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   _mm_storeu_ps(dst->f, _mm_sub_ps(_mm_loadu_ps(src0->f),
+                                    _mm_loadu_ps(src1->f)));
+}
+
+static inline void
+fast_micro_mul(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   _mm_storeu_ps(dst->f, _mm_mul_ps(_mm_loadu_ps(src0->f),
+                                    _mm_loadu_ps(src1->f)));
+}
+
+/* minps/maxps return the second operand unless the comparison holds,
+ * just like micro_min/max.
+ */
+static inline void
+fast_micro_min(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   _mm_storeu_ps(dst->f, _mm_min_ps(_mm_loadu_ps(src0->f),
+                                    _mm_loadu_ps(src1->f)));
+}
+
+static inline void
+fast_micro_max(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   _mm_storeu_ps(dst->f, _mm_max_ps(_mm_loadu_ps(src0->f),
+                                    _mm_loadu_ps(src1->f)));
+}
+
+static inline void
+fast_micro_slt(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   __m128 mask = _mm_cmplt_ps(_mm_loadu_ps(src0->f), _mm_loadu_ps(src1->f));
+   _mm_storeu_ps(dst->f, _mm_and_ps(mask, _mm_set1_ps(1.0f)));
+}
+
+static inline void
+fast_micro_sge(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1)
+{
+   __m128 mask = _mm_cmpge_ps(_mm_loadu_ps(src0->f), _mm_loadu_ps(src1->f));
+   _mm_storeu_ps(dst->f, _mm_and_ps(mask, _mm_set1_ps(1.0f)));
+}
+
+static inline void
+fast_micro_mad(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src0,
+               const union tgsi_exec_channel *src1,
+               const union tgsi_exec_channel *src2)
+{
+   __m128 tmp = _mm_mul_ps(_mm_loadu_ps(src0->f), _mm_loadu_ps(src1->f));
+   _mm_storeu_ps(dst->f, _mm_add_ps(tmp, _mm_loadu_ps(src2->f)));
+}
+
+/* Like the C code in store_dest(): NaNs are left alone. */
+static inline void
+fast_micro_sat(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src)
+{
+   __m128 tmp = _mm_min_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(src->f));
+   _mm_storeu_ps(dst->f, _mm_max_ps(_mm_setzero_ps(), tmp));
+}
+
+#else
+
+#define fast_micro_add micro_add
+#define fast_micro_sub micro_sub
+#define fast_micro_mul micro_mul
+#define fast_micro_min micro_min
+#define fast_micro_max micro_max
+#define fast_micro_slt micro_slt
+#define fast_micro_sge micro_sge
+#define fast_micro_mad micro_mad
+
+static inline void
+fast_micro_sat(union tgsi_exec_channel *dst,
+               const union tgsi_exec_channel *src)
+{
+   uint i;
+
+   for (i = 0; i < TGSI_QUAD_SIZE; i++) {
+      if (src->f[i] < 0.0f)
+         dst->f[i] = 0.0f;
+      else if (src->f[i] > 1.0f)
+         dst->f[i] = 1.0f;
+      else
+         dst->i[i] = src->i[i];
+   }
+}
+
+#endif /* PIPE_ARCH_SSE */
+
+
+/**
+ * Return a source channel, either straight from the register file or
+ * computed into tmp.
+ */
+static inline const union tgsi_exec_channel *
+fast_fetch(const struct tgsi_exec_machine *mach,
+           const struct tgsi_exec_fast_src *src,
+           uint chan,
+           union tgsi_exec_channel *tmp)
+{
+   uint i;
+
+   switch (src->kind) {
+   case TGSI_EXEC_FAST_SRC_REG:
+      return src->reg[chan];
+
+   case TGSI_EXEC_FAST_SRC_REG_MOD:
+      *tmp = *src->reg[chan];
+      break;
+
+   case TGSI_EXEC_FAST_SRC_IMM:
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         tmp->f[i] = *src->imm[chan];
+      break;
+
+   case TGSI_EXEC_FAST_SRC_CONST:
+   default:
+      {
+         const int pos = src->index * 4 + src->swizzle[chan];
+         uint value = 0;
+
+         /* same bounds check as fetch_src_file_channel() */
+         if (pos < (int) mach->ConstsSize[src->dimension])
+            value = ((const uint *) mach->Consts[src->dimension])[pos];
+
+         for (i = 0; i < TGSI_QUAD_SIZE; i++)
+            tmp->u[i] = value;
+      }
+      break;
+   }
+
+   if (src->absolute)
+      micro_abs(tmp, tmp);
+   if (src->negate)
+      micro_neg(tmp, tmp);
+
+   return tmp;
+}
+
+
+static inline void
+fast_store(struct tgsi_exec_machine *mach,
+           const struct tgsi_exec_fast_inst *inst,
+           uint chan,
+           const union tgsi_exec_channel *val)
+{
+   union tgsi_exec_channel *dst = inst->dst[chan];
+   const uint execmask = mach->ExecMask;
+   union tgsi_exec_channel sat;
+   uint i;
+
+   if (inst->saturate) {
+      fast_micro_sat(&sat, val);
+      val = &sat;
+   }
+
+   if (execmask == 0xf) {
+      *dst = *val;
+   }
+   else {
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         if (execmask & (1 << i))
+            dst->u[i] = val->u[i];
+   }
+}
+
+
+static void
+fast_mov(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   struct tgsi_exec_vector dst;
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan)) {
+         union tgsi_exec_channel tmp;
+
+         dst.xyzw[chan] = *fast_fetch(mach, &inst->src[0], chan, &tmp);
+      }
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan))
+         fast_store(mach, inst, chan, &dst.xyzw[chan]);
+   }
+}
+
+
+static inline void
+fast_vector_binary(struct tgsi_exec_machine *mach,
+                   const struct tgsi_exec_fast_inst *inst,
+                   micro_binary_op op)
+{
+   struct tgsi_exec_vector dst;
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan)) {
+         union tgsi_exec_channel tmp[2];
+
+         op(&dst.xyzw[chan],
+            fast_fetch(mach, &inst->src[0], chan, &tmp[0]),
+            fast_fetch(mach, &inst->src[1], chan, &tmp[1]));
+      }
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan))
+         fast_store(mach, inst, chan, &dst.xyzw[chan]);
+   }
+}
+
+
+static void
+fast_add(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_add);
+}
+
+static void
+fast_sub(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_sub);
+}
+
+static void
+fast_mul(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_mul);
+}
+
+static void
+fast_min(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_min);
+}
+
+static void
+fast_max(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_max);
+}
+
+static void
+fast_slt(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_slt);
+}
+
+static void
+fast_sge(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_vector_binary(mach, inst, fast_micro_sge);
+}
+
+
+static void
+fast_mad(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   struct tgsi_exec_vector dst;
+   uint chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan)) {
+         union tgsi_exec_channel tmp[3];
+
+         fast_micro_mad(&dst.xyzw[chan],
+                        fast_fetch(mach, &inst->src[0], chan, &tmp[0]),
+                        fast_fetch(mach, &inst->src[1], chan, &tmp[1]),
+                        fast_fetch(mach, &inst->src[2], chan, &tmp[2]));
+      }
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan))
+         fast_store(mach, inst, chan, &dst.xyzw[chan]);
+   }
+}
+
+
+/**
+ * DP3/DP4, in the same order of operations as exec_dp3/4().
+ */
+static inline void
+fast_dp(struct tgsi_exec_machine *mach,
+        const struct tgsi_exec_fast_inst *inst,
+        uint num_chans)
+{
+   union tgsi_exec_channel tmp[2];
+   union tgsi_exec_channel res;
+   uint chan;
+
+   fast_micro_mul(&res,
+                  fast_fetch(mach, &inst->src[0], TGSI_CHAN_X, &tmp[0]),
+                  fast_fetch(mach, &inst->src[1], TGSI_CHAN_X, &tmp[1]));
+
+   for (chan = TGSI_CHAN_Y; chan < num_chans; chan++) {
+      fast_micro_mad(&res,
+                     fast_fetch(mach, &inst->src[0], chan, &tmp[0]),
+                     fast_fetch(mach, &inst->src[1], chan, &tmp[1]),
+                     &res);
+   }
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (inst->writemask & (1 << chan))
+         fast_store(mach, inst, chan, &res);
+   }
+}
+
+static void
+fast_dp3(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_dp(mach, inst, 3);
+}
+
+static void
+fast_dp4(struct tgsi_exec_machine *mach,
+         const struct tgsi_exec_fast_inst *inst)
+{
+   fast_dp(mach, inst, 4);
+}
+
+
+static boolean
+fast_decode_src(const struct tgsi_exec_machine *mach,
+                const struct tgsi_full_src_register *reg,
+                struct tgsi_exec_fast_src *src)
+{
+   const int index = reg->Register.Index;
+   const struct tgsi_exec_vector *vec;
+   uint chan;
+
+   if (reg->Register.Indirect)
+      return FALSE;
+
+   if (reg->Register.Dimension &&
+       (reg->Register.File != TGSI_FILE_CONSTANT || reg->Dimension.Indirect))
+      return FALSE;
+
+   src->absolute = reg->Register.Absolute;
+   src->negate = reg->Register.Negate;
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+      src->swizzle[chan] = tgsi_util_get_full_src_register_swizzle(reg, chan);
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (index < 0 || index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      vec = &mach->Temps[index];
+      break;
+
+   case TGSI_FILE_INPUT:
+      if (index < 0 || index >= PIPE_MAX_SHADER_INPUTS)
+         return FALSE;
+      vec = &mach->Inputs[index];
+      break;
+
+   case TGSI_FILE_OUTPUT:
+      if (index < 0 || index >= PIPE_MAX_SHADER_OUTPUTS)
+         return FALSE;
+      vec = &mach->Outputs[index];
+      break;
+
+   case TGSI_FILE_IMMEDIATE:
+      if (index < 0 || index >= (int) mach->ImmLimit)
+         return FALSE;
+      src->kind = TGSI_EXEC_FAST_SRC_IMM;
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+         src->imm[chan] = &mach->Imms[index][src->swizzle[chan]];
+      return TRUE;
+
+   case TGSI_FILE_CONSTANT:
+      src->kind = TGSI_EXEC_FAST_SRC_CONST;
+      src->dimension = reg->Register.Dimension ? reg->Dimension.Index : 0;
+      src->index = index;
+      return index >= 0 && src->dimension < PIPE_MAX_CONSTANT_BUFFERS;
+
+   default:
+      return FALSE;
+   }
+
+   src->kind = src->absolute || src->negate ?
+      TGSI_EXEC_FAST_SRC_REG_MOD : TGSI_EXEC_FAST_SRC_REG;
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+      src->reg[chan] = &vec->xyzw[src->swizzle[chan]];
+
+   return TRUE;
+}
+
+
+static void
+fast_decode_instruction(struct tgsi_exec_machine *mach,
+                        const struct tgsi_full_instruction *inst,
+                        struct tgsi_exec_fast_inst *fast)
+{
+   const struct tgsi_full_dst_register *reg = &inst->Dst[0];
+   const int index = reg->Register.Index;
+   struct tgsi_exec_vector *vec;
+   tgsi_exec_fast_func func;
+   uint i;
+
+   memset(fast, 0, sizeof *fast);
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_MOV:
+      func = fast_mov;
+      break;
+   case TGSI_OPCODE_ADD:
+      func = fast_add;
+      break;
+   case TGSI_OPCODE_SUB:
+      func = fast_sub;
+      break;
+   case TGSI_OPCODE_MUL:
+      func = fast_mul;
+      break;
+   case TGSI_OPCODE_MAD:
+      func = fast_mad;
+      break;
+   case TGSI_OPCODE_MIN:
+      func = fast_min;
+      break;
+   case TGSI_OPCODE_MAX:
+      func = fast_max;
+      break;
+   case TGSI_OPCODE_SLT:
+      func = fast_slt;
+      break;
+   case TGSI_OPCODE_SGE:
+      func = fast_sge;
+      break;
+   case TGSI_OPCODE_DP3:
+      func = fast_dp3;
+      break;
+   case TGSI_OPCODE_DP4:
+      func = fast_dp4;
+      break;
+   default:
+      return;
+   }
+
+   if (inst->Instruction.Predicate ||
+       inst->Instruction.NumDstRegs != 1 ||
+       inst->Instruction.NumSrcRegs > Elements(fast->src))
+      return;
+
+   if (reg->Register.Indirect || reg->Register.Dimension)
+      return;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (index < 0 || index >= TGSI_EXEC_NUM_TEMPS)
+         return;
+      vec = &mach->Temps[index];
+      break;
+
+   case TGSI_FILE_OUTPUT:
+      /* GS outputs move with every emitted vertex */
+      if (mach->Processor == TGSI_PROCESSOR_GEOMETRY ||
+          index < 0 || index >= PIPE_MAX_SHADER_OUTPUTS)
+         return;
+      vec = &mach->Outputs[index];
+      break;
+
+   default:
+      return;
+   }
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      if (!fast_decode_src(mach, &inst->Src[i], &fast->src[i]))
+         return;
+   }
+
+   for (i = 0; i < TGSI_NUM_CHANNELS; i++)
+      fast->dst[i] = &vec->xyzw[i];
+   fast->writemask = reg->Register.WriteMask;
+   fast->saturate = inst->Instruction.Saturate;
+   fast->func = func;
+}
+
+
+/**
+ * Pre-decode the bound shader's instructions, see above.
+ */
+static void
+fast_decode_shader(struct tgsi_exec_machine *mach)
+{
+   uint i;
+
+   FREE(mach->FastInstructions);
+   mach->FastInstructions = NULL;
+
+   if (mach->NoFastPath || !mach->NumInstructions)
+      return;
+
+   mach->FastInstructions =
+      MALLOC(mach->NumInstructions * sizeof(struct tgsi_exec_fast_inst));
+   if (!mach->FastInstructions)
+      return;
+
+   for (i = 0; i < mach->NumInstructions; i++) {
+      fast_decode_instruction(mach, &mach->Instructions[i],
+                              &mach->FastInstructions[i]);
+   }
+}
+
+
 uint
 tgsi_exec_machine_run( struct tgsi_exec_machine *mach )
 {
@@ -5236,7 +5803,14 @@ tgsi_exec_machine_run( struct tgsi_exec_machine *mach )
 #endif
 
          assert(pc < (int) mach->NumInstructions);
-         exec_instruction(mach, mach->Instructions + pc, &pc);
+         if (mach->FastInstructions && mach->FastInstructions[pc].func) {
+            const struct tgsi_exec_fast_inst *fast = &mach->FastInstructions[pc];
+            fast->func(mach, fast);
+            pc++;
+         }
+         else {
+            exec_instruction(mach, mach->Instructions + pc, &pc);
+         }
 
 #if DEBUG_EXECUTION
          for (i = 0; i < TGSI_EXEC_NUM_TEMPS + TGSI_EXEC_NUM_TEMP_EXTRAS; i++) {
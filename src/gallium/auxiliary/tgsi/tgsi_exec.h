@@ -270,6 +270,51 @@ enum tgsi_break_type {
 #define TGSI_EXEC_MAX_BREAK_STACK (TGSI_EXEC_MAX_LOOP_NESTING + TGSI_EXEC_MAX_SWITCH_NESTING)
 
 
+struct tgsi_exec_machine;
+struct tgsi_exec_fast_inst;
+
+typedef void (*tgsi_exec_fast_func)(struct tgsi_exec_machine *mach,
+                                    const struct tgsi_exec_fast_inst *inst);
+
+enum tgsi_exec_fast_src_kind {
+   TGSI_EXEC_FAST_SRC_REG,       /**< TEMP/INPUT/OUTPUT, no modifiers */
+   TGSI_EXEC_FAST_SRC_REG_MOD,   /**< TEMP/INPUT/OUTPUT, abs and/or neg */
+   TGSI_EXEC_FAST_SRC_IMM,       /**< IMM, broadcast */
+   TGSI_EXEC_FAST_SRC_CONST      /**< CONST, broadcast and bounds checked */
+};
+
+/**
+ * A source operand of a pre-decoded instruction.  Register addresses are
+ * resolved when the shader is bound, except for constants, which are
+ * only known when the shader runs.
+ */
+struct tgsi_exec_fast_src
+{
+   enum tgsi_exec_fast_src_kind kind;
+   boolean absolute;
+   boolean negate;
+   unsigned dimension;                 /**< CONST buffer */
+   int index;                          /**< CONST register */
+   unsigned swizzle[TGSI_NUM_CHANNELS];
+   const union tgsi_exec_channel *reg[TGSI_NUM_CHANNELS];  /**< REG(_MOD) */
+   const float *imm[TGSI_NUM_CHANNELS];                    /**< IMM */
+};
+
+/**
+ * An instruction pre-decoded for tgsi_exec_machine_run()'s fast path.
+ * Only simple float instructions with directly addressed operands are
+ * pre-decoded; func is NULL for all others.
+ */
+struct tgsi_exec_fast_inst
+{
+   tgsi_exec_fast_func func;
+   unsigned writemask;
+   boolean saturate;
+   union tgsi_exec_channel *dst[TGSI_NUM_CHANNELS];
+   struct tgsi_exec_fast_src src[3];
+};
+
+
 /**
  * Run-time virtual machine state for executing TGSI shader.
  */
@@ -362,6 +407,10 @@ struct tgsi_exec_machine
    struct tgsi_full_instruction *Instructions;
    uint NumInstructions;
 
+   /** Pre-decoded Instructions, or NULL */
+   struct tgsi_exec_fast_inst *FastInstructions;
+   boolean NoFastPath;  /**< don't pre-decode, see TGSI_EXEC_NO_FAST */
+
    struct tgsi_full_declaration *Declarations;
    uint NumDeclarations;
 
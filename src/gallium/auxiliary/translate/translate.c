@@ -46,6 +46,15 @@ struct translate *translate_create( const struct translate_key *key )
    (void)translate;
 #endif
 
+#if HAVE_LLVM
+   /* Covers the formats translate_sse can't do, or all of them on other
+    * architectures.
+    */
+   translate = translate_llvm_create( key );
+   if (translate)
+      return translate;
+#endif
+
    return translate_generic_create( key );
 }
 
@@ -0,0 +1,542 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Vertex translation compiled with LLVM.
+ *
+ * Each translate_key is compiled into one function per run entrypoint.
+ * Attributes are fetched with lp_build_fetch_rgba_aos(), so the formats
+ * translate_sse rejects (half floats, packed 10_10_10_2, 16-bit normalized
+ * and scaled types, ...) get converted inline, using F16C for half floats
+ * when the CPU has it.  Formats gallivm has no inline path for end up
+ * calling the u_format fetch function from the generated code.
+ *
+ * Only 32-bit outputs are handled (floats, plus pure integers fetched from
+ * integer array formats), as well as straight copies when the input and
+ * output formats match.  translate_create() falls back to translate_generic
+ * for anything else.
+ */
+
+
+#include "pipe/p_compiler.h"
+#include "util/u_memory.h"
+#include "util/u_format.h"
+
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "translate.h"
+
+
+struct translate_llvm_buffer {
+   const uint8_t *ptr;
+   unsigned stride;
+   unsigned max_index;
+};
+
+
+enum translate_llvm_run {
+   TRANSLATE_LLVM_RUN_ELTS,
+   TRANSLATE_LLVM_RUN_ELTS16,
+   TRANSLATE_LLVM_RUN_ELTS8,
+   TRANSLATE_LLVM_RUN_LINEAR,
+   TRANSLATE_LLVM_RUN_COUNT
+};
+
+
+struct translate_llvm {
+   struct translate translate;
+
+   /* Read by the generated code */
+   struct translate_llvm_buffer buffer[TRANSLATE_MAX_ATTRIBS];
+
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+};
+
+
+static inline struct translate_llvm *
+translate_llvm(struct translate *translate)
+{
+   return (struct translate_llvm *)translate;
+}
+
+
+/**
+ * Number of channels of a 32-bit output format, or zero if the format
+ * isn't one we can emit.
+ */
+static unsigned
+output_channels(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+   case PIPE_FORMAT_R32_SINT:
+   case PIPE_FORMAT_R32_UINT:
+      return 1;
+   case PIPE_FORMAT_R32G32_FLOAT:
+   case PIPE_FORMAT_R32G32_SINT:
+   case PIPE_FORMAT_R32G32_UINT:
+      return 2;
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+   case PIPE_FORMAT_R32G32B32_SINT:
+   case PIPE_FORMAT_R32G32B32_UINT:
+      return 3;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+   case PIPE_FORMAT_R32G32B32A32_SINT:
+   case PIPE_FORMAT_R32G32B32A32_UINT:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+
+static boolean
+is_copy(const struct translate_element *elem)
+{
+   const struct util_format_description *desc =
+      util_format_description(elem->input_format);
+
+   return elem->input_format == elem->output_format &&
+          desc->block.width == 1 &&
+          desc->block.height == 1 &&
+          !(desc->block.bits & 7);
+}
+
+
+static boolean
+is_element_supported(const struct translate_element *elem)
+{
+   const struct util_format_description *in_desc, *out_desc;
+
+   if (elem->input_buffer >= TRANSLATE_MAX_ATTRIBS)
+      return FALSE;
+
+   if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+      return elem->output_format == PIPE_FORMAT_R32_USCALED ||
+             elem->output_format == PIPE_FORMAT_R32_SSCALED ||
+             (output_channels(elem->output_format) &&
+              !util_format_is_pure_integer(elem->output_format));
+   }
+
+   if (is_copy(elem))
+      return TRUE;
+
+   in_desc = util_format_description(elem->input_format);
+   out_desc = util_format_description(elem->output_format);
+   if (!in_desc || !out_desc || !output_channels(elem->output_format))
+      return FALSE;
+
+   if (in_desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       in_desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       in_desc->block.width != 1 ||
+       in_desc->block.height != 1)
+      return FALSE;
+
+   if (in_desc->channel[0].pure_integer) {
+      /* Same rules as translate_generic, but only for the array formats
+       * lp_build_fetch_rgba_aos passes through as integers.
+       */
+      return in_desc->is_array &&
+             out_desc->channel[0].pure_integer &&
+             in_desc->channel[0].type == out_desc->channel[0].type &&
+             in_desc->nr_channels <= out_desc->nr_channels;
+   }
+
+   return !out_desc->channel[0].pure_integer && in_desc->fetch_rgba_float;
+}
+
+
+/**
+ * Load a member of translate_llvm::buffer[buf].
+ */
+static LLVMValueRef
+load_buffer_member(struct gallivm_state *gallivm,
+                   LLVMValueRef translate_ptr,
+                   unsigned buf,
+                   unsigned member_offset,
+                   LLVMTypeRef type,
+                   const char *name)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef offset, ptr;
+
+   offset = lp_build_const_int32(gallivm,
+                                 offsetof(struct translate_llvm, buffer) +
+                                 buf * sizeof(struct translate_llvm_buffer) +
+                                 member_offset);
+   ptr = LLVMBuildGEP(builder, translate_ptr, &offset, 1, "");
+   ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(type, 0), "");
+   return LLVMBuildLoad(builder, ptr, name);
+}
+
+
+/**
+ * Store the first nr_channels of a <4 x float> to unaligned memory.
+ */
+static void
+store_output(struct gallivm_state *gallivm,
+             LLVMValueRef dst,
+             LLVMValueRef value,
+             unsigned nr_channels)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef float_type = LLVMFloatTypeInContext(gallivm->context);
+   LLVMValueRef store;
+   unsigned chan;
+
+   if (nr_channels == 4) {
+      dst = LLVMBuildBitCast(builder, dst,
+                             LLVMPointerType(LLVMTypeOf(value), 0), "");
+      store = LLVMBuildStore(builder, value, dst);
+      lp_set_store_alignment(store, 4);
+      return;
+   }
+
+   dst = LLVMBuildBitCast(builder, dst, LLVMPointerType(float_type, 0), "");
+   for (chan = 0; chan < nr_channels; chan++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, chan);
+      LLVMValueRef elem = LLVMBuildExtractElement(builder, value, index, "");
+      LLVMBuildStore(builder, elem, LLVMBuildGEP(builder, dst, &index, 1, ""));
+   }
+}
+
+
+/**
+ * Generate the function for one of the run entrypoints.  Its signature
+ * matches the corresponding run function type in translate.h.
+ */
+static LLVMValueRef
+generate_run(struct translate_llvm *tl, enum translate_llvm_run run)
+{
+   static const char *names[TRANSLATE_LLVM_RUN_COUNT] = {
+      "translate_run_elts", "translate_run_elts16",
+      "translate_run_elts8", "translate_run"
+   };
+   const struct translate_key *key = &tl->translate.key;
+   struct gallivm_state *gallivm = tl->gallivm;
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(context);
+   LLVMTypeRef int16_type = LLVMInt16TypeInContext(context);
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(context);
+   LLVMTypeRef float_type = LLVMFloatTypeInContext(context);
+   LLVMTypeRef byte_ptr_type = LLVMPointerType(int8_type, 0);
+   LLVMTypeRef arg_types[6];
+   LLVMTypeRef func_type;
+   LLVMValueRef function, translate_ptr, first, count;
+   LLVMValueRef start_instance, instance_id, output;
+   LLVMValueRef src_ptr[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef src_stride[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef max_index[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef instance_value = NULL;
+   LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+   struct lp_build_for_loop_state loop;
+   LLVMBasicBlockRef block;
+   unsigned i;
+
+   arg_types[0] = byte_ptr_type;                    /* translate */
+   switch (run) {
+   case TRANSLATE_LLVM_RUN_ELTS:
+      arg_types[1] = LLVMPointerType(int32_type, 0); /* elts */
+      break;
+   case TRANSLATE_LLVM_RUN_ELTS16:
+      arg_types[1] = LLVMPointerType(int16_type, 0); /* elts */
+      break;
+   case TRANSLATE_LLVM_RUN_ELTS8:
+      arg_types[1] = LLVMPointerType(int8_type, 0);  /* elts */
+      break;
+   default:
+      arg_types[1] = int32_type;                     /* start */
+      break;
+   }
+   arg_types[2] = int32_type;                       /* count */
+   arg_types[3] = int32_type;                       /* start_instance */
+   arg_types[4] = int32_type;                       /* instance_id */
+   arg_types[5] = byte_ptr_type;                    /* output_buffer */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                arg_types, Elements(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, names[run], func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+   for (i = 0; i < Elements(arg_types); ++i)
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
+
+   translate_ptr  = LLVMGetParam(function, 0);
+   first          = LLVMGetParam(function, 1);
+   count          = LLVMGetParam(function, 2);
+   start_instance = LLVMGetParam(function, 3);
+   instance_id    = LLVMGetParam(function, 4);
+   output         = LLVMGetParam(function, 5);
+
+   block = LLVMAppendBasicBlockInContext(context, function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   /*
+    * Loop invariants: buffer pointers, strides and clamps, and the source
+    * of the instanced attributes.
+    */
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *elem = &key->element[i];
+      unsigned buf = elem->input_buffer;
+      LLVMValueRef offset;
+
+      if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         if (!instance_value) {
+            LLVMValueRef value = LLVMBuildUIToFP(builder, instance_id,
+                                                 float_type, "");
+            instance_value = lp_build_const_vec(gallivm,
+                                                lp_float32_vec4_type(), 0);
+            instance_value = LLVMBuildInsertElement(builder, instance_value,
+                                                    value, zero, "");
+            instance_value =
+               LLVMBuildInsertElement(builder, instance_value,
+                                      LLVMConstReal(float_type, 1.0),
+                                      lp_build_const_int32(gallivm, 3), "");
+         }
+         continue;
+      }
+
+      src_ptr[i] = load_buffer_member(gallivm, translate_ptr, buf,
+                                      offsetof(struct translate_llvm_buffer,
+                                               ptr),
+                                      byte_ptr_type, "");
+      offset = lp_build_const_int32(gallivm, elem->input_offset);
+      src_ptr[i] = LLVMBuildGEP(builder, src_ptr[i], &offset, 1, "");
+
+      src_stride[i] = load_buffer_member(gallivm, translate_ptr, buf,
+                                         offsetof(struct translate_llvm_buffer,
+                                                  stride),
+                                         int32_type, "");
+      src_stride[i] = LLVMBuildZExt(builder, src_stride[i], int64_type, "");
+
+      if (elem->instance_divisor) {
+         LLVMValueRef index;
+
+         /* XXX not clamped, same as translate_generic */
+         index = LLVMBuildUDiv(builder, instance_id,
+                               lp_build_const_int32(gallivm,
+                                                    elem->instance_divisor),
+                               "");
+         index = LLVMBuildAdd(builder, start_instance, index, "");
+         index = LLVMBuildZExt(builder, index, int64_type, "");
+         offset = LLVMBuildMul(builder, index, src_stride[i], "");
+         src_ptr[i] = LLVMBuildGEP(builder, src_ptr[i], &offset, 1, "");
+         max_index[i] = NULL;
+      }
+      else {
+         max_index[i] =
+            load_buffer_member(gallivm, translate_ptr, buf,
+                               offsetof(struct translate_llvm_buffer,
+                                        max_index),
+                               int32_type, "");
+      }
+   }
+
+   lp_build_for_loop_begin(&loop, gallivm, zero, LLVMIntULT, count,
+                           lp_build_const_int32(gallivm, 1));
+   {
+      LLVMValueRef elt, vertex, offset;
+
+      if (run == TRANSLATE_LLVM_RUN_LINEAR) {
+         elt = LLVMBuildAdd(builder, first, loop.counter, "");
+      }
+      else {
+         elt = LLVMBuildGEP(builder, first, &loop.counter, 1, "");
+         elt = LLVMBuildLoad(builder, elt, "");
+         elt = LLVMBuildZExt(builder, elt, int32_type, "");
+      }
+
+      offset = LLVMBuildMul(builder, loop.counter,
+                            lp_build_const_int32(gallivm, key->output_stride),
+                            "");
+      offset = LLVMBuildZExt(builder, offset, int64_type, "");
+      vertex = LLVMBuildGEP(builder, output, &offset, 1, "");
+
+      for (i = 0; i < key->nr_elements; i++) {
+         const struct translate_element *elem = &key->element[i];
+         LLVMValueRef src, dst;
+
+         offset = lp_build_const_int32(gallivm, elem->output_offset);
+         dst = LLVMBuildGEP(builder, vertex, &offset, 1, "");
+
+         if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+            if (elem->output_format == PIPE_FORMAT_R32_USCALED ||
+                elem->output_format == PIPE_FORMAT_R32_SSCALED) {
+               dst = LLVMBuildBitCast(builder, dst,
+                                      LLVMPointerType(int32_type, 0), "");
+               LLVMBuildStore(builder, instance_id, dst);
+            }
+            else {
+               store_output(gallivm, dst, instance_value,
+                            output_channels(elem->output_format));
+            }
+            continue;
+         }
+
+         src = src_ptr[i];
+         if (max_index[i]) {
+            LLVMValueRef index, in_range;
+
+            /* clamp to avoid going out of bounds */
+            in_range = LLVMBuildICmp(builder, LLVMIntULT, elt, max_index[i],
+                                     "");
+            index = LLVMBuildSelect(builder, in_range, elt, max_index[i], "");
+            index = LLVMBuildZExt(builder, index, int64_type, "");
+            offset = LLVMBuildMul(builder, index, src_stride[i], "");
+            src = LLVMBuildGEP(builder, src, &offset, 1, "");
+         }
+
+         if (is_copy(elem)) {
+            unsigned bits = util_format_get_blocksizebits(elem->input_format);
+            LLVMTypeRef copy_ptr_type =
+               LLVMPointerType(LLVMIntTypeInContext(context, bits), 0);
+            LLVMValueRef value;
+
+            src = LLVMBuildBitCast(builder, src, copy_ptr_type, "");
+            dst = LLVMBuildBitCast(builder, dst, copy_ptr_type, "");
+            value = LLVMBuildLoad(builder, src, "");
+            lp_set_load_alignment(value, 1);
+            lp_set_store_alignment(LLVMBuildStore(builder, value, dst), 1);
+         }
+         else {
+            const struct util_format_description *desc =
+               util_format_description(elem->input_format);
+            LLVMValueRef value;
+
+            value = lp_build_fetch_rgba_aos(gallivm, desc,
+                                            lp_float32_vec4_type(), FALSE,
+                                            src, zero, zero, zero, NULL);
+            store_output(gallivm, dst, value,
+                         output_channels(elem->output_format));
+         }
+      }
+   }
+   lp_build_for_loop_end(&loop);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+
+   return function;
+}
+
+
+static void
+llvm_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (buf < TRANSLATE_MAX_ATTRIBS) {
+      tl->buffer[buf].ptr = ptr;
+      tl->buffer[buf].stride = stride;
+      tl->buffer[buf].max_index = max_index;
+   }
+}
+
+
+static void
+llvm_release(struct translate *translate)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (tl->gallivm)
+      gallivm_destroy(tl->gallivm);
+   if (tl->context)
+      LLVMContextDispose(tl->context);
+   FREE(tl);
+}
+
+
+struct translate *
+translate_llvm_create(const struct translate_key *key)
+{
+   struct translate_llvm *tl;
+   LLVMValueRef functions[TRANSLATE_LLVM_RUN_COUNT];
+   unsigned i;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      if (!is_element_supported(&key->element[i]))
+         return NULL;
+   }
+
+   if (!lp_build_init())
+      return NULL;
+
+   tl = CALLOC_STRUCT(translate_llvm);
+   if (!tl)
+      return NULL;
+
+   tl->translate.key = *key;
+   tl->translate.release = llvm_release;
+   tl->translate.set_buffer = llvm_set_buffer;
+
+   tl->context = LLVMContextCreate();
+   if (!tl->context)
+      goto fail;
+
+   tl->gallivm = gallivm_create("translate", tl->context);
+   if (!tl->gallivm)
+      goto fail;
+
+   for (i = 0; i < TRANSLATE_LLVM_RUN_COUNT; i++)
+      functions[i] = generate_run(tl, i);
+
+   gallivm_compile_module(tl->gallivm);
+
+   tl->translate.run_elts = (run_elts_func)
+      gallivm_jit_function(tl->gallivm, functions[TRANSLATE_LLVM_RUN_ELTS]);
+   tl->translate.run_elts16 = (run_elts16_func)
+      gallivm_jit_function(tl->gallivm, functions[TRANSLATE_LLVM_RUN_ELTS16]);
+   tl->translate.run_elts8 = (run_elts8_func)
+      gallivm_jit_function(tl->gallivm, functions[TRANSLATE_LLVM_RUN_ELTS8]);
+   tl->translate.run = (run_func)
+      gallivm_jit_function(tl->gallivm, functions[TRANSLATE_LLVM_RUN_LINEAR]);
+
+   gallivm_free_ir(tl->gallivm);
+
+   if (!tl->translate.run_elts || !tl->translate.run_elts16 ||
+       !tl->translate.run_elts8 || !tl->translate.run)
+      goto fail;
+
+   return &tl->translate;
+
+fail:
+   llvm_release(&tl->translate);
+   return NULL;
+}
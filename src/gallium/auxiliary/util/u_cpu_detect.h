@@ -66,6 +66,13 @@ struct util_cpu_caps {
    unsigned has_avx:1;
    unsigned has_avx2:1;
    unsigned has_f16c:1;
+   unsigned has_avx512f:1;
+   unsigned has_avx512cd:1;
+   unsigned has_avx512er:1;
+   unsigned has_avx512pf:1;
+   unsigned has_avx512bw:1;
+   unsigned has_avx512dq:1;
+   unsigned has_avx512vl:1;
    unsigned has_3dnow:1;
    unsigned has_3dnow_ext:1;
    unsigned has_xop:1;
@@ -457,6 +457,16 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                                        LLVMInt32TypeInContext(context), bits);
       count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
    }
+   else if (util_cpu_caps.has_avx512f && type.length == 16) {
+      /* compare into a k register and count its bits */
+      const char *popcntintr = "llvm.ctpop.i16";
+      LLVMTypeRef i16t = LLVMInt16TypeInContext(context);
+      LLVMValueRef bits = LLVMBuildICmp(builder, LLVMIntNE, maskvalue,
+                                        LLVMConstNull(LLVMTypeOf(maskvalue)), "");
+      bits = LLVMBuildBitCast(builder, bits, i16t, "");
+      count = lp_build_intrinsic_unary(builder, popcntintr, i16t, bits);
+      count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
+   }
    else {
       unsigned i;
       LLVMValueRef countv = LLVMBuildAnd(builder, maskvalue, countmask, "countv");
@@ -511,6 +521,123 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Position of pixel (x, y) of a 4x4 block in a 16-wide vector, which holds
+ * the four 2x2 quads of the block in the same order as the interpolation
+ * code (see quad_offset_x/y in lp_bld_interp.c).
+ */
+static inline unsigned
+quad_index_4x4(unsigned x, unsigned y)
+{
+   return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+}
+
+
+/**
+ * Load the depth/stencil values of a whole 4x4 block into a 16-wide vector.
+ * Only the first row gets loaded for 1d resources.
+ */
+static LLVMValueRef
+load_zs_4x4(struct gallivm_state *gallivm,
+            struct lp_type zs_type,
+            boolean is_1d,
+            LLVMValueRef depth_ptr,
+            LLVMValueRef depth_stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type row_type = zs_type;
+   LLVMTypeRef row_ptr_type;
+   LLVMValueRef rows[4];
+   LLVMValueRef shuffles[16];
+   unsigned x, y;
+
+   assert(zs_type.length == 16);
+
+   row_type.length = 4;
+   row_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, row_type), 0);
+
+   for (y = 0; y < 4; y++) {
+      if (y == 0 || !is_1d) {
+         LLVMValueRef offset = LLVMBuildMul(builder, depth_stride,
+                                            lp_build_const_int32(gallivm, y), "");
+         LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, row_ptr_type, "");
+         rows[y] = LLVMBuildLoad(builder, ptr, "");
+      }
+      else {
+         rows[y] = lp_build_undef(gallivm, row_type);
+      }
+   }
+
+   rows[0] = lp_build_concat(gallivm, &rows[0], row_type, 2);
+   rows[2] = lp_build_concat(gallivm, &rows[2], row_type, 2);
+
+   for (y = 0; y < 4; y++) {
+      for (x = 0; x < 4; x++) {
+         shuffles[quad_index_4x4(x, y)] = lp_build_const_int32(gallivm, y * 4 + x);
+      }
+   }
+
+   return LLVMBuildShuffleVector(builder, rows[0], rows[2],
+                                 LLVMConstVector(shuffles, 16), "");
+}
+
+
+/**
+ * Store the depth/stencil values of a whole 4x4 block held in 16-wide
+ * vectors.  For formats wider than 32 bits z_value and s_value get
+ * interleaved.  Only the first row gets stored for 1d resources.
+ */
+static void
+store_zs_4x4(struct gallivm_state *gallivm,
+             struct lp_type zs_type,
+             unsigned block_bits,
+             boolean is_1d,
+             LLVMValueRef depth_ptr,
+             LLVMValueRef depth_stride,
+             LLVMValueRef z_value,
+             LLVMValueRef s_value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type row_type = zs_type;
+   LLVMTypeRef row_vec_type;
+   LLVMValueRef shuffles[8];
+   unsigned x, y;
+
+   assert(zs_type.length == 16);
+
+   row_type.length = 4;
+   row_vec_type = lp_build_vec_type(gallivm, row_type);
+
+   for (y = 0; y < (is_1d ? 1 : 4); y++) {
+      LLVMValueRef offset = LLVMBuildMul(builder, depth_stride,
+                                         lp_build_const_int32(gallivm, y), "");
+      LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+      LLVMValueRef row;
+
+      if (block_bits <= 32) {
+         for (x = 0; x < 4; x++) {
+            shuffles[x] = lp_build_const_int32(gallivm, quad_index_4x4(x, y));
+         }
+         row = LLVMBuildShuffleVector(builder, z_value, z_value,
+                                      LLVMConstVector(shuffles, 4), "");
+      }
+      else {
+         for (x = 0; x < 4; x++) {
+            shuffles[x*2] = lp_build_const_int32(gallivm, quad_index_4x4(x, y));
+            shuffles[x*2+1] = lp_build_const_int32(gallivm, quad_index_4x4(x, y) + 16);
+         }
+         row = LLVMBuildShuffleVector(builder, z_value, s_value,
+                                      LLVMConstVector(shuffles, 8), "");
+         row = LLVMBuildBitCast(builder, row, row_vec_type, "");
+      }
+
+      ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(row_vec_type, 0), "");
+      LLVMBuildStore(builder, row, ptr);
+   }
+}
+
+
 /**
  * Load depth/stencil values.
  * The stored values are linear, swizzle them.
@@ -565,11 +692,10 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, i);
       }
    }
-   else {
+   else if (z_src_type.length == 8) {
       unsigned i;
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
       depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
       /*
        * We load 2x4 values, and need to swizzle them (order
@@ -579,24 +705,34 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
       }
    }
+   else {
+      /* whole 4x4 block, see load_zs_4x4 */
+      assert(z_src_type.length == 16);
+   }
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
-
-   /* Load current z/stencil values from z/stencil buffer */
-   zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-   zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   if (is_1d) {
-      zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+   if (z_src_type.length == 16) {
+      *z_fb = load_zs_4x4(gallivm, zs_type, is_1d, depth_ptr, depth_stride);
    }
    else {
-      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+      depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+
+      /* Load current z/stencil values from z/stencil buffer */
+      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
       zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-      zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      if (is_1d) {
+         zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      }
+      else {
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      }
+
+      *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
+                                     LLVMConstVector(shuffles, zs_type.length), "");
    }
 
-   *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
-                                  LLVMConstVector(shuffles, zs_type.length), "");
    *s_fb = *z_fb;
 
    if (format_desc->block.bits < z_src_type.width) {
@@ -706,11 +842,10 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                    lp_build_const_int32(gallivm, depth_bytes * 2), "");
       depth_offset1 = LLVMBuildAdd(builder, depth_offset1, offset2, "");
    }
-   else {
+   else if (z_src_type.length == 8) {
       unsigned i;
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
       depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
       /*
        * We load 2x4 values, and need to swizzle them (order
@@ -720,13 +855,10 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
       }
    }
-
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
-
-   zs_dst_ptr1 = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr1 = LLVMBuildBitCast(builder, zs_dst_ptr1, load_ptr_type, "");
-   zs_dst_ptr2 = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
-   zs_dst_ptr2 = LLVMBuildBitCast(builder, zs_dst_ptr2, load_ptr_type, "");
+   else {
+      /* whole 4x4 block, see store_zs_4x4 */
+      assert(z_src_type.length == 16);
+   }
 
    if (format_desc->block.bits > 32) {
       s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
@@ -747,6 +879,19 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                lp_build_int_vec_type(gallivm, zs_type), "");
    }
 
+   if (z_src_type.length == 16) {
+      store_zs_4x4(gallivm, zs_type, format_desc->block.bits, is_1d,
+                   depth_ptr, depth_stride, z_value, s_value);
+      return;
+   }
+
+   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+
+   zs_dst_ptr1 = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
+   zs_dst_ptr1 = LLVMBuildBitCast(builder, zs_dst_ptr1, load_ptr_type, "");
+   zs_dst_ptr2 = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+   zs_dst_ptr2 = LLVMBuildBitCast(builder, zs_dst_ptr2, load_ptr_type, "");
+
    if (format_desc->block.bits <= 32) {
       if (z_src_type.length == 4) {
          zs_dst1 = lp_build_extract_range(gallivm, z_value, 0, 2);
@@ -1116,3 +1261,41 @@ lp_build_depth_stencil_test(struct gallivm_state *gallivm,
       lp_build_mask_update(mask, z_pass);
 }
 
+
+
+/**
+ * Compute the depth of a sample from the interpolated depth at the pixel
+ * center and the depth plane gradients.
+ *
+ * \param z_src_type  type of the (float) depth values
+ * \param z  depth at the pixel centers
+ * \param dzdx, dzdy  scalar depth gradients
+ * \param dx, dy  offset of the sample from the pixel center, in pixels
+ */
+LLVMValueRef
+lp_build_depth_sample_z(struct gallivm_state *gallivm,
+                        struct lp_type z_src_type,
+                        LLVMValueRef z,
+                        LLVMValueRef dzdx,
+                        LLVMValueRef dzdy,
+                        float dx,
+                        float dy)
+{
+   struct lp_build_context bld;
+   LLVMValueRef offset;
+
+   assert(z_src_type.floating);
+
+   lp_build_context_init(&bld, gallivm, z_src_type);
+
+   dzdx = lp_build_broadcast_scalar(&bld, dzdx);
+   dzdy = lp_build_broadcast_scalar(&bld, dzdy);
+
+   offset = lp_build_add(&bld,
+                         lp_build_mul(&bld, dzdx, lp_build_const_vec(gallivm, z_src_type, dx)),
+                         lp_build_mul(&bld, dzdy, lp_build_const_vec(gallivm, z_src_type, dy)));
+   z = lp_build_add(&bld, z, offset);
+
+   /* Like the interpolated position, clamp to the depth range upper bound */
+   return lp_build_min(&bld, z, bld.one);
+}
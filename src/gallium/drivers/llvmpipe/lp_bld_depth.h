@@ -102,4 +102,13 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                          LLVMValueRef maskvalue,
                          LLVMValueRef counter);
 
+LLVMValueRef
+lp_build_depth_sample_z(struct gallivm_state *gallivm,
+                        struct lp_type z_src_type,
+                        LLVMValueRef z,
+                        LLVMValueRef dzdx,
+                        LLVMValueRef dzdy,
+                        float dx,
+                        float dy);
+
 #endif /* !LP_BLD_DEPTH_H */
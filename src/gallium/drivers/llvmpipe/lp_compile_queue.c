@@ -0,0 +1,287 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Compile queue.  A pool of threads which run LLVM compilation jobs in
+ * the background, so that the thread which needs a new shader variant
+ * does not have to wait for it until the code is actually executed.
+ *
+ * LLVM contexts are not thread safe, so every compile thread owns its own
+ * context.  Anything done later with the IR or the code of a job (most
+ * notably destroying it) must hold that context's lock, see
+ * lp_compile_job_lock().
+ */
+
+#include "os/os_thread.h"
+#include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+#include "lp_compile_queue.h"
+
+
+#define LP_MAX_COMPILE_THREADS 8
+
+
+struct lp_compile_thread
+{
+   struct lp_compile_queue *queue;
+   pipe_thread thread;
+   LLVMContextRef context;
+   pipe_mutex context_mutex;
+};
+
+
+struct lp_compile_queue
+{
+   pipe_mutex mutex;
+   pipe_condvar work_cond;   /**< signalled when a job is added */
+   pipe_condvar done_cond;   /**< broadcast when a job is done */
+
+   struct lp_compile_job *head;
+   struct lp_compile_job *tail;
+   unsigned num_busy;
+   boolean exit_flag;
+
+   unsigned num_threads;
+   struct lp_compile_thread threads[LP_MAX_COMPILE_THREADS];
+};
+
+
+static PIPE_THREAD_ROUTINE( compile_thread_proc, init_data )
+{
+   struct lp_compile_thread *thread = (struct lp_compile_thread *) init_data;
+   struct lp_compile_queue *queue = thread->queue;
+
+   pipe_mutex_lock(queue->mutex);
+
+   while (1) {
+      struct lp_compile_job *job;
+
+      while (!queue->head && !queue->exit_flag)
+         pipe_condvar_wait(queue->work_cond, queue->mutex);
+
+      if (queue->exit_flag)
+         break;
+
+      job = queue->head;
+      queue->head = job->next;
+      if (!queue->head)
+         queue->tail = NULL;
+      job->next = NULL;
+      job->context_mutex = &thread->context_mutex;
+      queue->num_busy++;
+
+      pipe_mutex_unlock(queue->mutex);
+
+      pipe_mutex_lock(thread->context_mutex);
+      job->execute(job, thread->context);
+      pipe_mutex_unlock(thread->context_mutex);
+
+      pipe_mutex_lock(queue->mutex);
+
+      p_atomic_set_release(&job->done, 1);
+      queue->num_busy--;
+      pipe_condvar_broadcast(queue->done_cond);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+
+   return 0;
+}
+
+
+/**
+ * Create a compile queue with the given number of threads.
+ */
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads)
+{
+   struct lp_compile_queue *queue;
+   unsigned i;
+
+   num_threads = MIN2(num_threads, LP_MAX_COMPILE_THREADS);
+   if (!num_threads)
+      return NULL;
+
+   queue = CALLOC_STRUCT(lp_compile_queue);
+   if (!queue)
+      return NULL;
+
+   pipe_mutex_init(queue->mutex);
+   pipe_condvar_init(queue->work_cond);
+   pipe_condvar_init(queue->done_cond);
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_compile_thread *thread = &queue->threads[i];
+
+      thread->queue = queue;
+      thread->context = LLVMContextCreate();
+      if (!thread->context)
+         break;
+      pipe_mutex_init(thread->context_mutex);
+
+      thread->thread = pipe_thread_create(compile_thread_proc, thread);
+      if (!thread->thread) {
+         pipe_mutex_destroy(thread->context_mutex);
+         LLVMContextDispose(thread->context);
+         break;
+      }
+
+      queue->num_threads++;
+   }
+
+   if (!queue->num_threads) {
+      lp_compile_queue_destroy(queue);
+      return NULL;
+   }
+
+   return queue;
+}
+
+
+/**
+ * Destroy the compile queue.  Any job which was queued must have been
+ * waited for, and any code produced by the jobs must have been freed,
+ * since this disposes of the threads' LLVM contexts.
+ */
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue)
+{
+   unsigned i;
+
+   lp_compile_queue_finish(queue);
+
+   pipe_mutex_lock(queue->mutex);
+   queue->exit_flag = TRUE;
+   pipe_condvar_broadcast(queue->work_cond);
+   pipe_mutex_unlock(queue->mutex);
+
+   for (i = 0; i < queue->num_threads; i++) {
+      struct lp_compile_thread *thread = &queue->threads[i];
+
+      pipe_thread_wait(thread->thread);
+      pipe_mutex_destroy(thread->context_mutex);
+      LLVMContextDispose(thread->context);
+   }
+
+   pipe_condvar_destroy(queue->done_cond);
+   pipe_condvar_destroy(queue->work_cond);
+   pipe_mutex_destroy(queue->mutex);
+   FREE(queue);
+}
+
+
+/**
+ * Add a job to the tail of the queue.  It will be executed by the first
+ * compile thread which becomes idle.
+ */
+void
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_compile_job *job)
+{
+   assert(job->execute);
+
+   job->queue = queue;
+   job->next = NULL;
+   job->context_mutex = NULL;
+   job->failed = FALSE;
+   job->done = 0;
+
+   pipe_mutex_lock(queue->mutex);
+
+   if (queue->tail)
+      queue->tail->next = job;
+   else
+      queue->head = job;
+   queue->tail = job;
+
+   pipe_condvar_signal(queue->work_cond);
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Wait until all the queued jobs are done.
+ */
+void
+lp_compile_queue_finish(struct lp_compile_queue *queue)
+{
+   pipe_mutex_lock(queue->mutex);
+   while (queue->head || queue->num_busy)
+      pipe_condvar_wait(queue->done_cond, queue->mutex);
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Check, without blocking, whether a job has been executed.
+ */
+boolean
+lp_compile_job_is_done(struct lp_compile_job *job)
+{
+   return !job->queue || p_atomic_read_acquire(&job->done);
+}
+
+
+/**
+ * Block until a job has been executed.  Jobs which never went through a
+ * queue count as done.
+ */
+void
+lp_compile_job_wait(struct lp_compile_job *job)
+{
+   struct lp_compile_queue *queue = job->queue;
+
+   if (lp_compile_job_is_done(job))
+      return;
+
+   pipe_mutex_lock(queue->mutex);
+   while (!job->done)
+      pipe_condvar_wait(queue->done_cond, queue->mutex);
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Lock the LLVM context the job was compiled in.  Must be held while
+ * freeing the job's IR or code, since the compile thread may be busy with
+ * another job in the same context.
+ */
+void
+lp_compile_job_lock(struct lp_compile_job *job)
+{
+   lp_compile_job_wait(job);
+   if (job->context_mutex)
+      pipe_mutex_lock(*job->context_mutex);
+}
+
+
+void
+lp_compile_job_unlock(struct lp_compile_job *job)
+{
+   if (job->context_mutex)
+      pipe_mutex_unlock(*job->context_mutex);
+}
@@ -0,0 +1,84 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#ifndef LP_COMPILE_QUEUE_H
+#define LP_COMPILE_QUEUE_H
+
+#include "pipe/p_compiler.h"
+#include "os/os_thread.h"
+#include "gallivm/lp_bld.h"
+
+struct lp_compile_queue;
+
+
+/**
+ * A unit of work for the compile threads.  Meant to be embedded in the
+ * object being compiled.
+ */
+struct lp_compile_job
+{
+   /** Called by a compile thread, with that thread's LLVM context */
+   void (*execute)(struct lp_compile_job *job, LLVMContextRef context);
+
+   /** Set by execute if the job couldn't be carried out */
+   boolean failed;
+
+   /* Private to the queue */
+   struct lp_compile_queue *queue;
+   struct lp_compile_job *next;
+   pipe_mutex *context_mutex;
+   int done;
+};
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads);
+
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue);
+
+void
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_compile_job *job);
+
+void
+lp_compile_queue_finish(struct lp_compile_queue *queue);
+
+boolean
+lp_compile_job_is_done(struct lp_compile_job *job);
+
+void
+lp_compile_job_wait(struct lp_compile_job *job);
+
+void
+lp_compile_job_lock(struct lp_compile_job *job);
+
+void
+lp_compile_job_unlock(struct lp_compile_job *job);
+
+
+#endif /* LP_COMPILE_QUEUE_H */
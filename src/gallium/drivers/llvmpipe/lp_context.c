@@ -38,12 +38,16 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "lp_clear.h"
+#include "lp_compile_queue.h"
 #include "lp_context.h"
+#include "lp_cs_tpool.h"
 #include "lp_flush.h"
 #include "lp_perf.h"
 #include "lp_state.h"
+#include "lp_state_cs.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
 
 /* This is only safe if there's just one concurrent context */
@@ -54,8 +58,14 @@
 static void llvmpipe_destroy( struct pipe_context *pipe )
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    uint i, j;
 
+   /* Background compiles of this context's shaders refer to the context.
+    */
+   if (screen->compile_queue)
+      lp_compile_queue_finish(screen->compile_queue);
+
    lp_print_counters();
 
    if (llvmpipe->blitter) {
@@ -95,6 +105,14 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       pipe_resource_reference(&llvmpipe->vertex_buffer[i].buffer, NULL);
    }
 
+   for (i = 0; i < Elements(llvmpipe->ssbos); i++) {
+      for (j = 0; j < Elements(llvmpipe->ssbos[i]); j++) {
+         pipe_resource_reference(&llvmpipe->ssbos[i][j].buffer, NULL);
+      }
+   }
+
+   llvmpipe_cleanup_compute(llvmpipe);
+
    lp_delete_setup_variants(llvmpipe);
 
 #ifndef USE_GLOBAL_LLVM_CONTEXT
@@ -102,6 +120,8 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 #endif
    llvmpipe->context = NULL;
 
+   pipe_mutex_destroy(llvmpipe->stats_mutex);
+
    align_free( llvmpipe );
 }
 
@@ -141,6 +161,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
 
    memset(llvmpipe, 0, sizeof *llvmpipe);
 
+   pipe_mutex_init(llvmpipe->stats_mutex);
+
    make_empty_list(&llvmpipe->fs_variants_list);
 
    make_empty_list(&llvmpipe->setup_variants_list);
@@ -167,6 +189,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_fs_funcs(llvmpipe);
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
+   llvmpipe_init_compute_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
@@ -195,6 +218,14 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->setup)
       goto fail;
 
+   llvmpipe->cs_locals =
+      CALLOC(lp_cs_tpool_num_workers(llvmpipe_screen(screen)->cs_tpool),
+             sizeof *llvmpipe->cs_locals);
+   if (!llvmpipe->cs_locals)
+      goto fail;
+   llvmpipe->num_cs_locals =
+      lp_cs_tpool_num_workers(llvmpipe_screen(screen)->cs_tpool);
+
    llvmpipe->blitter = util_blitter_create(&llvmpipe->pipe);
    if (!llvmpipe->blitter) {
       goto fail;
@@ -34,10 +34,13 @@
 #include "pipe/p_context.h"
 
 #include "draw/draw_vertex.h"
+#include "os/os_thread.h"
 #include "util/u_blitter.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
+#include "lp_limits.h"
+#include "lp_perf.h"
 #include "lp_setup.h"
 #include "lp_state_fs.h"
 #include "lp_state_setup.h"
@@ -48,6 +51,9 @@ struct draw_context;
 struct draw_stage;
 struct draw_vertex_shader;
 struct lp_fragment_shader;
+struct lp_fragment_shader_variant;
+struct lp_compute_shader;
+struct lp_cs_local;
 struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
@@ -67,6 +73,7 @@ struct llvmpipe_context {
    const struct lp_geometry_shader *gs;
    const struct lp_velems_state *velems;
    const struct lp_so_state *so;
+   struct lp_compute_shader *cs;
 
    /** Other rendering state */
    unsigned sample_mask;
@@ -78,6 +85,7 @@ struct llvmpipe_context {
    struct pipe_poly_stipple poly_stipple;
    struct pipe_scissor_state scissors[PIPE_MAX_VIEWPORTS];
    struct pipe_sampler_view *sampler_views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   struct pipe_shader_buffer ssbos[PIPE_SHADER_TYPES][LP_MAX_TGSI_SHADER_BUFFERS];
 
    struct pipe_viewport_state viewports[PIPE_MAX_VIEWPORTS];
    struct pipe_vertex_buffer vertex_buffer[PIPE_MAX_ATTRIBS];
@@ -97,6 +105,13 @@ struct llvmpipe_context {
 
    unsigned active_occlusion_queries;
 
+   /** Driver query counters.  The ones added to by other threads (the
+    * rasterizer and shader compile threads) must be accessed under
+    * stats_mutex, see lp_stats_add().
+    */
+   uint64_t stats[LP_STAT_COUNT];
+   pipe_mutex stats_mutex;
+
    unsigned dirty; /**< Mask of LP_NEW_x flags */
 
    /** Mapped vertex buffers */
@@ -139,6 +154,9 @@ struct llvmpipe_context {
    unsigned tex_timestamp;
    boolean no_rast;
 
+   /** The fragment shader variant in use, set by llvmpipe_update_fs() */
+   struct lp_fragment_shader_variant *fs_variant;
+
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
@@ -152,6 +170,10 @@ struct llvmpipe_context {
    uint render_cond_mode;
    boolean render_cond_cond;
 
+   /** Per compute thread scratch memory, indexed by thread */
+   struct lp_cs_local **cs_locals;
+   unsigned num_cs_locals;
+
    /** The LLVMContext to use for LLVM related work */
    LLVMContextRef context;
 };
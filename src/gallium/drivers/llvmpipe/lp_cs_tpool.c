@@ -0,0 +1,231 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Compute thread pool.  Runs the iterations of a job (the blocks of a
+ * compute grid) on a set of threads, and waits for them all to finish.
+ *
+ * The thread which starts the run works on it as well, so a pool with no
+ * threads simply runs everything inline.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+#include "lp_cs_tpool.h"
+
+
+struct lp_cs_tpool_thread
+{
+   struct lp_cs_tpool *pool;
+   pipe_thread thread;
+   unsigned index;
+};
+
+
+struct lp_cs_tpool
+{
+   /** Serializes runs from different contexts */
+   pipe_mutex run_mutex;
+
+   pipe_mutex mutex;
+   pipe_condvar work_cond;   /**< broadcast when a run starts */
+   pipe_condvar done_cond;   /**< signalled when the last thread is done */
+
+   /* The current run, protected by mutex */
+   unsigned generation;
+   lp_cs_tpool_work work;
+   void *data;
+   unsigned num_iterations;
+   unsigned num_pending;     /**< threads still working on the run */
+   boolean exit_flag;
+
+   int next_iteration;
+
+   unsigned num_threads;
+   struct lp_cs_tpool_thread *threads;
+};
+
+
+static void
+do_work(struct lp_cs_tpool *pool, lp_cs_tpool_work work, void *data,
+        unsigned num_iterations, unsigned thread_index)
+{
+   unsigned iteration;
+
+   while ((iteration = p_atomic_inc_return(&pool->next_iteration) - 1) <
+          num_iterations) {
+      work(data, iteration, thread_index);
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( cs_thread_proc, init_data )
+{
+   struct lp_cs_tpool_thread *thread = (struct lp_cs_tpool_thread *) init_data;
+   struct lp_cs_tpool *pool = thread->pool;
+   unsigned generation = 0;
+
+   pipe_mutex_lock(pool->mutex);
+
+   while (1) {
+      lp_cs_tpool_work work;
+      void *data;
+      unsigned num_iterations;
+
+      while (pool->generation == generation && !pool->exit_flag)
+         pipe_condvar_wait(pool->work_cond, pool->mutex);
+
+      if (pool->exit_flag)
+         break;
+
+      generation = pool->generation;
+      work = pool->work;
+      data = pool->data;
+      num_iterations = pool->num_iterations;
+
+      pipe_mutex_unlock(pool->mutex);
+
+      do_work(pool, work, data, num_iterations, thread->index);
+
+      pipe_mutex_lock(pool->mutex);
+
+      if (--pool->num_pending == 0)
+         pipe_condvar_signal(pool->done_cond);
+   }
+
+   pipe_mutex_unlock(pool->mutex);
+
+   return 0;
+}
+
+
+/**
+ * Create a pool with the given number of threads, besides the caller's.
+ */
+struct lp_cs_tpool *
+lp_cs_tpool_create(unsigned num_threads)
+{
+   struct lp_cs_tpool *pool;
+   unsigned i;
+
+   pool = CALLOC_STRUCT(lp_cs_tpool);
+   if (!pool)
+      return NULL;
+
+   pipe_mutex_init(pool->run_mutex);
+   pipe_mutex_init(pool->mutex);
+   pipe_condvar_init(pool->work_cond);
+   pipe_condvar_init(pool->done_cond);
+
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof *pool->threads);
+      if (!pool->threads) {
+         lp_cs_tpool_destroy(pool);
+         return NULL;
+      }
+   }
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_cs_tpool_thread *thread = &pool->threads[i];
+
+      thread->pool = pool;
+      thread->index = i;
+      thread->thread = pipe_thread_create(cs_thread_proc, thread);
+      if (!thread->thread)
+         break;
+
+      pool->num_threads++;
+   }
+
+   return pool;
+}
+
+
+void
+lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
+{
+   unsigned i;
+
+   pipe_mutex_lock(pool->mutex);
+   pool->exit_flag = TRUE;
+   pipe_condvar_broadcast(pool->work_cond);
+   pipe_mutex_unlock(pool->mutex);
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pipe_thread_wait(pool->threads[i].thread);
+   }
+
+   pipe_condvar_destroy(pool->done_cond);
+   pipe_condvar_destroy(pool->work_cond);
+   pipe_mutex_destroy(pool->mutex);
+   pipe_mutex_destroy(pool->run_mutex);
+   FREE(pool->threads);
+   FREE(pool);
+}
+
+
+/**
+ * Number of distinct thread indices passed to work callbacks.
+ */
+unsigned
+lp_cs_tpool_num_workers(const struct lp_cs_tpool *pool)
+{
+   return pool->num_threads + 1;
+}
+
+
+/**
+ * Call work for every iteration in [0, num_iterations), spread over the
+ * pool's threads and the calling thread, and wait for all of them.
+ */
+void
+lp_cs_tpool_run(struct lp_cs_tpool *pool,
+                lp_cs_tpool_work work, void *data,
+                unsigned num_iterations)
+{
+   pipe_mutex_lock(pool->run_mutex);
+
+   pipe_mutex_lock(pool->mutex);
+   pool->work = work;
+   pool->data = data;
+   pool->num_iterations = num_iterations;
+   pool->next_iteration = 0;
+   pool->num_pending = pool->num_threads;
+   pool->generation++;
+   pipe_condvar_broadcast(pool->work_cond);
+   pipe_mutex_unlock(pool->mutex);
+
+   do_work(pool, work, data, num_iterations, pool->num_threads);
+
+   pipe_mutex_lock(pool->mutex);
+   while (pool->num_pending)
+      pipe_condvar_wait(pool->done_cond, pool->mutex);
+   pipe_mutex_unlock(pool->mutex);
+
+   pipe_mutex_unlock(pool->run_mutex);
+}
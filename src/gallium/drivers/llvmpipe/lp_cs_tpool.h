@@ -0,0 +1,60 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef LP_CS_TPOOL_H
+#define LP_CS_TPOOL_H
+
+#include "pipe/p_compiler.h"
+
+struct lp_cs_tpool;
+
+
+/**
+ * Work callback, called once for every iteration of a run.
+ *
+ * \param thread_index  index of the calling thread, below
+ *                      lp_cs_tpool_num_workers(), for per-thread scratch
+ */
+typedef void (*lp_cs_tpool_work)(void *data, unsigned iteration,
+                                 unsigned thread_index);
+
+
+struct lp_cs_tpool *
+lp_cs_tpool_create(unsigned num_threads);
+
+void
+lp_cs_tpool_destroy(struct lp_cs_tpool *pool);
+
+unsigned
+lp_cs_tpool_num_workers(const struct lp_cs_tpool *pool);
+
+void
+lp_cs_tpool_run(struct lp_cs_tpool *pool,
+                lp_cs_tpool_work work, void *data,
+                unsigned num_iterations);
+
+
+#endif /* LP_CS_TPOOL_H */
@@ -48,6 +48,7 @@ st_print_current(void);
 #define DEBUG_FENCE         0x2000
 #define DEBUG_MEM           0x4000
 #define DEBUG_FS            0x8000
+#define DEBUG_SCHED         0x10000
 
 /* Performance flags.  These are active even on release builds.
  */
@@ -59,6 +60,9 @@ st_print_current(void);
 #define PERF_NO_BLEND       0x20  	/* disable blending */
 #define PERF_NO_DEPTH       0x40  	/* disable depth buffering entirely */
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
+#define PERF_NO_TILED_TEX   0x100  	/* store all textures linearly */
+#define PERF_NO_HIZ         0x200  	/* disable hierarchical z */
+#define PERF_NO_EARLY_CULL  0x400  	/* no batched culling before setup */
 
 
 extern int LP_PERF;
@@ -35,6 +35,7 @@
 #include "pipe/p_context.h"
 #include "util/u_draw.h"
 #include "util/u_prim.h"
+#include "os/os_time.h"
 
 #include "lp_context.h"
 #include "lp_state.h"
@@ -56,6 +57,7 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    struct llvmpipe_context *lp = llvmpipe_context(pipe);
    struct draw_context *draw = lp->draw;
    const void *mapped_indices = NULL;
+   int64_t t0;
    unsigned i;
 
    if (!llvmpipe_check_render_cond(lp))
@@ -69,6 +71,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   llvmpipe_use_fs_variant(lp);
+
    /*
     * Map vertex buffers
     */
@@ -129,7 +133,9 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
                                     lp->active_statistics_queries > 0);
 
    /* draw! */
+   t0 = os_time_get();
    draw_vbo(draw, info);
+   lp->stats[LP_STAT_BIN_TIME] += os_time_get() - t0;
 
    /*
     * unmap vertex/index buffers
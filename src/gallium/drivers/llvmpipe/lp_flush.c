@@ -34,6 +34,7 @@
 #include "pipe/p_screen.h"
 #include "util/u_debug_image.h"
 #include "util/u_string.h"
+#include "os/os_time.h"
 #include "draw/draw_context.h"
 #include "lp_flush.h"
 #include "lp_context.h"
@@ -82,8 +83,11 @@ llvmpipe_finish( struct pipe_context *pipe,
    struct pipe_fence_handle *fence = NULL;
    llvmpipe_flush(pipe, &fence, reason);
    if (fence) {
+      int64_t t0 = os_time_get();
       pipe->screen->fence_finish(pipe->screen, fence, PIPE_TIMEOUT_INFINITE);
       pipe->screen->fence_reference(pipe->screen, &fence, NULL);
+      llvmpipe_context(pipe)->stats[LP_STAT_FENCE_WAIT_TIME] +=
+         os_time_get() - t0;
    }
 }
 
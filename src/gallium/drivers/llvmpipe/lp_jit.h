@@ -45,6 +45,7 @@
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -233,10 +234,12 @@ enum {
  * @param dady          shader input dady
  * @param color         color buffer
  * @param depth         depth buffer
- * @param mask          mask of visible pixels in block
+ * @param mask          mask of visible pixels in block, 16 bits per sample
  * @param thread_data   task thread data
  * @param stride        color buffer row stride in bytes
  * @param depth_stride  depth buffer row stride in bytes
+ * @param sample_stride color buffer sample stride in bytes
+ * @param depth_sample_stride  depth buffer sample stride in bytes
  */
 typedef void
 (*lp_jit_frag_func)(const struct lp_jit_context *context,
@@ -248,10 +251,92 @@ typedef void
                     const void *dady,
                     uint8_t **color,
                     uint8_t *depth,
-                    uint32_t mask,
+                    uint64_t mask,
                     struct lp_jit_thread_data *thread_data,
                     unsigned *stride,
-                    unsigned depth_stride);
+                    unsigned depth_stride,
+                    unsigned *sample_stride,
+                    unsigned depth_sample_stride);
+
+
+
+/**
+ * This structure is passed directly to the generated compute shader.
+ *
+ * Changes here must be reflected in the lp_jit_cs_context_* macros and
+ * lp_jit_init_cs_types function.
+ */
+struct lp_jit_cs_context
+{
+   const float *constants[LP_MAX_TGSI_CONST_BUFFERS];
+   int num_constants[LP_MAX_TGSI_CONST_BUFFERS];
+
+   uint8_t *ssbos[LP_MAX_TGSI_SHADER_BUFFERS];
+   uint32_t ssbo_sizes[LP_MAX_TGSI_SHADER_BUFFERS];
+
+   uint32_t block_size[3];
+   uint32_t grid_size[3];
+   uint32_t shared_size;
+};
+
+
+/**
+ * These enum values must match the position of the fields in the
+ * lp_jit_cs_context struct above.
+ */
+enum {
+   LP_JIT_CS_CTX_CONSTANTS = 0,
+   LP_JIT_CS_CTX_NUM_CONSTANTS,
+   LP_JIT_CS_CTX_SSBOS,
+   LP_JIT_CS_CTX_SSBO_SIZES,
+   LP_JIT_CS_CTX_BLOCK_SIZE,
+   LP_JIT_CS_CTX_GRID_SIZE,
+   LP_JIT_CS_CTX_SHARED_SIZE,
+   LP_JIT_CS_CTX_COUNT
+};
+
+
+#define lp_jit_cs_context_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_CONSTANTS, "constants")
+
+#define lp_jit_cs_context_num_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_NUM_CONSTANTS, "num_constants")
+
+#define lp_jit_cs_context_ssbos(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_SSBOS, "ssbos")
+
+#define lp_jit_cs_context_ssbo_sizes(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_SSBO_SIZES, "ssbo_sizes")
+
+#define lp_jit_cs_context_block_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_BLOCK_SIZE, "block_size")
+
+#define lp_jit_cs_context_grid_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GRID_SIZE, "grid_size")
+
+#define lp_jit_cs_context_shared_size(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_SHARED_SIZE, "shared_size")
+
+
+/**
+ * typedef for compute shader function
+ *
+ * @param context       jit context
+ * @param block_x       block id x
+ * @param block_y       block id y
+ * @param block_z       block id z
+ * @param invocation    linear index of the vector's first invocation
+ * @param shared_mem    the block's shared memory
+ * @param coro          coroutine to yield on barriers
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_cs_context *context,
+                  uint32_t block_x,
+                  uint32_t block_y,
+                  uint32_t block_z,
+                  uint32_t invocation,
+                  uint8_t *shared_mem,
+                  void *coro);
 
 
 void
@@ -266,4 +351,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
@@ -61,7 +61,21 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Number of samples of multisample surfaces.  This is the only sample
+ * count supported besides single-sampled surfaces.  The rasterizer's
+ * coverage masks hold 16 bits (one 4x4 block) per sample, hence this
+ * can't be more than 4.
+ */
+#define LP_MAX_SAMPLES 4
+
+
+/**
+ * Upper bound for the number of rasterizer threads.  The per-thread
+ * rasterizer and query data is sized at runtime for the actual number of
+ * threads, so this is merely a sanity limit.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
@@ -98,6 +98,9 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
+      debug_printf("llvmpipe: nr_hiz_rejected_64x64:        %9u\n", lp_count.nr_hiz_rejected_64);
+      debug_printf("llvmpipe: nr_hiz_rejected_16x16:        %9u\n", lp_count.nr_hiz_rejected_16);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
@@ -106,5 +109,11 @@ lp_print_counters(void)
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      debug_printf("llvmpipe: nr_fs_variant_hits:           %9u\n", lp_count.nr_fs_variant_hits);
+      debug_printf("llvmpipe: nr_fs_variant_misses:         %9u\n", lp_count.nr_fs_variant_misses);
+      debug_printf("llvmpipe: nr_fs_compile_stalls:         %9u\n", lp_count.nr_fs_compile_stalls);
+      debug_printf("llvmpipe: nr_fs_variant_promotions:     %9u\n", lp_count.nr_fs_variant_promotions);
+      debug_printf("llvmpipe: total fs compile stall time:  %.2f sec\n", lp_count.fs_compile_stall_time / 1000000.0);
+
    }
 }
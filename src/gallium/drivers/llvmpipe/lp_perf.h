@@ -56,8 +56,15 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_rejected_64;
+   unsigned nr_hiz_rejected_16;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_variant_hits;
+   unsigned nr_fs_variant_misses;
+   unsigned nr_fs_compile_stalls;
+   unsigned nr_fs_variant_promotions;
+   int64_t fs_compile_stall_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
@@ -68,6 +75,32 @@ struct lp_counters
 extern struct lp_counters lp_count;
 
 
+/**
+ * Counters which are always kept, per context, and exposed as driver
+ * queries (for the HUD and GL_AMD_performance_monitor).  The rasterizer
+ * threads count into their own task, and the totals of a scene are added
+ * to the context once it has been rasterized.  Times are in microseconds.
+ */
+enum lp_stat
+{
+   /* rasterizer, summed over all threads */
+   LP_STAT_BINS_RASTERIZED,
+   LP_STAT_TILES_FULLY_COVERED,
+   LP_STAT_BLOCKS_FULLY_COVERED,
+   LP_STAT_BLOCKS_PARTIALLY_COVERED,
+   LP_STAT_FS_QUADS,
+   LP_STAT_RAST_TIME,
+
+   /* context */
+   LP_STAT_BIN_TIME,
+   LP_STAT_COMPILE_TIME,
+   LP_STAT_SCENE_FLUSHES,
+   LP_STAT_FENCE_WAIT_TIME,
+
+   LP_STAT_COUNT
+};
+
+
 /** Increment the named counter (only for debug builds) */
 #ifdef DEBUG
 #define LP_COUNT(counter) lp_count.counter++
@@ -48,19 +48,65 @@ static struct llvmpipe_query *llvmpipe_query( struct pipe_query *p )
    return (struct llvmpipe_query *)p;
 }
 
+
+static inline boolean
+is_driver_query(unsigned type)
+{
+   return type >= PIPE_QUERY_DRIVER_SPECIFIC;
+}
+
+
+/**
+ * Add to one of the context's driver query counters.  Must be used by
+ * all threads but the context's own, and for any counter which other
+ * threads add to.
+ */
+void
+lp_stats_add(struct llvmpipe_context *lp, enum lp_stat stat, uint64_t value)
+{
+   pipe_mutex_lock(lp->stats_mutex);
+   lp->stats[stat] += value;
+   pipe_mutex_unlock(lp->stats_mutex);
+}
+
+
+static uint64_t
+get_stat(struct llvmpipe_context *lp, unsigned type)
+{
+   uint64_t value;
+
+   pipe_mutex_lock(lp->stats_mutex);
+   value = lp->stats[type - PIPE_QUERY_DRIVER_SPECIFIC];
+   pipe_mutex_unlock(lp->stats_mutex);
+
+   return value;
+}
+
 static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe, 
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (is_driver_query(type) &&
+           type < PIPE_QUERY_DRIVER_SPECIFIC + LP_STAT_COUNT));
 
    pq = CALLOC_STRUCT( llvmpipe_query );
 
    if (pq) {
       pq->type = type;
+
+      /* One start and one end value per rasterizer thread */
+      pq->start = CALLOC(2 * num_threads, sizeof *pq->start);
+      if (!pq->start) {
+         FREE(pq);
+         return NULL;
+      }
+      pq->end = pq->start + num_threads;
    }
 
    return (struct pipe_query *) pq;
@@ -85,6 +131,7 @@ llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
       lp_fence_reference(&pq->fence, NULL);
    }
 
+   FREE(pq->start);
    FREE(pq);
 }
 
@@ -99,8 +146,14 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
    uint64_t *result = (uint64_t *)vresult;
+   int64_t t0;
    int i;
 
+   if (is_driver_query(pq->type)) {
+      *result = pq->end[0] - pq->start[0];
+      return TRUE;
+   }
+
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
@@ -110,7 +163,10 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
          if (!wait)
             return FALSE;
 
+         t0 = os_time_get();
          lp_fence_wait(pq->fence);
+         llvmpipe_context(pipe)->stats[LP_STAT_FENCE_WAIT_TIME] +=
+            os_time_get() - t0;
       }
    }
 
@@ -188,6 +244,8 @@ static boolean
 llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
    /* Check if the query is already in the scene.  If so, we need to
@@ -199,8 +257,14 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, num_threads * sizeof(*pq->end));
+
+   if (is_driver_query(pq->type)) {
+      pq->start[0] = get_stat(llvmpipe, pq->type);
+      return true;
+   }
+
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -245,6 +309,14 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   /* The rasterizer's counts are only added once a scene is done, so
+    * they lag behind by the scenes still in flight.
+    */
+   if (is_driver_query(pq->type)) {
+      pq->end[0] = get_stat(llvmpipe, pq->type);
+      return;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -320,6 +392,71 @@ llvmpipe_check_render_cond(struct llvmpipe_context *lp)
       return TRUE;
 }
 
+int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+#define QUERY(NAME, STAT, UNITS) \
+   {NAME, PIPE_QUERY_DRIVER_SPECIFIC + STAT, {0}, UNITS, \
+    PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE, 0, 0x0}
+
+   static const struct pipe_driver_query_info queries[] = {
+      QUERY("bins-rasterized", LP_STAT_BINS_RASTERIZED,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("tiles-fully-covered", LP_STAT_TILES_FULLY_COVERED,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("blocks-fully-covered", LP_STAT_BLOCKS_FULLY_COVERED,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("blocks-partially-covered", LP_STAT_BLOCKS_PARTIALLY_COVERED,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("fs-quads", LP_STAT_FS_QUADS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("rast-time", LP_STAT_RAST_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+      QUERY("bin-time", LP_STAT_BIN_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+      QUERY("compile-time", LP_STAT_COMPILE_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+      QUERY("scene-flushes", LP_STAT_SCENE_FLUSHES,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("fence-wait-time", LP_STAT_FENCE_WAIT_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+   };
+#undef QUERY
+
+   STATIC_ASSERT(Elements(queries) == LP_STAT_COUNT);
+
+   if (!info)
+      return Elements(queries);
+
+   if (index >= Elements(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
+
+int
+llvmpipe_get_driver_query_group_info(struct pipe_screen *screen,
+                                     unsigned index,
+                                     struct pipe_driver_query_group_info *info)
+{
+   if (!info)
+      return 1;
+
+   if (index != 0)
+      return 0;
+
+   /* All counters are kept all the time, so any number can be active */
+   info->name = "llvmpipe";
+   info->max_active_queries = LP_STAT_COUNT;
+   info->num_queries = LP_STAT_COUNT;
+   return 1;
+}
+
+
 void llvmpipe_init_query_funcs(struct llvmpipe_context *llvmpipe )
 {
    llvmpipe->pipe.create_query = llvmpipe_create_query;
@@ -36,14 +36,18 @@
 #include <limits.h>
 #include "os/os_thread.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 struct llvmpipe_context;
+struct pipe_screen;
+struct pipe_driver_query_info;
+struct pipe_driver_query_group_info;
 
 
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
    unsigned type;                   /* PIPE_QUERY_* */
    unsigned num_primitives_generated;
@@ -57,4 +61,17 @@ extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
 extern boolean llvmpipe_check_render_cond(struct llvmpipe_context *);
 
+extern void
+lp_stats_add(struct llvmpipe_context *lp, enum lp_stat stat, uint64_t value);
+
+extern int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info);
+
+extern int
+llvmpipe_get_driver_query_group_info(struct pipe_screen *screen,
+                                     unsigned index,
+                                     struct pipe_driver_query_group_info *info);
+
 #endif /* LP_QUERY_H */
@@ -26,14 +26,17 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <float.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
+#include "util/u_cpu_detect.h"
 
 #include "os/os_time.h"
+#include "os/os_misc.h"
 
 #include "lp_scene_queue.h"
 #include "lp_context.h"
@@ -56,6 +59,14 @@ const struct lp_rasterizer_task *jit_task = NULL;
 #endif
 
 
+const int lp_sample_pos[LP_MAX_SAMPLES][2] = {
+   { -2 * FIXED_ONE / 16, -6 * FIXED_ONE / 16 },
+   {  6 * FIXED_ONE / 16, -2 * FIXED_ONE / 16 },
+   { -6 * FIXED_ONE / 16,  2 * FIXED_ONE / 16 },
+   {  2 * FIXED_ONE / 16,  6 * FIXED_ONE / 16 },
+};
+
+
 /**
  * Begin rasterizing a scene.
  * Called once per scene by one thread.
@@ -68,17 +79,56 @@ lp_rast_begin( struct lp_rasterizer *rast,
 
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
+   /* There is no fallback shader to rasterize with, so the frame still
+    * stalls here on a variant which is compiling in the background.
+    */
+   lp_scene_wait_pending_compiles( scene );
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, rast->num_threads );
+}
+
+
+/**
+ * Add the counts of all threads for the scene to its context's driver
+ * query counters.
+ */
+static void
+lp_rast_add_stats( struct lp_rasterizer *rast,
+                   struct lp_scene *scene )
+{
+   struct llvmpipe_context *lp = llvmpipe_context(scene->pipe);
+   unsigned num_tasks = MAX2(1, rast->num_threads);
+   unsigned i, j;
+
+   pipe_mutex_lock(lp->stats_mutex);
+   for (i = 0; i < num_tasks; i++) {
+      struct lp_rasterizer_task *task = &rast->tasks[i];
+      for (j = 0; j < LP_STAT_COUNT; j++) {
+         lp->stats[j] += task->stats[j];
+         task->stats[j] = 0;
+      }
+   }
+   pipe_mutex_unlock(lp->stats_mutex);
 }
 
 
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+
+   lp_scene_end_rasterization( scene );
+
+   lp_rast_add_stats( rast, scene );
 
    rast->curr_scene = NULL;
+
+   /* The setup module may release and reuse the scene as soon as the
+    * fence is signalled, so this must be the last access to it.
+    */
+   if (scene->fence) {
+      lp_fence_signal(scene->fence);
+   }
 }
 
 
@@ -108,6 +158,14 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->ps_invocations = 0;
 
+   memset(task->color_clear_blocks, 0, sizeof(task->color_clear_blocks));
+   task->zs_clear_blocks = 0;
+
+   if (scene->hiz) {
+      for (i = 0; i < Elements(task->hiz); i++)
+         task->hiz[i] = FLT_MAX;
+   }
+
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
@@ -123,10 +181,100 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Bitmask of the tile's 16x16 blocks which are inside the framebuffer.
+ */
+static inline unsigned
+tile_blocks(const struct lp_rasterizer_task *task)
+{
+   const unsigned nx = (task->width + 15) / 16;
+   const unsigned ny = (task->height + 15) / 16;
+
+   return ((1 << nx) - 1) * (0x1111 & ((1 << (4 * ny)) - 1));
+}
+
+
+/**
+ * Get the part of the current tile covered by some of its 16x16 blocks,
+ * relative to the tile.  Returns FALSE if the blocks can't be cleared as
+ * a single rectangle.
+ */
+static boolean
+blocks_rect(const struct lp_rasterizer_task *task, unsigned blocks,
+            unsigned *x, unsigned *y, unsigned *width, unsigned *height)
+{
+   unsigned i = ffs(blocks) - 1;
+
+   if (blocks == tile_blocks(task)) {
+      *x = *y = 0;
+      *width = task->width;
+      *height = task->height;
+      return TRUE;
+   }
+
+   if (blocks != (1u << i))
+      return FALSE;
+
+   *x = (i & 3) * 16;
+   *y = (i >> 2) * 16;
+   *width = MIN2(16, task->width - *x);
+   *height = MIN2(16, task->height - *y);
+   return TRUE;
+}
+
+
+/**
+ * Write the pending clear of a color buffer to some 16x16 blocks of the
+ * current tile.
+ * Clears always clear all bound layers.
+ */
+void
+lp_rast_flush_color_clear(struct lp_rasterizer_task *task,
+                          unsigned cbuf, unsigned blocks)
+{
+   const struct lp_scene *scene = task->scene;
+   unsigned x, y, width, height;
+
+   assert((task->color_clear_blocks[cbuf] & blocks) == blocks);
+
+   if (!blocks_rect(task, blocks, &x, &y, &width, &height)) {
+      while (blocks) {
+         unsigned i = ffs(blocks) - 1;
+         lp_rast_flush_color_clear(task, cbuf, 1 << i);
+         blocks &= ~(1 << i);
+      }
+      return;
+   }
+
+   /*
+    * The samples of all layers are stored one after another, so they can
+    * be cleared as if they were layers.
+    */
+   util_fill_box(scene->cbufs[cbuf].map,
+                 scene->fb.cbufs[cbuf]->format,
+                 scene->cbufs[cbuf].stride,
+                 scene->cbufs[cbuf].sample_stride,
+                 task->x + x,
+                 task->y + y,
+                 0,
+                 width,
+                 height,
+                 (scene->fb_max_layer + 1) * scene->fb_samples,
+                 &task->color_clear_value[cbuf]);
+
+   task->color_clear_blocks[cbuf] &= ~blocks;
+
+   /* this will increase for each rb which probably doesn't mean much */
+   if (!task->color_clear_blocks[cbuf])
+      LP_COUNT(nr_color_tile_clear);
+}
+
+
 /**
  * Clear the rasterizer's current color tile.
  * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * The clear is only recorded here, and each 16x16 block is written when
+ * it's first accessed, or at the end of the tile.
  */
 static void
 lp_rast_clear_color(struct lp_rasterizer_task *task,
@@ -151,136 +299,210 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
    LP_DBG(DEBUG_RAST, "%s clear value (target format %d) raw 0x%x,0x%x,0x%x,0x%x\n",
           __FUNCTION__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
+   /* A clear replaces any earlier one */
+   task->color_clear_value[cbuf] = uc;
+   task->color_clear_blocks[cbuf] = tile_blocks(task);
+}
 
-   util_fill_box(scene->cbufs[cbuf].map,
-                 format,
-                 scene->cbufs[cbuf].stride,
-                 scene->cbufs[cbuf].layer_stride,
-                 task->x,
-                 task->y,
-                 0,
-                 task->width,
-                 task->height,
-                 scene->fb_max_layer + 1,
-                 &uc);
 
-   /* this will increase for each rb which probably doesn't mean much */
-   LP_COUNT(nr_color_tile_clear);
+/**
+ * Unpack the depth part of a packed z/stencil clear value.
+ */
+static float
+clear_depth_value(enum pipe_format format, uint64_t value)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   uint16_t value16 = (uint16_t) value;
+   uint32_t value32 = (uint32_t) value;
+   float depth = 0.0f;
+
+   switch (desc->block.bits) {
+   case 16:
+      desc->unpack_z_float(&depth, 0, (const uint8_t *) &value16, 0, 1, 1);
+      break;
+   case 32:
+      desc->unpack_z_float(&depth, 0, (const uint8_t *) &value32, 0, 1, 1);
+      break;
+   case 64:
+      desc->unpack_z_float(&depth, 0, (const uint8_t *) &value, 0, 1, 1);
+      break;
+   default:
+      assert(0);
+      break;
+   }
+
+   return depth;
 }
 
 
 /**
- * Clear the rasterizer's current z/stencil tile.
- * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * Write the pending z/stencil clear to some 16x16 blocks of the current
+ * tile.
+ * Clears always clear all bound layers.
  */
-static void
-lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
-                       const union lp_rast_cmd_arg arg)
+void
+lp_rast_flush_zs_clear(struct lp_rasterizer_task *task, unsigned blocks)
 {
    const struct lp_scene *scene = task->scene;
-   uint64_t clear_value64 = arg.clear_zstencil.value;
-   uint64_t clear_mask64 = arg.clear_zstencil.mask;
+   uint64_t clear_value64 = task->zs_clear_value;
+   uint64_t clear_mask64 = task->zs_clear_mask;
    uint32_t clear_value = (uint32_t) clear_value64;
    uint32_t clear_mask = (uint32_t) clear_mask64;
-   const unsigned height = task->height;
-   const unsigned width = task->width;
    const unsigned dst_stride = scene->zsbuf.stride;
-   uint8_t *dst;
+   const unsigned num_images = (scene->fb_max_layer + 1) * scene->fb_samples;
+   unsigned x, y, width, height;
+   unsigned layer;
+   uint8_t *dst, *dst_layer;
    unsigned i, j;
    unsigned block_size;
 
-   LP_DBG(DEBUG_RAST, "%s: value=0x%08x, mask=0x%08x\n",
-           __FUNCTION__, clear_value, clear_mask);
+   assert((task->zs_clear_blocks & blocks) == blocks);
 
-   /*
-    * Clear the area of the depth/depth buffer matching this tile.
-    */
+   if (!blocks_rect(task, blocks, &x, &y, &width, &height)) {
+      while (blocks) {
+         unsigned b = ffs(blocks) - 1;
+         lp_rast_flush_zs_clear(task, 1 << b);
+         blocks &= ~(1 << b);
+      }
+      return;
+   }
 
-   if (scene->fb.zsbuf) {
-      unsigned layer;
-      uint8_t *dst_layer = task->depth_tile;
-      block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
-
-      clear_value &= clear_mask;
-
-      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
-         dst = dst_layer;
-
-         switch (block_size) {
-         case 1:
-            assert(clear_mask == 0xff);
-            memset(dst, (uint8_t) clear_value, height * width);
-            break;
-         case 2:
-            if (clear_mask == 0xffff) {
-               for (i = 0; i < height; i++) {
-                  uint16_t *row = (uint16_t *)dst;
-                  for (j = 0; j < width; j++)
-                     *row++ = (uint16_t) clear_value;
-                  dst += dst_stride;
-               }
+   block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
+   dst_layer = task->depth_tile + y * dst_stride + x * block_size;
+
+   clear_value &= clear_mask;
+
+   /* Clear all samples of all layers */
+   for (layer = 0; layer < num_images; layer++) {
+      dst = dst_layer;
+
+      switch (block_size) {
+      case 1:
+         assert(clear_mask == 0xff);
+         for (i = 0; i < height; i++) {
+            memset(dst, (uint8_t) clear_value, width);
+            dst += dst_stride;
+         }
+         break;
+      case 2:
+         if (clear_mask == 0xffff) {
+            for (i = 0; i < height; i++) {
+               uint16_t *row = (uint16_t *)dst;
+               for (j = 0; j < width; j++)
+                  *row++ = (uint16_t) clear_value;
+               dst += dst_stride;
             }
-            else {
-               for (i = 0; i < height; i++) {
-                  uint16_t *row = (uint16_t *)dst;
-                  for (j = 0; j < width; j++) {
-                     uint16_t tmp = ~clear_mask & *row;
-                     *row++ = clear_value | tmp;
-                  }
-                  dst += dst_stride;
+         }
+         else {
+            for (i = 0; i < height; i++) {
+               uint16_t *row = (uint16_t *)dst;
+               for (j = 0; j < width; j++) {
+                  uint16_t tmp = ~clear_mask & *row;
+                  *row++ = clear_value | tmp;
                }
+               dst += dst_stride;
             }
-            break;
-         case 4:
-            if (clear_mask == 0xffffffff) {
-               for (i = 0; i < height; i++) {
-                  uint32_t *row = (uint32_t *)dst;
-                  for (j = 0; j < width; j++)
-                     *row++ = clear_value;
-                  dst += dst_stride;
-               }
+         }
+         break;
+      case 4:
+         if (clear_mask == 0xffffffff) {
+            for (i = 0; i < height; i++) {
+               uint32_t *row = (uint32_t *)dst;
+               for (j = 0; j < width; j++)
+                  *row++ = clear_value;
+               dst += dst_stride;
             }
-            else {
-               for (i = 0; i < height; i++) {
-                  uint32_t *row = (uint32_t *)dst;
-                  for (j = 0; j < width; j++) {
-                     uint32_t tmp = ~clear_mask & *row;
-                     *row++ = clear_value | tmp;
-                  }
-                  dst += dst_stride;
+         }
+         else {
+            for (i = 0; i < height; i++) {
+               uint32_t *row = (uint32_t *)dst;
+               for (j = 0; j < width; j++) {
+                  uint32_t tmp = ~clear_mask & *row;
+                  *row++ = clear_value | tmp;
                }
+               dst += dst_stride;
             }
-            break;
-         case 8:
-            clear_value64 &= clear_mask64;
-            if (clear_mask64 == 0xffffffffffULL) {
-               for (i = 0; i < height; i++) {
-                  uint64_t *row = (uint64_t *)dst;
-                  for (j = 0; j < width; j++)
-                     *row++ = clear_value64;
-                  dst += dst_stride;
-               }
+         }
+         break;
+      case 8:
+         clear_value64 &= clear_mask64;
+         if (clear_mask64 == 0xffffffffffULL) {
+            for (i = 0; i < height; i++) {
+               uint64_t *row = (uint64_t *)dst;
+               for (j = 0; j < width; j++)
+                  *row++ = clear_value64;
+               dst += dst_stride;
             }
-            else {
-               for (i = 0; i < height; i++) {
-                  uint64_t *row = (uint64_t *)dst;
-                  for (j = 0; j < width; j++) {
-                     uint64_t tmp = ~clear_mask64 & *row;
-                     *row++ = clear_value64 | tmp;
-                  }
-                  dst += dst_stride;
+         }
+         else {
+            for (i = 0; i < height; i++) {
+               uint64_t *row = (uint64_t *)dst;
+               for (j = 0; j < width; j++) {
+                  uint64_t tmp = ~clear_mask64 & *row;
+                  *row++ = clear_value64 | tmp;
                }
+               dst += dst_stride;
             }
-            break;
-
-         default:
-            assert(0);
-            break;
          }
-         dst_layer += scene->zsbuf.layer_stride;
+         break;
+
+      default:
+         assert(0);
+         break;
+      }
+      dst_layer += scene->zsbuf.sample_stride;
+   }
+
+   task->zs_clear_blocks &= ~blocks;
+}
+
+
+/**
+ * Clear the rasterizer's current z/stencil tile.
+ * This is a bin command called during bin processing.
+ * As with color clears, the clear is only recorded here.
+ */
+static void
+lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
+                       const union lp_rast_cmd_arg arg)
+{
+   const struct lp_scene *scene = task->scene;
+   uint64_t clear_value64 = arg.clear_zstencil.value;
+   uint64_t clear_mask64 = arg.clear_zstencil.mask;
+   unsigned i;
+
+   LP_DBG(DEBUG_RAST, "%s: value=0x%08x, mask=0x%08x\n",
+           __FUNCTION__, (uint32_t) clear_value64, (uint32_t) clear_mask64);
+
+   if (!scene->fb.zsbuf)
+      return;
+
+   clear_value64 &= clear_mask64;
+
+   if (task->zs_clear_blocks &&
+       (clear_mask64 & task->zs_clear_mask) != task->zs_clear_mask) {
+      /* A clear of only some of the earlier cleared channels.  They can
+       * be merged, unless some blocks already got the earlier clear.
+       */
+      if (task->zs_clear_blocks != tile_blocks(task))
+         lp_rast_flush_zs_clear(task, task->zs_clear_blocks);
+      else {
+         clear_value64 |= task->zs_clear_value & ~clear_mask64;
+         clear_mask64 |= task->zs_clear_mask;
       }
    }
+
+   task->zs_clear_value = clear_value64;
+   task->zs_clear_mask = clear_mask64;
+   task->zs_clear_blocks = tile_blocks(task);
+
+   if (scene->hiz &&
+       (clear_mask64 & scene->hiz_zmask) == scene->hiz_zmask) {
+      float depth = clear_depth_value(scene->fb.zsbuf->format,
+                                      clear_value64);
+      for (i = 0; i < Elements(task->hiz); i++)
+         task->hiz[i] = depth;
+   }
 }
 
 
@@ -298,8 +520,10 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_shader_inputs *inputs = arg.shade_tile;
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
+   lp_jit_frag_func jit_func;
    const unsigned tile_x = task->x, tile_y = task->y;
-   unsigned x, y;
+   unsigned hiz, hidden = 0;
+   unsigned x, y, i;
 
    if (inputs->disable) {
       /* This command was partially binned and has been disabled */
@@ -314,25 +538,45 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
       return;
    }
    variant = state->variant;
+   jit_func = lp_fs_variant_jit_function(variant, RAST_WHOLE);
+
+   task->stats[LP_STAT_TILES_FULLY_COVERED]++;
+
+   /* skip the 16x16 blocks where the triangle is hidden */
+   hiz = scene->hiz ? variant->hiz : 0;
+   if (hiz & LP_HIZ_TEST) {
+      for (i = 0; i < Elements(task->hiz); i++) {
+         if (lp_rast_hiz_hidden_16(task, inputs, i))
+            hidden |= 1 << i;
+      }
+      LP_COUNT_ADD(nr_hiz_rejected_16, util_bitcount(hidden));
+   }
 
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
          unsigned stride[PIPE_MAX_COLOR_BUFS];
+         unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
          uint8_t *depth = NULL;
          unsigned depth_stride = 0;
+         unsigned depth_sample_stride = 0;
          unsigned i;
 
+         if (hidden & (1 << ((y / 16) * 4 + x / 16)))
+            continue;
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
                stride[i] = scene->cbufs[i].stride;
+               sample_stride[i] = scene->cbufs[i].sample_stride;
                color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
                                                           tile_y + y, inputs->layer);
             }
             else {
                stride[i] = 0;
+               sample_stride[i] = 0;
                color[i] = NULL;
             }
          }
@@ -342,28 +586,37 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
             depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
                                                     tile_y + y, inputs->layer);
             depth_stride = scene->zsbuf.stride;
+            depth_sample_stride = scene->zsbuf.sample_stride;
          }
 
          /* Propagate non-interpolated raster state. */
          task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
          /* run shader on 4x4 block */
+         task->stats[LP_STAT_FS_QUADS]++;
          BEGIN_JIT_CALL(state, task);
-         variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                            tile_x + x, tile_y + y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            0xffff,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride);
+         jit_func( &state->jit_context,
+                   tile_x + x, tile_y + y,
+                   inputs->frontfacing,
+                   GET_A0(inputs),
+                   GET_DADX(inputs),
+                   GET_DADY(inputs),
+                   color,
+                   depth,
+                   LP_RAST_FULL_MASK,
+                   &task->thread_data,
+                   stride,
+                   depth_stride,
+                   sample_stride,
+                   depth_sample_stride);
          END_JIT_CALL();
       }
    }
+
+   if (hiz & LP_HIZ_UPDATE) {
+      for (i = 0; i < Elements(task->hiz); i++)
+         lp_rast_hiz_cover_16(task, inputs, i);
+   }
 }
 
 
@@ -383,6 +636,13 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
       return;
    }
 
+   /* Every pixel of the color tile gets overwritten, so pending clears
+    * can be dropped (unless other layers or samples have them too).
+    */
+   if (task->scene->fb_max_layer == 0 && task->scene->fb_samples == 1 &&
+       !arg.shade_tile->disable)
+      memset(task->color_clear_blocks, 0, sizeof(task->color_clear_blocks));
+
    lp_rast_shade_tile(task, arg);
 }
 
@@ -392,20 +652,26 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
  * This is a bin command called during bin processing.
  * \param x  X position of quad in window coords
  * \param y  Y position of quad in window coords
+ * \param mask  coverage mask, 16 bits per sample (sample s in bits
+ *              16*s to 16*s+15).  For single-sampled inputs only the
+ *              lowest 16 bits are used, and apply to all samples.
  */
 void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask)
+                         uint64_t mask)
 {
    const struct lp_rast_state *state = task->state;
    struct lp_fragment_shader_variant *variant = state->variant;
+   lp_jit_frag_func jit_func;
    const struct lp_scene *scene = task->scene;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    assert(state);
@@ -419,15 +685,20 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    assert((x % 4) == 0);
    assert((y % 4) == 0);
 
+   if (!inputs->multisample)
+      mask = lp_rast_replicate_mask((unsigned) mask);
+
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -435,6 +706,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    /* depth buffer */
    if (scene->zsbuf.map) {
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.sample_stride;
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
    }
 
@@ -448,24 +720,28 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
       /* not very accurate would need a popcount on the mask */
       /* always count this not worth bothering? */
       task->ps_invocations += 1 * variant->ps_inv_multiplier;
+      task->stats[LP_STAT_FS_QUADS]++;
 
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
       /* run shader on 4x4 block */
+      jit_func = lp_fs_variant_jit_function(variant, RAST_EDGE_TEST);
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
-                                            x, y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            mask,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride);
+      jit_func(&state->jit_context,
+               x, y,
+               inputs->frontfacing,
+               GET_A0(inputs),
+               GET_DADX(inputs),
+               GET_DADY(inputs),
+               color,
+               depth,
+               mask,
+               &task->thread_data,
+               stride,
+               depth_stride,
+               sample_stride,
+               depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -552,6 +828,16 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
       lp_rast_end_query(task, lp_rast_arg_query(task->scene->active_queries[i]));
    }
 
+   /* Write the clears of the blocks nothing was drawn to, unless the
+    * z/stencil buffer contents were discarded.
+    */
+   for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
+      if (task->color_clear_blocks[i])
+         lp_rast_flush_color_clear(task, i, task->color_clear_blocks[i]);
+   }
+   if (task->zs_clear_blocks && !task->scene->zs_discard)
+      lp_rast_flush_zs_clear(task, task->zs_clear_blocks);
+
    /* debug */
    memset(task->color_tiles, 0, sizeof(task->color_tiles));
    task->depth_tile = NULL;
@@ -593,11 +879,106 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
 };
 
 
+/**
+ * Hierarchical z bound of the part of the current tile inside the
+ * framebuffer.
+ */
+static float
+hiz_tile_max(const struct lp_rasterizer_task *task)
+{
+   const unsigned nx = (task->width + 15) / 16;
+   const unsigned ny = (task->height + 15) / 16;
+   float zmax = -FLT_MAX;
+   unsigned x, y;
+
+   for (y = 0; y < ny; y++)
+      for (x = 0; x < nx; x++)
+         zmax = MAX2(zmax, task->hiz[y * 4 + x]);
+
+   return zmax;
+}
+
+
+/**
+ * Hierarchical z for a command about to be executed.  Returns TRUE if
+ * the command draws a primitive which is hidden in the whole tile, and
+ * can be skipped.
+ */
+static boolean
+hiz_cull_cmd(struct lp_rasterizer_task *task,
+             unsigned cmd, const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_shader_inputs *inputs;
+   unsigned hiz, i;
+   float zmin, zmax;
+
+   switch (cmd) {
+   case LP_RAST_OP_CLEAR_COLOR:
+   case LP_RAST_OP_CLEAR_ZSTENCIL:
+   case LP_RAST_OP_BEGIN_QUERY:
+   case LP_RAST_OP_END_QUERY:
+   case LP_RAST_OP_SET_STATE:
+      return FALSE;
+   case LP_RAST_OP_SHADE_TILE:
+   case LP_RAST_OP_SHADE_TILE_OPAQUE:
+      inputs = arg.shade_tile;
+      break;
+   default:
+      inputs = &arg.triangle.tri->inputs;
+      break;
+   }
+
+   if (inputs->disable)
+      return FALSE;
+
+   assert(task->state);
+   hiz = task->state->variant->hiz;
+
+   if (hiz & LP_HIZ_INVALIDATE) {
+      for (i = 0; i < Elements(task->hiz); i++)
+         task->hiz[i] = FLT_MAX;
+   }
+   else if (hiz & LP_HIZ_TEST) {
+      lp_rast_depth_bounds(inputs, task->x, task->y,
+                           task->x + task->width - 1,
+                           task->y + task->height - 1,
+                           &zmin, &zmax);
+      if (MIN2(zmin, 1.0f) > hiz_tile_max(task) + task->scene->hiz_eps) {
+         LP_COUNT(nr_hiz_rejected_64);
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Whether the command draws with a fragment shader variant whose code
+ * failed to compile in the background, see generate_variant().
+ */
+static inline boolean
+shader_failed_cmd(const struct lp_rasterizer_task *task, unsigned cmd)
+{
+   switch (cmd) {
+   case LP_RAST_OP_CLEAR_COLOR:
+   case LP_RAST_OP_CLEAR_ZSTENCIL:
+   case LP_RAST_OP_BEGIN_QUERY:
+   case LP_RAST_OP_END_QUERY:
+   case LP_RAST_OP_SET_STATE:
+      return FALSE;
+   default:
+      return task->state && task->state->variant->compile_job.failed;
+   }
+}
+
+
 static void
 do_rasterize_bin(struct lp_rasterizer_task *task,
                  const struct cmd_bin *bin,
                  int x, int y)
 {
+   const boolean hiz = task->scene->hiz;
    const struct cmd_block *block;
    unsigned k;
 
@@ -606,6 +987,12 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
+         if (hiz && hiz_cull_cmd(task, block->cmd[k], block->arg[k]))
+            continue;
+
+         if (shader_failed_cmd(task, block->cmd[k]))
+            continue;
+
          dispatch[block->cmd[k]]( task, block->arg[k] );
       }
    }
@@ -641,20 +1028,6 @@ rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
-/* An empty bin is one that just loads the contents of the tile and
- * stores them again unchanged.  This typically happens when bins have
- * been flushed for some reason in the middle of a frame, or when
- * incremental updates are being made to a render target.
- * 
- * Try to avoid doing pointless work in this case.
- */
-static boolean
-is_empty_bin( const struct cmd_bin *bin )
-{
-   return bin->head == NULL;
-}
-
-
 /**
  * Rasterize/execute all bins within a scene.
  * Called per thread.
@@ -680,13 +1053,20 @@ rasterize_scene(struct lp_rasterizer_task *task,
       /* loop over scene bins, rasterize each */
       {
          struct cmd_bin *bin;
+         boolean stolen;
          int i, j;
+         int64_t t0 = os_time_get();
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
-               rasterize_bin(task, bin, i, j);
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j, &stolen))) {
+            rasterize_bin(task, bin, i, j);
+            task->bins_rasterized++;
+            task->bins_stolen += stolen;
+            task->stats[LP_STAT_BINS_RASTERIZED]++;
          }
+
+         task->stats[LP_STAT_RAST_TIME] += os_time_get() - t0;
       }
    }
 
@@ -705,10 +1085,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -722,6 +1098,8 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
 
+   lp_fence_reference(&rast->last_fence, scene->fence);
+
    if (rast->num_threads == 0) {
       /* no threading */
       unsigned fpstate = util_fpstate_get();
@@ -757,19 +1135,41 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Wait until all scenes queued so far have been rasterized.
+ * The caller must hold the screen's rast_mutex.
+ */
 void
 lp_rast_finish( struct lp_rasterizer *rast )
 {
-   if (rast->num_threads == 0) {
-      /* nothing to do */
+   if (rast->last_fence && lp_fence_issued(rast->last_fence)) {
+      lp_fence_wait(rast->last_fence);
    }
-   else {
-      int i;
+}
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
+
+/**
+ * Print how long each rasterizer thread spent working on the last scene
+ * and how long it sat idle waiting for the other threads to finish.
+ * Called by thread[0] once all threads are done with the scene.
+ */
+static void
+lp_rast_print_sched_stats(struct lp_rasterizer *rast, int64_t scene_time)
+{
+   unsigned i;
+
+   debug_printf("llvmpipe: scene rasterized in %.3f ms\n",
+                scene_time / 1000.0);
+
+   for (i = 0; i < rast->num_threads; i++) {
+      const struct lp_rasterizer_task *task = &rast->tasks[i];
+      int64_t idle_time = scene_time - task->busy_time;
+
+      debug_printf("llvmpipe:   thread %2u: bins %5u (stolen %5u) "
+                   "busy %8.3f ms idle %8.3f ms (%3.0f%%)\n",
+                   i, task->bins_rasterized, task->bins_stolen,
+                   task->busy_time / 1000.0, idle_time / 1000.0,
+                   scene_time ? 100.0 * idle_time / scene_time : 0.0);
    }
 }
 
@@ -788,10 +1188,16 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    boolean debug = false;
    char thread_name[16];
    unsigned fpstate;
+   int64_t scene_start = 0;
 
    util_snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    pipe_thread_setname(thread_name);
 
+   if (task->cpu >= 0 && !pipe_thread_set_affinity(task->cpu)) {
+      debug_printf("llvmpipe: failed to pin thread %u to cpu %d\n",
+                   task->thread_index, task->cpu);
+   }
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -825,23 +1231,31 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
+      task->bins_rasterized = 0;
+      task->bins_stolen = 0;
+      if (LP_DEBUG & DEBUG_SCHED)
+         scene_start = os_time_get();
+
       rasterize_scene(task,
                       rast->curr_scene);
-      
+
+      if (LP_DEBUG & DEBUG_SCHED)
+         task->busy_time = os_time_get() - scene_start;
+
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
 
+      if ((LP_DEBUG & DEBUG_SCHED) && task->thread_index == 0)
+         lp_rast_print_sched_stats(rast, os_time_get() - scene_start);
+
       /* XXX: shouldn't be necessary:
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -852,6 +1266,133 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
 }
 
 
+struct lp_cpu_slot {
+   int cpu;
+   int key;    /**< package, or -1 for the package we prefer */
+   int rank;   /**< index of the cpu within its package */
+};
+
+
+static int
+cmp_cpu_slot_package(const void *a, const void *b)
+{
+   const struct lp_cpu_slot *sa = a, *sb = b;
+   if (sa->key != sb->key)
+      return sa->key - sb->key;
+   return sa->cpu - sb->cpu;
+}
+
+
+static int
+cmp_cpu_slot_rank(const void *a, const void *b)
+{
+   const struct lp_cpu_slot *sa = a, *sb = b;
+   if (sa->rank != sb->rank)
+      return sa->rank - sb->rank;
+   return cmp_cpu_slot_package(a, b);
+}
+
+
+/**
+ * Choose the CPU each rasterizer thread gets pinned to, according to the
+ * LP_THREAD_AFFINITY policy:
+ *
+ *  - none: threads aren't pinned, and may migrate freely (default)
+ *  - local: fill the CPUs of the socket the screen is created on first,
+ *    which is where the application thread has been touching (and hence
+ *    allocating) the framebuffer and texture memory
+ *  - compact: fill the sockets one after another
+ *  - scatter: distribute threads round-robin across the sockets
+ *
+ * Only CPUs in the affinity mask of the creating thread are used.  Threads
+ * beyond the number of those CPUs wrap around.
+ */
+static void
+assign_thread_cpus(struct lp_rasterizer *rast)
+{
+   const char *policy = debug_get_option("LP_THREAD_AFFINITY", "none");
+   unsigned nr_cpus;
+   unsigned *cpus;
+   struct lp_cpu_slot *slots;
+   int local_package = -1;
+   unsigned i;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      rast->tasks[i].cpu = -1;
+   }
+
+   if (rast->num_threads == 0 || strcmp(policy, "none") == 0)
+      return;
+
+   if (strcmp(policy, "local") != 0 &&
+       strcmp(policy, "compact") != 0 &&
+       strcmp(policy, "scatter") != 0) {
+      debug_printf("llvmpipe: unknown LP_THREAD_AFFINITY policy \"%s\"\n",
+                   policy);
+      return;
+   }
+
+   /* Only pick CPUs we may run on, which aren't necessarily numbered
+    * 0..nr_cpus-1 when some are offline or the process is in a cpuset.
+    */
+   nr_cpus = os_get_allowed_cpus(NULL, 0);
+   if (nr_cpus == 0) {
+      nr_cpus = MAX2(1, util_cpu_caps.nr_cpus);
+      cpus = MALLOC(nr_cpus * sizeof *cpus);
+      if (!cpus)
+         return;
+      for (i = 0; i < nr_cpus; i++)
+         cpus[i] = i;
+   }
+   else {
+      cpus = MALLOC(nr_cpus * sizeof *cpus);
+      if (!cpus)
+         return;
+      nr_cpus = MIN2(nr_cpus, os_get_allowed_cpus(cpus, nr_cpus));
+      if (nr_cpus == 0) {
+         FREE(cpus);
+         return;
+      }
+   }
+
+   slots = MALLOC(nr_cpus * sizeof *slots);
+   if (!slots) {
+      FREE(cpus);
+      return;
+   }
+
+   if (strcmp(policy, "local") == 0) {
+      int cpu = os_get_current_cpu();
+      if (cpu >= 0)
+         local_package = os_get_cpu_package(cpu);
+   }
+
+   for (i = 0; i < nr_cpus; i++) {
+      int package = os_get_cpu_package(cpus[i]);
+      slots[i].cpu = cpus[i];
+      slots[i].key = (package >= 0 && package == local_package) ? -1 : package;
+   }
+
+   qsort(slots, nr_cpus, sizeof *slots, cmp_cpu_slot_package);
+
+   for (i = 0; i < nr_cpus; i++) {
+      slots[i].rank = (i > 0 && slots[i].key == slots[i - 1].key) ?
+                      slots[i - 1].rank + 1 : 0;
+   }
+
+   if (strcmp(policy, "scatter") == 0)
+      qsort(slots, nr_cpus, sizeof *slots, cmp_cpu_slot_rank);
+
+   for (i = 0; i < rast->num_threads; i++) {
+      rast->tasks[i].cpu = slots[i % nr_cpus].cpu;
+      LP_DBG(DEBUG_RAST, "thread %u -> cpu %d\n", i, rast->tasks[i].cpu);
+   }
+
+   FREE(slots);
+   FREE(cpus);
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -892,6 +1433,16 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   if (!rast->tasks) {
+      goto no_tasks;
+   }
+
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof *rast->threads);
+   if (!rast->threads) {
+      goto no_threads;
+   }
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
@@ -907,6 +1458,8 @@ lp_rast_create( unsigned num_threads )
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
 
+   assign_thread_cpus(rast);
+
    create_rast_threads(rast);
 
    /* for synchronizing rasterization threads */
@@ -919,12 +1472,16 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
 
+   FREE(rast->threads);
+no_threads:
+   FREE(rast->tasks);
+no_tasks:
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -975,6 +1532,10 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   lp_fence_reference(&rast->last_fence, NULL);
+
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
@@ -37,9 +37,12 @@
 #ifndef LP_RAST_H
 #define LP_RAST_H
 
+#include <float.h>
 #include "pipe/p_compiler.h"
+#include "util/u_math.h"
 #include "util/u_pack_color.h"
 #include "lp_jit.h"
+#include "lp_limits.h"
 
 
 struct lp_rasterizer;
@@ -100,7 +103,8 @@ struct lp_rast_shader_inputs {
    unsigned frontfacing:1;      /** True for front-facing */
    unsigned disable:1;          /** Partially binned, disable this command */
    unsigned opaque:1;           /** Is opaque */
-   unsigned pad0:29;            /* wasted space */
+   unsigned multisample:1;      /** Per-sample coverage (edge planes are conservative) */
+   unsigned pad0:28;            /* wasted space */
    unsigned stride;             /* how much to advance data between a0, dadx, dady */
    unsigned layer;              /* the layer to render to (from gs, already clamped) */
    unsigned viewport_index;     /* the active viewport index (from gs, already clamped) */
@@ -143,6 +147,64 @@ struct lp_rast_triangle {
 };
 
 
+/**
+ * Coverage mask passed to the fragment shader for fully covered blocks.
+ * Coverage masks hold 16 bits (one per pixel of a 4x4 block) per sample.
+ */
+#define LP_RAST_FULL_MASK (~(uint64_t)0)
+
+
+/**
+ * Farthest distance of a sample from the pixel center along either axis,
+ * in FIXED_ONE units.
+ */
+#define LP_MAX_SAMPLE_OFFSET (6 * FIXED_ONE / 16)
+
+
+/**
+ * Sample positions of multisample surfaces, relative to the pixel center,
+ * in FIXED_ONE units.  This is the standard 4x pattern.
+ */
+extern const int lp_sample_pos[LP_MAX_SAMPLES][2];
+
+
+/**
+ * Expand the single-sample coverage mask of a 4x4 block to all samples.
+ */
+static inline uint64_t
+lp_rast_replicate_mask(unsigned mask)
+{
+   return (uint64_t)(mask & 0xffff) * 0x0001000100010001ULL;
+}
+
+
+/**
+ * The amount by which the c value of a triangle edge is increased for
+ * multisampled triangles, so that the edge covers every pixel with at
+ * least one covered sample.  Computed from the scaled dcdx/dcdy.
+ */
+static inline int64_t
+lp_rast_sample_margin(int32_t dcdx, int32_t dcdy)
+{
+   return IMUL64((abs(dcdx) >> FIXED_ORDER) + (abs(dcdy) >> FIXED_ORDER),
+                 LP_MAX_SAMPLE_OFFSET);
+}
+
+
+/**
+ * Offset to add to the c value of an edge of a multisampled triangle to
+ * evaluate the edge at sample s rather than with the conservative margin
+ * at the pixel center.
+ */
+static inline int64_t
+lp_rast_sample_offset(const struct lp_rast_plane *plane, unsigned s)
+{
+   return IMUL64(plane->dcdy >> FIXED_ORDER, lp_sample_pos[s][1]) -
+          IMUL64(plane->dcdx >> FIXED_ORDER, lp_sample_pos[s][0]) -
+          lp_rast_sample_margin(plane->dcdx, plane->dcdy);
+}
+
+
 struct lp_rast_clear_rb {
    union util_color color_val;
    unsigned cbuf;
@@ -155,6 +217,31 @@ struct lp_rast_clear_rb {
 #define GET_PLANES(tri) ((struct lp_rast_plane *)((char *)(&(tri)->inputs + 1) + 3 * (tri)->inputs.stride))
 
 
+/**
+ * Conservative bounds of a primitive's depth over the pixels x0..x1,
+ * y0..y1 (inclusive), from the position plane.  The area is grown by a
+ * pixel, so that the bounds also hold at the sample positions, and the
+ * bounds by the rounding error of evaluating the plane.
+ */
+static inline void
+lp_rast_depth_bounds(const struct lp_rast_shader_inputs *inputs,
+                     int x0, int y0, int x1, int y1,
+                     float *zmin, float *zmax)
+{
+   const float z0 = GET_A0(inputs)[0][2];
+   const float zx0 = GET_DADX(inputs)[0][2] * (float) (x0 - 1);
+   const float zx1 = GET_DADX(inputs)[0][2] * (float) (x1 + 1);
+   const float zy0 = GET_DADY(inputs)[0][2] * (float) (y0 - 1);
+   const float zy1 = GET_DADY(inputs)[0][2] * (float) (y1 + 1);
+   const float err = (fabsf(z0) +
+                      MAX2(fabsf(zx0), fabsf(zx1)) +
+                      MAX2(fabsf(zy0), fabsf(zy1))) * (4 * FLT_EPSILON);
+
+   *zmin = z0 + MIN2(zx0, zx1) + MIN2(zy0, zy1) - err;
+   *zmax = z0 + MAX2(zx0, zx1) + MAX2(zy0, zy1) + err;
+}
+
+
 
 struct lp_rasterizer *
 lp_rast_create( unsigned num_threads );
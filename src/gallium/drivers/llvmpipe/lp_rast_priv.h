@@ -30,8 +30,10 @@
 
 #include "os/os_thread.h"
 #include "util/u_format.h"
+#include "util/u_pack_color.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
+#include "lp_perf.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
 #include "lp_state.h"
@@ -91,17 +93,40 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /** Hierarchical z: bound of the depth values of each 16x16 block */
+   float hiz[16];
+
+   /** Clears not yet written to the tile: masks of the 16x16 blocks still
+    * to clear, see lp_rast_flush_color_clear() / lp_rast_flush_zs_clear().
+    */
+   unsigned color_clear_blocks[PIPE_MAX_COLOR_BUFS];
+   union util_color color_clear_value[PIPE_MAX_COLOR_BUFS];
+   unsigned zs_clear_blocks;
+   uint64_t zs_clear_value;
+   uint64_t zs_clear_mask;
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
    /** "my" index */
    unsigned thread_index;
 
+   /** CPU this thread is pinned to, or -1 (see LP_THREAD_AFFINITY) */
+   int cpu;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
+   /** Bin scheduling statistics for the current scene */
+   unsigned bins_rasterized;
+   unsigned bins_stolen;
+   int64_t busy_time;   /**< in microseconds, only with LP_DEBUG=sched */
+
+   /** Driver query counts for the current scene, LP_STAT_x */
+   uint64_t stats[LP_STAT_COUNT];
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -123,11 +148,14 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
+   /** Fence of the last scene queued, see lp_rast_finish() */
+   struct lp_fence *last_fence;
+
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   pipe_thread *threads;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
@@ -138,11 +166,61 @@ void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask);
+                         uint64_t mask);
+
+
+/**
+ * Hierarchical z: whether a primitive lies behind the depth values of
+ * 16x16 block i of the current tile, so that it would fail the depth
+ * test (which must be LESS or LEQUAL) everywhere.
+ */
+static inline boolean
+lp_rast_hiz_hidden_16(const struct lp_rasterizer_task *task,
+                      const struct lp_rast_shader_inputs *inputs,
+                      unsigned i)
+{
+   const int x = task->x + (i & 3) * 16;
+   const int y = task->y + (i >> 2) * 16;
+   float zmin, zmax;
+
+   lp_rast_depth_bounds(inputs, x, y, x + 15, y + 15, &zmin, &zmax);
+
+   /* unorm depth values get clamped to one */
+   return MIN2(zmin, 1.0f) > task->hiz[i] + task->scene->hiz_eps;
+}
+
+
+/**
+ * Hierarchical z: a primitive with LP_HIZ_UPDATE state was drawn over
+ * all of 16x16 block i, so the block's depth values are no larger than
+ * the primitive's.
+ */
+static inline void
+lp_rast_hiz_cover_16(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned i)
+{
+   const int x = task->x + (i & 3) * 16;
+   const int y = task->y + (i >> 2) * 16;
+   float zmin, zmax;
+
+   lp_rast_depth_bounds(inputs, x, y, x + 15, y + 15, &zmin, &zmax);
+
+   task->hiz[i] = MIN2(task->hiz[i], zmax);
+}
+
+
+void
+lp_rast_flush_color_clear(struct lp_rasterizer_task *task,
+                          unsigned cbuf, unsigned blocks);
+
+void
+lp_rast_flush_zs_clear(struct lp_rasterizer_task *task, unsigned blocks);
 
 
 /**
  * Get the pointer to a 4x4 color block (within a 64x64 tile).
+ * Writes the pending clear of the surrounding 16x16 block first, if any.
  * \param x, y location of 4x4 block in window coords
  */
 static inline uint8_t *
@@ -169,6 +247,12 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
    px = x % TILE_SIZE;
    py = y % TILE_SIZE;
 
+   if (task->color_clear_blocks[buf]) {
+      unsigned block = 1 << ((py / 16) * 4 + px / 16);
+      if (task->color_clear_blocks[buf] & block)
+         lp_rast_flush_color_clear(task, buf, block);
+   }
+
    pixel_offset = px * task->scene->cbufs[buf].format_bytes +
                   py * task->scene->cbufs[buf].stride;
    color = task->color_tiles[buf] + pixel_offset;
@@ -184,6 +268,7 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
 
 /**
  * Get the pointer to a 4x4 depth block (within a 64x64 tile).
+ * Writes the pending clear of the surrounding 16x16 block first, if any.
  * \param x, y location of 4x4 block in window coords
  */
 static inline uint8_t *
@@ -203,6 +288,12 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
    px = x % TILE_SIZE;
    py = y % TILE_SIZE;
 
+   if (task->zs_clear_blocks) {
+      unsigned block = 1 << ((py / 16) * 4 + px / 16);
+      if (task->zs_clear_blocks & block)
+         lp_rast_flush_zs_clear(task, block);
+   }
+
    pixel_offset = px * task->scene->zsbuf.format_bytes +
                   py * task->scene->zsbuf.stride;
    depth = task->depth_tile + pixel_offset;
@@ -230,21 +321,26 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    const struct lp_scene *scene = task->scene;
    const struct lp_rast_state *state = task->state;
    struct lp_fragment_shader_variant *variant = state->variant;
+   lp_jit_frag_func jit_func;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -252,6 +348,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    if (scene->zsbuf.map) {
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.sample_stride;
    }
 
    /*
@@ -267,19 +364,22 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
       /* run shader on 4x4 block */
+      jit_func = lp_fs_variant_jit_function(variant, RAST_WHOLE);
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                         x, y,
-                                         inputs->frontfacing,
-                                         GET_A0(inputs),
-                                         GET_DADX(inputs),
-                                         GET_DADY(inputs),
-                                         color,
-                                         depth,
-                                         0xffff,
-                                         &task->thread_data,
-                                         stride,
-                                         depth_stride);
+      jit_func( &state->jit_context,
+                x, y,
+                inputs->frontfacing,
+                GET_A0(inputs),
+                GET_DADX(inputs),
+                GET_DADY(inputs),
+                color,
+                depth,
+                LP_RAST_FULL_MASK,
+                &task->thread_data,
+                stride,
+                depth_stride,
+                sample_stride,
+                depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -67,6 +67,46 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
       lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
 }
 
+/**
+ * Multisample version of do_block_4: evaluate the planes at each sample
+ * position to build a coverage mask per sample.
+ * ms_off holds the per plane and per sample offsets to apply to c.
+ */
+static void
+TAG(do_block_4_ms)(struct lp_rasterizer_task *task,
+                   const struct lp_rast_triangle *tri,
+                   const struct lp_rast_plane *plane,
+                   int x, int y,
+                   const int64_t *c,
+                   const int64_t (*ms_off)[LP_MAX_SAMPLES])
+{
+   uint64_t mask = 0;
+   unsigned s;
+   int j;
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      unsigned smask = 0xffff;
+
+      for (j = 0; j < NR_PLANES; j++) {
+         /*
+          * The sample offsets have arbitrary lower FIXED_ORDER bits, but
+          * as with RASTER_64 dropping them doesn't change the sign.
+          */
+         smask &= ~BUILD_MASK_LINEAR((int32_t)((c[j] + ms_off[j][s] - 1) >>
+                                               (int64_t)FIXED_ORDER),
+                                     -plane[j].dcdx >> FIXED_ORDER,
+                                     plane[j].dcdy >> FIXED_ORDER);
+      }
+
+      mask |= (uint64_t)smask << (16 * s);
+   }
+
+   /* Now pass to the shader:
+    */
+   if (mask)
+      lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+}
+
 /**
  * Evaluate a 16x16 block of pixels to determine which 4x4 subblocks are in/out
  * of the triangle's bounds.
@@ -76,7 +116,8 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
                  const struct lp_rast_triangle *tri,
                  const struct lp_rast_plane *plane,
                  int x, int y,
-                 const int64_t *c)
+                 const int64_t *c,
+                 const int64_t (*ms_off)[LP_MAX_SAMPLES])
 {
    unsigned outmask, inmask, partmask, partial_mask;
    unsigned j;
@@ -130,6 +171,14 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
    LP_COUNT_ADD(nr_empty_4, util_bitcount(0xffff & ~(partial_mask | inmask)));
 
+   /* The edges of multisampled triangles are conservative, so nothing can
+    * be trivially accepted.
+    */
+   if (ms_off) {
+      partial_mask |= inmask;
+      inmask = 0;
+   }
+
    /* Iterate over partials:
     */
    while (partial_mask) {
@@ -149,7 +198,10 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
                   - IMUL64(plane[j].dcdx, ix)
                   + IMUL64(plane[j].dcdy, iy));
 
-      TAG(do_block_4)(task, tri, plane, px, py, cx);
+      if (ms_off)
+         TAG(do_block_4_ms)(task, tri, plane, px, py, cx, ms_off);
+      else
+         TAG(do_block_4)(task, tri, plane, px, py, cx);
    }
 
    /* Iterate over fulls: 
@@ -183,6 +235,9 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
    const int x = task->x, y = task->y;
    struct lp_rast_plane plane[NR_PLANES];
    int64_t c[NR_PLANES];
+   int64_t ms_off[NR_PLANES][LP_MAX_SAMPLES];
+   const boolean multisample = tri->inputs.multisample;
+   const unsigned hiz = task->scene->hiz ? task->state->variant->hiz : 0;
    unsigned outmask, inmask, partmask, partial_mask;
    unsigned j = 0;
 
@@ -200,6 +255,15 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       plane_mask &= ~(1 << i);
       c[j] = plane[j].c + IMUL64(plane[j].dcdy, y) - IMUL64(plane[j].dcdx, x);
 
+      if (multisample) {
+         /* Only the first three planes are triangle edges, the rest are
+          * scissor planes which apply to whole pixels.
+          */
+         unsigned s;
+         for (s = 0; s < LP_MAX_SAMPLES; s++)
+            ms_off[j][s] = i < 3 ? lp_rast_sample_offset(&plane[j], s) : 0;
+      }
+
       {
 #ifdef RASTER_64
          /*
@@ -284,6 +348,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
    LP_COUNT_ADD(nr_empty_16, util_bitcount(0xffff & ~(partial_mask | inmask)));
 
+   if (multisample) {
+      partial_mask |= inmask;
+      inmask = 0;
+   }
+
    /* Iterate over partials:
     */
    while (partial_mask) {
@@ -294,15 +363,22 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       int py = y + iy;
       int64_t cx[NR_PLANES];
 
+      partial_mask &= ~(1 << i);
+
+      if ((hiz & LP_HIZ_TEST) && lp_rast_hiz_hidden_16(task, &tri->inputs, i)) {
+         LP_COUNT(nr_hiz_rejected_16);
+         continue;
+      }
+
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j]
                   - IMUL64(plane[j].dcdx, ix)
                   + IMUL64(plane[j].dcdy, iy));
 
-      partial_mask &= ~(1 << i);
-
       LP_COUNT(nr_partially_covered_16);
-      TAG(do_block_16)(task, tri, plane, px, py, cx);
+      task->stats[LP_STAT_BLOCKS_PARTIALLY_COVERED]++;
+      TAG(do_block_16)(task, tri, plane, px, py, cx,
+                       multisample ? (const int64_t (*)[LP_MAX_SAMPLES])ms_off : NULL);
    }
 
    /* Iterate over fulls: 
@@ -316,8 +392,17 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if ((hiz & LP_HIZ_TEST) && lp_rast_hiz_hidden_16(task, &tri->inputs, i)) {
+         LP_COUNT(nr_hiz_rejected_16);
+         continue;
+      }
+
       LP_COUNT(nr_fully_covered_16);
+      task->stats[LP_STAT_BLOCKS_FULLY_COVERED]++;
       block_full_16(task, tri, px, py);
+
+      if (hiz & LP_HIZ_UPDATE)
+         lp_rast_hiz_cover_16(task, &tri->inputs, i);
    }
 }
 
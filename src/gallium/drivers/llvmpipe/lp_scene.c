@@ -25,15 +25,20 @@
  *
  **************************************************************************/
 
+#include <float.h>
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
 #include "util/simple_list.h"
+#include "util/u_atomic.h"
 #include "util/u_format.h"
+#include "os/os_time.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_compile_queue.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -62,8 +67,6 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -90,7 +93,6 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
    FREE(scene);
@@ -160,6 +162,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       if (!cbuf) {
          scene->cbufs[i].stride = 0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = NULL;
          continue;
       }
@@ -169,6 +172,8 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                            cbuf->u.tex.level);
          scene->cbufs[i].layer_stride = llvmpipe_layer_stride(cbuf->texture,
                                                               cbuf->u.tex.level);
+         scene->cbufs[i].sample_stride = llvmpipe_sample_stride(cbuf->texture,
+                                                                cbuf->u.tex.level);
 
          scene->cbufs[i].map = llvmpipe_resource_map(cbuf->texture,
                                                      cbuf->u.tex.level,
@@ -181,6 +186,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
          unsigned pixstride = util_format_get_blocksize(cbuf->format);
          scene->cbufs[i].stride = cbuf->texture->width0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = lpr->data;
          scene->cbufs[i].map += cbuf->u.buf.first_element * pixstride;
          scene->cbufs[i].format_bytes = util_format_get_blocksize(cbuf->format);
@@ -191,6 +197,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       struct pipe_surface *zsbuf = scene->fb.zsbuf;
       scene->zsbuf.stride = llvmpipe_resource_stride(zsbuf->texture, zsbuf->u.tex.level);
       scene->zsbuf.layer_stride = llvmpipe_layer_stride(zsbuf->texture, zsbuf->u.tex.level);
+      scene->zsbuf.sample_stride = llvmpipe_sample_stride(zsbuf->texture, zsbuf->u.tex.level);
 
       scene->zsbuf.map = llvmpipe_resource_map(zsbuf->texture,
                                                zsbuf->u.tex.level,
@@ -204,12 +211,16 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer after the scene has been rasterized.
+ * Called by the rasterizer.  The scene's commands, data and resource
+ * references are kept until lp_scene_release() is called by the setup
+ * module, so that it can keep checking which resources are in use by
+ * scenes still in flight without racing with the rasterizer threads.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -232,6 +243,17 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
+
+/**
+ * Free all the temporary data in a scene, so that it can be reused for
+ * binning.  Must not be called while the scene is being rasterized.
+ */
+void
+lp_scene_release(struct lp_scene *scene)
+{
+   int i, j;
 
    /* Reset all command lists:
     */
@@ -295,6 +317,7 @@ lp_scene_end_rasterization(struct lp_scene *scene )
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
 
+   scene->num_pending_compiles = 0;
    scene->alloc_failed = FALSE;
 
    util_unreference_framebuffer_state( &scene->fb );
@@ -318,6 +341,11 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
       else {
          bin->head = block;
          bin->tail = block;
+         if (scene->touched_bins) {
+            unsigned i = bin - &scene->tile[0][0];
+            unsigned x = i / TILES_Y, y = i % TILES_Y;
+            scene->touched_bins[scene->num_touched_bins++] = (y << 8) | x;
+         }
       }
       //memset(block, 0, sizeof *block);
       block->next = NULL;
@@ -447,63 +475,237 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
+/**
+ * Wait for a compile job, counting the time spent as a stall.
+ */
+static void
+wait_compile(struct lp_compile_job *job)
+{
+   if (!lp_compile_job_is_done(job)) {
+      int64_t t0 = os_time_get();
+      lp_compile_job_wait(job);
+      LP_COUNT(nr_fs_compile_stalls);
+      LP_COUNT_ADD(fs_compile_stall_time, os_time_get() - t0);
+   }
+}
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Note that the scene uses a shader whose code is still being compiled.
+ */
+void
+lp_scene_add_pending_compile(struct lp_scene *scene,
+                             struct lp_compile_job *job)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   unsigned i;
+
+   if (lp_compile_job_is_done(job))
+      return;
+
+   for (i = 0; i < scene->num_pending_compiles; i++) {
+      if (scene->pending_compiles[i] == job)
+         return;
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+
+   if (scene->num_pending_compiles == LP_SCENE_MAX_PENDING_COMPILES) {
+      /* Rather than growing the list, just wait for it now. */
+      wait_compile(job);
+      return;
    }
-   return TRUE;
+
+   scene->pending_compiles[scene->num_pending_compiles++] = job;
 }
 
 
+/**
+ * Wait for the code of all the shaders used by the scene.  Called before
+ * rasterizing it.
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_wait_pending_compiles(struct lp_scene *scene)
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned i;
+
+   for (i = 0; i < scene->num_pending_compiles; i++) {
+      wait_compile(scene->pending_compiles[i]);
+   }
+
+   scene->num_pending_compiles = 0;
+}
+
+
+
+
+/**
+ * Estimate the cost of rasterizing a bin as the number of commands in it.
+ */
+static unsigned
+bin_cost(const struct cmd_bin *bin)
+{
+   const struct cmd_block *block;
+   unsigned cost = 0;
+
+   for (block = bin->head; block; block = block->next) {
+      cost += block->count;
+   }
+   return cost;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Set up the bin schedule for the given number of rasterizer threads.
+ *
+ * Non-empty bins are listed in serpentine row order, so that consecutive
+ * bins are always neighbours, and the list is cut into one contiguous
+ * range per thread such that each range has roughly the same estimated
+ * cost.  Threads which run out of work steal from the far end of other
+ * threads' ranges (see lp_scene_bin_iter_next()).
+ *
+ * Empty bins are not scheduled at all.  Rasterizing one would just load
+ * the contents of the tile and store them again unchanged, which
+ * typically happens when bins have been flushed in the middle of a
+ * frame, or when incremental updates are made to a render target.
+ */
+void
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads )
+{
+   unsigned total_cost = 0, cost = 0;
+   unsigned num_bins = 0;
+   unsigned x, y, i, q;
+
+   num_threads = MAX2(1, num_threads);
+   assert(num_threads <= LP_MAX_THREADS);
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (i = 0; i < scene->tiles_x; i++) {
+         const struct cmd_bin *bin;
+
+         x = (y & 1) ? scene->tiles_x - 1 - i : i;
+         bin = lp_scene_get_bin(scene, x, y);
+         if (bin->head) {
+            total_cost += bin_cost(bin);
+            scene->bin_order[num_bins++] = (y << 8) | x;
+         }
+      }
+   }
+
+   scene->num_bins = num_bins;
+   scene->num_queues = num_threads;
+
+   /* Split the bin list into ranges of (nearly) equal cost.  Range q ends
+    * at the first bin where the accumulated cost reaches (q+1)/n of the
+    * total.
+    */
+   i = 0;
+   for (q = 0; q < num_threads; q++) {
+      unsigned head = i;
+
+      if (q == num_threads - 1) {
+         i = num_bins;
+      }
+      else {
+         uint64_t target = (uint64_t)total_cost * (q + 1) / num_threads;
+         while (i < num_bins && cost < target) {
+            unsigned pos = scene->bin_order[i++];
+            cost += bin_cost(lp_scene_get_bin(scene, pos & 0xff, pos >> 8));
+         }
+      }
+
+      scene->queues[q].range = LP_BIN_QUEUE_RANGE(head, i);
+   }
+}
+
+
+/**
+ * Pop a bin from the head of a queue.  Only the owning thread does this.
+ */
+static boolean
+bin_queue_pop(struct lp_bin_queue *queue, unsigned *index)
+{
+   uint32_t range = p_atomic_read(&queue->range);
+
+   for (;;) {
+      unsigned head = LP_BIN_QUEUE_HEAD(range);
+      unsigned tail = LP_BIN_QUEUE_TAIL(range);
+      uint32_t old;
+
+      if (head >= tail)
+         return FALSE;
+
+      old = p_atomic_cmpxchg(&queue->range, range,
+                             LP_BIN_QUEUE_RANGE(head + 1, tail));
+      if (old == range) {
+         *index = head;
+         return TRUE;
+      }
+      range = old;
+   }
+}
+
+
+/**
+ * Steal a bin from the tail of another thread's queue.  Stealing from the
+ * far end keeps the victim walking through neighbouring tiles.
+ */
+static boolean
+bin_queue_steal(struct lp_bin_queue *queue, unsigned *index)
+{
+   uint32_t range = p_atomic_read(&queue->range);
+
+   for (;;) {
+      unsigned head = LP_BIN_QUEUE_HEAD(range);
+      unsigned tail = LP_BIN_QUEUE_TAIL(range);
+      uint32_t old;
+
+      if (head >= tail)
+         return FALSE;
+
+      old = p_atomic_cmpxchg(&queue->range, range,
+                             LP_BIN_QUEUE_RANGE(head, tail - 1));
+      if (old == range) {
+         *index = tail - 1;
+         return TRUE;
+      }
+      range = old;
+   }
+}
+
+
+/**
+ * Return pointer to next bin to be rendered by the given thread, or NULL
+ * when all bins of the scene have been handed out.
+ * Each rasterizer thread first drains its own range of bins, and then
+ * steals bins from the other threads.  No locks are taken.
+ * \param stolen  returns whether the bin came from another thread's range
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y, boolean *stolen )
 {
-   struct cmd_bin *bin = NULL;
+   unsigned num_queues = scene->num_queues;
+   unsigned index, i;
 
-   pipe_mutex_lock(scene->mutex);
+   assert(thread_index < num_queues);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
+   if (bin_queue_pop(&scene->queues[thread_index], &index)) {
+      *stolen = FALSE;
    }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   else {
+      for (i = 1; i < num_queues; i++) {
+         unsigned victim = (thread_index + i) % num_queues;
+         if (bin_queue_steal(&scene->queues[victim], &index))
+            break;
+      }
+      if (i == num_queues)
+         return NULL;
+      *stolen = TRUE;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   assert(index < scene->num_bins);
+   *x = scene->bin_order[index] & 0xff;
+   *y = scene->bin_order[index] >> 8;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   return lp_scene_get_bin(scene, *x, *y);
 }
 
 
@@ -546,6 +748,49 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+   scene->fb_samples = util_framebuffer_get_num_samples(fb);
+
+   scene->zs_discard = FALSE;
+
+   /*
+    * Layered rendering would need summaries for each layer, don't bother.
+    */
+   scene->hiz = FALSE;
+   if (fb->zsbuf && max_layer == 0 && !(LP_PERF & PERF_NO_HIZ)) {
+      enum pipe_format format = fb->zsbuf->format;
+
+      if (util_format_has_depth(util_format_description(format))) {
+         unsigned bits = util_format_get_component_bits(format,
+                                                        UTIL_FORMAT_COLORSPACE_ZS,
+                                                        0);
+         scene->hiz = TRUE;
+         scene->hiz_zmask = util_pack64_mask_z_stencil(format, ~0, 0);
+         if (util_format_is_float(format))
+            scene->hiz_eps = 2 * FLT_EPSILON;
+         else
+            scene->hiz_eps = 2.0f / (float) ((1ULL << bits) - 1);
+
+         /* The depth buffer's contents are unknown */
+         lp_scene_hiz_set(scene, FLT_MAX);
+      }
+   }
+}
+
+
+/**
+ * Set the hierarchical z bound of all bins, when the depth buffer is
+ * cleared or its contents become unknown.
+ */
+void
+lp_scene_hiz_set(struct lp_scene *scene, float z)
+{
+   unsigned x, y;
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         lp_scene_get_bin(scene, x, y)->hiz_max = z;
+      }
+   }
 }
 
 
@@ -41,6 +41,7 @@
 
 struct lp_scene_queue;
 struct lp_rast_state;
+struct lp_compile_job;
 
 /* We're limited to 2K by 2K for 32bit fixed point rasterization.
  * Will need a 64-bit version for larger framebuffers.
@@ -67,6 +68,11 @@ struct lp_rast_state;
  */
 #define LP_SCENE_MAX_RESOURCE_SIZE (64*1024*1024)
 
+/* Max number of shader variants still being compiled which a scene can
+ * refer to.  Binning waits for the compile beyond that.
+ */
+#define LP_SCENE_MAX_PENDING_COMPILES 16
+
 
 /* switch to a non-pointer value for this:
  */
@@ -97,6 +103,7 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;       /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   float hiz_max;   /**< bound of the tile's depth after the commands so far */
 };
    
 
@@ -117,6 +124,23 @@ struct data_block_list {
 
 struct resource_ref;
 
+
+/**
+ * A range of bins (indices into lp_scene::bin_order) owned by one
+ * rasterizer thread.  The head and tail indices are packed into a single
+ * word so that the owning thread (which pops bins at the head) and other
+ * threads (which steal bins at the tail) can both update the range with
+ * a single compare-and-swap, without taking a lock.
+ */
+struct lp_bin_queue {
+   uint32_t range;   /**< (tail << 16) | head */
+};
+
+#define LP_BIN_QUEUE_HEAD(range) ((range) & 0xffff)
+#define LP_BIN_QUEUE_TAIL(range) ((range) >> 16)
+#define LP_BIN_QUEUE_RANGE(head, tail) (((uint32_t)(tail) << 16) | (head))
+
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -142,12 +166,32 @@ struct lp_scene {
       uint8_t *map;
       unsigned stride;
       unsigned layer_stride;
+      unsigned sample_stride;
       unsigned format_bytes;
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* The number of samples per pixel of the fb (1 if single-sampled) */
+   unsigned fb_samples;
+
+   /**
+    * Hierarchical z.  Setup and rasterizer both keep an upper bound of
+    * the depth values of each tile (or block), to reject primitives
+    * which lie behind it.  hiz_eps covers the rounding of depth values
+    * to the zsbuf format, hiz_zmask is the depth part of clear masks.
+    */
+   boolean hiz;
+   float hiz_eps;
+   uint64_t hiz_zmask;
+
+   /**
+    * The z/stencil buffer's contents were invalidated after the last
+    * clear, so clears of blocks nothing was drawn to needn't be written.
+    */
+   boolean zs_discard;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
@@ -165,6 +209,20 @@ struct lp_scene {
     */
    unsigned resource_reference_size;
 
+   /** Compile jobs of the shaders used by the scene which were not done
+    * yet at binning time.  Rasterization waits for them.
+    */
+   struct lp_compile_job *pending_compiles[LP_SCENE_MAX_PENDING_COMPILES];
+   unsigned num_pending_compiles;
+
+   /**
+    * If non-NULL, bins which get their first command block are appended
+    * here, packed as (y << 8) | x.  Only set for the private scenes of
+    * parallel binning, see lp_setup_parallel.c.
+    */
+   uint16_t *touched_bins;
+   unsigned num_touched_bins;
+
    boolean alloc_failed;
    boolean discard;
    /**
@@ -173,8 +231,16 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /**
+    * Bin scheduling state, set up by lp_scene_bin_iter_begin().
+    * bin_order holds the non-empty bins, packed as (y << 8) | x, in a
+    * spatially coherent order; each rasterizer thread is seeded with a
+    * contiguous range of it of roughly equal estimated cost.
+    */
+   unsigned num_bins;
+   unsigned num_queues;
+   struct lp_bin_queue queues[LP_MAX_THREADS];
+   uint16_t bin_order[TILES_X * TILES_Y];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -202,6 +268,11 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
 boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                         const struct pipe_resource *resource );
 
+void lp_scene_add_pending_compile(struct lp_scene *scene,
+                                  struct lp_compile_job *job);
+
+void lp_scene_wait_pending_compiles(struct lp_scene *scene);
+
 
 /**
  * Allocate space for a command/data in the bin's data buffer.
@@ -293,6 +364,9 @@ lp_scene_get_bin(struct lp_scene *scene, unsigned x, unsigned y)
 void
 lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y);
 
+void
+lp_scene_hiz_set(struct lp_scene *scene, float z);
+
 
 /* Add a command to bin[x][y].
  */
@@ -379,10 +453,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y, boolean *stolen );
 
 
 
@@ -405,6 +480,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_release(struct lp_scene *scene);
+
 
 
 
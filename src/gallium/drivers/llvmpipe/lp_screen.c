@@ -46,8 +46,12 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_public.h"
+#include "lp_query.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_cs_tpool.h"
+#include "lp_state_cs.h"
+#include "lp_compile_queue.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -67,6 +71,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "fence", DEBUG_FENCE, NULL },
    { "mem", DEBUG_MEM, NULL },
    { "fs", DEBUG_FS, NULL },
+   { "sched", DEBUG_SCHED, NULL },
    DEBUG_NAMED_VALUE_END
 };
 #endif
@@ -81,6 +86,9 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_tiling",      PERF_NO_TILED_TEX, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_early_cull",  PERF_NO_EARLY_CULL, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -210,7 +218,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
-      return 0;
+      return LP_HAVE_COMPUTE;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
       return 1;
@@ -352,9 +360,57 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
       default:
          return draw_get_shader_param(shader, param);
       }
+   case PIPE_SHADER_COMPUTE:
+      switch (param) {
+      case PIPE_SHADER_CAP_MAX_TEXTURE_SAMPLERS:
+      case PIPE_SHADER_CAP_MAX_SAMPLER_VIEWS:
+      case PIPE_SHADER_CAP_MAX_SHADER_IMAGES:
+         return 0;
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return LP_MAX_TGSI_SHADER_BUFFERS;
+      default:
+         return gallivm_get_shader_param(param);
+      }
+   default:
+      return 0;
+   }
+}
+
+static int
+llvmpipe_get_compute_param(struct pipe_screen *_screen,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+
+#define RET(x) do {                  \
+   if (ret)                          \
+      memcpy(ret, x, sizeof(x));     \
+   return sizeof(x);                 \
+} while (0)
+
+   switch (param) {
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+      RET((uint64_t []) { 3 });
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      RET(((uint64_t []) { 65535, 65535, 65535 }));
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      RET(((uint64_t []) { 1024, 1024, 1024 }));
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      RET((uint64_t []) { 1024 });
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      RET((uint64_t []) { 32768 });
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+      RET((uint32_t []) { MAX2(screen->num_threads, 1) });
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+      RET((uint32_t []) { lp_native_vector_width / 32 });
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+      RET((uint32_t []) { 0 });
    default:
       return 0;
    }
+
+#undef RET
 }
 
 static float
@@ -415,8 +471,22 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
           target == PIPE_TEXTURE_CUBE ||
           target == PIPE_TEXTURE_CUBE_ARRAY);
 
-   if (sample_count > 1)
-      return FALSE;
+   /*
+    * Multisampling is only supported for render targets and depth/stencil
+    * buffers, which need to be resolved with a blit before sampling.
+    */
+   if (sample_count > 1) {
+      if (sample_count != LP_MAX_SAMPLES)
+         return FALSE;
+      if (target != PIPE_TEXTURE_2D &&
+          target != PIPE_TEXTURE_2D_ARRAY &&
+          target != PIPE_TEXTURE_RECT)
+         return FALSE;
+      if (bind & ~(PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL))
+         return FALSE;
+      if (util_format_is_pure_integer(format))
+         return FALSE;
+   }
 
    if (bind & PIPE_BIND_RENDER_TARGET) {
       if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB) {
@@ -511,6 +581,14 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
 
    assert(texture->dt);
+
+   /* Flushing a context doesn't wait for the rasterizer any more, so make
+    * sure rendering to the display target has completed.
+    */
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_rast_finish(screen->rast);
+   pipe_mutex_unlock(screen->rast_mutex);
+
    if (texture->dt)
       winsys->displaytarget_display(winsys, texture->dt, context_private, sub_box);
 }
@@ -521,6 +599,12 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   if (screen->compile_queue)
+      lp_compile_queue_destroy(screen->compile_queue);
+
+   if (screen->cs_tpool)
+      lp_cs_tpool_destroy(screen->cs_tpool);
+
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
@@ -610,6 +694,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_device_vendor = llvmpipe_get_vendor; // TODO should be the CPU vendor
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
@@ -619,6 +704,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
+   screen->base.get_driver_query_group_info = llvmpipe_get_driver_query_group_info;
 
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
@@ -637,6 +724,17 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    pipe_mutex_init(screen->rast_mutex);
 
+   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
+   if (!screen->cs_tpool) {
+      lp_rast_destroy(screen->rast);
+      lp_jit_screen_cleanup(screen);
+      FREE(screen);
+      return NULL;
+   }
+
+   screen->compile_queue =
+      lp_compile_queue_create(debug_get_num_option("LP_NUM_COMPILE_THREADS", 0));
+
    util_format_s3tc_init();
 
    return &screen->base;
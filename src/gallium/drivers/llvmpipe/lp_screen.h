@@ -41,6 +41,8 @@
 
 
 struct sw_winsys;
+struct lp_compile_queue;
+struct lp_cs_tpool;
 
 
 struct llvmpipe_screen
@@ -57,6 +59,12 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /* Background shader compilation, NULL if disabled */
+   struct lp_compile_queue *compile_queue;
+
+   /* Compute shader threads */
+   struct lp_cs_tpool *cs_tpool;
 };
 
 
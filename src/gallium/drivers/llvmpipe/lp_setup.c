@@ -33,6 +33,7 @@
  */
 
 #include <limits.h>
+#include <float.h>
 
 #include "pipe/p_defines.h"
 #include "util/u_framebuffer.h"
@@ -73,14 +74,24 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
 
    setup->scene = setup->scenes[setup->scene_idx];
 
+   /* The scenes are used round-robin, so this is the oldest one.  Wait for
+    * the rasterizer to be done with it, if it's still in flight.
+    */
    if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
-      lp_fence_wait(setup->scene->fence);
+      if (lp_fence_issued(setup->scene->fence)) {
+         int64_t t0 = os_time_get();
+         lp_fence_wait(setup->scene->fence);
+         llvmpipe_context(setup->pipe)->stats[LP_STAT_FENCE_WAIT_TIME] +=
+            os_time_get() - t0;
+      }
    }
 
+   lp_scene_release(setup->scene);
+
    lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
 
 }
@@ -164,23 +175,16 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   pipe_mutex_lock(screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer: binning of the next scene proceeds
+    * while this one is rasterized.  The scene is only released once it is
+    * about to be reused (see lp_setup_get_empty_scene()), and anything
+    * that needs its results waits on the scene's fence, e.g. through
+    * llvmpipe_flush_resource().
     */
+   pipe_mutex_lock(screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -198,9 +202,10 @@ begin_binning( struct lp_setup_context *setup )
    assert(scene);
    assert(scene->fence == NULL);
 
-   /* Always create a fence:
+   /* Always create a fence.  It is signalled once by the rasterizer when
+    * it is completely done with the scene.
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -341,7 +346,7 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_scene_release(setup->scene);
       setup->scene = NULL;
    }
 
@@ -529,9 +534,42 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
          (setup->clear.zsvalue & ~zsmask) | (zsvalue & zsmask);
    }
 
+   if (setup->state == SETUP_ACTIVE)
+      setup->scene->zs_discard = FALSE;
+
+   if ((flags & PIPE_CLEAR_DEPTH) && setup->scene && setup->scene->hiz)
+      lp_scene_hiz_set(setup->scene, (float) depth);
+
    return TRUE;
 }
 
+/**
+ * The contents of a resource become undefined.  Only the bound z/stencil
+ * buffer is of interest: pending clears of it needn't be written.
+ */
+void
+lp_setup_invalidate_resource(struct lp_setup_context *setup,
+                             struct pipe_resource *resource)
+{
+   if (!setup->fb.zsbuf || setup->fb.zsbuf->texture != resource)
+      return;
+
+   LP_DBG(DEBUG_SETUP, "%s state %d\n", __FUNCTION__, setup->state);
+
+   if (setup->state == SETUP_CLEARED) {
+      setup->clear.flags &= ~PIPE_CLEAR_DEPTHSTENCIL;
+      setup->clear.zsmask = 0;
+      setup->clear.zsvalue = 0;
+
+      if (setup->scene->hiz)
+         lp_scene_hiz_set(setup->scene, FLT_MAX);
+   }
+   else if (setup->state == SETUP_ACTIVE) {
+      setup->scene->zs_discard = TRUE;
+   }
+}
+
+
 void
 lp_setup_clear( struct lp_setup_context *setup,
                 const union pipe_color_union *color,
@@ -580,7 +618,8 @@ lp_setup_set_triangle_state( struct lp_setup_context *setup,
                              boolean ccw_is_frontface,
                              boolean scissor,
                              boolean half_pixel_center,
-                             boolean bottom_edge_rule)
+                             boolean bottom_edge_rule,
+                             boolean multisample)
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
 
@@ -589,6 +628,7 @@ lp_setup_set_triangle_state( struct lp_setup_context *setup,
    setup->triangle = first_triangle;
    setup->pixel_offset = half_pixel_center ? 0.5f : 0.0f;
    setup->bottom_edge_rule = bottom_edge_rule;
+   setup->multisample = multisample;
 
    if (setup->scissor_test != scissor) {
       setup->dirty |= LP_SETUP_NEW_SCISSOR;
@@ -862,6 +902,9 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                      jit_tex->mip_offsets[j] = lp_tex->mip_offsets[j];
                      jit_tex->row_stride[j] = lp_tex->row_stride[j];
                      jit_tex->img_stride[j] = lp_tex->img_stride[j];
+                     /* the sampler wants the stride between rows of tiles */
+                     if (lp_tex->tiled)
+                        jit_tex->row_stride[j] *= LP_TEXTURE_TILE_SIZE;
                   }
 
                   if (res->target == PIPE_TEXTURE_1D_ARRAY ||
@@ -989,9 +1032,24 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
+   /* check the scenes still being binned or rasterized */
    for (i = 0; i < Elements(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
+      const struct lp_scene *scene = setup->scenes[i];
+      unsigned j;
+
+      if (scene != setup->scene &&
+          (!scene->fence || lp_fence_signalled(scene->fence)))
+         continue;
+
+      for (j = 0; j < scene->fb.nr_cbufs; j++) {
+         if (scene->fb.cbufs[j] && scene->fb.cbufs[j]->texture == texture)
+            return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+      }
+      if (scene->fb.zsbuf && scene->fb.zsbuf->texture == texture) {
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+      }
+
+      if (lp_scene_is_resource_referenced(scene, texture)) {
          return LP_REFERENCED_FOR_READ;
       }
    }
@@ -1176,6 +1234,13 @@ try_update_scene_state( struct lp_setup_context *setup )
                }
             }
          }
+
+         /* The shader code may still be compiling in the background.
+          */
+         if (setup->fs.current.variant) {
+            lp_scene_add_pending_compile(scene,
+                                         &setup->fs.current.variant->compile_job);
+         }
       }
    }
 
@@ -1281,6 +1346,8 @@ lp_setup_destroy( struct lp_setup_context *setup )
 
    lp_setup_reset( setup );
 
+   lp_setup_destroy_workers(setup);
+
    util_unreference_framebuffer_state(&setup->fb);
 
    for (i = 0; i < Elements(setup->fs.current_tex); i++) {
@@ -1291,13 +1358,14 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
+   /* wait for the scenes still in flight, and free all scenes */
    for (i = 0; i < Elements(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
+      if (scene->fence && lp_fence_issued(scene->fence))
          lp_fence_wait(scene->fence);
 
+      lp_scene_release(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1318,6 +1386,7 @@ lp_setup_create( struct pipe_context *pipe,
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_setup_context *setup;
+   unsigned num_setup_threads;
    unsigned i;
 
    setup = CALLOC_STRUCT(lp_setup_context);
@@ -1355,6 +1424,12 @@ lp_setup_create( struct pipe_context *pipe,
    
    setup->dirty = ~0;
 
+   /* Parallel triangle binning is off by default */
+   num_setup_threads = debug_get_num_option("LP_NUM_SETUP_THREADS", 0);
+   if (!lp_setup_create_workers(setup, num_setup_threads)) {
+      goto no_scenes;
+   }
+
    return setup;
 
 no_scenes:
@@ -1495,6 +1570,8 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 
    assert(setup->state == SETUP_ACTIVE);
 
+   llvmpipe_context(setup->pipe)->stats[LP_STAT_SCENE_FLUSHES]++;
+
    if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
       return FALSE;
    
@@ -62,6 +62,11 @@ lp_setup_clear(struct lp_setup_context *setup,
 
 
 
+void
+lp_setup_invalidate_resource(struct lp_setup_context *setup,
+                             struct pipe_resource *resource);
+
+
 void
 lp_setup_flush( struct lp_setup_context *setup,
                 struct pipe_fence_handle **fence,
@@ -78,7 +83,8 @@ lp_setup_set_triangle_state( struct lp_setup_context *setup,
                              boolean front_is_ccw,
                              boolean scissor,
                              boolean half_pixel_center,
-                             boolean bottom_edge_rule);
+                             boolean bottom_edge_rule,
+                             boolean multisample);
 
 void 
 lp_setup_set_line_state( struct lp_setup_context *setup,
@@ -41,6 +41,7 @@
 #include "lp_bld_interp.h"	/* for struct lp_shader_input */
 
 #include "draw/draw_vbuf.h"
+#include "os/os_thread.h"
 #include "util/u_rect.h"
 #include "util/u_pack_color.h"
 
@@ -52,11 +53,21 @@
 
 
 struct lp_setup_variant;
+struct lp_setup_worker;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/**
+ * Max number of scenes.  While one scene is being binned, the others
+ * may be queued for or undergoing rasterization.
+ */
+#define MAX_SCENES 4
+
+
+/**
+ * Max number of threads (including the calling thread) which may bin the
+ * triangles of a single draw in parallel.  See lp_setup_parallel.c.
+ */
+#define LP_MAX_SETUP_THREADS 16
 
 
 
@@ -82,6 +93,10 @@ struct lp_setup_context
    uint vertex_buffer_size;
    void *vertex_buffer;
 
+   /** Indices of the triangles left by lp_setup_cull_triangles() */
+   ushort *cull_indices;
+   unsigned cull_indices_size;
+
    /* Final pipeline stage for draw module.  Draw module should
     * create/install this itself now.
     */
@@ -92,6 +107,12 @@ struct lp_setup_context
    struct lp_scene *scene;               /**< current scene being built */
 
    struct lp_fence *last_fence;
+
+   /** Parallel triangle binning, see lp_setup_parallel.c */
+   unsigned num_workers;
+   struct lp_setup_worker *workers;
+   struct lp_setup_worker *worker;  /**< non-NULL in a worker's private copy */
+
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
@@ -102,6 +123,7 @@ struct lp_setup_context
    boolean rasterizer_discard;
    unsigned cullmode;
    unsigned bottom_edge_rule;
+   boolean multisample;
    float pixel_offset;
    float line_width;
    float point_size;
@@ -168,6 +190,50 @@ struct lp_setup_context
                      const float (*v2)[4]);
 };
 
+/**
+ * One of the threads binning a chunk of a draw's triangles in parallel.
+ * Each worker bins into a private scene, with its own setup context of
+ * which only the state triangle setup looks at is kept in sync with the
+ * parent's.  The private bins are appended to the real scene's bins in
+ * chunk order once all the workers are done, so that the commands in
+ * every bin end up in submission order.
+ */
+struct lp_setup_worker
+{
+   struct lp_setup_context *parent;
+   struct lp_setup_context setup;   /**< bins into scene */
+   struct lp_scene *scene;          /**< private bins and data blocks */
+   unsigned index;
+
+   /** The bins of scene which got commands, see lp_scene::touched_bins */
+   uint16_t touched_bins[TILES_X * TILES_Y];
+
+   /* The chunk of triangles to bin */
+   const void *vertex_buffer;
+   unsigned stride;
+   const ushort *indices;           /**< NULL for non-indexed draws */
+   unsigned start, count;           /**< in triangles */
+
+   /** Bins whose earlier contents got discarded by a full-tile draw */
+   uint32_t bin_reset[TILES_Y][TILES_X / 32];
+
+   boolean failed;                  /**< ran out of scene memory */
+   boolean exit_flag;
+
+   pipe_thread thread;
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+};
+
+
+static inline void
+lp_setup_worker_bin_reset(struct lp_setup_worker *worker,
+                          unsigned x, unsigned y)
+{
+   worker->bin_reset[y][x / 32] |= 1u << (x % 32);
+}
+
+
 static inline void
 scissor_planes_needed(boolean scis_planes[4], const struct u_rect *bbox,
                       const struct u_rect *scissor)
@@ -196,6 +262,25 @@ void lp_setup_destroy( struct lp_setup_context *setup );
 
 boolean lp_setup_flush_and_restart(struct lp_setup_context *setup);
 
+boolean lp_setup_create_workers(struct lp_setup_context *setup,
+                                unsigned num_threads);
+
+void lp_setup_destroy_workers(struct lp_setup_context *setup);
+
+boolean
+lp_setup_bin_triangles_parallel(struct lp_setup_context *setup,
+                                const void *vertex_buffer,
+                                unsigned stride,
+                                const ushort *indices,
+                                unsigned nr);
+
+const ushort *
+lp_setup_cull_triangles(struct lp_setup_context *setup,
+                        const void *vertex_buffer,
+                        unsigned stride,
+                        const ushort *indices,
+                        unsigned *nr);
+
 void
 lp_setup_print_triangle(struct lp_setup_context *setup,
                         const float (*v0)[4],
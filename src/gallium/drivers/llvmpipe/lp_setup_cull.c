@@ -0,0 +1,399 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Early culling of triangle lists.
+ *
+ * Before the triangles of a PIPE_PRIM_TRIANGLES draw are set up one by
+ * one, reject in batches the ones triangle setup would throw away anyway:
+ * back facing (per the cull mode), zero area, with an empty bounding box
+ * (too small to cover any pixel center), or outside the draw region.
+ * The survivors are returned as a compacted index list.
+ *
+ * The tests are exactly those of triangle_cw/ccw/both() and
+ * do_triangle_ccw(), on the same fixed point positions, so culling here
+ * never changes the rendering.  With SSE2, four triangles are tested at
+ * once; the area is computed in double precision, which is exact as long
+ * as the fixed point coordinates are below 2^25.  Triangles with larger
+ * (or NaN) coordinates are left for setup to deal with.
+ */
+
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_rect.h"
+#include "util/u_sse.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_scene.h"
+#include "lp_setup_context.h"
+
+
+/** Don't bother with draws with fewer triangles than this */
+#define LP_CULL_MIN_TRIS 8
+
+
+/**
+ * The per draw parameters of the culling tests.
+ */
+struct cull_params {
+   float pixel_offset;
+   int adj;                /**< bottom edge rule adjustment */
+   int expand;             /**< bbox expansion for multisampling */
+   boolean keep_ccw;       /**< keep triangles with positive area */
+   boolean keep_cw;        /**< keep triangles with negative area */
+   boolean test_region;
+   struct u_rect region;
+};
+
+
+static inline unsigned
+tri_index(const ushort *indices, unsigned tri, unsigned vert)
+{
+   return indices ? indices[tri * 3 + vert] : tri * 3 + vert;
+}
+
+
+static inline const float *
+tri_vert(const void *vertex_buffer, unsigned stride, unsigned index)
+{
+   return (const float *)((const char *)vertex_buffer + index * stride);
+}
+
+
+#if defined(PIPE_ARCH_SSE)
+
+static inline __m128i
+min_epi32(__m128i a, __m128i b)
+{
+   __m128i mask = _mm_cmplt_epi32(a, b);
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+static inline __m128i
+max_epi32(__m128i a, __m128i b)
+{
+   __m128i mask = _mm_cmpgt_epi32(a, b);
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+/**
+ * Compute a*b - c*d of the low and high pairs of lanes, in double
+ * precision, and return masks of the lanes where it is > 0 and < 0.
+ */
+static inline void
+area_sign(__m128i a, __m128i b, __m128i c, __m128i d,
+          __m128 *positive, __m128 *negative)
+{
+   const __m128d zero = _mm_setzero_pd();
+   __m128d lo, hi;
+
+   lo = _mm_sub_pd(_mm_mul_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b)),
+                   _mm_mul_pd(_mm_cvtepi32_pd(c), _mm_cvtepi32_pd(d)));
+
+   a = _mm_shuffle_epi32(a, _MM_SHUFFLE(1,0,3,2));
+   b = _mm_shuffle_epi32(b, _MM_SHUFFLE(1,0,3,2));
+   c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1,0,3,2));
+   d = _mm_shuffle_epi32(d, _MM_SHUFFLE(1,0,3,2));
+
+   hi = _mm_sub_pd(_mm_mul_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b)),
+                   _mm_mul_pd(_mm_cvtepi32_pd(c), _mm_cvtepi32_pd(d)));
+
+   *positive = _mm_shuffle_ps(_mm_castpd_ps(_mm_cmpgt_pd(lo, zero)),
+                              _mm_castpd_ps(_mm_cmpgt_pd(hi, zero)),
+                              _MM_SHUFFLE(2,0,2,0));
+   *negative = _mm_shuffle_ps(_mm_castpd_ps(_mm_cmplt_pd(lo, zero)),
+                              _mm_castpd_ps(_mm_cmplt_pd(hi, zero)),
+                              _MM_SHUFFLE(2,0,2,0));
+}
+
+
+/**
+ * Test four triangles, and return a bitmask of the ones to cull.
+ * Same fixed point snapping as calc_fixed_position() in lp_setup_tri.c.
+ */
+static inline unsigned
+cull_tris_4(const struct cull_params *params, const float *v[3][4])
+{
+   const __m128 pix_offset = _mm_set1_ps(params->pixel_offset);
+   const __m128 fixed_one = _mm_set1_ps((float)FIXED_ONE);
+   const __m128 limit = _mm_set1_ps((float)(1 << 25));
+   const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+   const __m128i adj = _mm_set1_epi32(params->adj);
+   const __m128i one = _mm_set1_epi32(1);
+   const __m128i expand = _mm_set1_epi32(params->expand);
+   __m128 inexact = _mm_setzero_ps();
+   __m128 ccw, cw, keep;
+   __m128i x[3], y[3];
+   __m128i bx0, bx1, by0, by1;
+   __m128i cull;
+   unsigned j;
+
+   for (j = 0; j < 3; j++) {
+      __m128 fx = _mm_setr_ps(v[j][0][0], v[j][1][0], v[j][2][0], v[j][3][0]);
+      __m128 fy = _mm_setr_ps(v[j][0][1], v[j][1][1], v[j][2][1], v[j][3][1]);
+
+      fx = _mm_mul_ps(_mm_sub_ps(fx, pix_offset), fixed_one);
+      fy = _mm_mul_ps(_mm_sub_ps(fy, pix_offset), fixed_one);
+
+      /* also true for NaNs */
+      inexact = _mm_or_ps(inexact,
+                          _mm_cmpnlt_ps(_mm_and_ps(fx, abs_mask), limit));
+      inexact = _mm_or_ps(inexact,
+                          _mm_cmpnlt_ps(_mm_and_ps(fy, abs_mask), limit));
+
+      x[j] = _mm_cvtps_epi32(fx);
+      y[j] = _mm_cvtps_epi32(fy);
+   }
+
+   /* area = dx01 * dy20 - dx20 * dy01 */
+   area_sign(_mm_sub_epi32(x[0], x[1]), _mm_sub_epi32(y[2], y[0]),
+             _mm_sub_epi32(x[2], x[0]), _mm_sub_epi32(y[0], y[1]),
+             &ccw, &cw);
+
+   keep = _mm_setzero_ps();
+   if (params->keep_ccw)
+      keep = _mm_or_ps(keep, ccw);
+   if (params->keep_cw)
+      keep = _mm_or_ps(keep, cw);
+
+   cull = _mm_xor_si128(_mm_castps_si128(keep), _mm_set1_epi32(-1));
+
+   /* bounding box, as in do_triangle_ccw() */
+   bx0 = _mm_srai_epi32(min_epi32(min_epi32(x[0], x[1]), x[2]), FIXED_ORDER);
+   bx1 = _mm_srai_epi32(_mm_sub_epi32(max_epi32(max_epi32(x[0], x[1]), x[2]),
+                                      one), FIXED_ORDER);
+   by0 = _mm_srai_epi32(_mm_add_epi32(min_epi32(min_epi32(y[0], y[1]), y[2]),
+                                      adj), FIXED_ORDER);
+   by1 = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(max_epi32(max_epi32(y[0], y[1]), y[2]),
+                                                    one), adj), FIXED_ORDER);
+
+   bx0 = _mm_sub_epi32(bx0, expand);
+   by0 = _mm_sub_epi32(by0, expand);
+   bx1 = _mm_add_epi32(bx1, expand);
+   by1 = _mm_add_epi32(by1, expand);
+
+   cull = _mm_or_si128(cull, _mm_cmplt_epi32(bx1, bx0));
+   cull = _mm_or_si128(cull, _mm_cmplt_epi32(by1, by0));
+
+   if (params->test_region) {
+      cull = _mm_or_si128(cull, _mm_cmplt_epi32(_mm_set1_epi32(params->region.x1), bx0));
+      cull = _mm_or_si128(cull, _mm_cmplt_epi32(bx1, _mm_set1_epi32(params->region.x0)));
+      cull = _mm_or_si128(cull, _mm_cmplt_epi32(_mm_set1_epi32(params->region.y1), by0));
+      cull = _mm_or_si128(cull, _mm_cmplt_epi32(by1, _mm_set1_epi32(params->region.y0)));
+   }
+
+   cull = _mm_andnot_si128(_mm_castps_si128(inexact), cull);
+
+   return _mm_movemask_ps(_mm_castsi128_ps(cull));
+}
+
+
+static unsigned
+cull_tris(const struct cull_params *params,
+          const void *vertex_buffer, unsigned stride,
+          const ushort *indices, unsigned num_tris,
+          ushort *out)
+{
+   unsigned nr = 0;
+   unsigned t, lane, j;
+
+   for (t = 0; t < num_tris; t += 4) {
+      const unsigned n = MIN2(4, num_tris - t);
+      const float *v[3][4];
+      unsigned culled;
+
+      /* A partial batch repeats its last triangle */
+      for (lane = 0; lane < 4; lane++) {
+         unsigned tri = t + MIN2(lane, n - 1);
+         for (j = 0; j < 3; j++)
+            v[j][lane] = tri_vert(vertex_buffer, stride,
+                                  tri_index(indices, tri, j));
+      }
+
+      culled = cull_tris_4(params, v);
+
+      for (lane = 0; lane < n; lane++) {
+         if (!(culled & (1 << lane))) {
+            for (j = 0; j < 3; j++)
+               out[nr++] = tri_index(indices, t + lane, j);
+         }
+      }
+   }
+
+   return nr;
+}
+
+#else /* !PIPE_ARCH_SSE */
+
+static inline int
+subpixel_snap(float a)
+{
+   return util_iround(FIXED_ONE * a);
+}
+
+
+/**
+ * Test one triangle, same as the non-SSE paths of lp_setup_tri.c.
+ */
+static inline boolean
+cull_tri(const struct cull_params *params, const float *v[3])
+{
+   int x[3], y[3];
+   int64_t area;
+   struct u_rect bbox;
+   unsigned j;
+
+   for (j = 0; j < 3; j++) {
+      x[j] = subpixel_snap(v[j][0] - params->pixel_offset);
+      y[j] = subpixel_snap(v[j][1] - params->pixel_offset);
+   }
+
+   area = IMUL64(x[0] - x[1], y[2] - y[0]) - IMUL64(x[2] - x[0], y[0] - y[1]);
+
+   if (!((area > 0 && params->keep_ccw) || (area < 0 && params->keep_cw)))
+      return TRUE;
+
+   bbox.x0 = (MIN3(x[0], x[1], x[2]) >> FIXED_ORDER) - params->expand;
+   bbox.x1 = ((MAX3(x[0], x[1], x[2]) - 1) >> FIXED_ORDER) + params->expand;
+   bbox.y0 = ((MIN3(y[0], y[1], y[2]) + params->adj) >> FIXED_ORDER) - params->expand;
+   bbox.y1 = ((MAX3(y[0], y[1], y[2]) - 1 + params->adj) >> FIXED_ORDER) + params->expand;
+
+   if (bbox.x1 < bbox.x0 || bbox.y1 < bbox.y0)
+      return TRUE;
+
+   if (params->test_region &&
+       !u_rect_test_intersection(&params->region, &bbox))
+      return TRUE;
+
+   return FALSE;
+}
+
+
+static unsigned
+cull_tris(const struct cull_params *params,
+          const void *vertex_buffer, unsigned stride,
+          const ushort *indices, unsigned num_tris,
+          ushort *out)
+{
+   unsigned nr = 0;
+   unsigned t, j;
+
+   for (t = 0; t < num_tris; t++) {
+      const float *v[3];
+
+      for (j = 0; j < 3; j++)
+         v[j] = tri_vert(vertex_buffer, stride, tri_index(indices, t, j));
+
+      if (!cull_tri(params, v)) {
+         for (j = 0; j < 3; j++)
+            out[nr++] = tri_index(indices, t, j);
+      }
+   }
+
+   return nr;
+}
+
+#endif /* !PIPE_ARCH_SSE */
+
+
+/**
+ * Cull the triangles of a PIPE_PRIM_TRIANGLES draw which triangle setup
+ * would reject.
+ *
+ * \param indices  the draw's indices, or NULL for non-indexed draws
+ * \param nr  number of vertices/indices, updated to the number of
+ *            indices returned
+ * \return the indices of the remaining triangles, which is \p indices
+ *         itself if culling was skipped
+ */
+const ushort *
+lp_setup_cull_triangles(struct lp_setup_context *setup,
+                        const void *vertex_buffer,
+                        unsigned stride,
+                        const ushort *indices,
+                        unsigned *nr)
+{
+   const struct llvmpipe_context *lp = (const struct llvmpipe_context *)setup->pipe;
+   const unsigned num_tris = *nr / 3;
+   struct cull_params params;
+   unsigned culled;
+
+   if (num_tris < LP_CULL_MIN_TRIS ||
+       (LP_PERF & PERF_NO_EARLY_CULL) ||
+       /* triangle_both() counts all triangles it gets */
+       lp->active_statistics_queries)
+      return indices;
+
+   if (setup->cull_indices_size < num_tris * 3) {
+      FREE(setup->cull_indices);
+      setup->cull_indices = MALLOC(num_tris * 3 * sizeof(ushort));
+      setup->cull_indices_size = setup->cull_indices ? num_tris * 3 : 0;
+      if (!setup->cull_indices)
+         return indices;
+   }
+
+   params.pixel_offset = setup->pixel_offset;
+   params.adj = setup->bottom_edge_rule != 0 ? 1 : 0;
+   params.expand = (setup->multisample && setup->scene->fb_samples > 1) ? 1 : 0;
+
+   switch (setup->cullmode) {
+   case PIPE_FACE_NONE:
+      params.keep_ccw = TRUE;
+      params.keep_cw = TRUE;
+      break;
+   case PIPE_FACE_BACK:
+      params.keep_ccw = setup->ccw_is_frontface;
+      params.keep_cw = !setup->ccw_is_frontface;
+      break;
+   case PIPE_FACE_FRONT:
+      params.keep_ccw = !setup->ccw_is_frontface;
+      params.keep_cw = setup->ccw_is_frontface;
+      break;
+   default:
+      params.keep_ccw = FALSE;
+      params.keep_cw = FALSE;
+      break;
+   }
+
+   /* With a viewport index output the region varies per triangle */
+   params.region = setup->draw_regions[0];
+   params.test_region = setup->viewport_index_slot <= 0 &&
+                        params.region.x0 <= params.region.x1 &&
+                        params.region.y0 <= params.region.y1;
+
+   *nr = cull_tris(&params, vertex_buffer, stride, indices, num_tris,
+                   setup->cull_indices);
+
+   culled = num_tris - *nr / 3;
+   LP_COUNT_ADD(nr_culled_tris, culled);
+
+   return setup->cull_indices;
+}
@@ -0,0 +1,462 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Parallel triangle setup and binning.
+ *
+ * With many small triangles, setup and binning on the application's
+ * thread easily becomes the bottleneck, leaving the rasterizer threads
+ * idle.  When enabled with LP_NUM_SETUP_THREADS, the triangles of large
+ * PIPE_PRIM_TRIANGLES draws are split into contiguous chunks, one per
+ * worker, and each worker sets up and bins its chunk into a private scene.
+ * The calling thread bins the first chunk itself.
+ *
+ * Once all the chunks are binned, the private command lists are appended
+ * to the real scene's bins in chunk order, and the private data blocks
+ * are handed over to the real scene.  Since triangles within a chunk are
+ * binned in order, every bin ends up with the same commands, in the same
+ * order, as with serial binning.
+ *
+ * Workers cannot flush the scene when they run out of memory.  In that
+ * case all the private bins are thrown away and the caller bins the draw
+ * serially, which flushes as needed.
+ */
+
+
+#include <float.h>
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_scene.h"
+#include "lp_setup_context.h"
+
+
+/** Don't bother splitting draws into chunks smaller than this */
+#define LP_SETUP_MIN_CHUNK_TRIS 64
+
+
+typedef const float (*const_float4_ptr)[4];
+
+static inline const_float4_ptr
+get_vert(const void *vertex_buffer, int index, int stride)
+{
+   return (const_float4_ptr)((char *)vertex_buffer + index * stride);
+}
+
+
+/**
+ * Bin the worker's chunk of triangles into its private scene.
+ */
+static void
+bin_chunk(struct lp_setup_worker *worker)
+{
+   struct lp_setup_context *setup = &worker->setup;
+   const void *vertex_buffer = worker->vertex_buffer;
+   const unsigned stride = worker->stride;
+   const ushort *indices = worker->indices;
+   unsigned i, end = worker->start + worker->count;
+
+   for (i = worker->start; i < end && !worker->failed; i++) {
+      if (indices) {
+         setup->triangle(setup,
+                         get_vert(vertex_buffer, indices[i*3+0], stride),
+                         get_vert(vertex_buffer, indices[i*3+1], stride),
+                         get_vert(vertex_buffer, indices[i*3+2], stride));
+      }
+      else {
+         setup->triangle(setup,
+                         get_vert(vertex_buffer, i*3+0, stride),
+                         get_vert(vertex_buffer, i*3+1, stride),
+                         get_vert(vertex_buffer, i*3+2, stride));
+      }
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( worker_thread_function, init_data )
+{
+   struct lp_setup_worker *worker = (struct lp_setup_worker *) init_data;
+   char thread_name[16];
+
+   util_snprintf(thread_name, sizeof thread_name, "llvmpipe-bin-%u",
+                 worker->index);
+   pipe_thread_setname(thread_name);
+
+   while (1) {
+      pipe_semaphore_wait(&worker->work_ready);
+
+      if (worker->exit_flag)
+         break;
+
+      bin_chunk(worker);
+
+      pipe_semaphore_signal(&worker->work_done);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Copy the parent's state which triangle setup and binning look at (see
+ * lp_setup_tri.c) into the worker's setup context.  This is much smaller
+ * than the whole context, most of which is the current fragment shader
+ * state, of which setup only needs the variant.
+ */
+static void
+copy_tri_state(struct lp_setup_context *setup,
+               const struct lp_setup_context *parent)
+{
+   /* Without a viewport index output only the first viewport is used */
+   unsigned num_viewports =
+      parent->viewport_index_slot > 0 ? PIPE_MAX_VIEWPORTS : 1;
+
+   setup->pipe = parent->pipe;
+   setup->flatshade_first = parent->flatshade_first;
+   setup->ccw_is_frontface = parent->ccw_is_frontface;
+   setup->scissor_test = parent->scissor_test;
+   setup->cullmode = parent->cullmode;
+   setup->bottom_edge_rule = parent->bottom_edge_rule;
+   setup->multisample = parent->multisample;
+   setup->pixel_offset = parent->pixel_offset;
+   setup->viewport_index_slot = parent->viewport_index_slot;
+   setup->layer_slot = parent->layer_slot;
+   setup->fb.width = parent->fb.width;
+   setup->fb.height = parent->fb.height;
+   setup->fs.stored = parent->fs.stored;
+   setup->fs.current.variant = parent->fs.current.variant;
+   setup->setup.variant = parent->setup.variant;
+   setup->triangle = parent->triangle;
+
+   memcpy(setup->scissors, parent->scissors,
+          num_viewports * sizeof parent->scissors[0]);
+   memcpy(setup->draw_regions, parent->draw_regions,
+          num_viewports * sizeof parent->draw_regions[0]);
+}
+
+
+/**
+ * Prepare the worker's setup context and private scene for binning a
+ * chunk of triangles.
+ */
+static void
+begin_chunk(struct lp_setup_worker *worker,
+            const void *vertex_buffer, unsigned stride,
+            const ushort *indices, unsigned start, unsigned count)
+{
+   struct lp_setup_context *parent = worker->parent;
+   struct lp_scene *scene = worker->scene;
+
+   copy_tri_state(&worker->setup, parent);
+
+   /* Only the bits of the scene which setup looks at.  The zsbuf pointer
+    * is not referenced, it's only tested for NULL, and is cleared again
+    * in end_chunk().
+    */
+   scene->tiles_x = parent->scene->tiles_x;
+   scene->tiles_y = parent->scene->tiles_y;
+   scene->fb_max_layer = parent->scene->fb_max_layer;
+   scene->had_queries = parent->scene->had_queries;
+   scene->fb.zsbuf = parent->scene->fb.zsbuf;
+   scene->scene_size = 0;
+   scene->num_touched_bins = 0;
+
+   worker->vertex_buffer = vertex_buffer;
+   worker->stride = stride;
+   worker->indices = indices;
+   worker->start = start;
+   worker->count = count;
+   worker->failed = FALSE;
+}
+
+
+/**
+ * Clear the worker's record of bin resets.  Only touched bins can have
+ * been reset, so there's no need to clear all of it.
+ */
+static void
+clear_bin_resets(struct lp_setup_worker *worker)
+{
+   const struct lp_scene *wscene = worker->scene;
+   unsigned i;
+
+   for (i = 0; i < wscene->num_touched_bins; i++) {
+      unsigned x = wscene->touched_bins[i] & 0xff;
+      unsigned y = wscene->touched_bins[i] >> 8;
+      worker->bin_reset[y][x / 32] &= ~(1u << (x % 32));
+   }
+}
+
+
+/**
+ * Throw away whatever the worker binned.
+ */
+static void
+end_chunk(struct lp_setup_worker *worker)
+{
+   clear_bin_resets(worker);
+   worker->scene->num_touched_bins = 0;
+   worker->scene->fb.zsbuf = NULL;
+   lp_scene_release(worker->scene);
+}
+
+
+/**
+ * Append the worker's bins to the parent scene's, and hand over its data
+ * blocks.  The worker's scene gets \p spare as its new, empty data block.
+ *
+ * Only the bins the worker touched are visited, so the cost doesn't
+ * depend on the framebuffer size.
+ */
+static void
+merge_chunk(struct lp_setup_worker *worker, struct data_block *spare)
+{
+   struct lp_scene *scene = worker->parent->scene;
+   struct lp_scene *wscene = worker->scene;
+   struct data_block *head, *tail;
+   unsigned i;
+
+   for (i = 0; i < wscene->num_touched_bins; i++) {
+      unsigned x = wscene->touched_bins[i] & 0xff;
+      unsigned y = wscene->touched_bins[i] >> 8;
+      struct cmd_bin *wbin = lp_scene_get_bin(wscene, x, y);
+      struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+
+      if (worker->bin_reset[y][x / 32] & (1u << (x % 32))) {
+         worker->bin_reset[y][x / 32] &= ~(1u << (x % 32));
+         lp_scene_bin_reset(scene, x, y);
+      }
+
+      if (bin->tail)
+         bin->tail->next = wbin->head;
+      else
+         bin->head = wbin->head;
+      bin->tail = wbin->tail;
+      bin->last_state = wbin->last_state;
+
+      wbin->head = NULL;
+      wbin->tail = NULL;
+      wbin->last_state = NULL;
+   }
+   wscene->num_touched_bins = 0;
+
+   /* Splice the worker's data blocks in behind the parent's current
+    * block, which setup keeps allocating from.
+    */
+   head = wscene->data.head;
+   for (tail = head; tail->next; tail = tail->next)
+      ;
+   tail->next = scene->data.head->next;
+   scene->data.head->next = head;
+
+   spare->used = 0;
+   spare->next = NULL;
+   wscene->data.head = spare;
+
+   scene->scene_size += wscene->scene_size;
+
+   wscene->fb.zsbuf = NULL;
+   wscene->scene_size = 0;
+   wscene->alloc_failed = FALSE;
+}
+
+
+/**
+ * Try to set up and bin a list of independent triangles in parallel.
+ * Returns FALSE if nothing was binned, in which case the caller must bin
+ * the triangles itself.
+ *
+ * \param indices  triangle vertex indices, or NULL for sequential vertices
+ * \param nr  number of vertices (or indices)
+ */
+boolean
+lp_setup_bin_triangles_parallel(struct lp_setup_context *setup,
+                                const void *vertex_buffer,
+                                unsigned stride,
+                                const ushort *indices,
+                                unsigned nr)
+{
+   struct llvmpipe_context *lp_context = (struct llvmpipe_context *)setup->pipe;
+   struct data_block *spare[LP_MAX_SETUP_THREADS];
+   unsigned num_tris = nr / 3;
+   unsigned num_chunks, chunk_size, start, i;
+   boolean failed = FALSE;
+
+   if (setup->num_workers < 2 || setup->worker)
+      return FALSE;
+
+   /* Pipeline statistics are counted on the context by triangle setup.
+    * Keep things simple and don't run in parallel while they're active.
+    */
+   if (lp_context->active_statistics_queries)
+      return FALSE;
+
+   num_chunks = MIN2(setup->num_workers, num_tris / LP_SETUP_MIN_CHUNK_TRIS);
+   if (num_chunks < 2)
+      return FALSE;
+
+   chunk_size = (num_tris + num_chunks - 1) / num_chunks;
+
+   for (i = 0, start = 0; i < num_chunks; i++, start += chunk_size) {
+      begin_chunk(&setup->workers[i], vertex_buffer, stride, indices,
+                  start, MIN2(chunk_size, num_tris - start));
+   }
+
+   for (i = 1; i < num_chunks; i++)
+      pipe_semaphore_signal(&setup->workers[i].work_ready);
+
+   bin_chunk(&setup->workers[0]);
+
+   for (i = 1; i < num_chunks; i++)
+      pipe_semaphore_wait(&setup->workers[i].work_done);
+
+   /* Allocate all the replacement data blocks up front, so that merging
+    * can't fail half way through.
+    */
+   for (i = 0; i < num_chunks; i++) {
+      spare[i] = NULL;
+      if (failed || setup->workers[i].failed ||
+          !(spare[i] = MALLOC_STRUCT(data_block)))
+         failed = TRUE;
+   }
+
+   /* Each chunk only checked its own data against the scene size limit,
+    * so check the total.
+    */
+   if (!failed) {
+      unsigned size = setup->scene->scene_size;
+      for (i = 0; i < num_chunks; i++)
+         size += setup->workers[i].scene->scene_size;
+      if (size > LP_SCENE_MAX_SIZE)
+         failed = TRUE;
+   }
+
+   if (failed) {
+      for (i = 0; i < num_chunks; i++) {
+         FREE(spare[i]);
+         end_chunk(&setup->workers[i]);
+      }
+      LP_DBG(DEBUG_SETUP, "%s: out of memory, binning serially\n",
+             __FUNCTION__);
+      return FALSE;
+   }
+
+   for (i = 0; i < num_chunks; i++)
+      merge_chunk(&setup->workers[i], spare[i]);
+
+   /* The workers don't track hierarchical z */
+   if (setup->scene->hiz &&
+       (setup->fs.current.variant->hiz & LP_HIZ_INVALIDATE))
+      lp_scene_hiz_set(setup->scene, FLT_MAX);
+
+   return TRUE;
+}
+
+
+/**
+ * Create the binning threads.  num_threads includes the calling thread.
+ */
+boolean
+lp_setup_create_workers(struct lp_setup_context *setup,
+                        unsigned num_threads)
+{
+   unsigned i;
+
+   num_threads = MIN2(num_threads, LP_MAX_SETUP_THREADS);
+   if (num_threads < 2)
+      return TRUE;
+
+   setup->workers = CALLOC(num_threads, sizeof setup->workers[0]);
+   if (!setup->workers)
+      return FALSE;
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_setup_worker *worker = &setup->workers[i];
+
+      worker->parent = setup;
+      worker->index = i;
+      worker->setup.worker = worker;
+      worker->scene = lp_scene_create(setup->pipe);
+      if (!worker->scene || !worker->scene->data.head)
+         goto fail;
+      worker->setup.scene = worker->scene;
+      worker->scene->touched_bins = worker->touched_bins;
+   }
+
+   /* Worker 0 is the calling thread */
+   for (i = 1; i < num_threads; i++) {
+      struct lp_setup_worker *worker = &setup->workers[i];
+
+      pipe_semaphore_init(&worker->work_ready, 0);
+      pipe_semaphore_init(&worker->work_done, 0);
+      worker->thread = pipe_thread_create(worker_thread_function,
+                                          (void *) worker);
+   }
+
+   setup->num_workers = num_threads;
+   return TRUE;
+
+fail:
+   for (i = 0; i < num_threads; i++) {
+      if (setup->workers[i].scene)
+         lp_scene_destroy(setup->workers[i].scene);
+   }
+   FREE(setup->workers);
+   setup->workers = NULL;
+   return FALSE;
+}
+
+
+void
+lp_setup_destroy_workers(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   if (!setup->workers)
+      return;
+
+   for (i = 1; i < setup->num_workers; i++) {
+      setup->workers[i].exit_flag = TRUE;
+      pipe_semaphore_signal(&setup->workers[i].work_ready);
+   }
+
+   for (i = 0; i < setup->num_workers; i++) {
+      struct lp_setup_worker *worker = &setup->workers[i];
+
+      if (i > 0) {
+         pipe_thread_wait(worker->thread);
+         pipe_semaphore_destroy(&worker->work_ready);
+         pipe_semaphore_destroy(&worker->work_done);
+      }
+
+      lp_scene_destroy(worker->scene);
+   }
+
+   FREE(setup->workers);
+   setup->workers = NULL;
+   setup->num_workers = 0;
+}
@@ -29,6 +29,7 @@
  * Binning code for triangles
  */
 
+#include <float.h>
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_rect.h"
@@ -242,6 +243,8 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
           * All previous rendering will be overwritten so reset the bin.
           */
          lp_scene_bin_reset( scene, tx, ty );
+         if (setup->worker)
+            lp_setup_worker_bin_reset(setup->worker, tx, ty);
       }
 
       LP_COUNT(nr_shade_opaque_64);
@@ -282,6 +285,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    unsigned viewport_index = 0;
    unsigned layer = 0;
    const float (*pv)[4];
+   const boolean multisample = setup->multisample && scene->fb_samples > 1;
 
    /* Area should always be positive here */
    assert(position->area > 0);
@@ -320,6 +324,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
       /* Inclusive / exclusive depending upon adj (bottom-left or top-right) */
       bbox.y0 = (MIN3(position->y[0], position->y[1], position->y[2]) + adj) >> FIXED_ORDER;
       bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
+
+      /* Samples may be covered in pixels whose center isn't. */
+      if (multisample) {
+         bbox.x0 -= 1;
+         bbox.y0 -= 1;
+         bbox.x1 += 1;
+         bbox.y1 += 1;
+      }
    }
 
    if (bbox.x1 < bbox.x0 ||
@@ -383,6 +395,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.frontfacing = frontfacing;
    tri->inputs.disable = FALSE;
    tri->inputs.opaque = setup->fs.current.variant->opaque;
+   tri->inputs.multisample = multisample;
    tri->inputs.layer = layer;
    tri->inputs.viewport_index = viewport_index;
 
@@ -639,6 +652,17 @@ do_triangle_ccw(struct lp_setup_context *setup,
       }
    }
 
+   /*
+    * For multisampling, push the edges out so that they include every
+    * pixel where any sample is covered.  The rasterizer takes the margin
+    * off again when evaluating the edges at the sample positions.
+    */
+   if (multisample) {
+      int i;
+      for (i = 0; i < 3; i++)
+         plane[i].c += lp_rast_sample_margin(plane[i].dcdx, plane[i].dcdy);
+   }
+
    if (0) {
       debug_printf("p0: %"PRIx64"/%08x/%08x/%08x\n",
                    plane[0].c,
@@ -749,6 +773,46 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Hierarchical z for a triangle about to be binned in tile (x, y).
+ * Returns TRUE if the triangle is hidden in the tile, and need not be
+ * binned there.  A triangle covering the whole tile lowers the tile's
+ * depth bound.
+ */
+static boolean
+hiz_bin_tile(struct lp_scene *scene, unsigned hiz,
+             const struct lp_rast_triangle *tri,
+             const struct u_rect *box,
+             int x, int y, boolean covered)
+{
+   struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+   float zmin, zmax;
+
+   if (hiz & LP_HIZ_INVALIDATE) {
+      bin->hiz_max = FLT_MAX;
+      return FALSE;
+   }
+
+   lp_rast_depth_bounds(&tri->inputs,
+                        MAX2(box->x0, x * TILE_SIZE),
+                        MAX2(box->y0, y * TILE_SIZE),
+                        MIN2(box->x1, (x + 1) * TILE_SIZE - 1),
+                        MIN2(box->y1, (y + 1) * TILE_SIZE - 1),
+                        &zmin, &zmax);
+
+   if ((hiz & LP_HIZ_TEST) &&
+       MIN2(zmin, 1.0f) > bin->hiz_max + scene->hiz_eps) {
+      LP_COUNT(nr_hiz_rejected_64);
+      return TRUE;
+   }
+
+   if (covered && (hiz & LP_HIZ_UPDATE))
+      bin->hiz_max = MIN2(bin->hiz_max, zmax);
+
+   return FALSE;
+}
+
+
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
@@ -758,6 +822,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
 {
    struct lp_scene *scene = setup->scene;
    struct u_rect trimmed_box = *bbox;   
+   const unsigned hiz = scene->hiz ? setup->fs.current.variant->hiz : 0;
    int i;
    /* What is the largest power-of-two boundary this triangle crosses:
     */
@@ -792,7 +857,14 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
-      if (nr_planes == 3) {
+      if (hiz && hiz_bin_tile(scene, hiz, tri, &trimmed_box,
+                              ix0, iy0, FALSE))
+         return TRUE;
+
+      /* The special cased small triangle paths have no multisample
+       * support.
+       */
+      if (nr_planes == 3 && !tri->inputs.multisample) {
          if (sz < 4)
          {
             /* Triangle is contained in a single 4x4 stamp:
@@ -831,7 +903,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                                                 lp_rast_arg_triangle_contained(tri, px, py) );
          }
       }
-      else if (nr_planes == 4 && sz < 16) 
+      else if (nr_planes == 4 && sz < 16 && !tri->inputs.multisample)
       {
          px = MIN2(px, TILE_SIZE - 16);
          py = MIN2(py, TILE_SIZE - 16);
@@ -880,6 +952,10 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                   plane[i].dcdx - 
                   (int64_t)plane[i].eo) << TILE_ORDER;
 
+         /* Only accept whole tiles if all samples are covered */
+         if (tri->inputs.multisample && i < 3)
+            ei[i] -= 2 * lp_rast_sample_margin(plane[i].dcdx, plane[i].dcdy);
+
          eo[i] = (int64_t)plane[i].eo << TILE_ORDER;
          xstep[i] = -(((int64_t)plane[i].dcdx) << TILE_ORDER);
          ystep[i] = ((int64_t)plane[i].dcdy) << TILE_ORDER;
@@ -924,7 +1000,11 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                 */
                int count = util_bitcount(partial);
                in = TRUE;
-               
+
+               if (hiz && hiz_bin_tile(scene, hiz, tri, &trimmed_box,
+                                       x, y, FALSE))
+                  goto next;
+
                if (!lp_scene_bin_cmd_with_state( scene, x, y,
                                                  setup->fs.stored,
                                                  use_32bits ?
@@ -939,10 +1019,16 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                /* triangle covers the whole tile- shade whole tile */
                LP_COUNT(nr_fully_covered_64);
                in = TRUE;
+
+               if (hiz && hiz_bin_tile(scene, hiz, tri, &trimmed_box,
+                                       x, y, TRUE))
+                  goto next;
+
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y))
                   goto fail;
             }
 
+         next:
             /* Iterate cx values across the region: */
             for (i = 0; i < nr_planes; i++)
                cx[i] += xstep[i];
@@ -978,6 +1064,14 @@ static void retry_triangle_ccw( struct lp_setup_context *setup,
 {
    if (!do_triangle_ccw( setup, position, v0, v1, v2, front ))
    {
+      /* Binning threads can't flush, the whole draw gets binned again
+       * serially instead.
+       */
+      if (setup->worker) {
+         setup->worker->failed = TRUE;
+         return;
+      }
+
       if (!lp_setup_flush_and_restart(setup))
          return;
 
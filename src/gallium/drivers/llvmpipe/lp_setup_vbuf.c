@@ -184,6 +184,11 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
+      indices = lp_setup_cull_triangles(setup, vertex_buffer, stride,
+                                        indices, &nr);
+      if (lp_setup_bin_triangles_parallel(setup, vertex_buffer, stride,
+                                          indices, nr))
+         break;
       for (i = 2; i < nr; i += 3) {
          setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-2], stride),
@@ -339,6 +344,7 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    const void *vertex_buffer =
       (void *) get_vert(setup->vertex_buffer, start, stride);
    const boolean flatshade_first = setup->flatshade_first;
+   const ushort *indices;
    unsigned i;
 
    if (!lp_setup_update_state(setup, TRUE))
@@ -382,6 +388,20 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
+      indices = lp_setup_cull_triangles(setup, vertex_buffer, stride,
+                                        NULL, &nr);
+      if (lp_setup_bin_triangles_parallel(setup, vertex_buffer, stride,
+                                          indices, nr))
+         break;
+      if (indices) {
+         for (i = 2; i < nr; i += 3) {
+            setup->triangle( setup,
+                             get_vert(vertex_buffer, indices[i-2], stride),
+                             get_vert(vertex_buffer, indices[i-1], stride),
+                             get_vert(vertex_buffer, indices[i-0], stride) );
+         }
+         break;
+      }
       for (i = 2; i < nr; i += 3) {
          setup->triangle( setup,
                           get_vert(vertex_buffer, i-2, stride),
@@ -531,6 +551,8 @@ lp_setup_vbuf_destroy(struct vbuf_render *vbr)
       align_free(setup->vertex_buffer);
       setup->vertex_buffer = NULL;
    }
+   FREE(setup->cull_indices);
+   setup->cull_indices = NULL;
    lp_setup_destroy(setup);
 }
 
@@ -0,0 +1,729 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Compute shaders.
+ *
+ * A compute shader variant runs the invocations of a block one vector at
+ * a time.  The blocks of a grid are spread over the screen's compute
+ * threads, each with its own shared memory.
+ *
+ * Shaders with barriers run every invocation vector of a block as a
+ * coroutine.  A barrier yields back to the scheduler, which resumes the
+ * vectors round robin, so all of them reach a barrier before any of them
+ * gets past it.
+ */
+
+#include "pipe/p_defines.h"
+#include "util/u_memory.h"
+#include "util/u_inlines.h"
+#include "util/u_pointer.h"
+#include "util/u_string.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_type.h"
+#include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_debug.h"
+#include "lp_flush.h"
+#include "lp_screen.h"
+#include "lp_state_cs.h"
+#include "lp_texture.h"
+
+#if LP_HAVE_COMPUTE
+#include <ucontext.h>
+#endif
+
+
+/** Stack size of the coroutine of an invocation vector */
+#define LP_CS_STACK_SIZE (256 * 1024)
+
+
+static unsigned cs_no = 0;
+
+
+struct lp_cs_local;
+
+
+#if LP_HAVE_COMPUTE
+struct lp_cs_coro
+{
+   ucontext_t context;
+   struct lp_cs_local *local;
+   unsigned invocation;
+   boolean done;
+};
+#endif
+
+
+/**
+ * Per thread scratch memory.
+ */
+struct lp_cs_local
+{
+   uint8_t *shared_mem;
+   unsigned shared_size;
+
+#if LP_HAVE_COMPUTE
+   ucontext_t sched_context;
+   struct lp_cs_coro *coros;
+   uint8_t *stacks;
+   unsigned max_coros;
+
+   /* The block being run */
+   const struct lp_cs_job *job;
+   unsigned block[3];
+#endif
+};
+
+
+/**
+ * A grid launch.
+ */
+struct lp_cs_job
+{
+   struct lp_jit_cs_context jit_context;
+   lp_jit_cs_func func;
+   struct llvmpipe_context *lp;
+
+   unsigned grid[3];
+   unsigned vector_length;
+   unsigned num_vectors;    /**< per block */
+   boolean has_barriers;
+};
+
+
+/**
+ * TGSI translation interface, with the coroutine barriers yield from.
+ */
+struct lp_cs_iface
+{
+   struct lp_build_tgsi_cs_iface base;
+
+   LLVMValueRef coro;
+};
+
+
+#if LP_HAVE_COMPUTE
+
+/**
+ * Called by the generated code on barriers.  A block which fits in a
+ * single vector isn't run as coroutines, and has nothing to wait for.
+ */
+static void
+lp_cs_coro_yield(void *data)
+{
+   struct lp_cs_coro *coro = (struct lp_cs_coro *) data;
+
+   if (!coro)
+      return;
+
+   swapcontext(&coro->context, &coro->local->sched_context);
+}
+
+
+/**
+ * Coroutine entry point.  makecontext() only passes int arguments, so the
+ * coroutine pointer is split in two.
+ */
+static void
+lp_cs_coro_entry(unsigned lo, unsigned hi)
+{
+   struct lp_cs_coro *coro =
+      (struct lp_cs_coro *) (uintptr_t) (((uint64_t) hi << 32) | lo);
+   struct lp_cs_local *local = coro->local;
+   const struct lp_cs_job *job = local->job;
+
+   job->func(&job->jit_context,
+             local->block[0], local->block[1], local->block[2],
+             coro->invocation, local->shared_mem, coro);
+
+   coro->done = TRUE;
+}
+
+
+static void
+run_block_coros(struct lp_cs_local *local)
+{
+   const struct lp_cs_job *job = local->job;
+   unsigned i, remaining;
+
+   for (i = 0; i < job->num_vectors; i++) {
+      struct lp_cs_coro *coro = &local->coros[i];
+      uint64_t ptr = (uintptr_t) coro;
+
+      coro->local = local;
+      coro->invocation = i * job->vector_length;
+      coro->done = FALSE;
+
+      getcontext(&coro->context);
+      coro->context.uc_stack.ss_sp = local->stacks + i * LP_CS_STACK_SIZE;
+      coro->context.uc_stack.ss_size = LP_CS_STACK_SIZE;
+      coro->context.uc_link = &local->sched_context;
+      makecontext(&coro->context, (void (*)(void)) lp_cs_coro_entry, 2,
+                  (unsigned) ptr, (unsigned) (ptr >> 32));
+   }
+
+   do {
+      remaining = 0;
+      for (i = 0; i < job->num_vectors; i++) {
+         struct lp_cs_coro *coro = &local->coros[i];
+
+         if (!coro->done) {
+            swapcontext(&local->sched_context, &coro->context);
+            if (!coro->done)
+               remaining++;
+         }
+      }
+   } while (remaining);
+}
+
+#endif /* LP_HAVE_COMPUTE */
+
+
+static struct lp_cs_local *
+get_cs_local(const struct lp_cs_job *job, unsigned thread_index)
+{
+   struct llvmpipe_context *lp = job->lp;
+   struct lp_cs_local *local = lp->cs_locals[thread_index];
+   unsigned shared_size = job->jit_context.shared_size;
+
+   if (!local) {
+      local = CALLOC_STRUCT(lp_cs_local);
+      if (!local)
+         return NULL;
+      lp->cs_locals[thread_index] = local;
+   }
+
+   if (local->shared_size < shared_size) {
+      align_free(local->shared_mem);
+      local->shared_mem = align_malloc(shared_size, 16);
+      local->shared_size = local->shared_mem ? shared_size : 0;
+      if (!local->shared_mem)
+         return NULL;
+   }
+
+#if LP_HAVE_COMPUTE
+   if (job->has_barriers && local->max_coros < job->num_vectors) {
+      FREE(local->coros);
+      FREE(local->stacks);
+      local->coros = CALLOC(job->num_vectors, sizeof *local->coros);
+      local->stacks = MALLOC(job->num_vectors * LP_CS_STACK_SIZE);
+      if (!local->coros || !local->stacks) {
+         FREE(local->coros);
+         FREE(local->stacks);
+         local->coros = NULL;
+         local->stacks = NULL;
+         local->max_coros = 0;
+         return NULL;
+      }
+      local->max_coros = job->num_vectors;
+   }
+#endif
+
+   return local;
+}
+
+
+/**
+ * Thread pool callback, runs one block of the grid.
+ */
+static void
+run_block(void *data, unsigned iteration, unsigned thread_index)
+{
+   const struct lp_cs_job *job = (const struct lp_cs_job *) data;
+   struct lp_cs_local *local = get_cs_local(job, thread_index);
+   unsigned block_x, block_y, block_z;
+   unsigned i;
+
+   if (!local)
+      return;
+
+   block_x = iteration % job->grid[0];
+   block_y = (iteration / job->grid[0]) % job->grid[1];
+   block_z = iteration / (job->grid[0] * job->grid[1]);
+
+#if LP_HAVE_COMPUTE
+   if (job->has_barriers) {
+      local->job = job;
+      local->block[0] = block_x;
+      local->block[1] = block_y;
+      local->block[2] = block_z;
+      run_block_coros(local);
+      return;
+   }
+#endif
+
+   for (i = 0; i < job->num_vectors; i++) {
+      job->func(&job->jit_context, block_x, block_y, block_z,
+                i * job->vector_length, local->shared_mem, NULL);
+   }
+}
+
+
+static void
+cs_emit_barrier(const struct lp_build_tgsi_cs_iface *cs_iface,
+                struct lp_build_tgsi_context *bld_base)
+{
+#if LP_HAVE_COMPUTE
+   const struct lp_cs_iface *iface = (const struct lp_cs_iface *) cs_iface;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMTypeRef arg_type =
+      LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMValueRef function;
+
+   function = lp_build_const_func_pointer(gallivm,
+                                          func_to_pointer((func_pointer) lp_cs_coro_yield),
+                                          LLVMVoidTypeInContext(gallivm->context),
+                                          &arg_type, 1, "lp_cs_coro_yield");
+   LLVMBuildCall(gallivm->builder, function, (LLVMValueRef *) &iface->coro, 1, "");
+#endif
+}
+
+
+/**
+ * Generate the compute shader function.  Any change to the prototype must
+ * be reflected in lp_jit.h's lp_jit_cs_func, and vice-versa.
+ */
+static void
+generate_compute(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   LLVMContextRef lc = gallivm->context;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(lc);
+   LLVMTypeRef int8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+   LLVMTypeRef arg_types[7];
+   LLVMTypeRef func_type;
+   LLVMValueRef function;
+   LLVMValueRef context_ptr, invocation, shared_ptr, coro;
+   LLVMValueRef block_id[3];
+   LLVMValueRef block_size_ptr, grid_size_ptr, consts_ptr, num_consts_ptr;
+   LLVMValueRef lane_ids[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef ids, tmp, total, mask_val;
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   LLVMBasicBlockRef block;
+   LLVMBuilderRef builder;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_build_mask_context mask;
+   struct lp_build_context uint_bld;
+   struct lp_cs_iface cs_iface;
+   struct lp_type cs_type;
+   char func_name[64];
+   unsigned i;
+
+   memset(&cs_type, 0, sizeof cs_type);
+   cs_type.floating = TRUE;      /* floating point values */
+   cs_type.sign = TRUE;          /* values are signed */
+   cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
+   cs_type.width = 32;           /* 32-bit float */
+   cs_type.length = MIN2(lp_native_vector_width / 32, 16);
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u_variant", shader->no);
+
+   arg_types[0] = variant->jit_cs_context_ptr_type;   /* context */
+   arg_types[1] = int32_type;                         /* block_x */
+   arg_types[2] = int32_type;                         /* block_y */
+   arg_types[3] = int32_type;                         /* block_z */
+   arg_types[4] = int32_type;                         /* invocation */
+   arg_types[5] = int8_ptr_type;                      /* shared_mem */
+   arg_types[6] = int8_ptr_type;                      /* coro */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(lc),
+                                arg_types, Elements(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function = function;
+
+   context_ptr = LLVMGetParam(function, 0);
+   block_id[0] = LLVMGetParam(function, 1);
+   block_id[1] = LLVMGetParam(function, 2);
+   block_id[2] = LLVMGetParam(function, 3);
+   invocation  = LLVMGetParam(function, 4);
+   shared_ptr  = LLVMGetParam(function, 5);
+   coro        = LLVMGetParam(function, 6);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(block_id[0], "block_x");
+   lp_build_name(block_id[1], "block_y");
+   lp_build_name(block_id[2], "block_z");
+   lp_build_name(invocation, "invocation");
+   lp_build_name(shared_ptr, "shared_mem");
+   lp_build_name(coro, "coro");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(lc, function, "entry");
+   builder = gallivm->builder;
+   assert(builder);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(cs_type));
+
+   memset(&system_values, 0, sizeof system_values);
+
+   block_size_ptr = lp_jit_cs_context_block_size(gallivm, context_ptr);
+   grid_size_ptr = lp_jit_cs_context_grid_size(gallivm, context_ptr);
+   for (i = 0; i < 3; i++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, i);
+
+      system_values.block_id[i] = block_id[i];
+      system_values.block_size[i] =
+         lp_build_array_get(gallivm, block_size_ptr, index);
+      system_values.grid_size[i] =
+         lp_build_array_get(gallivm, grid_size_ptr, index);
+   }
+
+   /* linear invocation index of every lane, and from it the thread ids */
+   for (i = 0; i < cs_type.length; i++) {
+      lane_ids[i] = lp_build_const_int32(gallivm, i);
+   }
+   ids = LLVMBuildAdd(builder,
+                      lp_build_broadcast_scalar(&uint_bld, invocation),
+                      LLVMConstVector(lane_ids, cs_type.length), "");
+
+   tmp = lp_build_broadcast_scalar(&uint_bld, system_values.block_size[0]);
+   system_values.thread_id[0] = LLVMBuildURem(builder, ids, tmp, "");
+   tmp = LLVMBuildUDiv(builder, ids, tmp, "");
+   system_values.thread_id[1] =
+      LLVMBuildURem(builder, tmp,
+                    lp_build_broadcast_scalar(&uint_bld,
+                                              system_values.block_size[1]), "");
+   system_values.thread_id[2] =
+      LLVMBuildUDiv(builder, tmp,
+                    lp_build_broadcast_scalar(&uint_bld,
+                                              system_values.block_size[1]), "");
+
+   /* lanes past the end of the block are masked out */
+   total = LLVMBuildMul(builder, system_values.block_size[0],
+                        system_values.block_size[1], "");
+   total = LLVMBuildMul(builder, total, system_values.block_size[2], "");
+   mask_val = lp_build_cmp(&uint_bld, PIPE_FUNC_LESS, ids,
+                           lp_build_broadcast_scalar(&uint_bld, total));
+
+   lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
+
+   consts_ptr = lp_jit_cs_context_constants(gallivm, context_ptr);
+   num_consts_ptr = lp_jit_cs_context_num_constants(gallivm, context_ptr);
+
+   memset(&cs_iface, 0, sizeof cs_iface);
+   cs_iface.base.ssbo_ptr = lp_jit_cs_context_ssbos(gallivm, context_ptr);
+   cs_iface.base.ssbo_sizes_ptr =
+      lp_jit_cs_context_ssbo_sizes(gallivm, context_ptr);
+   cs_iface.base.shared_ptr = shared_ptr;
+   cs_iface.base.shared_size =
+      lp_jit_cs_context_shared_size(gallivm, context_ptr);
+   cs_iface.base.emit_barrier = cs_emit_barrier;
+   cs_iface.coro = coro;
+
+   memset(outputs, 0, sizeof outputs);
+
+   lp_build_tgsi_soa(gallivm, shader->base.tokens, cs_type, &mask,
+                     consts_ptr, num_consts_ptr, &system_values,
+                     NULL, outputs, context_ptr, NULL,
+                     NULL, &shader->info, NULL, &cs_iface.base);
+
+   lp_build_mask_end(&mask);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader)
+{
+   struct lp_compute_shader_variant *variant;
+   char module_name[64];
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   util_snprintf(module_name, sizeof(module_name), "cs%u", shader->no);
+
+   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   lp_jit_init_cs_types(variant);
+
+   generate_compute(lp, shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs = lp_build_count_ir_module(variant->gallivm->module);
+
+   variant->jit_function = (lp_jit_cs_func)
+      gallivm_jit_function(variant->gallivm, variant->function);
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct lp_compute_shader *shader;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->no = cs_no++;
+   shader->req_local_mem = templ->req_local_mem;
+
+   shader->base.tokens = tgsi_dup_tokens(templ->prog);
+   if (!shader->base.tokens) {
+      FREE(shader);
+      return NULL;
+   }
+
+   tgsi_scan_shader(shader->base.tokens, &shader->info);
+
+   shader->has_barriers =
+      shader->info.opcode_count[TGSI_OPCODE_BARRIER] > 0;
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->base.tokens, 0);
+      debug_printf("\n");
+   }
+
+   shader->variant = generate_variant(llvmpipe, shader);
+   if (!shader->variant) {
+      FREE((void *) shader->base.tokens);
+      FREE(shader);
+      return NULL;
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *) cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct lp_compute_shader *shader = (struct lp_compute_shader *) cs;
+
+   if (!shader)
+      return;
+
+   gallivm_destroy(shader->variant->gallivm);
+   FREE(shader->variant);
+   FREE((void *) shader->base.tokens);
+   FREE(shader);
+}
+
+
+static void
+llvmpipe_set_shader_buffers(struct pipe_context *pipe, unsigned shader,
+                            unsigned start_slot, unsigned count,
+                            struct pipe_shader_buffer *buffers)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(shader < PIPE_SHADER_TYPES);
+   assert(start_slot + count <= Elements(llvmpipe->ssbos[shader]));
+
+   for (i = 0; i < count; i++) {
+      struct pipe_shader_buffer *dst = &llvmpipe->ssbos[shader][start_slot + i];
+
+      if (buffers && buffers[i].buffer) {
+         pipe_resource_reference(&dst->buffer, buffers[i].buffer);
+         dst->buffer_offset = buffers[i].buffer_offset;
+         dst->buffer_size = buffers[i].buffer_size;
+      }
+      else {
+         pipe_resource_reference(&dst->buffer, NULL);
+         dst->buffer_offset = 0;
+         dst->buffer_size = 0;
+      }
+   }
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const struct pipe_grid_info *info)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader *shader = llvmpipe->cs;
+   struct lp_cs_job job;
+   unsigned num_blocks, num_invocations;
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   memset(&job, 0, sizeof job);
+
+   if (info->indirect) {
+      const uint32_t *grid = (const uint32_t *)
+         ((const uint8_t *) llvmpipe_resource_data(info->indirect) +
+          info->indirect_offset);
+      for (i = 0; i < 3; i++)
+         job.grid[i] = grid[i];
+   }
+   else {
+      for (i = 0; i < 3; i++)
+         job.grid[i] = info->grid[i];
+   }
+
+   num_blocks = job.grid[0] * job.grid[1] * job.grid[2];
+   num_invocations = info->block[0] * info->block[1] * info->block[2];
+   if (!num_blocks || !num_invocations)
+      return;
+
+   /* The shader reads and writes buffers directly, so any rendering to
+    * them must be done first.
+    */
+   llvmpipe_finish(pipe, __FUNCTION__);
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      static const float fake_const_buf[4];
+      const struct pipe_constant_buffer *cb =
+         &llvmpipe->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         job.jit_context.constants[i] =
+            (const float *) (data + cb->buffer_offset);
+         job.jit_context.num_constants[i] =
+            MIN2(cb->buffer_size, LP_MAX_TGSI_CONST_BUFFER_SIZE) /
+            (sizeof(float) * 4);
+      }
+      else {
+         job.jit_context.constants[i] = fake_const_buf;
+         job.jit_context.num_constants[i] = 0;
+      }
+   }
+
+   for (i = 0; i < LP_MAX_TGSI_SHADER_BUFFERS; i++) {
+      const struct pipe_shader_buffer *sb =
+         &llvmpipe->ssbos[PIPE_SHADER_COMPUTE][i];
+
+      if (sb->buffer && sb->buffer_offset < sb->buffer->width0) {
+         job.jit_context.ssbos[i] =
+            (uint8_t *) llvmpipe_resource_data(sb->buffer) + sb->buffer_offset;
+         job.jit_context.ssbo_sizes[i] =
+            MIN2(sb->buffer_size, sb->buffer->width0 - sb->buffer_offset);
+      }
+   }
+
+   for (i = 0; i < 3; i++) {
+      job.jit_context.block_size[i] = info->block[i];
+      job.jit_context.grid_size[i] = job.grid[i];
+   }
+   job.jit_context.shared_size = shader->req_local_mem;
+
+   job.func = shader->variant->jit_function;
+   job.lp = llvmpipe;
+   job.vector_length = MIN2(lp_native_vector_width / 32, 16);
+   job.num_vectors = (num_invocations + job.vector_length - 1) /
+                     job.vector_length;
+   job.has_barriers = shader->has_barriers && job.num_vectors > 1;
+
+   lp_cs_tpool_run(screen->cs_tpool, run_block, &job, num_blocks);
+}
+
+
+/**
+ * Free the per thread compute scratch memory.
+ */
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe)
+{
+   unsigned i;
+
+   for (i = 0; i < llvmpipe->num_cs_locals; i++) {
+      struct lp_cs_local *local = llvmpipe->cs_locals[i];
+
+      if (!local)
+         continue;
+
+      align_free(local->shared_mem);
+#if LP_HAVE_COMPUTE
+      FREE(local->coros);
+      FREE(local->stacks);
+#endif
+      FREE(local);
+   }
+
+   FREE(llvmpipe->cs_locals);
+   llvmpipe->cs_locals = NULL;
+   llvmpipe->num_cs_locals = 0;
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.set_shader_buffers = llvmpipe_set_shader_buffers;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
@@ -0,0 +1,90 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef LP_STATE_CS_H
+#define LP_STATE_CS_H
+
+#include "pipe/p_config.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "gallivm/lp_bld.h"
+#include "lp_jit.h"
+
+
+struct llvmpipe_context;
+
+
+/*
+ * Barriers switch between the invocations of a block with ucontext
+ * coroutines, so compute shaders are only available where those are.
+ */
+#if defined(PIPE_OS_UNIX) && !defined(PIPE_OS_ANDROID) && !defined(PIPE_OS_APPLE)
+#define LP_HAVE_COMPUTE 1
+#else
+#define LP_HAVE_COMPUTE 0
+#endif
+
+
+struct lp_compute_shader_variant
+{
+   struct gallivm_state *gallivm;
+
+   LLVMTypeRef jit_cs_context_ptr_type;
+
+   LLVMValueRef function;
+   lp_jit_cs_func jit_function;
+
+   /* Total number of LLVM instructions generated */
+   unsigned nr_instrs;
+};
+
+
+/** Subclass of pipe_compute_state */
+struct lp_compute_shader
+{
+   struct pipe_shader_state base;
+
+   struct tgsi_shader_info info;
+
+   unsigned req_local_mem;
+
+   /** Whether the invocations of a block have to run as coroutines */
+   boolean has_barriers;
+
+   unsigned no;
+
+   struct lp_compute_shader_variant *variant;
+};
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe);
+
+
+#endif /* LP_STATE_CS_H */
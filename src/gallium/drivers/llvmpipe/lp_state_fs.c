@@ -66,7 +66,10 @@
 #include "util/u_dump.h"
 #include "util/u_string.h"
 #include "util/simple_list.h"
+#include "util/hash_table.h"
 #include "util/u_dual_blend.h"
+#include "util/u_framebuffer.h"
+#include "util/u_atomic.h"
 #include "os/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -93,12 +96,14 @@
 #include "lp_bld_depth.h"
 #include "lp_bld_interp.h"
 #include "lp_context.h"
+#include "lp_screen.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_tex_sample.h"
 #include "lp_flush.h"
+#include "lp_query.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
 
@@ -240,6 +245,11 @@ lp_llvm_viewport(LLVMValueRef context_ptr,
 
 /**
  * Generate the fragment shader, depth/stencil test, and alpha tests.
+ *
+ * With multisampling the depth/stencil test is done per sample after the
+ * loop.  In that case the depth value (and the stencil reference, if the
+ * shader writes it) of each iteration is stored to z_store (s_store)
+ * instead.
  */
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
@@ -256,7 +266,9 @@ generate_fs_loop(struct gallivm_state *gallivm,
                  LLVMValueRef depth_ptr,
                  LLVMValueRef depth_stride,
                  LLVMValueRef facing,
-                 LLVMValueRef thread_data_ptr)
+                 LLVMValueRef thread_data_ptr,
+                 LLVMValueRef z_store,
+                 LLVMValueRef s_store)
 {
    const struct util_format_description *zs_format_desc = NULL;
    const struct tgsi_token *tokens = shader->base.tokens;
@@ -325,6 +337,10 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                         (key->stencil[1].enabled &&
                                          key->stencil[1].writemask))))
          depth_mode &= ~(LATE_DEPTH_WRITE | EARLY_DEPTH_WRITE);
+
+      /* Only compute the depth value here, see above */
+      if (key->multisample)
+         depth_mode = LATE_DEPTH_TEST;
    }
    else {
       depth_mode = 0;
@@ -422,7 +438,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
                      consts_ptr, num_consts_ptr, &system_values,
                      interp->inputs,
                      outputs, context_ptr, thread_data_ptr,
-                     sampler, &shader->info.base, NULL);
+                     sampler, &shader->info.base, NULL, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -525,31 +541,44 @@ generate_fs_loop(struct gallivm_state *gallivm,
          stencil_refs[0] = LLVMBuildBitCast(builder, stencil_refs[0], int_vec_type, "");
          stencil_refs[0] = LLVMBuildAnd(builder, stencil_refs[0], s_max_mask, "");
          stencil_refs[1] = stencil_refs[0];
-      }
 
-      lp_build_depth_stencil_load_swizzled(gallivm, type,
-                                           zs_format_desc, key->resource_1d,
-                                           depth_ptr, depth_stride,
-                                           &z_fb, &s_fb, loop_state.counter);
+         if (s_store) {
+            LLVMBuildStore(builder, stencil_refs[0],
+                           LLVMBuildGEP(builder, s_store,
+                                        &loop_state.counter, 1, ""));
+         }
+      }
 
-      lp_build_depth_stencil_test(gallivm,
-                                  &key->depth,
-                                  key->stencil,
-                                  type,
-                                  zs_format_desc,
-                                  &mask,
-                                  stencil_refs,
-                                  z, z_fb, s_fb,
-                                  facing,
-                                  &z_value, &s_value,
-                                  !simple_shader);
-      /* Late Z write */
-      if (depth_mode & LATE_DEPTH_WRITE) {
-         lp_build_depth_stencil_write_swizzled(gallivm, type,
-                                               zs_format_desc, key->resource_1d,
-                                               NULL, NULL, NULL, loop_state.counter,
-                                               depth_ptr, depth_stride,
-                                               z_value, s_value);
+      if (z_store) {
+         LLVMBuildStore(builder, z,
+                        LLVMBuildGEP(builder, z_store,
+                                     &loop_state.counter, 1, ""));
+      }
+      else {
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_state.counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     z, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     !simple_shader);
+         /* Late Z write */
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_state.counter,
+                                                  depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
       }
    }
    else if ((depth_mode & EARLY_DEPTH_TEST) &&
@@ -590,7 +619,8 @@ generate_fs_loop(struct gallivm_state *gallivm,
       }
    }
 
-   if (key->occlusion_count) {
+   /* With multisampling, samples are counted after the depth test */
+   if (key->occlusion_count && !key->multisample) {
       LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
       lp_build_name(counter, "counter");
       lp_build_occlusion_count(gallivm, type,
@@ -1685,7 +1715,9 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* blending is done at most 8-wide, see generate_fragment */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256) :
+                                         lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2153,6 +2185,176 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Compute the per-sample coverage masks of a multisampled 4x4 stamp,
+ * doing the depth/stencil test and the occlusion count for each sample.
+ *
+ * The shader itself runs once per pixel; fs_mask holds the pixels which
+ * survived it, and z_store/s_store its depth and stencil reference values
+ * at the pixel centers.
+ *
+ * \param mask_input  coverage of the stamp, 16 bits per sample
+ * \param sample_mask  returns the coverage vectors of each sample
+ */
+static void
+generate_sample_masks(struct gallivm_state *gallivm,
+                      struct lp_fragment_shader *shader,
+                      const struct lp_fragment_shader_variant_key *key,
+                      struct lp_type type,
+                      unsigned num_fs,
+                      LLVMValueRef mask_input,
+                      unsigned partial_mask,
+                      const LLVMValueRef *fs_mask,
+                      LLVMValueRef z_store,
+                      LLVMValueRef s_store,
+                      LLVMValueRef context_ptr,
+                      LLVMValueRef depth_ptr,
+                      LLVMValueRef depth_stride,
+                      LLVMValueRef depth_sample_stride,
+                      LLVMValueRef dadx_ptr,
+                      LLVMValueRef dady_ptr,
+                      LLVMValueRef facing,
+                      LLVMValueRef thread_data_ptr,
+                      LLVMValueRef sample_mask[LP_MAX_SAMPLES][16 / 4])
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
+   LLVMTypeRef int_vec_type = lp_build_int_vec_type(gallivm, type);
+   const struct util_format_description *zs_format_desc = NULL;
+   LLVMValueRef stencil_refs[2] = { NULL, NULL };
+   LLVMValueRef dzdx = NULL, dzdy = NULL;
+   LLVMValueRef counter = NULL;
+   boolean depth_write = FALSE;
+   unsigned s, i;
+
+   if (z_store) {
+      zs_format_desc = util_format_description(key->zsbuf_format);
+      assert(zs_format_desc);
+
+      depth_write = (key->depth.enabled && key->depth.writemask) ||
+                    (key->stencil[0].enabled &&
+                     (key->stencil[0].writemask ||
+                      (key->stencil[1].enabled && key->stencil[1].writemask)));
+
+      /* The depth plane gradients, to move z from the pixel center */
+      if (!shader->info.base.writes_z) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, 2);
+         dzdx = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, dadx_ptr, &index, 1, ""),
+                              "dzdx");
+         dzdy = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, dady_ptr, &index, 1, ""),
+                              "dzdy");
+      }
+
+      if (!s_store) {
+         stencil_refs[0] = lp_jit_context_stencil_ref_front_value(gallivm, context_ptr);
+         stencil_refs[1] = lp_jit_context_stencil_ref_back_value(gallivm, context_ptr);
+         stencil_refs[0] = lp_build_broadcast(gallivm, int_vec_type, stencil_refs[0]);
+         stencil_refs[1] = lp_build_broadcast(gallivm, int_vec_type, stencil_refs[1]);
+      }
+   }
+
+   if (key->occlusion_count) {
+      counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
+      lp_build_name(counter, "counter");
+   }
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      LLVMValueRef smask_input = NULL;
+      LLVMValueRef sample_depth_ptr = NULL;
+
+      if (!(key->sample_mask & (1 << s))) {
+         for (i = 0; i < num_fs; i++)
+            sample_mask[s][i] = lp_build_const_int_vec(gallivm, type, 0);
+         continue;
+      }
+
+      if (partial_mask) {
+         smask_input = LLVMBuildLShr(builder, mask_input,
+                                     LLVMConstInt(int64_type, 16 * s, 0), "");
+         smask_input = LLVMBuildTrunc(builder, smask_input, int32_type, "");
+      }
+
+      if (z_store) {
+         LLVMValueRef offset = LLVMBuildMul(builder, depth_sample_stride,
+                                            lp_build_const_int32(gallivm, s), "");
+         sample_depth_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1,
+                                         "sample_depth_ptr");
+      }
+
+      for (i = 0; i < num_fs; i++) {
+         LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
+         LLVMValueRef mask = fs_mask[i];
+
+         if (partial_mask) {
+            mask = LLVMBuildAnd(builder, mask,
+                                generate_quad_mask(gallivm, type,
+                                                   i*type.length/4, smask_input),
+                                "");
+         }
+
+         if (z_store) {
+            struct lp_build_mask_context mask_ctx;
+            LLVMValueRef z, z_fb, s_fb, z_value, s_value;
+
+            z = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, z_store, &indexi, 1, ""),
+                              "z");
+            if (dzdx) {
+               z = lp_build_depth_sample_z(gallivm, type, z, dzdx, dzdy,
+                                           (float)lp_sample_pos[s][0] / FIXED_ONE,
+                                           (float)lp_sample_pos[s][1] / FIXED_ONE);
+            }
+
+            if (s_store) {
+               stencil_refs[0] = LLVMBuildLoad(builder,
+                                               LLVMBuildGEP(builder, s_store,
+                                                            &indexi, 1, ""),
+                                               "s");
+               stencil_refs[1] = stencil_refs[0];
+            }
+
+            lp_build_mask_begin(&mask_ctx, gallivm, type, mask);
+
+            lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                                 zs_format_desc, key->resource_1d,
+                                                 sample_depth_ptr, depth_stride,
+                                                 &z_fb, &s_fb, indexi);
+
+            lp_build_depth_stencil_test(gallivm,
+                                        &key->depth,
+                                        key->stencil,
+                                        type,
+                                        zs_format_desc,
+                                        &mask_ctx,
+                                        stencil_refs,
+                                        z, z_fb, s_fb,
+                                        facing,
+                                        &z_value, &s_value,
+                                        FALSE);
+
+            if (depth_write) {
+               lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                     zs_format_desc, key->resource_1d,
+                                                     NULL, NULL, NULL, indexi,
+                                                     sample_depth_ptr, depth_stride,
+                                                     z_value, s_value);
+            }
+
+            mask = lp_build_mask_end(&mask_ctx);
+         }
+
+         if (counter)
+            lp_build_occlusion_count(gallivm, type, mask, counter);
+
+         sample_mask[s][i] = mask;
+      }
+   }
+}
+
+
 /**
  * Generate the runtime callable function for the whole fragment pipeline.
  * Note that the function which we generate operates on a block of 16
@@ -2173,9 +2375,10 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[13];
+   LLVMTypeRef arg_types[15];
    LLVMTypeRef func_type;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
    LLVMValueRef context_ptr;
    LLVMValueRef x;
@@ -2188,12 +2391,16 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef depth_ptr;
    LLVMValueRef depth_stride;
    LLVMValueRef mask_input;
+   LLVMValueRef pixel_mask;
    LLVMValueRef thread_data_ptr;
+   LLVMValueRef sample_stride_ptr;
+   LLVMValueRef depth_sample_stride;
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
    struct lp_build_sampler_soa *sampler;
    struct lp_build_interp_soa_context interp;
    LLVMValueRef fs_mask[16 / 4];
+   LLVMValueRef sample_mask[LP_MAX_SAMPLES][16 / 4];
    LLVMValueRef fs_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][16 / 4];
    LLVMValueRef function;
    LLVMValueRef facing;
@@ -2261,10 +2468,12 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[6] = LLVMPointerType(fs_elem_type, 0);    /* dady */
    arg_types[7] = LLVMPointerType(LLVMPointerType(blend_vec_type, 0), 0);  /* color */
    arg_types[8] = LLVMPointerType(int8_type, 0);       /* depth */
-   arg_types[9] = int32_type;                          /* mask_input */
+   arg_types[9] = int64_type;                          /* mask_input */
    arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
    arg_types[11] = LLVMPointerType(int32_type, 0);     /* stride */
    arg_types[12] = int32_type;                         /* depth_stride */
+   arg_types[13] = LLVMPointerType(int32_type, 0);     /* sample_stride */
+   arg_types[14] = int32_type;                         /* depth_sample_stride */
 
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, Elements(arg_types), 0);
@@ -2294,6 +2503,8 @@ generate_fragment(struct llvmpipe_context *lp,
    thread_data_ptr  = LLVMGetParam(function, 10);
    stride_ptr   = LLVMGetParam(function, 11);
    depth_stride = LLVMGetParam(function, 12);
+   sample_stride_ptr = LLVMGetParam(function, 13);
+   depth_sample_stride = LLVMGetParam(function, 14);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(x, "x");
@@ -2307,6 +2518,8 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_build_name(thread_data_ptr, "thread_data");
    lp_build_name(stride_ptr, "stride_ptr");
    lp_build_name(depth_stride, "depth_stride");
+   lp_build_name(sample_stride_ptr, "sample_stride_ptr");
+   lp_build_name(depth_sample_stride, "depth_sample_stride");
 
    /*
     * Function body
@@ -2322,7 +2535,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
    num_fs = 16 / fs_type.length; /* number of loops per 4x4 stamp */
    /* for 1d resources only run "upper half" of stamp */
-   if (key->resource_1d)
+   if (key->resource_1d && num_fs > 1)
       num_fs /= 2;
 
    {
@@ -2331,6 +2544,8 @@ generate_fragment(struct llvmpipe_context *lp,
       LLVMValueRef mask_store = lp_build_array_alloca(gallivm, mask_type,
                                                       num_loop, "mask_store");
       LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS];
+      LLVMValueRef z_store = NULL;
+      LLVMValueRef s_store = NULL;
       boolean pixel_center_integer =
          shader->info.base.properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER];
 
@@ -2348,6 +2563,23 @@ generate_fragment(struct llvmpipe_context *lp,
                                a0_ptr, dadx_ptr, dady_ptr,
                                x, y);
 
+      /*
+       * The shader runs once per pixel, for every pixel with at least one
+       * covered sample.
+       */
+      pixel_mask = mask_input;
+      if (key->multisample) {
+         pixel_mask = LLVMBuildOr(builder, pixel_mask,
+                                  LLVMBuildLShr(builder, pixel_mask,
+                                                LLVMConstInt(int64_type, 32, 0), ""),
+                                  "");
+         pixel_mask = LLVMBuildOr(builder, pixel_mask,
+                                  LLVMBuildLShr(builder, pixel_mask,
+                                                LLVMConstInt(int64_type, 16, 0), ""),
+                                  "");
+      }
+      pixel_mask = LLVMBuildTrunc(builder, pixel_mask, int32_type, "pixel_mask");
+
       for (i = 0; i < num_fs; i++) {
          LLVMValueRef mask;
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
@@ -2356,7 +2588,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
          if (partial_mask) {
             mask = generate_quad_mask(gallivm, fs_type,
-                                      i*fs_type.length/4, mask_input);
+                                      i*fs_type.length/4, pixel_mask);
          }
          else {
             mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
@@ -2364,6 +2596,21 @@ generate_fragment(struct llvmpipe_context *lp,
          LLVMBuildStore(builder, mask, mask_ptr);
       }
 
+      if (key->multisample &&
+          (key->depth.enabled || key->stencil[0].enabled)) {
+         LLVMTypeRef vec_type = lp_build_vec_type(gallivm, fs_type);
+         LLVMTypeRef int_vec_type = lp_build_int_vec_type(gallivm, fs_type);
+
+         z_store = lp_build_array_alloca(gallivm, vec_type,
+                                         num_loop, "z_store");
+         if (key->stencil[0].enabled &&
+             find_output_by_semantic(&shader->info.base,
+                                     TGSI_SEMANTIC_STENCIL, 0) >= 0) {
+            s_store = lp_build_array_alloca(gallivm, int_vec_type,
+                                            num_loop, "s_store");
+         }
+      }
+
       generate_fs_loop(gallivm,
                        shader, key,
                        builder,
@@ -2377,7 +2624,9 @@ generate_fragment(struct llvmpipe_context *lp,
                        depth_ptr,
                        depth_stride,
                        facing,
-                       thread_data_ptr);
+                       thread_data_ptr,
+                       z_store,
+                       s_store);
 
       for (i = 0; i < num_fs; i++) {
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
@@ -2403,10 +2652,64 @@ generate_fragment(struct llvmpipe_context *lp,
             }
          }
       }
+
+      if (key->multisample) {
+         generate_sample_masks(gallivm, shader, key, fs_type, num_fs,
+                               mask_input, partial_mask, fs_mask,
+                               z_store, s_store, context_ptr,
+                               depth_ptr, depth_stride, depth_sample_stride,
+                               dadx_ptr, dady_ptr, facing, thread_data_ptr,
+                               sample_mask);
+      }
    }
 
    sampler->destroy(sampler);
 
+   /*
+    * Blending and the color buffer swizzles only handle up to 8-wide
+    * vectors, so when shading a whole 4x4 block per 16-wide vector, blend
+    * its upper and lower halves separately.  The halves match the two
+    * iterations of the 8-wide fs loop.
+    */
+   if (fs_type.length == 16) {
+      LLVMValueRef mask16 = fs_mask[0];
+      LLVMTypeRef vec8_ptr_type;
+      unsigned nr_outputs = dual_source_blend ? MAX2(key->nr_cbufs, 2) :
+                                                key->nr_cbufs;
+
+      fs_type.length = 8;
+      vec8_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, fs_type), 0);
+      num_fs = key->resource_1d ? 1 : 2;
+
+      for (i = 0; i < num_fs; i++) {
+         fs_mask[i] = lp_build_extract_range(gallivm, mask16, i * 8, 8);
+      }
+
+      if (key->multisample) {
+         unsigned s;
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            LLVMValueRef smask16 = sample_mask[s][0];
+            for (i = 0; i < num_fs; i++) {
+               sample_mask[s][i] = lp_build_extract_range(gallivm, smask16,
+                                                          i * 8, 8);
+            }
+         }
+      }
+
+      for (cbuf = 0; cbuf < nr_outputs; cbuf++) {
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+            LLVMValueRef ptr16 = fs_out_color[cbuf][chan][0];
+            LLVMValueRef ptr8 = LLVMBuildBitCast(builder, ptr16,
+                                                 vec8_ptr_type, "");
+            for (i = 0; i < num_fs; i++) {
+               LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
+               fs_out_color[cbuf][chan][i] = LLVMBuildGEP(builder, ptr8,
+                                                          &indexi, 1, "");
+            }
+         }
+      }
+   }
+
    /* Loop over color outputs / color buffers to do blending.
     */
    for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
@@ -2431,11 +2734,47 @@ generate_fragment(struct llvmpipe_context *lp,
                                 LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
                                 "");
 
-         generate_unswizzled_blend(gallivm, cbuf, variant,
-                                   key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
-                                   context_ptr, color_ptr, stride,
-                                   partial_mask, do_branch);
+         if (key->multisample) {
+            /* Blend the shaded pixels into each sample they cover */
+            LLVMTypeRef color_ptr_type = LLVMTypeOf(color_ptr);
+            LLVMTypeRef int8_ptr_type = LLVMPointerType(int8_type, 0);
+            LLVMValueRef sample_stride;
+            unsigned s;
+
+            sample_stride = LLVMBuildLoad(builder,
+                                          LLVMBuildGEP(builder, sample_stride_ptr,
+                                                       &index, 1, ""),
+                                          "sample_stride");
+
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               LLVMValueRef offset, sample_ptr;
+
+               if (!(key->sample_mask & (1 << s)))
+                  continue;
+
+               offset = LLVMBuildMul(builder, sample_stride,
+                                     lp_build_const_int32(gallivm, s), "");
+               sample_ptr = LLVMBuildBitCast(builder, color_ptr,
+                                             int8_ptr_type, "");
+               sample_ptr = LLVMBuildGEP(builder, sample_ptr, &offset, 1, "");
+               sample_ptr = LLVMBuildBitCast(builder, sample_ptr,
+                                             color_ptr_type, "");
+
+               generate_unswizzled_blend(gallivm, cbuf, variant,
+                                         key->cbuf_format[cbuf],
+                                         num_fs, fs_type, sample_mask[s],
+                                         fs_out_color, context_ptr,
+                                         sample_ptr, stride,
+                                         partial_mask, do_branch);
+            }
+         }
+         else {
+            generate_unswizzled_blend(gallivm, cbuf, variant,
+                                      key->cbuf_format[cbuf],
+                                      num_fs, fs_type, fs_mask, fs_out_color,
+                                      context_ptr, color_ptr, stride,
+                                      partial_mask, do_branch);
+         }
       }
    }
 
@@ -2483,6 +2822,11 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
       debug_printf("occlusion_count = 1\n");
    }
 
+   if (key->multisample) {
+      debug_printf("multisample = 1\n");
+      debug_printf("sample_mask = 0x%x\n", key->sample_mask);
+   }
+
    if (key->blend.logicop_enable) {
       debug_printf("blend.logicop_func = %s\n", util_dump_logicop(key->blend.logicop_func, TRUE));
    }
@@ -2544,38 +2888,281 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz = 0x%x\n", variant->hiz);
    debug_printf("\n");
 }
 
 
+/**
+ * Generate and compile the code of a fragment shader variant, in the
+ * given LLVM context and with the variant's optimization tier.
+ * \return FALSE if the jit functions couldn't be produced
+ */
+static boolean
+compile_variant(struct lp_fragment_shader_variant *variant,
+                LLVMContextRef context)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   char module_name[64];
+
+   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                 shader->no, variant->no);
+
+   variant->gallivm = gallivm_create(module_name, context);
+   if (!variant->gallivm) {
+      return FALSE;
+   }
+   variant->gallivm->opt_tier = variant->opt_tier;
+
+   lp_jit_init_types(variant);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(variant->lp, shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(variant->lp, shader, variant, RAST_WHOLE);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+   if (!variant->gallivm->engine) {
+      return FALSE;
+   }
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant->jit_function[RAST_EDGE_TEST] != NULL &&
+          variant->jit_function[RAST_WHOLE] != NULL;
+}
+
+
+/**
+ * Compile job callback, run by one of the screen's compile threads.
+ */
+static void
+compile_variant_job(struct lp_compile_job *job, LLVMContextRef context)
+{
+   struct lp_fragment_shader_variant *variant =
+      (struct lp_fragment_shader_variant *)
+      ((char *) job - Offset(struct lp_fragment_shader_variant, compile_job));
+   int64_t t0, t1;
+
+   t0 = os_time_get();
+   if (!compile_variant(variant, context)) {
+      /* Nothing gets drawn with the variant, see lp_rast.c. */
+      debug_printf("llvmpipe: failed to compile fragment shader variant %u\n",
+                   variant->no);
+      job->failed = TRUE;
+   }
+   t1 = os_time_get();
+
+   LP_COUNT_ADD(llvm_compile_time, t1 - t0);
+   lp_stats_add(variant->lp, LP_STAT_COMPILE_TIME, t1 - t0);
+
+   /* The variant was accounted for with no instructions when it was
+    * created, see llvmpipe_update_fs().
+    */
+   p_atomic_add(&variant->lp->nr_fs_instrs, variant->nr_instrs);
+}
+
+
+/**
+ * Compile the variant again with the tier it was promoted to, and publish
+ * the new code in variant->promoted.
+ */
+static void
+promote_variant_job(struct lp_compile_job *job, LLVMContextRef context)
+{
+   struct lp_fragment_shader_variant *variant =
+      (struct lp_fragment_shader_variant *)
+      ((char *) job - Offset(struct lp_fragment_shader_variant, promote_job));
+   struct lp_fragment_shader_variant *tmp;
+   struct lp_fs_variant_code *code;
+
+   /* Build the new code in a scratch variant, with only the state code
+    * generation looks at, so that nothing the rasterizer or the other
+    * compile jobs may be using is touched.
+    */
+   tmp = CALLOC_STRUCT(lp_fragment_shader_variant);
+   code = CALLOC_STRUCT(lp_fs_variant_code);
+   if (!tmp || !code)
+      goto fail;
+
+   memcpy(&tmp->key, &variant->key, variant->shader->variant_key_size);
+   tmp->shader = variant->shader;
+   tmp->lp = variant->lp;
+   tmp->no = variant->no;
+   tmp->opaque = variant->opaque;
+   tmp->hiz = variant->hiz;
+   tmp->ps_inv_multiplier = variant->ps_inv_multiplier;
+   tmp->opt_tier = variant->opt_tier;
+
+   if (!compile_variant(tmp, context))
+      goto fail;
+
+   code->gallivm = tmp->gallivm;
+   code->jit_function[RAST_EDGE_TEST] = tmp->jit_function[RAST_EDGE_TEST];
+   code->jit_function[RAST_WHOLE] = tmp->jit_function[RAST_WHOLE];
+   p_atomic_set_release(&variant->promoted, code);
+
+   FREE(tmp);
+   return;
+
+fail:
+   if (tmp && tmp->gallivm)
+      gallivm_destroy(tmp->gallivm);
+   FREE(tmp);
+   FREE(code);
+}
+
+
+/**
+ * Count a draw with the current fragment shader variant, and recompile it
+ * with a higher optimization tier if it was used often enough.
+ */
+void
+llvmpipe_use_fs_variant(struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+   enum gallivm_opt_tier opt_tier;
+
+   if (!variant)
+      return;
+
+   variant->uses++;
+
+   if (variant->promotion_queued)
+      return;
+
+   opt_tier = gallivm_get_opt_tier(PIPE_SHADER_FRAGMENT, variant->uses);
+   if (opt_tier <= variant->opt_tier)
+      return;
+
+   /* The first compile must be done before its code can be replaced. */
+   if (!lp_compile_job_is_done(&variant->compile_job) ||
+       variant->compile_job.failed)
+      return;
+
+   variant->promotion_queued = TRUE;
+   variant->opt_tier = opt_tier;
+   LP_COUNT(nr_fs_variant_promotions);
+
+   variant->promote_job.execute = promote_variant_job;
+   if (screen->compile_queue) {
+      lp_compile_queue_add(screen->compile_queue, &variant->promote_job);
+   }
+   else {
+      promote_variant_job(&variant->promote_job, lp->context);
+   }
+}
+
+
+/**
+ * Determine how primitives drawn with the given state interact with the
+ * rasterizer's hierarchical z summaries, which hold the maximum depth
+ * value of each block of the depth buffer.
+ */
+static unsigned
+fs_variant_hiz(const struct lp_fragment_shader_variant_key *key,
+               const struct tgsi_shader_info *info)
+{
+   unsigned hiz = 0;
+   unsigned i;
+
+   if (!key->depth.enabled)
+      return 0;
+
+   if (key->depth.func != PIPE_FUNC_LESS &&
+       key->depth.func != PIPE_FUNC_LEQUAL) {
+      /* Other tests let depth values grow, except for these */
+      if (key->depth.writemask &&
+          key->depth.func != PIPE_FUNC_EQUAL &&
+          key->depth.func != PIPE_FUNC_NEVER)
+         return LP_HIZ_INVALIDATE;
+      return 0;
+   }
+
+   /*
+    * Fragments failing the depth test can still update the stencil
+    * buffer, and depth written by the shader or clamped to the depth
+    * range isn't bounded by the primitive's.
+    */
+   hiz = LP_HIZ_TEST;
+   for (i = 0; i < 2; i++) {
+      if (key->stencil[i].enabled &&
+          key->stencil[i].zfail_op != PIPE_STENCIL_OP_KEEP)
+         hiz = 0;
+   }
+   if (info->writes_z || key->depth_clamp)
+      return 0;
+
+   /* Only if all covered pixels are sure to be written */
+   if (key->depth.writemask &&
+       !key->stencil[0].enabled &&
+       !key->alpha.enabled &&
+       !key->blend.alpha_to_coverage &&
+       !info->uses_kill &&
+       (!key->multisample ||
+        key->sample_mask == (1 << LP_MAX_SAMPLES) - 1))
+      hiz |= LP_HIZ_UPDATE;
+
+   return hiz;
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * If the screen has a compile queue, the code is compiled in the
+ * background and the variant is returned straight away.  All the state
+ * needed for binning (the key, opaque, etc) is valid at that point, but
+ * the jit functions must not be called before the compile job is done.
+ * This only defers the compile: the first scene using the variant waits
+ * for the job before being rasterized, and there is no fallback shader
+ * to draw with meanwhile.  If the job fails, primitives using the
+ * variant are dropped by the rasterizer.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
-   char module_name[64];
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if (!variant)
       return NULL;
 
-   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-                 shader->no, shader->variants_created);
-
-   variant->gallivm = gallivm_create(module_name, lp->context);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
    variant->shader = shader;
+   variant->lp = lp;
+   variant->opt_tier = gallivm_get_opt_tier(PIPE_SHADER_FRAGMENT, 0);
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    variant->no = shader->variants_created++;
@@ -2599,9 +3186,13 @@ generate_variant(struct llvmpipe_context *lp,
          !key->alpha.enabled &&
          !key->blend.alpha_to_coverage &&
          !key->depth.enabled &&
-         !shader->info.base.uses_kill
+         !shader->info.base.uses_kill &&
+         (!key->multisample ||
+          key->sample_mask == (1 << LP_MAX_SAMPLES) - 1)
       ? TRUE : FALSE;
 
+   variant->hiz = fs_variant_hiz(key, &shader->info.base);
+
    if ((shader->info.base.num_tokens <= 1) &&
        !key->depth.enabled && !key->stencil[0].enabled) {
       variant->ps_inv_multiplier = 0;
@@ -2613,43 +3204,49 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+   /* Dumping the IR from several threads at once would be unreadable. */
+   if (screen->compile_queue && !(gallivm_debug & GALLIVM_DEBUG_IR)) {
+      variant->compile_job.execute = compile_variant_job;
+      lp_compile_queue_add(screen->compile_queue, &variant->compile_job);
+      return variant;
+   }
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
+   if (!compile_variant(variant, lp->context)) {
+      if (variant->gallivm)
+         gallivm_destroy(variant->gallivm);
+      FREE(variant);
+      return NULL;
    }
 
-   /*
-    * Compile everything
-    */
+   return variant;
+}
 
-   gallivm_compile_module(variant->gallivm);
 
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+/**
+ * The size of the meaningful part of a variant key.  It only depends on the
+ * shader, so keys of different sizes never match.
+ */
+static inline unsigned
+fs_variant_key_size(const struct lp_fragment_shader_variant_key *key)
+{
+   return Offset(struct lp_fragment_shader_variant_key,
+                 state[MAX2(key->nr_samplers, key->nr_sampler_views)]);
+}
 
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
-   }
+static uint32_t
+fs_variant_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, fs_variant_key_size(key));
+}
 
-   gallivm_free_ir(variant->gallivm);
 
-   return variant;
+static bool
+fs_variant_key_equals(const void *a, const void *b)
+{
+   unsigned size = fs_variant_key_size(a);
+
+   return size == fs_variant_key_size(b) && memcmp(a, b, size) == 0;
 }
 
 
@@ -2670,6 +3267,13 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    shader->no = fs_no++;
    make_empty_list(&shader->variants);
 
+   shader->variant_table = _mesa_hash_table_create(NULL, fs_variant_key_hash,
+                                                   fs_variant_key_equals);
+   if (!shader->variant_table) {
+      FREE(shader);
+      return NULL;
+   }
+
    /* get/save the summary info for this shader */
    lp_build_tgsi_info(templ->tokens, &shader->info);
 
@@ -2678,6 +3282,7 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
 
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
+      _mesa_hash_table_destroy(shader->variant_table, NULL);
       FREE((void *) shader->base.tokens);
       FREE(shader);
       return NULL;
@@ -2774,6 +3379,8 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   struct hash_entry *entry;
+
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
       debug_printf("llvmpipe: del fs #%u var #%u v created #%u v cached"
                    " #%u v total cached #%u\n",
@@ -2784,16 +3391,35 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
-   gallivm_destroy(variant->gallivm);
+   lp_compile_job_lock(&variant->compile_job);
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   lp_compile_job_unlock(&variant->compile_job);
+
+   lp_compile_job_lock(&variant->promote_job);
+   if (variant->promoted) {
+      gallivm_destroy(variant->promoted->gallivm);
+      FREE(variant->promoted);
+   }
+   lp_compile_job_unlock(&variant->promote_job);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
+   entry = _mesa_hash_table_search(variant->shader->variant_table,
+                                   &variant->key);
+   if (entry)
+      _mesa_hash_table_remove(variant->shader->variant_table, entry);
+   if (variant->shader->last_variant == variant)
+      variant->shader->last_variant = NULL;
 
    /* remove from context's list */
    remove_from_list(&variant->list_item_global);
    lp->nr_fs_variants--;
-   lp->nr_fs_instrs -= variant->nr_instrs;
+   p_atomic_add(&lp->nr_fs_instrs, -(int) variant->nr_instrs);
+
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
 
    FREE(variant);
 }
@@ -2826,7 +3452,15 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
    /* Delete draw module's data */
    draw_delete_fragment_shader(llvmpipe->draw, shader->draw_data);
 
+   if (LP_DEBUG & DEBUG_FS) {
+      debug_printf("llvmpipe: fs #%u: %u variant lookups, %u hits, "
+                   "%u variants created\n", shader->no,
+                   shader->variant_lookups, shader->variant_hits,
+                   shader->variants_created);
+   }
+
    assert(shader->variants_cached == 0);
+   _mesa_hash_table_destroy(shader->variant_table, NULL);
    FREE((void *) shader->base.tokens);
    FREE(shader);
 }
@@ -2900,6 +3534,21 @@ force_dst_alpha_one(unsigned factor, boolean clamped_zero)
 }
 
 
+/**
+ * Like lp_sampler_static_texture_state(), but also recording the layout of
+ * llvmpipe's textures.
+ */
+static void
+lp_fs_static_texture_state(struct lp_static_texture_state *state,
+                           const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && view->texture)
+      state->tiled = llvmpipe_resource(view->texture)->tiled;
+}
+
+
 /**
  * We need to generate several variants of the fragment pipeline to match
  * all the combinations of the contributing state atoms.
@@ -2963,6 +3612,11 @@ make_variant_key(struct llvmpipe_context *lp,
       key->occlusion_count = TRUE;
    }
 
+   if (util_framebuffer_get_num_samples(&lp->framebuffer) > 1) {
+      key->multisample = TRUE;
+      key->sample_mask = lp->sample_mask & ((1 << LP_MAX_SAMPLES) - 1);
+   }
+
    if (lp->framebuffer.nr_cbufs) {
       memcpy(&key->blend, lp->blend, sizeof key->blend);
    }
@@ -3069,8 +3723,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            lp_fs_static_texture_state(&key->state[i].texture_state,
+                                       lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3078,8 +3732,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            lp_fs_static_texture_state(&key->state[i].texture_state,
+                                       lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3097,25 +3751,38 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    struct lp_fragment_shader *shader = lp->fs;
    struct lp_fragment_shader_variant_key key;
    struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
+   uint32_t hash = 0;
 
    make_variant_key(lp, shader, &key);
 
-   /* Search the variants for one which matches the key */
-   li = first_elem(&shader->variants);
-   while(!at_end(&shader->variants, li)) {
-      if(memcmp(&li->base->key, &key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-      li = next_elem(li);
+   /* Search the variants for one which matches the key, starting with the
+    * one found last.
+    */
+   shader->variant_lookups++;
+   if (shader->last_variant &&
+       memcmp(&shader->last_variant->key, &key,
+              shader->variant_key_size) == 0) {
+      variant = shader->last_variant;
+   }
+   else {
+      struct hash_entry *entry;
+
+      hash = fs_variant_key_hash(&key);
+      entry = _mesa_hash_table_search_pre_hashed(shader->variant_table,
+                                                 hash, &key);
+      if (entry)
+         variant = entry->data;
    }
 
    if (variant) {
+      shader->variant_hits++;
+      shader->last_variant = variant;
+
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
       move_to_head(&lp->fs_variants_list, &variant->list_item_global);
+      LP_COUNT(nr_fs_variant_hits);
    }
    else {
       /* variant not found, create it now */
@@ -3123,6 +3790,8 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       unsigned i;
       unsigned variants_to_cull;
 
+      LP_COUNT(nr_fs_variant_misses);
+
       if (0) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
                       lp->nr_fs_variants,
@@ -3171,20 +3840,31 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       variant = generate_variant(lp, shader, &key);
       t1 = os_time_get();
       dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
       if (variant) {
+         _mesa_hash_table_insert_pre_hashed(shader->variant_table, hash,
+                                            &variant->key, variant);
+         shader->last_variant = variant;
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
+
+         /* Background compiles account for their own time and
+          * instructions once done.
+          */
+         if (!variant->compile_job.queue) {
+            LP_COUNT_ADD(llvm_compile_time, dt);
+            lp_stats_add(lp, LP_STAT_COMPILE_TIME, dt);
+            p_atomic_add(&lp->nr_fs_instrs, variant->nr_instrs);
+         }
       }
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
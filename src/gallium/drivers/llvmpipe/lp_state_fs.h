@@ -32,14 +32,19 @@
 
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
+#include "util/u_atomic.h"
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
+#include "lp_compile_queue.h"
+#include "lp_limits.h" /* for LP_MAX_SAMPLES */
 
 
+struct hash_table;
 struct tgsi_token;
 struct lp_fragment_shader;
+struct llvmpipe_context;
 
 
 /** Indexes into jit_function[] array */
@@ -47,6 +52,15 @@ struct lp_fragment_shader;
 #define RAST_EDGE_TEST 1
 
 
+/**
+ * How a fragment shader variant interacts with the hierarchical z
+ * summaries (lp_fragment_shader_variant::hiz).
+ */
+#define LP_HIZ_TEST       (1 << 0)  /**< fragments behind the summary fail */
+#define LP_HIZ_UPDATE     (1 << 1)  /**< covered pixels get the primitive's z */
+#define LP_HIZ_INVALIDATE (1 << 2)  /**< may increase the depth values */
+
+
 struct lp_sampler_static_state
 {
    /*
@@ -77,6 +91,8 @@ struct lp_fragment_shader_variant_key
    unsigned occlusion_count:1;
    unsigned resource_1d:1;
    unsigned depth_clamp:1;
+   unsigned multisample:1;      /* the framebuffer has LP_MAX_SAMPLES samples */
+   unsigned sample_mask:LP_MAX_SAMPLES;
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -85,6 +101,17 @@ struct lp_fragment_shader_variant_key
 };
 
 
+/**
+ * Code of a variant compiled again with a higher optimization tier.  Never
+ * modified once published in lp_fragment_shader_variant::promoted.
+ */
+struct lp_fs_variant_code
+{
+   struct gallivm_state *gallivm;
+   lp_jit_frag_func jit_function[2];
+};
+
+
 /** doubly-linked list item */
 struct lp_fs_variant_list_item
 {
@@ -98,6 +125,7 @@ struct lp_fragment_shader_variant
    struct lp_fragment_shader_variant_key key;
 
    boolean opaque;
+   unsigned hiz;   /**< LP_HIZ_x flags */
    uint8_t ps_inv_multiplier;
 
    struct gallivm_state *gallivm;
@@ -113,8 +141,25 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Background compilation.  The jit functions (and nr_instrs) are only
+    * valid once the job is done.
+    */
+   struct lp_compile_job compile_job;
+
+   /* Tiered compilation.  Once used often enough, the variant is compiled
+    * again with a higher optimization tier, and the new code is published
+    * in promoted, see lp_fs_variant_jit_function().  The old code is kept
+    * until the variant is destroyed, as it may still be executing.
+    */
+   enum gallivm_opt_tier opt_tier;
+   unsigned uses;
+   boolean promotion_queued;
+   struct lp_fs_variant_code *promoted;
+   struct lp_compile_job promote_job;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
+   struct llvmpipe_context *lp;
 
    /* For debugging/profiling purposes */
    unsigned no;
@@ -130,6 +175,10 @@ struct lp_fragment_shader
 
    struct lp_fs_variant_list_item variants;
 
+   /** The variants indexed by key, and the one found last */
+   struct hash_table *variant_table;
+   struct lp_fragment_shader_variant *last_variant;
+
    struct draw_fragment_shader *draw_data;
 
    /* For debugging/profiling purposes */
@@ -137,12 +186,28 @@ struct lp_fragment_shader
    unsigned no;
    unsigned variants_created;
    unsigned variants_cached;
+   unsigned variant_lookups;
+   unsigned variant_hits;
 
    /** Fragment shader input interpolation info */
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
 };
 
 
+/**
+ * The jit function to rasterize with, the promoted one if any.
+ */
+static inline lp_jit_frag_func
+lp_fs_variant_jit_function(const struct lp_fragment_shader_variant *variant,
+                           unsigned i)
+{
+   const struct lp_fs_variant_code *promoted =
+      p_atomic_read_acquire(&variant->promoted);
+
+   return promoted ? promoted->jit_function[i] : variant->jit_function[i];
+}
+
+
 void
 lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant);
 
@@ -140,6 +140,12 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
       }
       pipe_sampler_view_reference(&llvmpipe->sampler_views[shader][start + i],
                                   views[i]);
+
+      /* The draw module's samplers only know the linear texture layout */
+      if (views[i] &&
+          (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_GEOMETRY)) {
+         llvmpipe_resource_linearize(pipe, views[i]->texture);
+      }
    }
 
    /* find highest non-null sampler_views[] entry */
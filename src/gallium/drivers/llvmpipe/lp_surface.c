@@ -27,6 +27,8 @@
 
 #include "util/u_rect.h"
 #include "util/u_surface.h"
+#include "util/u_memory.h"
+#include "util/u_format.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_limits.h"
@@ -34,6 +36,51 @@
 #include "lp_texture.h"
 #include "lp_query.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Copy a region of every sample of a multisampled resource, which the
+ * transfer based util_resource_copy_region() can't do.
+ */
+static void
+lp_resource_copy_samples(struct pipe_resource *dst, unsigned dst_level,
+                         unsigned dstx, unsigned dsty, unsigned dstz,
+                         struct pipe_resource *src, unsigned src_level,
+                         const struct pipe_box *src_box)
+{
+   unsigned nr_samples = llvmpipe_resource_nr_samples(src);
+   unsigned src_stride = llvmpipe_resource_stride(src, src_level);
+   unsigned dst_stride = llvmpipe_resource_stride(dst, dst_level);
+   unsigned src_sample_stride = llvmpipe_sample_stride(src, src_level);
+   unsigned dst_sample_stride = llvmpipe_sample_stride(dst, dst_level);
+   int z;
+   unsigned s;
+
+   assert(llvmpipe_resource_nr_samples(dst) == nr_samples);
+
+   for (z = 0; z < src_box->depth; z++) {
+      const uint8_t *src_map = llvmpipe_resource_map(src, src_level,
+                                                     src_box->z + z,
+                                                     LP_TEX_USAGE_READ);
+      uint8_t *dst_map = llvmpipe_resource_map(dst, dst_level, dstz + z,
+                                               LP_TEX_USAGE_READ_WRITE);
+
+      for (s = 0; s < nr_samples; s++) {
+         util_copy_rect(dst_map + s * dst_sample_stride, dst->format,
+                        dst_stride, dstx, dsty,
+                        src_box->width, src_box->height,
+                        src_map + s * src_sample_stride,
+                        src_stride, src_box->x, src_box->y);
+      }
+
+      llvmpipe_resource_unmap(dst, dst_level, dstz + z);
+      llvmpipe_resource_unmap(src, src_level, src_box->z + z);
+   }
+}
+
 
 static void
 lp_resource_copy(struct pipe_context *pipe,
@@ -56,29 +103,235 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
+   if (llvmpipe_resource_nr_samples(src) > 1) {
+      lp_resource_copy_samples(dst, dst_level, dstx, dsty, dstz,
+                               src, src_level, src_box);
+      return;
+   }
+
    util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
                              src, src_level, src_box);
 }
 
 
+/**
+ * Average four rows of 8-bit unorm texels, one per sample.
+ */
+static void
+lp_resolve_row_4x8unorm(uint8_t *dst, const uint8_t *src,
+                        unsigned sample_stride, unsigned size)
+{
+   const uint8_t *src0 = src;
+   const uint8_t *src1 = src + sample_stride;
+   const uint8_t *src2 = src + 2 * sample_stride;
+   const uint8_t *src3 = src + 3 * sample_stride;
+   unsigned i = 0;
+
+#if defined(PIPE_ARCH_SSE)
+   for (; i + 16 <= size; i += 16) {
+      __m128i s0 = _mm_loadu_si128((const __m128i *)(src0 + i));
+      __m128i s1 = _mm_loadu_si128((const __m128i *)(src1 + i));
+      __m128i s2 = _mm_loadu_si128((const __m128i *)(src2 + i));
+      __m128i s3 = _mm_loadu_si128((const __m128i *)(src3 + i));
+
+      _mm_storeu_si128((__m128i *)(dst + i),
+                       _mm_avg_epu8(_mm_avg_epu8(s0, s1),
+                                    _mm_avg_epu8(s2, s3)));
+   }
+#endif
+
+   for (; i < size; i++) {
+      dst[i] = (src0[i] + src1[i] + src2[i] + src3[i] + 2) >> 2;
+   }
+}
+
+
+/**
+ * Resolve a region of a multisampled resource into a single-sampled one of
+ * the same format.
+ *
+ * Color samples are averaged.  Depth/stencil and integer formats can't be
+ * averaged meaningfully, so these take the first sample instead.
+ */
+static void
+lp_resolve(struct pipe_resource *dst, unsigned dst_level,
+           unsigned dstx, unsigned dsty, unsigned dstz,
+           struct pipe_resource *src, unsigned src_level,
+           const struct pipe_box *src_box)
+{
+   enum pipe_format format = src->format;
+   const struct util_format_description *desc = util_format_description(format);
+   unsigned nr_samples = llvmpipe_resource_nr_samples(src);
+   unsigned src_stride = llvmpipe_resource_stride(src, src_level);
+   unsigned dst_stride = llvmpipe_resource_stride(dst, dst_level);
+   unsigned sample_stride = llvmpipe_sample_stride(src, src_level);
+   unsigned bpp = util_format_get_blocksize(format);
+   unsigned width = src_box->width;
+   boolean average = !util_format_is_depth_or_stencil(format) &&
+                     !util_format_is_pure_integer(format);
+   boolean fast = nr_samples == 4 &&
+                  util_format_is_rgba8_variant(desc) &&
+                  !util_format_is_srgb(format);
+   float *tmp = NULL, *acc = NULL;
+   int y, z;
+   unsigned s, i;
+
+   assert(dst->format == format);
+   assert(desc->block.width == 1 && desc->block.height == 1);
+
+   if (average && !fast) {
+      tmp = MALLOC(2 * width * 4 * sizeof(float));
+      if (!tmp)
+         return;
+      acc = tmp + width * 4;
+   }
+
+   for (z = 0; z < src_box->depth; z++) {
+      const uint8_t *src_map = llvmpipe_resource_map(src, src_level,
+                                                     src_box->z + z,
+                                                     LP_TEX_USAGE_READ);
+      uint8_t *dst_map = llvmpipe_resource_map(dst, dst_level, dstz + z,
+                                               LP_TEX_USAGE_READ_WRITE);
+
+      if (!average) {
+         util_copy_rect(dst_map, format, dst_stride, dstx, dsty,
+                        width, src_box->height,
+                        src_map, src_stride, src_box->x, src_box->y);
+      }
+      else {
+         for (y = 0; y < src_box->height; y++) {
+            const uint8_t *src_row = src_map +
+                                     (src_box->y + y) * src_stride +
+                                     src_box->x * bpp;
+            uint8_t *dst_row = dst_map + (dsty + y) * dst_stride + dstx * bpp;
+
+            if (fast) {
+               lp_resolve_row_4x8unorm(dst_row, src_row, sample_stride,
+                                       width * bpp);
+               continue;
+            }
+
+            memset(acc, 0, width * 4 * sizeof(float));
+            for (s = 0; s < nr_samples; s++) {
+               desc->unpack_rgba_float(tmp, 0, src_row + s * sample_stride, 0,
+                                       width, 1);
+               for (i = 0; i < width * 4; i++)
+                  acc[i] += tmp[i];
+            }
+            for (i = 0; i < width * 4; i++)
+               acc[i] *= 1.0f / nr_samples;
+            desc->pack_rgba_float(dst_row, 0, acc, 0, width, 1);
+         }
+      }
+
+      llvmpipe_resource_unmap(dst, dst_level, dstz + z);
+      llvmpipe_resource_unmap(src, src_level, src_box->z + z);
+   }
+
+   FREE(tmp);
+}
+
+
+/**
+ * Resolve the source of a multisample resolve blit.
+ *
+ * Simple resolves are done in place, and TRUE is returned.  Otherwise the
+ * source region is resolved into a temporary resource and the blit is
+ * redirected to it, so that the generic blit path takes care of scaling,
+ * flipping, format conversion and scissoring.
+ */
+static boolean
+lp_blit_resolve(struct pipe_context *pipe,
+                struct pipe_blit_info *info,
+                struct pipe_resource **tmp)
+{
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_resource *dst = info->dst.resource;
+   struct pipe_resource templ;
+   struct pipe_box box = info->src.box;
+   unsigned format_mask = util_format_get_mask(src->format);
+
+   llvmpipe_flush_resource(pipe, src, info->src.level,
+                           TRUE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve src");
+
+   if (info->src.format == src->format &&
+       info->dst.format == src->format &&
+       dst->format == src->format &&
+       info->src.box.width == info->dst.box.width &&
+       info->src.box.height == info->dst.box.height &&
+       info->src.box.depth == info->dst.box.depth &&
+       info->src.box.width > 0 && info->src.box.height > 0 &&
+       (info->mask & format_mask) == format_mask &&
+       !info->scissor_enable) {
+      llvmpipe_flush_resource(pipe, dst, info->dst.level,
+                              FALSE, /* read_only */
+                              TRUE, /* cpu_access */
+                              FALSE, /* do_not_block */
+                              "resolve dest");
+
+      lp_resolve(dst, info->dst.level,
+                 info->dst.box.x, info->dst.box.y, info->dst.box.z,
+                 src, info->src.level, &info->src.box);
+      return TRUE;
+   }
+
+   /* Flipped blits have negative extents */
+   if (box.width < 0) {
+      box.x += box.width;
+      box.width = -box.width;
+   }
+   if (box.height < 0) {
+      box.y += box.height;
+      box.height = -box.height;
+   }
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = box.depth > 1 ? PIPE_TEXTURE_2D_ARRAY : PIPE_TEXTURE_2D;
+   templ.format = src->format;
+   templ.width0 = box.width;
+   templ.height0 = box.height;
+   templ.depth0 = 1;
+   templ.array_size = box.depth;
+   templ.bind = PIPE_BIND_SAMPLER_VIEW;
+   templ.usage = PIPE_USAGE_DEFAULT;
+
+   *tmp = pipe->screen->resource_create(pipe->screen, &templ);
+   if (!*tmp)
+      return TRUE;
+
+   lp_resolve(*tmp, 0, 0, 0, 0, src, info->src.level, &box);
+
+   info->src.resource = *tmp;
+   info->src.level = 0;
+   info->src.box.x = info->src.box.width < 0 ? box.width : 0;
+   info->src.box.y = info->src.box.height < 0 ? box.height : 0;
+   info->src.box.z = 0;
+
+   return FALSE;
+}
+
+
 static void lp_blit(struct pipe_context *pipe,
                     const struct pipe_blit_info *blit_info)
 {
    struct llvmpipe_context *lp = llvmpipe_context(pipe);
    struct pipe_blit_info info = *blit_info;
+   struct pipe_resource *resolve_tmp = NULL;
 
    if (blit_info->render_condition_enable && !llvmpipe_check_render_cond(lp))
       return;
 
    if (info.src.resource->nr_samples > 1 &&
-       info.dst.resource->nr_samples <= 1 &&
-       !util_format_is_depth_or_stencil(info.src.resource->format) &&
-       !util_format_is_pure_integer(info.src.resource->format)) {
-      debug_printf("llvmpipe: color resolve unimplemented\n");
-      return;
+       info.dst.resource->nr_samples <= 1) {
+      if (lp_blit_resolve(pipe, &info, &resolve_tmp))
+         return; /* done */
    }
 
    if (util_try_blit_via_copy_region(pipe, &info)) {
+      pipe_resource_reference(&resolve_tmp, NULL);
       return; /* done */
    }
 
@@ -86,6 +339,7 @@ static void lp_blit(struct pipe_context *pipe,
       debug_printf("llvmpipe: blit unsupported %s -> %s\n",
                    util_format_short_name(info.src.resource->format),
                    util_format_short_name(info.dst.resource->format));
+      pipe_resource_reference(&resolve_tmp, NULL);
       return;
    }
 
@@ -115,6 +369,8 @@ static void lp_blit(struct pipe_context *pipe,
    util_blitter_save_render_condition(lp->blitter, lp->render_cond_query,
                                       lp->render_cond_cond, lp->render_cond_mode);
    util_blitter_blit(lp->blitter, &info);
+
+   pipe_resource_reference(&resolve_tmp, NULL);
 }
 
 
@@ -124,6 +380,16 @@ lp_flush_resource(struct pipe_context *ctx, struct pipe_resource *resource)
 }
 
 
+static void
+lp_invalidate_resource(struct pipe_context *ctx,
+                       struct pipe_resource *resource)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(ctx);
+
+   lp_setup_invalidate_resource(llvmpipe->setup, resource);
+}
+
+
 static struct pipe_surface *
 llvmpipe_create_surface(struct pipe_context *pipe,
                         struct pipe_resource *pt,
@@ -134,6 +400,10 @@ llvmpipe_create_surface(struct pipe_context *pipe,
    if (!(pt->bind & (PIPE_BIND_DEPTH_STENCIL | PIPE_BIND_RENDER_TARGET)))
       debug_printf("Illegal surface creation without bind flag\n");
 
+   /* Rendering needs the linear layout */
+   if (llvmpipe_resource_is_texture(pt))
+      llvmpipe_resource_linearize(pipe, pt);
+
    ps = CALLOC_STRUCT(pipe_surface);
    if (ps) {
       pipe_reference_init(&ps->reference, 1);
@@ -178,6 +448,38 @@ llvmpipe_surface_destroy(struct pipe_context *pipe,
 }
 
 
+/**
+ * Copy the first sample of a multisampled surface region to the others.
+ * The util clear helpers go through transfers, which only see the first
+ * sample of each layer.
+ */
+static void
+lp_replicate_sample0(struct pipe_surface *dst,
+                     unsigned dstx, unsigned dsty,
+                     unsigned width, unsigned height)
+{
+   struct pipe_resource *pt = dst->texture;
+   unsigned level = dst->u.tex.level;
+   unsigned nr_samples = llvmpipe_resource_nr_samples(pt);
+   unsigned stride = llvmpipe_resource_stride(pt, level);
+   unsigned sample_stride = llvmpipe_sample_stride(pt, level);
+   unsigned layer, s;
+
+   for (layer = dst->u.tex.first_layer; layer <= dst->u.tex.last_layer; layer++) {
+      uint8_t *map = llvmpipe_resource_map(pt, level, layer,
+                                           LP_TEX_USAGE_READ_WRITE);
+
+      for (s = 1; s < nr_samples; s++) {
+         util_copy_rect(map + s * sample_stride, pt->format, stride,
+                        dstx, dsty, width, height,
+                        map, stride, dstx, dsty);
+      }
+
+      llvmpipe_resource_unmap(pt, level, layer);
+   }
+}
+
+
 static void
 llvmpipe_clear_render_target(struct pipe_context *pipe,
                              struct pipe_surface *dst,
@@ -192,6 +494,9 @@ llvmpipe_clear_render_target(struct pipe_context *pipe,
 
    util_clear_render_target(pipe, dst, color,
                             dstx, dsty, width, height);
+
+   if (llvmpipe_resource_nr_samples(dst->texture) > 1)
+      lp_replicate_sample0(dst, dstx, dsty, width, height);
 }
 
 
@@ -212,6 +517,9 @@ llvmpipe_clear_depth_stencil(struct pipe_context *pipe,
    util_clear_depth_stencil(pipe, dst, clear_flags,
                             depth, stencil,
                             dstx, dsty, width, height);
+
+   if (llvmpipe_resource_nr_samples(dst->texture) > 1)
+      lp_replicate_sample0(dst, dstx, dsty, width, height);
 }
 
 
@@ -226,4 +534,5 @@ llvmpipe_init_surface_functions(struct llvmpipe_context *lp)
    lp->pipe.resource_copy_region = lp_resource_copy;
    lp->pipe.blit = lp_blit;
    lp->pipe.flush_resource = lp_flush_resource;
+   lp->pipe.invalidate_resource = lp_invalidate_resource;
 }
@@ -43,7 +43,10 @@
 #include "util/simple_list.h"
 #include "util/u_transfer.h"
 
+#include "gallivm/lp_bld_sample.h"
+
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
@@ -60,6 +63,48 @@ static struct llvmpipe_resource resource_list;
 static unsigned id_counter = 0;
 
 
+/**
+ * Whether to store a texture in LP_TEXTURE_TILE_SIZE tiles.
+ *
+ * Tiles keep the texels of a 2D neighbourhood in a few cache lines, which
+ * makes filtering, and minified or rotated sampling in particular, much
+ * friendlier to the caches and the TLB.  Only the fragment shader samplers
+ * and transfers understand the tiled layout, other uses convert a texture
+ * back to the linear layout, see llvmpipe_resource_linearize().
+ */
+static boolean
+llvmpipe_texture_can_tile(const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc;
+
+   if (LP_PERF & PERF_NO_TILED_TEX)
+      return FALSE;
+
+   if (!(pt->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (pt->bind & (PIPE_BIND_DEPTH_STENCIL |
+                    PIPE_BIND_DISPLAY_TARGET |
+                    PIPE_BIND_SCANOUT |
+                    PIPE_BIND_SHARED)) ||
+       pt->nr_samples > 1)
+      return FALSE;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_3D:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      break;
+   default:
+      return FALSE;
+   }
+
+   desc = util_format_description(pt->format);
+   return desc->block.width == 1 && desc->block.height == 1;
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -146,6 +191,11 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       else
          num_slices = 1;
 
+      /* Multisample resources store each sample as a separate image, with
+       * the samples of a layer adjacent to each other.
+       */
+      num_slices *= llvmpipe_resource_nr_samples(pt);
+
       /* if img_stride * num_slices_faces > LP_MAX_TEXTURE_SIZE */
       mipsize = (uint64_t)lpr->img_stride[level] * num_slices;
       if (mipsize > LP_MAX_TEXTURE_SIZE) {
@@ -174,6 +224,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       else {
          memset(lpr->tex_data, 0, total_size);
       }
+      lpr->total_alloc_size = total_size;
    }
 
    return TRUE;
@@ -264,6 +315,7 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
          /* texture map */
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
+         lpr->tiled = llvmpipe_texture_can_tile(&lpr->base);
       }
    }
    else {
@@ -388,7 +440,9 @@ llvmpipe_resource_map(struct pipe_resource *resource,
    }
    else if (llvmpipe_resource_is_texture(resource)) {
 
-      map = llvmpipe_get_texture_image_address(lpr, layer, level);
+      map = llvmpipe_get_texture_image_address(lpr,
+                                               layer * llvmpipe_resource_nr_samples(resource),
+                                               level);
       return map;
    }
    else {
@@ -498,6 +552,123 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Copy a rectangle between a tiled image and a linear buffer.
+ *
+ * \param tiled  the tiled image
+ * \param tiled_stride  row stride of the linear layout of the image
+ * \param linear  the linear buffer, holding the rectangle only
+ * \param to_tiled  copy from the linear buffer into the tiled image?
+ */
+static void
+llvmpipe_copy_tiled_rect(uint8_t *tiled, unsigned tiled_stride,
+                         uint8_t *linear, unsigned linear_stride,
+                         unsigned x, unsigned y,
+                         unsigned width, unsigned height,
+                         unsigned texel_size, boolean to_tiled)
+{
+   const unsigned ts = LP_TEXTURE_TILE_SIZE;
+   /* one row of tiles spans ts rows of the linear layout */
+   const unsigned tile_row_stride = tiled_stride * ts;
+   unsigned i, j;
+
+   for (j = y; j < y + height; j++) {
+      uint8_t *linear_row = linear + (j - y) * linear_stride;
+      uint8_t *tiled_row = tiled + (j / ts) * tile_row_stride +
+                           (j % ts) * ts * texel_size;
+
+      for (i = x; i < x + width; ) {
+         /* the texels of a tile row are contiguous */
+         unsigned n = MIN2(ts - i % ts, x + width - i);
+         uint8_t *t = tiled_row + ((i / ts) * ts * ts + i % ts) * texel_size;
+         uint8_t *l = linear_row + (i - x) * texel_size;
+
+         if (to_tiled)
+            memcpy(t, l, n * texel_size);
+         else
+            memcpy(l, t, n * texel_size);
+
+         i += n;
+      }
+   }
+}
+
+
+static unsigned
+llvmpipe_texture_num_slices(const struct pipe_resource *pt, unsigned level)
+{
+   switch (pt->target) {
+   case PIPE_TEXTURE_3D:
+      return u_minify(pt->depth0, level);
+   case PIPE_TEXTURE_1D_ARRAY:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      return pt->array_size;
+   default:
+      return 1;
+   }
+}
+
+
+/**
+ * Convert a tiled texture to the linear layout, for uses other than
+ * sampling from fragment shaders.  This is a one-way street: the texture
+ * stays linear from then on.
+ */
+void
+llvmpipe_resource_linearize(struct pipe_context *pipe,
+                            struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned texel_size = util_format_get_blocksize(resource->format);
+   unsigned mip_align = MAX2(64, util_cpu_caps.cacheline);
+   unsigned level, slice;
+   uint8_t *data;
+
+   if (!lpr->tiled)
+      return;
+
+   /* Wait for the rasterization of scenes sampling the tiled images */
+   llvmpipe_flush_resource(pipe, resource, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           __FUNCTION__);
+
+   data = align_malloc(lpr->total_alloc_size, mip_align);
+   if (!data)
+      return;
+
+   for (level = 0; level <= resource->last_level; level++) {
+      unsigned width = align(u_minify(resource->width0, level),
+                             LP_TEXTURE_TILE_SIZE);
+      unsigned height = align(u_minify(resource->height0, level),
+                              LP_TEXTURE_TILE_SIZE);
+      unsigned num_slices = llvmpipe_texture_num_slices(resource, level);
+
+      for (slice = 0; slice < num_slices; slice++) {
+         unsigned offset = lpr->mip_offsets[level] +
+                           slice * lpr->img_stride[level];
+
+         llvmpipe_copy_tiled_rect((uint8_t *)lpr->tex_data + offset,
+                                  lpr->row_stride[level],
+                                  data + offset, lpr->row_stride[level],
+                                  0, 0, width, height,
+                                  texel_size, FALSE);
+      }
+   }
+
+   align_free(lpr->tex_data);
+   lpr->tex_data = data;
+   lpr->tiled = FALSE;
+
+   /* Make all contexts pick up the new layout */
+   screen->timestamp++;
+}
+
+
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -519,6 +690,10 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
    assert(resource);
    assert(level <= resource->last_level);
 
+   /* Tiled textures are only ever mapped through a linear copy */
+   if (lpr->tiled && (usage & PIPE_TRANSFER_MAP_DIRECTLY))
+      return NULL;
+
    /*
     * Transfers, like other pipe operations, must happen in order, so flush the
     * context if necessary.
@@ -561,7 +736,7 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
    pt->box = *box;
    pt->level = level;
    pt->stride = lpr->row_stride[level];
-   pt->layer_stride = lpr->img_stride[level];
+   pt->layer_stride = llvmpipe_layer_stride(resource, level);
    pt->usage = usage;
    *transfer = pt;
 
@@ -605,6 +780,38 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       screen->timestamp++;
    }
 
+   if (lpr->tiled) {
+      unsigned texel_size = util_format_get_blocksize(format);
+      int z;
+
+      pt->stride = box->width * texel_size;
+      pt->layer_stride = pt->stride * box->height;
+
+      lpt->staging = MALLOC(pt->layer_stride * box->depth);
+      if (!lpt->staging) {
+         llvmpipe_resource_unmap(resource, level, box->z);
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         for (z = 0; z < box->depth; z++) {
+            llvmpipe_copy_tiled_rect(map + z * lpr->img_stride[level],
+                                     lpr->row_stride[level],
+                                     (uint8_t *)lpt->staging +
+                                     z * pt->layer_stride,
+                                     pt->stride,
+                                     box->x, box->y,
+                                     box->width, box->height,
+                                     texel_size, FALSE);
+         }
+      }
+
+      return lpt->staging;
+   }
+
    map +=
       box->y / util_format_get_blockheight(format) * pt->stride +
       box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
@@ -617,8 +824,36 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
+   if (lpt->staging) {
+      struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+      const struct pipe_box *box = &transfer->box;
+
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         unsigned texel_size =
+            util_format_get_blocksize(transfer->resource->format);
+         uint8_t *map = llvmpipe_get_texture_image_address(lpr, box->z,
+                                                           transfer->level);
+         int z;
+
+         for (z = 0; z < box->depth; z++) {
+            llvmpipe_copy_tiled_rect(map + z * lpr->img_stride[transfer->level],
+                                     lpr->row_stride[transfer->level],
+                                     (uint8_t *)lpt->staging +
+                                     z * transfer->layer_stride,
+                                     transfer->stride,
+                                     box->x, box->y,
+                                     box->width, box->height,
+                                     texel_size, TRUE);
+         }
+      }
+
+      FREE(lpt->staging);
+   }
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
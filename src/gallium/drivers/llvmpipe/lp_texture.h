@@ -69,6 +69,14 @@ struct llvmpipe_resource
    /** allocated total size (for non-display target texture resources only) */
    unsigned total_alloc_size;
 
+   /**
+    * Are the images stored in LP_TEXTURE_TILE_SIZE tiles rather than
+    * linearly?  Only textures which so far have only been sampled by
+    * fragment shaders are tiled.  The strides above are those of the linear
+    * layout, which takes the same space.
+    */
+   boolean tiled;
+
    /**
     * Display target, for textures with the PIPE_BIND_DISPLAY_TARGET
     * usage.
@@ -102,6 +110,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the mapped box, for tiled textures */
+   void *staging;
 };
 
 
@@ -175,9 +186,34 @@ llvmpipe_resource_is_1d(const struct pipe_resource *resource)
 }
 
 
+static inline unsigned
+llvmpipe_resource_nr_samples(const struct pipe_resource *resource)
+{
+   return resource->nr_samples > 1 ? resource->nr_samples : 1;
+}
+
+
+/**
+ * Distance between two layers of a resource.  This spans all the samples
+ * of a layer.
+ */
 static inline unsigned
 llvmpipe_layer_stride(struct pipe_resource *resource,
                       unsigned level)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   assert(level < LP_MAX_TEXTURE_2D_LEVELS);
+   return lpr->img_stride[level] * llvmpipe_resource_nr_samples(resource);
+}
+
+
+/**
+ * Distance between two samples of the same layer of a multisample
+ * resource.
+ */
+static inline unsigned
+llvmpipe_sample_stride(struct pipe_resource *resource,
+                       unsigned level)
 {
    struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
    assert(level < LP_MAX_TEXTURE_2D_LEVELS);
@@ -220,6 +256,11 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level);
 
 
+void
+llvmpipe_resource_linearize(struct pipe_context *pipe,
+                            struct pipe_resource *resource);
+
+
 extern void
 llvmpipe_print_resources(void);
 
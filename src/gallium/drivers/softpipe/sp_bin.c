@@ -0,0 +1,774 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Binned, multithreaded rasterization.
+ *
+ * Setup normally runs the quad pipeline on every batch of quads it
+ * produces (a run of at most 16 quads of one primitive, within one span).
+ * When SOFTPIPE_NUM_THREADS is set, setup passes the batches to
+ * sp_bin_quads() instead, which appends them to the bin of the 64x64 tile
+ * they fall in.  Batches never straddle a tile since they are aligned to
+ * 16 pixels horizontally and to a quad row vertically.
+ *
+ * At the end of every draw, sp_bin_rasterize() runs the bins through the
+ * quad pipeline in parallel.  Each tile is always handled by the same
+ * thread, which owns a quad pipeline, color/depth tile caches, a fragment
+ * shader machine and texture tile caches of its own.  Within a tile,
+ * batches are processed in the order setup emitted them, so the results
+ * are identical to those of serial rasterization.
+ *
+ * The context's own color/depth tile caches are only used for clears
+ * while binning is enabled; they are flushed before the threads start.
+ */
+
+
+#include "pipe/p_defines.h"
+#include "os/os_thread.h"
+#include "util/u_debug.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_exec.h"
+
+#include "sp_bin.h"
+#include "sp_context.h"
+#include "sp_flush.h"
+#include "sp_quad.h"
+#include "sp_quad_pipe.h"
+#include "sp_state.h"
+#include "sp_texture.h"
+#include "sp_tex_sample.h"
+#include "sp_tex_tile_cache.h"
+#include "sp_tile_cache.h"
+
+
+#define SP_BIN_MAX_THREADS 16
+
+/** Max number of quads setup emits at once */
+#define SP_BIN_MAX_QUADS 16
+
+/** Size of the blocks bins are allocated from */
+#define SP_BIN_BLOCK_SIZE (64 * 1024)
+
+
+struct sp_bin_quad
+{
+   struct quad_header_input input;
+   unsigned mask;
+};
+
+
+/**
+ * A batch of quads of one primitive, as setup emitted them.
+ */
+struct sp_bin_batch
+{
+   struct sp_bin_batch *next;
+   const struct tgsi_interp_coef *coef;
+   const struct tgsi_interp_coef *posCoef;
+   unsigned nr;
+   struct sp_bin_quad quad[SP_BIN_MAX_QUADS];  /**< only nr are allocated */
+};
+
+
+struct sp_bin_tile
+{
+   struct sp_bin_batch *head;
+   struct sp_bin_batch *tail;
+};
+
+
+struct sp_bin_block
+{
+   struct sp_bin_block *next;
+   unsigned used;
+   uint64_t data[SP_BIN_BLOCK_SIZE / sizeof(uint64_t)];
+};
+
+
+struct sp_bin_thread
+{
+   struct sp_bin_context *bin;
+   unsigned id;
+
+   struct sp_quad_pipeline quad;
+
+   struct sp_tgsi_sampler *sampler;
+   struct softpipe_tex_tile_cache *tex_cache[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   unsigned num_sampler_views;
+
+   uint64_t occlusion_count;
+   uint64_t ps_invocations;
+
+   struct quad_header quads[SP_BIN_MAX_QUADS];
+   struct quad_header *quad_ptrs[SP_BIN_MAX_QUADS];
+};
+
+
+struct sp_bin_context
+{
+   struct softpipe_context *softpipe;
+
+   /** threads[0] is run by the application's thread */
+   unsigned num_threads;
+   struct sp_bin_thread *threads[SP_BIN_MAX_THREADS];
+   pipe_thread handles[SP_BIN_MAX_THREADS];
+   pipe_barrier barrier;
+   boolean exit_flag;
+   unsigned fpstate;
+
+   struct sp_bin_tile *tiles;
+   unsigned tiles_x, tiles_y;
+   unsigned *used_tiles;      /**< indices of the non-empty tiles */
+   unsigned num_used_tiles;
+
+   struct sp_bin_block *blocks;       /**< in use, most recent first */
+   struct sp_bin_block *free_blocks;
+
+   /** Copy of the current primitive's coefficients, NULL until needed */
+   const struct tgsi_interp_coef *coef;
+   const struct tgsi_interp_coef *posCoef;
+};
+
+
+static void *
+bin_alloc(struct sp_bin_context *bin, unsigned size)
+{
+   struct sp_bin_block *block = bin->blocks;
+   void *ptr;
+
+   size = align(size, sizeof(uint64_t));
+   assert(size <= SP_BIN_BLOCK_SIZE);
+
+   if (!block || block->used + size > SP_BIN_BLOCK_SIZE) {
+      block = bin->free_blocks;
+      if (block) {
+         bin->free_blocks = block->next;
+      }
+      else {
+         block = MALLOC_STRUCT(sp_bin_block);
+         if (!block)
+            return NULL;
+      }
+
+      block->next = bin->blocks;
+      block->used = 0;
+      bin->blocks = block;
+   }
+
+   ptr = (ubyte *) block->data + block->used;
+   block->used += size;
+   return ptr;
+}
+
+
+static void
+bin_reset(struct sp_bin_context *bin)
+{
+   unsigned i;
+
+   for (i = 0; i < bin->num_used_tiles; i++) {
+      struct sp_bin_tile *tile = &bin->tiles[bin->used_tiles[i]];
+      tile->head = tile->tail = NULL;
+   }
+   bin->num_used_tiles = 0;
+
+   while (bin->blocks) {
+      struct sp_bin_block *block = bin->blocks;
+      bin->blocks = block->next;
+      block->next = bin->free_blocks;
+      bin->free_blocks = block;
+   }
+
+   bin->coef = NULL;
+   bin->posCoef = NULL;
+}
+
+
+static inline unsigned
+bin_tile_thread(const struct sp_bin_context *bin, unsigned t)
+{
+   return (t % bin->tiles_x + t / bin->tiles_x) % bin->num_threads;
+}
+
+
+/**
+ * Run the batches of a tile through a quad pipeline.
+ */
+static void
+bin_rasterize_tile(const struct sp_bin_tile *tile,
+                   struct quad_stage *first,
+                   struct quad_header *quads,
+                   struct quad_header **quad_ptrs)
+{
+   const struct sp_bin_batch *batch;
+   unsigned i;
+
+   for (batch = tile->head; batch; batch = batch->next) {
+      for (i = 0; i < batch->nr; i++) {
+         quads[i].input = batch->quad[i].input;
+         quads[i].inout.mask = batch->quad[i].mask;
+         quads[i].coef = batch->coef;
+         quads[i].posCoef = batch->posCoef;
+         quad_ptrs[i] = &quads[i];
+      }
+
+      first->run(first, quad_ptrs, batch->nr);
+   }
+}
+
+
+static void
+bin_rasterize_thread(struct sp_bin_thread *thread)
+{
+   const struct sp_bin_context *bin = thread->bin;
+   unsigned i;
+
+   for (i = 0; i < bin->num_used_tiles; i++) {
+      const unsigned t = bin->used_tiles[i];
+
+      if (bin_tile_thread(bin, t) == thread->id) {
+         bin_rasterize_tile(&bin->tiles[t], thread->quad.first,
+                            thread->quads, thread->quad_ptrs);
+      }
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( bin_thread_function, init_data )
+{
+   struct sp_bin_thread *thread = (struct sp_bin_thread *) init_data;
+   struct sp_bin_context *bin = thread->bin;
+
+   pipe_thread_setname("softpipe");
+
+   for (;;) {
+      pipe_barrier_wait(&bin->barrier);
+      if (bin->exit_flag)
+         break;
+
+      /* Same floating point environment as the application's thread */
+      util_fpstate_set(bin->fpstate);
+
+      bin_rasterize_thread(thread);
+
+      pipe_barrier_wait(&bin->barrier);
+   }
+
+   return 0;
+}
+
+
+/**
+ * Point a thread's sampler at the fragment sampler views, through the
+ * thread's own texture tile caches, and bind the fragment shader.
+ */
+static boolean
+bin_prepare_thread(struct sp_bin_thread *thread)
+{
+   struct softpipe_context *sp = thread->bin->softpipe;
+   const struct sp_tgsi_sampler *src = sp->tgsi.sampler[PIPE_SHADER_FRAGMENT];
+   struct sp_tgsi_sampler *dst = thread->sampler;
+   const unsigned num = sp->num_sampler_views[PIPE_SHADER_FRAGMENT];
+   struct tgsi_exec_machine *machine = thread->quad.fs_machine;
+   unsigned i;
+
+   memcpy(dst->sp_sampler, src->sp_sampler, sizeof dst->sp_sampler);
+
+   for (i = 0; i < num; i++) {
+      struct pipe_sampler_view *view =
+         sp->sampler_views[PIPE_SHADER_FRAGMENT][i];
+      struct softpipe_tex_tile_cache *tc;
+      struct softpipe_resource *spt;
+
+      dst->sp_sview[i] = src->sp_sview[i];
+      if (!view)
+         continue;
+
+      if (!thread->tex_cache[i]) {
+         thread->tex_cache[i] = sp_create_tex_tile_cache(&sp->pipe);
+         if (!thread->tex_cache[i])
+            return FALSE;
+      }
+
+      tc = thread->tex_cache[i];
+      sp_tex_tile_cache_set_sampler_view(tc, view);
+
+      spt = softpipe_resource(tc->texture);
+      if (spt->timestamp != tc->timestamp) {
+         sp_tex_tile_cache_validate_texture(tc);
+         tc->timestamp = spt->timestamp;
+      }
+
+      dst->sp_sview[i].cache = tc;
+   }
+
+   /* drop the textures no longer bound */
+   for (; i < thread->num_sampler_views; i++) {
+      if (thread->tex_cache[i])
+         sp_tex_tile_cache_set_sampler_view(thread->tex_cache[i], NULL);
+      memset(&dst->sp_sview[i], 0, sizeof dst->sp_sview[i]);
+   }
+   thread->num_sampler_views = num;
+
+   if (machine->Tokens != sp->fs_variant->tokens) {
+      sp->fs_variant->prepare(sp->fs_variant, machine,
+                              (struct tgsi_sampler *) dst);
+   }
+
+   sp_link_quad_pipeline(sp, &thread->quad);
+   thread->quad.first->begin(thread->quad.first);
+
+   return TRUE;
+}
+
+
+/**
+ * Whether a fragment texture is also a render target.  Mapping it for
+ * sampling would flush the context, which the threads can't do.
+ */
+static boolean
+bin_samples_framebuffer(const struct softpipe_context *sp)
+{
+   const struct pipe_framebuffer_state *fb = &sp->framebuffer;
+   unsigned i, j;
+
+   for (i = 0; i < sp->num_sampler_views[PIPE_SHADER_FRAGMENT]; i++) {
+      const struct pipe_sampler_view *view =
+         sp->sampler_views[PIPE_SHADER_FRAGMENT][i];
+
+      if (!view)
+         continue;
+
+      for (j = 0; j < fb->nr_cbufs; j++) {
+         if (fb->cbufs[j] && fb->cbufs[j]->texture == view->texture)
+            return TRUE;
+      }
+      if (fb->zsbuf && fb->zsbuf->texture == view->texture)
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Rasterize all binned quads, and empty the bins.
+ */
+void
+sp_bin_rasterize(struct sp_bin_context *bin)
+{
+   struct softpipe_context *sp = bin->softpipe;
+   boolean parallel = TRUE;
+   unsigned i;
+
+   if (!bin->num_used_tiles)
+      return;
+
+   /* Write back any clears, the threads read the surfaces directly */
+   for (i = 0; i < sp->framebuffer.nr_cbufs; i++)
+      sp_flush_tile_cache(sp->cbuf_cache[i]);
+   sp_flush_tile_cache(sp->zsbuf_cache);
+
+   if (bin_samples_framebuffer(sp))
+      parallel = FALSE;
+
+   for (i = 0; i < bin->num_threads && parallel; i++) {
+      if (!bin_prepare_thread(bin->threads[i]))
+         parallel = FALSE;
+   }
+
+   if (parallel) {
+      bin->fpstate = util_fpstate_get();
+
+      pipe_barrier_wait(&bin->barrier);
+      bin_rasterize_thread(bin->threads[0]);
+      pipe_barrier_wait(&bin->barrier);
+
+      for (i = 0; i < bin->num_threads; i++) {
+         struct sp_bin_thread *thread = bin->threads[i];
+
+         sp->occlusion_count += thread->occlusion_count;
+         sp->pipeline_statistics.ps_invocations += thread->ps_invocations;
+         thread->occlusion_count = 0;
+         thread->ps_invocations = 0;
+      }
+   }
+   else {
+      /* Rasterize serially, through the context's pipeline and caches */
+      struct sp_bin_thread *thread = bin->threads[0];
+
+      sp_bin_flush(bin, 0);
+
+      for (i = 0; i < bin->num_used_tiles; i++) {
+         bin_rasterize_tile(&bin->tiles[bin->used_tiles[i]], sp->quad.first,
+                            thread->quads, thread->quad_ptrs);
+      }
+   }
+
+   bin_reset(bin);
+}
+
+
+/**
+ * Called by setup at the start of every primitive.
+ */
+void
+sp_bin_begin_primitive(struct sp_bin_context *bin)
+{
+   bin->coef = NULL;
+   bin->posCoef = NULL;
+}
+
+
+static boolean
+bin_quads(struct sp_bin_context *bin,
+          struct quad_header *quads[], unsigned nr)
+{
+   const unsigned tx = quads[0]->input.x0 / TILE_SIZE;
+   const unsigned ty = quads[0]->input.y0 / TILE_SIZE;
+   const unsigned t = ty * bin->tiles_x + tx;
+   struct sp_bin_tile *tile;
+   struct sp_bin_batch *batch;
+   unsigned i;
+
+   if (!bin->coef) {
+      const unsigned num_inputs =
+         bin->softpipe->fs_variant->info.num_inputs;
+      struct tgsi_interp_coef *coef;
+
+      coef = bin_alloc(bin, (num_inputs + 1) * sizeof *coef);
+      if (!coef)
+         return FALSE;
+
+      memcpy(coef, quads[0]->coef, num_inputs * sizeof *coef);
+      coef[num_inputs] = *quads[0]->posCoef;
+
+      bin->coef = coef;
+      bin->posCoef = &coef[num_inputs];
+   }
+
+   batch = bin_alloc(bin, sizeof *batch -
+                          (SP_BIN_MAX_QUADS - nr) * sizeof batch->quad[0]);
+   if (!batch)
+      return FALSE;
+
+   batch->next = NULL;
+   batch->coef = bin->coef;
+   batch->posCoef = bin->posCoef;
+   batch->nr = nr;
+
+   for (i = 0; i < nr; i++) {
+      batch->quad[i].input = quads[i]->input;
+      batch->quad[i].mask = quads[i]->inout.mask;
+   }
+
+   tile = &bin->tiles[t];
+   if (tile->tail) {
+      tile->tail->next = batch;
+   }
+   else {
+      tile->head = batch;
+      bin->used_tiles[bin->num_used_tiles++] = t;
+   }
+   tile->tail = batch;
+
+   return TRUE;
+}
+
+
+/**
+ * Called by setup instead of running the quad pipeline.  The quads must
+ * all fall in the same tile.
+ */
+void
+sp_bin_quads(struct sp_bin_context *bin,
+             struct quad_header *quads[], unsigned nr)
+{
+   assert(nr && nr <= SP_BIN_MAX_QUADS);
+
+   if (quads[0]->input.x0 / TILE_SIZE >= bin->tiles_x ||
+       quads[0]->input.y0 / TILE_SIZE >= bin->tiles_y) {
+      /* only if the tile grid couldn't be allocated */
+      return;
+   }
+
+   if (!bin_quads(bin, quads, nr)) {
+      /* out of memory, empty the bins and try again */
+      sp_bin_rasterize(bin);
+      bin_quads(bin, quads, nr);
+   }
+}
+
+
+/**
+ * Write back the threads' tile caches, and optionally invalidate their
+ * texture caches.
+ */
+void
+sp_bin_flush(struct sp_bin_context *bin, unsigned flags)
+{
+   unsigned i, j;
+
+   for (i = 0; i < bin->num_threads; i++) {
+      struct sp_bin_thread *thread = bin->threads[i];
+
+      for (j = 0; j < PIPE_MAX_COLOR_BUFS; j++)
+         sp_flush_tile_cache(thread->quad.cbuf_cache[j]);
+      sp_flush_tile_cache(thread->quad.zsbuf_cache);
+
+      if (flags & SP_FLUSH_TEXTURE_CACHE) {
+         for (j = 0; j < thread->num_sampler_views; j++) {
+            if (thread->tex_cache[j])
+               sp_flush_tex_tile_cache(thread->tex_cache[j]);
+         }
+      }
+   }
+}
+
+
+/**
+ * Called before the framebuffer state changes.
+ */
+void
+sp_bin_set_framebuffer(struct sp_bin_context *bin,
+                       const struct pipe_framebuffer_state *fb)
+{
+   const unsigned tiles_x = DIV_ROUND_UP(fb->width, TILE_SIZE);
+   const unsigned tiles_y = DIV_ROUND_UP(fb->height, TILE_SIZE);
+   unsigned i, j;
+
+   assert(!bin->num_used_tiles);
+
+   if (tiles_x != bin->tiles_x || tiles_y != bin->tiles_y) {
+      /* Tiles change threads, so everything must be written back */
+      sp_bin_flush(bin, 0);
+
+      FREE(bin->tiles);
+      FREE(bin->used_tiles);
+      bin->tiles = NULL;
+      bin->used_tiles = NULL;
+      bin->tiles_x = 0;
+      bin->tiles_y = 0;
+
+      if (tiles_x && tiles_y) {
+         bin->tiles = CALLOC(tiles_x * tiles_y, sizeof *bin->tiles);
+         bin->used_tiles = MALLOC(tiles_x * tiles_y * sizeof *bin->used_tiles);
+         if (bin->tiles && bin->used_tiles) {
+            bin->tiles_x = tiles_x;
+            bin->tiles_y = tiles_y;
+         }
+      }
+   }
+
+   for (i = 0; i < bin->num_threads; i++) {
+      struct sp_bin_thread *thread = bin->threads[i];
+
+      for (j = 0; j < PIPE_MAX_COLOR_BUFS; j++) {
+         struct softpipe_tile_cache *tc = thread->quad.cbuf_cache[j];
+         struct pipe_surface *cb = j < fb->nr_cbufs ? fb->cbufs[j] : NULL;
+
+         if (sp_tile_cache_get_surface(tc) != cb) {
+            sp_flush_tile_cache(tc);
+            sp_tile_cache_set_surface(tc, cb);
+         }
+      }
+
+      if (sp_tile_cache_get_surface(thread->quad.zsbuf_cache) != fb->zsbuf) {
+         sp_flush_tile_cache(thread->quad.zsbuf_cache);
+         sp_tile_cache_set_surface(thread->quad.zsbuf_cache, fb->zsbuf);
+      }
+   }
+}
+
+
+/**
+ * Unbind a fragment shader variant which is about to be deleted from the
+ * threads' shader machines.
+ */
+void
+sp_bin_delete_fs_variant(struct sp_bin_context *bin,
+                         const struct sp_fragment_shader_variant *var)
+{
+   unsigned i;
+
+   for (i = 0; i < bin->num_threads; i++) {
+      struct tgsi_exec_machine *machine = bin->threads[i]->quad.fs_machine;
+
+      if (machine->Tokens == var->tokens)
+         tgsi_exec_machine_bind_shader(machine, NULL, NULL);
+   }
+}
+
+
+static void
+bin_destroy_thread(struct sp_bin_thread *thread)
+{
+   unsigned i;
+
+   sp_destroy_quad_pipeline(&thread->quad);
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++)
+      sp_destroy_tile_cache(thread->quad.cbuf_cache[i]);
+   sp_destroy_tile_cache(thread->quad.zsbuf_cache);
+
+   for (i = 0; i < Elements(thread->tex_cache); i++) {
+      if (thread->tex_cache[i]) {
+         sp_tex_tile_cache_set_sampler_view(thread->tex_cache[i], NULL);
+         sp_destroy_tex_tile_cache(thread->tex_cache[i]);
+      }
+   }
+
+   if (thread->quad.fs_machine)
+      tgsi_exec_machine_destroy(thread->quad.fs_machine);
+
+   FREE(thread->sampler);
+   FREE(thread);
+}
+
+
+static struct sp_bin_thread *
+bin_create_thread(struct sp_bin_context *bin, unsigned id)
+{
+   struct softpipe_context *sp = bin->softpipe;
+   struct sp_bin_thread *thread;
+   unsigned i;
+
+   thread = CALLOC_STRUCT(sp_bin_thread);
+   if (!thread)
+      return NULL;
+
+   thread->bin = bin;
+   thread->id = id;
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
+      thread->quad.cbuf_cache[i] = sp_create_tile_cache(&sp->pipe);
+      if (!thread->quad.cbuf_cache[i])
+         goto fail;
+   }
+
+   thread->quad.zsbuf_cache = sp_create_tile_cache(&sp->pipe);
+   if (!thread->quad.zsbuf_cache)
+      goto fail;
+
+   thread->quad.fs_machine = tgsi_exec_machine_create();
+   if (!thread->quad.fs_machine)
+      goto fail;
+
+   thread->sampler = sp_create_tgsi_sampler();
+   if (!thread->sampler)
+      goto fail;
+
+   thread->quad.occlusion_count = &thread->occlusion_count;
+   thread->quad.ps_invocations = &thread->ps_invocations;
+
+   if (!sp_init_quad_pipeline(sp, &thread->quad))
+      goto fail;
+
+   return thread;
+
+fail:
+   bin_destroy_thread(thread);
+   return NULL;
+}
+
+
+/**
+ * Create the rasterization threads, if SOFTPIPE_NUM_THREADS asks for more
+ * than one.  Returns NULL otherwise, or on failure, in which case quads
+ * are rasterized as setup emits them.
+ */
+struct sp_bin_context *
+sp_bin_create(struct softpipe_context *softpipe)
+{
+   struct sp_bin_context *bin;
+   unsigned num_threads, i;
+
+   num_threads = debug_get_num_option("SOFTPIPE_NUM_THREADS", 0);
+   num_threads = MIN2(num_threads, SP_BIN_MAX_THREADS);
+   if (num_threads < 2)
+      return NULL;
+
+   bin = CALLOC_STRUCT(sp_bin_context);
+   if (!bin)
+      return NULL;
+
+   bin->softpipe = softpipe;
+
+   for (i = 0; i < num_threads; i++) {
+      bin->threads[i] = bin_create_thread(bin, i);
+      if (!bin->threads[i])
+         goto fail;
+   }
+
+   bin->num_threads = num_threads;
+   pipe_barrier_init(&bin->barrier, num_threads);
+
+   for (i = 1; i < num_threads; i++) {
+      bin->handles[i] = pipe_thread_create(bin_thread_function,
+                                           (void *) bin->threads[i]);
+   }
+
+   return bin;
+
+fail:
+   for (i = 0; i < num_threads; i++) {
+      if (bin->threads[i])
+         bin_destroy_thread(bin->threads[i]);
+   }
+   FREE(bin);
+   return NULL;
+}
+
+
+void
+sp_bin_destroy(struct sp_bin_context *bin)
+{
+   unsigned i;
+
+   bin->exit_flag = TRUE;
+   pipe_barrier_wait(&bin->barrier);
+
+   for (i = 1; i < bin->num_threads; i++)
+      pipe_thread_wait(bin->handles[i]);
+
+   pipe_barrier_destroy(&bin->barrier);
+
+   for (i = 0; i < bin->num_threads; i++)
+      bin_destroy_thread(bin->threads[i]);
+
+   bin_reset(bin);
+   while (bin->free_blocks) {
+      struct sp_bin_block *block = bin->free_blocks;
+      bin->free_blocks = block->next;
+      FREE(block);
+   }
+
+   FREE(bin->tiles);
+   FREE(bin->used_tiles);
+   FREE(bin);
+}
@@ -0,0 +1,77 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Binned, multithreaded rasterization.
+ *
+ * Instead of running the quad pipeline as soon as setup produces quads,
+ * the quads are sorted into per-tile bins, which a pool of threads
+ * rasterizes at the end of every draw.  Each tile is always rasterized by
+ * the same thread, with its own quad pipeline and tile caches.
+ */
+
+#ifndef SP_BIN_H
+#define SP_BIN_H
+
+#include "pipe/p_compiler.h"
+
+
+struct softpipe_context;
+struct sp_bin_context;
+struct sp_fragment_shader_variant;
+struct pipe_framebuffer_state;
+struct quad_header;
+
+
+struct sp_bin_context *
+sp_bin_create(struct softpipe_context *softpipe);
+
+void
+sp_bin_destroy(struct sp_bin_context *bin);
+
+void
+sp_bin_begin_primitive(struct sp_bin_context *bin);
+
+void
+sp_bin_quads(struct sp_bin_context *bin,
+             struct quad_header *quads[], unsigned nr);
+
+void
+sp_bin_rasterize(struct sp_bin_context *bin);
+
+void
+sp_bin_flush(struct sp_bin_context *bin, unsigned flags);
+
+void
+sp_bin_set_framebuffer(struct sp_bin_context *bin,
+                       const struct pipe_framebuffer_state *fb);
+
+void
+sp_bin_delete_fs_variant(struct sp_bin_context *bin,
+                         const struct sp_fragment_shader_variant *var);
+
+
+#endif /* SP_BIN_H */
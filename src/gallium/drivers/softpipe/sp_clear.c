@@ -35,6 +35,7 @@
 #include "pipe/p_defines.h"
 #include "util/u_pack_color.h"
 #include "util/u_surface.h"
+#include "sp_bin.h"
 #include "sp_clear.h"
 #include "sp_context.h"
 #include "sp_query.h"
@@ -66,6 +67,10 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
    softpipe_update_derived(softpipe, PIPE_PRIM_TRIANGLES); /* not needed?? */
 #endif
 
+   /* The threads' caches may hold tiles the clear must overwrite */
+   if (softpipe->bin)
+      sp_bin_flush(softpipe->bin, 0);
+
    if (buffers & PIPE_CLEAR_COLOR) {
       for (i = 0; i < softpipe->framebuffer.nr_cbufs; i++) {
          sp_tile_cache_clear(softpipe->cbuf_cache[i], color, 0);
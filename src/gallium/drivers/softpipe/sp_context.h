@@ -36,6 +36,7 @@
 
 #include "draw/draw_vertex.h"
 
+#include "sp_quad_pipe.h"
 #include "sp_quad_pipe.h"
 #include "sp_setup.h"
 
@@ -56,6 +57,7 @@ struct sp_fragment_shader;
 struct sp_vertex_shader;
 struct sp_velems_state;
 struct sp_so_state;
+struct sp_bin_context;
 
 struct softpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -161,13 +163,10 @@ struct softpipe_context {
    } pstipple;
 
    /** Software quad rendering pipeline */
-   struct {
-      struct quad_stage *shade;
-      struct quad_stage *depth_test;
-      struct quad_stage *blend;
-      struct quad_stage *pstipple;
-      struct quad_stage *first; /**< points to one of the above stages */
-   } quad;
+   struct sp_quad_pipeline quad;
+
+   /** Binned, multithreaded rasterization, or NULL */
+   struct sp_bin_context *bin;
 
    /** TGSI exec things */
    struct {
@@ -33,6 +33,7 @@
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
+#include "sp_bin.h"
 #include "sp_flush.h"
 #include "sp_context.h"
 #include "sp_state.h"
@@ -63,6 +64,9 @@ softpipe_flush( struct pipe_context *pipe,
       }
    }
 
+   if (softpipe->bin)
+      sp_bin_flush(softpipe->bin, flags);
+
    /* If this is a swapbuffers, just flush color buffers.
     *
     * The zbuffer changes are not discarded, but held in the cache
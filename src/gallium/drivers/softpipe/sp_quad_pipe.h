@@ -31,9 +31,14 @@
 #ifndef SP_QUAD_PIPE_H
 #define SP_QUAD_PIPE_H
 
+#include "pipe/p_state.h"
+
 
 struct softpipe_context;
+struct softpipe_tile_cache;
+struct tgsi_exec_machine;
 struct quad_header;
+struct sp_quad_pipeline;
 
 
 /**
@@ -44,6 +49,9 @@ struct quad_header;
 struct quad_stage {
    struct softpipe_context *softpipe;
 
+   /** The pipeline this stage belongs to, for its caches and counters */
+   struct sp_quad_pipeline *pipeline;
+
    struct quad_stage *next;
 
    void (*begin)(struct quad_stage *qs);
@@ -67,6 +75,37 @@ struct quad_stage *sp_quad_blend_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_colormask_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_output_stage( struct softpipe_context *softpipe );
 
+
+/**
+ * The quad stages, and the tile caches, fragment shader machine and
+ * counters they write to.  The context has one of these.  With binned
+ * rasterization (see sp_bin.c) every thread has another, so that no two
+ * threads ever share a cache.
+ */
+struct sp_quad_pipeline {
+   struct quad_stage *shade;
+   struct quad_stage *depth_test;
+   struct quad_stage *blend;
+   struct quad_stage *pstipple;
+   struct quad_stage *first; /**< points to one of the above stages */
+
+   struct softpipe_tile_cache *cbuf_cache[PIPE_MAX_COLOR_BUFS];
+   struct softpipe_tile_cache *zsbuf_cache;
+   struct tgsi_exec_machine *fs_machine;
+
+   uint64_t *occlusion_count;
+   uint64_t *ps_invocations;
+};
+
+
+boolean sp_init_quad_pipeline(struct softpipe_context *sp,
+                              struct sp_quad_pipeline *qp);
+
+void sp_destroy_quad_pipeline(struct sp_quad_pipeline *qp);
+
+void sp_link_quad_pipeline(struct softpipe_context *sp,
+                           struct sp_quad_pipeline *qp);
+
 void sp_build_quad_pipeline(struct softpipe_context *sp);
 
 #endif /* SP_QUAD_PIPE_H */
@@ -32,6 +32,7 @@
  * \author  Brian Paul
  */
 
+#include "sp_bin.h"
 #include "sp_context.h"
 #include "sp_quad.h"
 #include "sp_quad_pipe.h"
@@ -153,6 +154,23 @@ quad_clip(struct setup_context *setup, struct quad_header *quad)
 }
 
 
+/**
+ * Pass quads to the quad pipeline, or to the bins when rasterizing in
+ * parallel.
+ */
+static inline void
+emit_quads(struct setup_context *setup, struct quad_header *quads[],
+           unsigned nr)
+{
+   struct softpipe_context *sp = setup->softpipe;
+
+   if (sp->bin)
+      sp_bin_quads(sp->bin, quads, nr);
+   else
+      sp->quad.first->run(sp->quad.first, quads, nr);
+}
+
+
 /**
  * Emit a quad (pass to next stage) with clipping.
  */
@@ -162,13 +180,11 @@ clip_emit_quad(struct setup_context *setup, struct quad_header *quad)
    quad_clip(setup, quad);
 
    if (quad->inout.mask) {
-      struct softpipe_context *sp = setup->softpipe;
-
 #if DEBUG_FRAGS
       setup->numFragsEmitted += util_bitcount(quad->inout.mask);
 #endif
 
-      sp->quad.first->run( sp->quad.first, &quad, 1 );
+      emit_quads(setup, &quad, 1);
    }
 }
 
@@ -203,7 +219,6 @@ flush_spans(struct setup_context *setup)
    const int xleft1 = setup->span.left[1];
    const int xright0 = setup->span.right[0];
    const int xright1 = setup->span.right[1];
-   struct quad_stage *pipe = setup->softpipe->quad.first;
 
    const int minleft = block_x(MIN2(xleft0, xleft1));
    const int maxright = MAX2(xright0, xright1);
@@ -248,7 +263,7 @@ flush_spans(struct setup_context *setup)
             lx += 2;
          } while (mask0 | mask1);
 
-         pipe->run( pipe, setup->quad_ptrs, q );
+         emit_quads(setup, setup->quad_ptrs, q);
       }
    }
 
@@ -821,6 +836,9 @@ sp_setup_tri(struct setup_context *setup,
 
    if (setup->softpipe->no_rast || setup->softpipe->rasterizer->rasterizer_discard)
       return;
+
+   if (setup->softpipe->bin)
+      sp_bin_begin_primitive(setup->softpipe->bin);
    
    det = calc_det(v0, v1, v2);
    /*
@@ -1107,6 +1125,9 @@ sp_setup_line(struct setup_context *setup,
    if (setup->softpipe->no_rast || setup->softpipe->rasterizer->rasterizer_discard)
       return;
 
+   if (setup->softpipe->bin)
+      sp_bin_begin_primitive(setup->softpipe->bin);
+
    if (dx == 0 && dy == 0)
       return;
 
@@ -1254,6 +1275,9 @@ sp_setup_point(struct setup_context *setup,
    if (setup->softpipe->no_rast || setup->softpipe->rasterizer->rasterizer_discard)
       return;
 
+   if (setup->softpipe->bin)
+      sp_bin_begin_primitive(setup->softpipe->bin);
+
    assert(setup->softpipe->reduced_prim == PIPE_PRIM_POINTS);
 
    if (setup->softpipe->layer_slot > 0) {
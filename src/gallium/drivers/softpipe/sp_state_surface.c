@@ -28,6 +28,7 @@
 /* Authors:  Keith Whitwell <keithw@vmware.com>
  */
 
+#include "sp_bin.h"
 #include "sp_context.h"
 #include "sp_state.h"
 #include "sp_tile_cache.h"
@@ -53,6 +54,9 @@ softpipe_set_framebuffer_state(struct pipe_context *pipe,
 
    draw_flush(sp->draw);
 
+   if (sp->bin)
+      sp_bin_set_framebuffer(sp->bin, fb);
+
    for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
       struct pipe_surface *cb = i < fb->nr_cbufs ? fb->cbufs[i] : NULL;
 
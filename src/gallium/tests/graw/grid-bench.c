@@ -0,0 +1,344 @@
+/* Vertex shading and triangle binning benchmark.
+ *
+ * Draws a dense grid of small triangles covering the whole window, for
+ * every number of threads from 1 to N with a fresh context, and prints
+ * the throughput of each run.  The mode selects what gets threaded:
+ *
+ *  -m vs: vertex shading in the draw module, through DRAW_NUM_THREADS.
+ *   A long vertex shader makes vertex processing the bottleneck.
+ *  -m setup: llvmpipe triangle setup and binning, through
+ *   LP_NUM_SETUP_THREADS.  The vertex shader is a plain copy, so setup
+ *   and binning are the bottleneck rather than rasterization.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "graw_util.h"
+#include "os/os_time.h"
+#include "util/u_string.h"
+
+static struct graw_info info;
+
+static const int WIDTH = 1024;
+static const int HEIGHT = 1024;
+
+static int NumFrames = 20;
+static int GridSize = 512;      /* GridSize x GridSize quads */
+static int ShaderLength = -1;   /* vertex shader instructions */
+static int MaxThreads = 4;
+
+
+struct bench_mode {
+   const char *name;
+   const char *env;              /* thread count variable */
+   int shader_length;            /* default vertex shader instructions */
+   const char *units;
+   unsigned verts_per_unit;
+};
+
+static const struct bench_mode modes[] = {
+   { "vs", "DRAW_NUM_THREADS", 64, "verts", 1 },
+   { "setup", "LP_NUM_SETUP_THREADS", 0, "tris", 3 },
+};
+
+static const struct bench_mode *Mode = &modes[0];
+
+
+struct vertex {
+   float position[4];
+   float color[4];
+};
+
+static struct pipe_vertex_buffer vbuf;
+static unsigned num_verts;
+
+
+static void
+set_vertex(struct vertex *v, float x, float y, float r, float g, float b)
+{
+   v->position[0] = x;
+   v->position[1] = y;
+   v->position[2] = 0.0f;
+   v->position[3] = 1.0f;
+   v->color[0] = r;
+   v->color[1] = g;
+   v->color[2] = b;
+   v->color[3] = 1.0f;
+}
+
+
+static void create_vertices( void )
+{
+   struct vertex *vertices, *v;
+   float step = 2.0f / GridSize;
+   int i, j;
+
+   num_verts = GridSize * GridSize * 6;
+   vertices = MALLOC(num_verts * sizeof *vertices);
+   if (!vertices)
+      exit(1);
+
+   v = vertices;
+
+   for (j = 0; j < GridSize; j++) {
+      for (i = 0; i < GridSize; i++) {
+         float x0 = -1.0f + i * step, x1 = x0 + step;
+         float y0 = -1.0f + j * step, y1 = y0 + step;
+         float c = (float) ((i + j) & 1);
+
+         set_vertex(v++, x0, y0, c, c, 1.0f);
+         set_vertex(v++, x1, y0, c, 1.0f, c);
+         set_vertex(v++, x0, y1, 1.0f, c, c);
+         set_vertex(v++, x1, y0, c, 1.0f, c);
+         set_vertex(v++, x1, y1, c, c, c);
+         set_vertex(v++, x0, y1, 1.0f, c, c);
+      }
+   }
+
+   memset(&vbuf, 0, sizeof vbuf);
+
+   vbuf.stride = sizeof( struct vertex );
+   vbuf.buffer_offset = 0;
+   vbuf.buffer = pipe_buffer_create_with_data(info.ctx,
+                                              PIPE_BIND_VERTEX_BUFFER,
+                                              PIPE_USAGE_DEFAULT,
+                                              num_verts * sizeof *vertices,
+                                              vertices);
+
+   FREE(vertices);
+}
+
+
+static void set_vertices( void )
+{
+   struct pipe_vertex_element ve[2];
+   void *handle;
+
+   memset(ve, 0, sizeof ve);
+
+   ve[0].src_offset = Offset(struct vertex, position);
+   ve[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve[1].src_offset = Offset(struct vertex, color);
+   ve[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   handle = info.ctx->create_vertex_elements_state(info.ctx, 2, ve);
+   info.ctx->bind_vertex_elements_state(info.ctx, handle);
+
+   info.ctx->set_vertex_buffers(info.ctx, 0, 1, &vbuf);
+}
+
+
+static void set_vertex_shader( void )
+{
+   void *handle;
+   char *text, *p;
+   int i;
+
+   text = MALLOC(256 + ShaderLength * 64);
+   if (!text)
+      exit(1);
+
+   /* A chain of dependent instructions which ends up in the color, so
+    * none of it can be optimized away.
+    */
+   p = text;
+   p += sprintf(p,
+                "VERT\n"
+                "DCL IN[0]\n"
+                "DCL IN[1]\n"
+                "DCL OUT[0], POSITION\n"
+                "DCL OUT[1], COLOR\n"
+                "DCL TEMP[0]\n"
+                "IMM[0] FLT32 { 0.999, 0.001, 0.0, 1.0 }\n"
+                "  0: MOV TEMP[0], IN[1]\n");
+
+   for (i = 0; i < ShaderLength; i++) {
+      p += sprintf(p, "%3d: MAD TEMP[0], TEMP[0], IMM[0].xxxx, IMM[0].yyyy\n",
+                   i + 1);
+   }
+
+   sprintf(p,
+           "%3d: MOV OUT[1], TEMP[0]\n"
+           "%3d: MOV OUT[0], IN[0]\n"
+           "%3d: END\n",
+           i + 1, i + 2, i + 3);
+
+   handle = graw_parse_vertex_shader(info.ctx, text);
+   info.ctx->bind_vs_state(info.ctx, handle);
+
+   FREE(text);
+}
+
+
+static void set_fragment_shader( void )
+{
+   void *handle;
+   const char *text =
+      "FRAG\n"
+      "DCL IN[0], COLOR, LINEAR\n"
+      "DCL OUT[0], COLOR\n"
+      "  0: MOV OUT[0], IN[0]\n"
+      "  1: END\n";
+
+   handle = graw_parse_fragment_shader(info.ctx, text);
+   info.ctx->bind_fs_state(info.ctx, handle);
+}
+
+
+static void set_state( void )
+{
+   struct pipe_framebuffer_state fb;
+
+   memset(&fb, 0, sizeof fb);
+   fb.nr_cbufs = 1;
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.cbufs[0] = info.color_surf[0];
+   info.ctx->set_framebuffer_state(info.ctx, &fb);
+
+   graw_util_default_state(&info, FALSE);
+   graw_util_viewport(&info, 0, 0, WIDTH, HEIGHT, 30, 1000);
+
+   set_vertices();
+   set_vertex_shader();
+   set_fragment_shader();
+}
+
+
+static void set_threads( int num_threads )
+{
+   char value[16];
+
+   util_snprintf(value, sizeof value, "%d", num_threads);
+#ifdef _WIN32
+   _putenv_s(Mode->env, value);
+#else
+   setenv(Mode->env, value, 1);
+#endif
+}
+
+
+/**
+ * Draw NumFrames frames and return the number of vertices or triangles
+ * per second.
+ */
+static double run( void )
+{
+   union pipe_color_union clear_color = { {1,0,1,1} };
+   struct pipe_fence_handle *fence = NULL;
+   int64_t start, end;
+   int i;
+
+   start = os_time_get();
+
+   for (i = 0; i < NumFrames; i++) {
+      info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR, &clear_color, 0, 0);
+      util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, num_verts);
+      info.ctx->flush(info.ctx, &fence, 0);
+      info.screen->fence_finish(info.screen, fence, PIPE_TIMEOUT_INFINITE);
+      info.screen->fence_reference(info.screen, &fence, NULL);
+   }
+
+   end = os_time_get();
+
+   return (double) NumFrames * (num_verts / Mode->verts_per_unit) *
+          1000000.0 / (double) MAX2(end - start, 1);
+}
+
+
+static void draw( void )
+{
+   struct pipe_context *ctx = info.ctx;
+   double base = 0.0;
+   int n;
+
+   printf("%u %s/frame, %d vertex shader instructions, %d frames\n",
+          num_verts / Mode->verts_per_unit, Mode->units, ShaderLength + 3,
+          NumFrames);
+
+   for (n = 1; n <= MaxThreads; n++) {
+      double rate;
+
+      set_threads(n);
+
+      info.ctx = info.screen->context_create(info.screen, NULL, 0);
+      if (!info.ctx)
+         exit(4);
+
+      set_state();
+      rate = run();
+      if (n == 1)
+         base = rate;
+
+      printf("%2d %s threads: %.3f M%s/sec (%.2fx)\n",
+             n, Mode->name, rate / 1000000.0, Mode->units, rate / base);
+
+      info.ctx->destroy(info.ctx);
+   }
+
+   info.ctx = ctx;
+   graw_util_flush_front(&info);
+}
+
+
+static void init( void )
+{
+   if (!graw_util_create_window(&info, WIDTH, HEIGHT, 1, FALSE))
+      exit(1);
+
+   create_vertices();
+}
+
+
+static void args(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ) {
+      if (graw_parse_args(&i, argc, argv)) {
+         /* ok */
+      }
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         NumFrames = MAX2(1, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+         GridSize = MAX2(1, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+         ShaderLength = MAX2(0, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+         MaxThreads = MAX2(1, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc &&
+               (strcmp(argv[i + 1], "vs") == 0 ||
+                strcmp(argv[i + 1], "setup") == 0)) {
+         Mode = &modes[strcmp(argv[i + 1], "vs") == 0 ? 0 : 1];
+         i += 2;
+      }
+      else {
+         printf("Invalid arg %s\n", argv[i]);
+         printf("Usage: %s [-m vs|setup] [-n frames] [-g grid size] "
+                "[-l shader length] [-t max threads]\n", argv[0]);
+         exit(1);
+      }
+   }
+
+   if (ShaderLength < 0)
+      ShaderLength = Mode->shader_length;
+}
+
+
+int main( int argc, char *argv[] )
+{
+   args(argc, argv);
+   init();
+
+   graw_set_display_func( draw );
+   graw_main_loop();
+   return 0;
+}
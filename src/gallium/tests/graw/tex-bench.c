@@ -0,0 +1,297 @@
+/* Texture sampling benchmark.
+ *
+ * Covers the whole window with a quad sampling a large texture, once
+ * for each of several rotations and scale factors, and prints the
+ * number of bilinearly filtered texels per second of each run.  Rotated
+ * and minified lookups are the access patterns where the texture's
+ * memory layout matters most.
+ *
+ * With llvmpipe, running once as is and once with LP_PERF=no_tiling
+ * compares the tiled and the linear texture layouts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "graw_util.h"
+#include "os/os_time.h"
+
+static struct graw_info info;
+
+static const int WIDTH = 1024;
+static const int HEIGHT = 1024;
+
+static int NumFrames = 20;
+static int TexSize = 4096;
+
+static struct pipe_resource *texture = NULL;
+static struct pipe_sampler_view *sv = NULL;
+static void *sampler = NULL;
+
+
+struct vertex {
+   float position[4];
+   float texcoord[4];
+};
+
+static struct vertex vertices[4];
+static struct pipe_vertex_buffer vbuf;
+
+
+static const struct {
+   float angle;                 /* degrees */
+   float scale;                 /* texels per pixel */
+} runs[] = {
+   {  0.0f, 1.0f },
+   { 30.0f, 1.0f },
+   { 90.0f, 1.0f },
+   {  0.0f, 4.0f },
+   { 30.0f, 4.0f },
+   { 90.0f, 4.0f },
+};
+
+
+static void set_texcoords( float angle, float scale )
+{
+   float c = cosf(angle * (float) M_PI / 180.0f);
+   float s = sinf(angle * (float) M_PI / 180.0f);
+   float k = scale * WIDTH / (2.0f * TexSize);
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      float x = vertices[i].position[0];
+      float y = vertices[i].position[1];
+
+      vertices[i].texcoord[0] = 0.5f + k * (c * x - s * y);
+      vertices[i].texcoord[1] = 0.5f + k * (s * x + c * y);
+      vertices[i].texcoord[2] = 0.0f;
+      vertices[i].texcoord[3] = 1.0f;
+   }
+
+   pipe_buffer_write(info.ctx, vbuf.buffer, 0, sizeof vertices, vertices);
+}
+
+
+static void set_vertices( void )
+{
+   static const float pos[4][2] = {
+      { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f }
+   };
+   struct pipe_vertex_element ve[2];
+   void *handle;
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      vertices[i].position[0] = pos[i][0];
+      vertices[i].position[1] = pos[i][1];
+      vertices[i].position[2] = 0.0f;
+      vertices[i].position[3] = 1.0f;
+   }
+
+   memset(ve, 0, sizeof ve);
+
+   ve[0].src_offset = Offset(struct vertex, position);
+   ve[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve[1].src_offset = Offset(struct vertex, texcoord);
+   ve[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   handle = info.ctx->create_vertex_elements_state(info.ctx, 2, ve);
+   info.ctx->bind_vertex_elements_state(info.ctx, handle);
+
+   memset(&vbuf, 0, sizeof vbuf);
+
+   vbuf.stride = sizeof( struct vertex );
+   vbuf.buffer_offset = 0;
+   vbuf.buffer = pipe_buffer_create_with_data(info.ctx,
+                                              PIPE_BIND_VERTEX_BUFFER,
+                                              PIPE_USAGE_DEFAULT,
+                                              sizeof vertices,
+                                              vertices);
+
+   info.ctx->set_vertex_buffers(info.ctx, 0, 1, &vbuf);
+}
+
+
+static void set_vertex_shader( void )
+{
+   void *handle;
+   const char *text =
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], GENERIC[0]\n"
+      "  0: MOV OUT[1], IN[1]\n"
+      "  1: MOV OUT[0], IN[0]\n"
+      "  2: END\n";
+
+   handle = graw_parse_vertex_shader(info.ctx, text);
+   info.ctx->bind_vs_state(info.ctx, handle);
+}
+
+
+static void set_fragment_shader( void )
+{
+   void *handle;
+   const char *text =
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL SAMP[0]\n"
+      "  0: TEX OUT[0], IN[0], SAMP[0], 2D\n"
+      "  1: END\n";
+
+   handle = graw_parse_fragment_shader(info.ctx, text);
+   info.ctx->bind_fs_state(info.ctx, handle);
+}
+
+
+static void init_tex( void )
+{
+   uint32_t *data;
+   int i, j;
+
+   data = MALLOC(TexSize * TexSize * sizeof *data);
+   if (!data)
+      exit(1);
+
+   for (j = 0; j < TexSize; j++) {
+      for (i = 0; i < TexSize; i++) {
+         data[j * TexSize + i] = 0xff000000 |
+                                 ((i & 0xff) << 16) |
+                                 ((j & 0xff) << 8) |
+                                 ((i ^ j) & 0xff);
+      }
+   }
+
+   texture = graw_util_create_tex2d(&info, TexSize, TexSize,
+                                    PIPE_FORMAT_B8G8R8A8_UNORM, data);
+   FREE(data);
+   if (!texture)
+      exit(4);
+
+   sv = graw_util_create_simple_sampler_view(&info, texture);
+   if (!sv)
+      exit(5);
+
+   info.ctx->set_sampler_views(info.ctx, PIPE_SHADER_FRAGMENT, 0, 1, &sv);
+
+   sampler = graw_util_create_simple_sampler(&info,
+                                             PIPE_TEX_WRAP_REPEAT,
+                                             PIPE_TEX_FILTER_LINEAR);
+   if (!sampler)
+      exit(6);
+
+   info.ctx->bind_sampler_states(info.ctx, PIPE_SHADER_FRAGMENT,
+                                 0, 1, &sampler);
+}
+
+
+/**
+ * Draw NumFrames frames and return the number of texels per second.
+ */
+static double run( void )
+{
+   union pipe_color_union clear_color = { {1,0,1,1} };
+   struct pipe_fence_handle *fence = NULL;
+   int64_t start, end;
+   int i;
+
+   start = os_time_get();
+
+   for (i = 0; i < NumFrames; i++) {
+      info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR, &clear_color, 0, 0);
+      util_draw_arrays(info.ctx, PIPE_PRIM_QUADS, 0, 4);
+      info.ctx->flush(info.ctx, &fence, 0);
+      info.screen->fence_finish(info.screen, fence, PIPE_TIMEOUT_INFINITE);
+      info.screen->fence_reference(info.screen, &fence, NULL);
+   }
+
+   end = os_time_get();
+
+   /* four texels per bilinear lookup */
+   return (double) NumFrames * WIDTH * HEIGHT * 4 * 1000000.0 /
+          (double) MAX2(end - start, 1);
+}
+
+
+static void draw( void )
+{
+   unsigned i;
+
+   printf("%dx%d texture, %dx%d window, %d frames\n",
+          TexSize, TexSize, WIDTH, HEIGHT, NumFrames);
+
+   for (i = 0; i < ARRAY_SIZE(runs); i++) {
+      set_texcoords(runs[i].angle, runs[i].scale);
+
+      /* warm up */
+      util_draw_arrays(info.ctx, PIPE_PRIM_QUADS, 0, 4);
+      info.ctx->flush(info.ctx, NULL, 0);
+
+      printf("rotated %3.0f deg, %.0f texels/pixel: %.3f Mtexels/sec\n",
+             runs[i].angle, runs[i].scale, run() / 1000000.0);
+   }
+
+   graw_util_flush_front(&info);
+}
+
+
+static void init( void )
+{
+   struct pipe_framebuffer_state fb;
+
+   if (!graw_util_create_window(&info, WIDTH, HEIGHT, 1, FALSE))
+      exit(1);
+
+   memset(&fb, 0, sizeof fb);
+   fb.nr_cbufs = 1;
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.cbufs[0] = info.color_surf[0];
+   info.ctx->set_framebuffer_state(info.ctx, &fb);
+
+   graw_util_default_state(&info, FALSE);
+   graw_util_viewport(&info, 0, 0, WIDTH, HEIGHT, 30, 1000);
+
+   set_vertices();
+   set_vertex_shader();
+   set_fragment_shader();
+   init_tex();
+}
+
+
+static void args(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ) {
+      if (graw_parse_args(&i, argc, argv)) {
+         /* ok */
+      }
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         NumFrames = MAX2(1, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+         TexSize = MAX2(4, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else {
+         printf("Invalid arg %s\n", argv[i]);
+         printf("Usage: %s [-n frames] [-s texture size]\n", argv[0]);
+         exit(1);
+      }
+   }
+}
+
+
+int main( int argc, char *argv[] )
+{
+   args(argc, argv);
+   init();
+
+   graw_set_display_func( draw );
+   graw_main_loop();
+   return 0;
+}
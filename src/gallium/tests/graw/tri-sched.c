@@ -0,0 +1,236 @@
+/* Rasterizer scheduling benchmark.
+ *
+ * Draws a scene whose cost is very unevenly distributed over the screen:
+ * one large triangle covering the whole window, plus a dense grid of
+ * small triangles piled up in one corner.  The scene is rendered a number
+ * of times and the average time per frame is printed.
+ *
+ * With llvmpipe, run with LP_DEBUG=sched to also get the per-thread busy
+ * and idle time of every scene.
+ */
+
+#include <stdio.h>
+#include "graw_util.h"
+#include "os/os_time.h"
+
+static struct graw_info info;
+
+static const int WIDTH = 1024;
+static const int HEIGHT = 1024;
+
+static int NumFrames = 100;
+static int GridSize = 64;       /* GridSize x GridSize quads in the corner */
+static float CornerSize = 0.5f; /* fraction of the window covered by grid */
+
+
+struct vertex {
+   float position[4];
+   float color[4];
+};
+
+static unsigned num_verts;
+
+
+static void
+set_vertex(struct vertex *v, float x, float y, float r, float g, float b)
+{
+   v->position[0] = x;
+   v->position[1] = y;
+   v->position[2] = 0.0f;
+   v->position[3] = 1.0f;
+   v->color[0] = r;
+   v->color[1] = g;
+   v->color[2] = b;
+   v->color[3] = 1.0f;
+}
+
+
+static void set_vertices( void )
+{
+   struct pipe_vertex_element ve[2];
+   struct pipe_vertex_buffer vbuf;
+   struct vertex *vertices, *v;
+   void *handle;
+   float step = 2.0f * CornerSize / GridSize;
+   int i, j;
+
+   num_verts = 3 + GridSize * GridSize * 6;
+   vertices = MALLOC(num_verts * sizeof *vertices);
+   if (!vertices)
+      exit(1);
+
+   v = vertices;
+
+   /* background triangle, covering the whole window */
+   set_vertex(v++, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f);
+   set_vertex(v++,  3.0f, -1.0f, 0.0f, 1.0f, 0.0f);
+   set_vertex(v++, -1.0f,  3.0f, 0.0f, 0.0f, 1.0f);
+
+   /* dense grid of quads in the bottom-left corner */
+   for (j = 0; j < GridSize; j++) {
+      for (i = 0; i < GridSize; i++) {
+         float x0 = -1.0f + i * step, x1 = x0 + step;
+         float y0 = -1.0f + j * step, y1 = y0 + step;
+         float c = (float) ((i + j) & 1);
+
+         set_vertex(v++, x0, y0, c, c, 1.0f);
+         set_vertex(v++, x1, y0, c, 1.0f, c);
+         set_vertex(v++, x0, y1, 1.0f, c, c);
+         set_vertex(v++, x1, y0, c, 1.0f, c);
+         set_vertex(v++, x1, y1, c, c, c);
+         set_vertex(v++, x0, y1, 1.0f, c, c);
+      }
+   }
+
+   memset(ve, 0, sizeof ve);
+
+   ve[0].src_offset = Offset(struct vertex, position);
+   ve[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   ve[1].src_offset = Offset(struct vertex, color);
+   ve[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   handle = info.ctx->create_vertex_elements_state(info.ctx, 2, ve);
+   info.ctx->bind_vertex_elements_state(info.ctx, handle);
+
+   memset(&vbuf, 0, sizeof vbuf);
+
+   vbuf.stride = sizeof( struct vertex );
+   vbuf.buffer_offset = 0;
+   vbuf.buffer = pipe_buffer_create_with_data(info.ctx,
+                                              PIPE_BIND_VERTEX_BUFFER,
+                                              PIPE_USAGE_DEFAULT,
+                                              num_verts * sizeof *vertices,
+                                              vertices);
+
+   info.ctx->set_vertex_buffers(info.ctx, 0, 1, &vbuf);
+
+   FREE(vertices);
+}
+
+
+static void set_vertex_shader( void )
+{
+   void *handle;
+   const char *text =
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "  0: MOV OUT[1], IN[1]\n"
+      "  1: MOV OUT[0], IN[0]\n"
+      "  2: END\n";
+
+   handle = graw_parse_vertex_shader(info.ctx, text);
+   info.ctx->bind_vs_state(info.ctx, handle);
+}
+
+
+static void set_fragment_shader( void )
+{
+   void *handle;
+   const char *text =
+      "FRAG\n"
+      "DCL IN[0], COLOR, LINEAR\n"
+      "DCL OUT[0], COLOR\n"
+      "  0: MOV OUT[0], IN[0]\n"
+      "  1: END\n";
+
+   handle = graw_parse_fragment_shader(info.ctx, text);
+   info.ctx->bind_fs_state(info.ctx, handle);
+}
+
+
+static void draw( void )
+{
+   union pipe_color_union clear_color = { {1,0,1,1} };
+   struct pipe_fence_handle *fence = NULL;
+   int64_t start, end;
+   int i;
+
+   start = os_time_get();
+
+   for (i = 0; i < NumFrames; i++) {
+      info.ctx->clear(info.ctx, PIPE_CLEAR_COLOR, &clear_color, 0, 0);
+      util_draw_arrays(info.ctx, PIPE_PRIM_TRIANGLES, 0, num_verts);
+      info.ctx->flush(info.ctx, &fence, 0);
+      info.screen->fence_finish(info.screen, fence, PIPE_TIMEOUT_INFINITE);
+      info.screen->fence_reference(info.screen, &fence, NULL);
+   }
+
+   end = os_time_get();
+
+   printf("%d frames, %u triangles/frame: %.3f ms/frame\n",
+          NumFrames, num_verts / 3,
+          (end - start) / 1000.0 / NumFrames);
+
+   graw_util_flush_front(&info);
+}
+
+
+static void init( void )
+{
+   if (!graw_util_create_window(&info, WIDTH, HEIGHT, 1, FALSE))
+      exit(1);
+
+   graw_util_default_state(&info, FALSE);
+
+   {
+      struct pipe_rasterizer_state rasterizer;
+      void *handle;
+      memset(&rasterizer, 0, sizeof rasterizer);
+      rasterizer.cull_face = PIPE_FACE_NONE;
+      rasterizer.half_pixel_center = 1;
+      rasterizer.bottom_edge_rule = 1;
+      rasterizer.depth_clip = 1;
+      handle = info.ctx->create_rasterizer_state(info.ctx, &rasterizer);
+      info.ctx->bind_rasterizer_state(info.ctx, handle);
+   }
+
+   graw_util_viewport(&info, 0, 0, WIDTH, HEIGHT, 30, 1000);
+
+   set_vertices();
+   set_vertex_shader();
+   set_fragment_shader();
+}
+
+
+static void args(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ) {
+      if (graw_parse_args(&i, argc, argv)) {
+         /* ok */
+      }
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         NumFrames = MAX2(1, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+         GridSize = MAX2(1, atoi(argv[i + 1]));
+         i += 2;
+      }
+      else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+         CornerSize = CLAMP((float) atof(argv[i + 1]), 0.01f, 1.0f);
+         i += 2;
+      }
+      else {
+         printf("Invalid arg %s\n", argv[i]);
+         printf("Usage: %s [-n frames] [-g grid size] [-c corner size]\n",
+                argv[0]);
+         exit(1);
+      }
+   }
+}
+
+
+int main( int argc, char *argv[] )
+{
+   args(argc, argv);
+   init();
+
+   graw_set_display_func( draw );
+   graw_main_loop();
+   return 0;
+}
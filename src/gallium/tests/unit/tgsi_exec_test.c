@@ -0,0 +1,272 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Checks that the tgsi_exec fast path (pre-decoded instructions) gives
+ * bit-identical results to the generic interpreter, and with the "bench"
+ * argument, compares the speed of both.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tgsi/tgsi_exec.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "os/os_time.h"
+
+
+#define NUM_INPUTS 2
+#define NUM_OUTPUTS 3
+#define NUM_CONSTS 4
+
+
+/* Exercises every pre-decoded opcode with swizzles, modifiers, saturation,
+ * immediates, out of bounds constants, partial write masks and partial
+ * execution masks, interleaved with instructions which aren't pre-decoded.
+ */
+static const char *shader_text =
+   "VERT\n"
+   "DCL IN[0]\n"
+   "DCL IN[1]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL OUT[2], GENERIC[1]\n"
+   "DCL CONST[0..7]\n"
+   "DCL TEMP[0..3]\n"
+   "IMM[0] FLT32 {    0.5000,    -2.0000,     1.0000,     0.0000}\n"
+   "  0: MUL TEMP[0], IN[0].xxxx, CONST[0]\n"
+   "  1: MAD TEMP[0], IN[0].yyyy, CONST[1], TEMP[0]\n"
+   "  2: MAD TEMP[0], IN[0].zzzz, CONST[2], TEMP[0]\n"
+   "  3: MAD OUT[0], IN[0].wwww, CONST[3], TEMP[0]\n"
+   "  4: DP3 TEMP[1].x, IN[1], -IN[0]\n"
+   "  5: DP4 TEMP[1].y, |IN[1]|, IMM[0]\n"
+   "  6: SUB TEMP[1].zw, IN[1].wzyx, IMM[0].xxyy\n"
+   "  7: MIN TEMP[2], TEMP[1], IN[0]\n"
+   "  8: MAX TEMP[2].xy, TEMP[2], -|IN[1]|\n"
+   "  9: SLT TEMP[3], IN[0], IN[1]\n"
+   " 10: SGE TEMP[3].yw, IN[0].yxwz, IN[1]\n"
+   " 11: ADD_SAT OUT[1], TEMP[2], TEMP[3]\n"
+   " 12: MOV TEMP[0], TEMP[0].yxwz\n"
+   " 13: IF TEMP[3].xxxx :16\n"
+   " 14:   MUL_SAT OUT[2], TEMP[0], IMM[0].zyxw\n"
+   " 15: ELSE :17\n"
+   " 16:   MOV OUT[2], -TEMP[1]\n"
+   " 17: ENDIF\n"
+   " 18: RCP TEMP[0].x, IN[1].xxxx\n"
+   " 19: ADD OUT[2].x, OUT[2], TEMP[0].xxxx\n"
+   " 20: MOV_SAT OUT[2].w, CONST[7].xxxx\n"
+   " 21: MAX OUT[1].z, OUT[1], CONST[0].wwww\n"
+   " 22: END\n";
+
+
+static const float special[] = {
+   0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 2.0f,
+   INFINITY, -INFINITY, NAN,
+};
+
+
+static float
+random_float(void)
+{
+   if (rand() % 8 == 0)
+      return special[rand() % Elements(special)];
+   return (float) (rand() % 2001 - 1000) / 250.0f;
+}
+
+
+static void
+set_inputs(struct tgsi_exec_machine *mach, const float *values)
+{
+   unsigned i, chan, lane;
+
+   for (i = 0; i < NUM_INPUTS; i++)
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+         for (lane = 0; lane < TGSI_QUAD_SIZE; lane++)
+            mach->Inputs[i].xyzw[chan].f[lane] = *values++;
+}
+
+
+static struct tgsi_exec_machine *
+create_machine(const struct tgsi_token *tokens, const float *consts,
+               boolean fast)
+{
+   struct tgsi_exec_machine *mach = tgsi_exec_machine_create();
+   const void *bufs[1];
+   unsigned sizes[1];
+
+   if (!mach)
+      return NULL;
+
+   mach->NoFastPath = !fast;
+   tgsi_exec_machine_bind_shader(mach, tokens, NULL);
+
+   bufs[0] = consts;
+   sizes[0] = NUM_CONSTS * 4;
+   tgsi_exec_set_constant_buffers(mach, 1, bufs, sizes);
+
+   return mach;
+}
+
+
+/**
+ * Compare the outputs bitwise, except that any two NaNs are equal: which
+ * NaN an operation on two NaNs returns depends on the order the compiler
+ * picked for the operands.
+ */
+static boolean
+compare_outputs(const struct tgsi_exec_machine *a,
+                const struct tgsi_exec_machine *b)
+{
+   unsigned i, chan, lane;
+
+   for (i = 0; i < NUM_OUTPUTS; i++) {
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         for (lane = 0; lane < TGSI_QUAD_SIZE; lane++) {
+            const union tgsi_exec_channel *ca = &a->Outputs[i].xyzw[chan];
+            const union tgsi_exec_channel *cb = &b->Outputs[i].xyzw[chan];
+
+            if (ca->u[lane] != cb->u[lane] &&
+                !(util_is_nan(ca->f[lane]) && util_is_nan(cb->f[lane]))) {
+               printf("OUT[%u].%c[%u]: %f (0x%08x) != %f (0x%08x)\n",
+                      i, "xyzw"[chan], lane,
+                      ca->f[lane], ca->u[lane], cb->f[lane], cb->u[lane]);
+               return FALSE;
+            }
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+static int
+test(struct tgsi_exec_machine *slow, struct tgsi_exec_machine *fast)
+{
+   float inputs[NUM_INPUTS * TGSI_NUM_CHANNELS * TGSI_QUAD_SIZE];
+   unsigned iter, i, failures = 0;
+
+   for (iter = 0; iter < 100000; iter++) {
+      for (i = 0; i < Elements(inputs); i++)
+         inputs[i] = random_float();
+
+      set_inputs(slow, inputs);
+      set_inputs(fast, inputs);
+      memset(slow->Outputs, 0, NUM_OUTPUTS * sizeof slow->Outputs[0]);
+      memset(fast->Outputs, 0, NUM_OUTPUTS * sizeof fast->Outputs[0]);
+
+      tgsi_exec_machine_run(slow);
+      tgsi_exec_machine_run(fast);
+
+      if (!compare_outputs(slow, fast)) {
+         if (++failures >= 10)
+            break;
+      }
+   }
+
+   if (failures) {
+      printf("Failure!\n");
+      return 1;
+   }
+
+   printf("Success!\n");
+   return 0;
+}
+
+
+static double
+benchmark_machine(struct tgsi_exec_machine *mach)
+{
+   float inputs[NUM_INPUTS * TGSI_NUM_CHANNELS * TGSI_QUAD_SIZE];
+   const unsigned runs = 1000000;
+   int64_t start, end;
+   unsigned i;
+
+   for (i = 0; i < Elements(inputs); i++)
+      inputs[i] = (float) (i % 7) - 3.0f;
+   set_inputs(mach, inputs);
+
+   start = os_time_get();
+   for (i = 0; i < runs; i++)
+      tgsi_exec_machine_run(mach);
+   end = os_time_get();
+
+   /* instructions executed per second, counting ELSE/ENDIF/END */
+   return (double) runs * mach->NumInstructions * 1000000.0 /
+          (double) MAX2(end - start, 1);
+}
+
+
+static int
+benchmark(struct tgsi_exec_machine *slow, struct tgsi_exec_machine *fast)
+{
+   double slow_rate = benchmark_machine(slow);
+   double fast_rate = benchmark_machine(fast);
+
+   printf("generic: %8.2f Minst/sec\n", slow_rate / 1000000.0);
+   printf("fast:    %8.2f Minst/sec (%.2fx)\n", fast_rate / 1000000.0,
+          fast_rate / slow_rate);
+   return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   static const float consts[NUM_CONSTS * 4] = {
+      1.0f, 0.0f, 0.0f, 0.25f,
+      0.0f, -1.0f, 0.5f, 0.0f,
+      2.0f, 0.0f, 1.0f, -3.0f,
+      0.0f, 0.125f, 0.0f, 1.0f,
+   };
+   struct tgsi_token tokens[1024];
+   struct tgsi_exec_machine *slow, *fast;
+   int ret;
+
+   if (!tgsi_text_translate(shader_text, tokens, Elements(tokens))) {
+      printf("Failed to parse shader\n");
+      return 1;
+   }
+
+   slow = create_machine(tokens, consts, FALSE);
+   fast = create_machine(tokens, consts, TRUE);
+   if (!slow || !fast) {
+      printf("Failed to create machines\n");
+      return 1;
+   }
+
+   if (argc > 1 && !strcmp(argv[1], "bench"))
+      ret = benchmark(slow, fast);
+   else
+      ret = test(slow, fast);
+
+   tgsi_exec_machine_destroy(slow);
+   tgsi_exec_machine_destroy(fast);
+
+   return ret;
+}
@@ -29,6 +29,7 @@
 #include "util/u_format.h"
 #include "util/u_half.h"
 #include "util/u_cpu_detect.h"
+#include "os/os_time.h"
 #include "rtasm/rtasm_cpu.h"
 
 /* don't use this for serious use */
@@ -46,6 +47,90 @@ static double rand_double()
    return v;
 }
 
+/**
+ * Time the conversion of common vertex formats to R32G32B32A32_FLOAT, to
+ * compare the translate backends' throughput.
+ */
+static int benchmark(struct translate *(*create_fn)(const struct translate_key *key),
+                     const char *name)
+{
+   static const enum pipe_format formats[] = {
+      PIPE_FORMAT_R32G32B32A32_FLOAT,
+      PIPE_FORMAT_R32G32B32_FLOAT,
+      PIPE_FORMAT_R32G32_FLOAT,
+      PIPE_FORMAT_R16G16B16A16_FLOAT,
+      PIPE_FORMAT_R16G16_FLOAT,
+      PIPE_FORMAT_R16G16B16A16_SNORM,
+      PIPE_FORMAT_R16G16B16A16_UNORM,
+      PIPE_FORMAT_R16G16B16A16_SSCALED,
+      PIPE_FORMAT_R8G8B8A8_UNORM,
+      PIPE_FORMAT_R8G8B8A8_SNORM,
+      PIPE_FORMAT_R10G10B10A2_UNORM,
+      PIPE_FORMAT_R10G10B10A2_SNORM,
+      PIPE_FORMAT_R32G32B32A32_FIXED,
+   };
+   const unsigned count = 64 * 1024;
+   const unsigned runs = 100;
+   struct translate_key key;
+   unsigned char *input, *output;
+   unsigned *elts;
+   unsigned i, j;
+
+   input = align_malloc(count * 16, 64);
+   output = align_malloc(count * 16, 64);
+   elts = align_malloc(count * sizeof *elts, 64);
+
+   for (i = 0; i < count * 16; ++i)
+      input[i] = rand() & 0x7f;
+
+   /* mostly sequential, like the indices of a typical mesh */
+   for (i = 0; i < count; ++i)
+      elts[i] = (i & ~15) | ((i * 7) & 15);
+
+   memset(&key, 0, sizeof key);
+   key.nr_elements = 1;
+   key.output_stride = 16;
+   key.element[0].type = TRANSLATE_ELEMENT_NORMAL;
+   key.element[0].output_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   for (i = 0; i < Elements(formats); ++i)
+   {
+      const struct util_format_description *desc =
+         util_format_description(formats[i]);
+      struct translate *translate;
+      int64_t start, end;
+      double rate;
+
+      key.element[0].input_format = formats[i];
+      translate = create_fn(&key);
+      if (!translate)
+      {
+         printf("%-32s unsupported\n", desc->name);
+         continue;
+      }
+
+      translate->set_buffer(translate, 0, input,
+                            util_format_get_blocksize(formats[i]), count - 1);
+
+      start = os_time_get();
+      for (j = 0; j < runs; ++j)
+         translate->run_elts(translate, elts, count, 0, 0, output);
+      end = os_time_get();
+
+      rate = (double) runs * count / (double) MAX2(end - start, 1);
+      printf("%-32s %8.1f Mverts/sec\n", desc->name, rate);
+
+      translate->release(translate);
+   }
+
+   printf("translate_%s benchmark done\n", name);
+
+   align_free(elts);
+   align_free(output);
+   align_free(input);
+   return 0;
+}
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
@@ -76,6 +161,10 @@ int main(int argc, char** argv)
       create_fn = translate_generic_create;
    else if (!strcmp(argv[1], "x86"))
       create_fn = translate_sse2_create;
+#if HAVE_LLVM
+   else if (!strcmp(argv[1], "llvm"))
+      create_fn = translate_llvm_create;
+#endif
    else if (!strcmp(argv[1], "nosse"))
    {
       util_cpu_caps.has_sse = 0;
@@ -129,10 +218,13 @@ int main(int argc, char** argv)
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [generic|x86|llvm|nosse|sse|sse2|sse3|sse4.1] [bench]\n");
       return 2;
    }
 
+   if (argc > 2 && !strcmp(argv[2], "bench"))
+      return benchmark(create_fn, argv[1]);
+
    for (i = 1; i < Elements(buffer); ++i)
       buffer[i] = align_malloc(buffer_size, 4096);
 
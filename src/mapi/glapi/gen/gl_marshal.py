@@ -0,0 +1,401 @@
+#!/usr/bin/env python
+
+# Copyright (C) 2016 VMware, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# This script generates the file marshal_generated.c, which contains the
+# glthread marshalling functions, which record GL calls into a command
+# batch, the matching unmarshalling functions, which execute them on the
+# worker thread, and _mesa_create_marshal_table().
+
+import argparse
+import license
+import gl_XML
+import marshal_XML
+
+
+header = """/**
+ * \\file marshal_generated.c
+ * Marshalling and unmarshalling functions for glthread.
+ */
+
+
+#include "main/api_exec.h"
+#include "main/context.h"
+#include "main/dispatch.h"
+#include "main/glthread.h"
+#include "main/marshal.h"
+#include "glapi/glapi.h"
+
+
+static inline void
+_mesa_glthread_begin_sync(struct gl_context *ctx)
+{
+   _mesa_glthread_finish(ctx);
+
+   /* Functions which dispatch through the thread's table themselves, like
+    * the array element loopback, or which switch it, like glCallLists,
+    * must see the real one.
+    */
+   _glapi_set_dispatch(ctx->CurrentServerDispatch);
+}
+
+
+static inline void
+_mesa_glthread_end_sync(struct gl_context *ctx)
+{
+   _glapi_set_dispatch(ctx->CurrentClientDispatch);
+}
+"""
+
+
+current_indent = 0
+
+
+def out(s):
+    """Print s at the current indentation level."""
+    if s:
+        print ' ' * current_indent + s
+    else:
+        print
+
+
+class indent(object):
+    def __init__(self, amount = 3):
+        self.amount = amount
+
+    def __enter__(self):
+        global current_indent
+        current_indent += self.amount
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        global current_indent
+        current_indent -= self.amount
+
+
+def variable_size_string(func, p):
+    return '{0} * {1} * {2}'.format(p.counter, p.count_scale,
+                                    marshal_XML.element_size_string(p))
+
+
+class PrintCode(gl_XML.gl_print_base):
+    def __init__(self):
+        super(PrintCode, self).__init__()
+
+        self.name = 'gl_marshal.py'
+        self.license = license.bsd_license_template % (
+            'Copyright (C) 2016 VMware, Inc.', 'VMWARE')
+
+    def printRealHeader(self):
+        print header
+
+    def printRealFooter(self):
+        pass
+
+    def print_sync_call(self, func):
+        call = 'CALL_{0}(ctx->CurrentServerDispatch, ({1}))'.format(
+            func.name, func.get_called_parameter_string())
+        out('_mesa_glthread_begin_sync(ctx);')
+        if func.return_type == 'void':
+            out('{0};'.format(call))
+        else:
+            out('result = {0};'.format(call))
+        out('_mesa_glthread_end_sync(ctx);')
+        if func.marshal_call_after:
+            out(func.marshal_call_after)
+
+    def print_sync_body(self, func):
+        out('/* {0}: marshalled synchronously */'.format(func.name))
+        out('static {0} GLAPIENTRY'.format(func.return_type))
+        out('_mesa_marshal_{0}({1})'.format(
+            func.name, func.get_parameter_string()))
+        out('{')
+        with indent():
+            out('GET_CURRENT_CONTEXT(ctx);')
+            if func.return_type != 'void':
+                out('{0} result;'.format(func.return_type))
+            self.print_fail_check(func)
+            self.print_sync_call(func)
+            if func.return_type != 'void':
+                out('return result;')
+        out('}')
+        out('')
+
+    def print_fail_check(self, func):
+        if not func.marshal_fail:
+            return
+        out('if (unlikely({0})) {{'.format(func.marshal_fail))
+        with indent():
+            out('_mesa_glthread_disable(ctx, "{0}");'.format(func.name))
+            call = 'CALL_{0}(ctx->CurrentServerDispatch, ({1}))'.format(
+                func.name, func.get_called_parameter_string())
+            if func.return_type == 'void':
+                out('{0};'.format(call))
+                out('return;')
+            else:
+                out('return {0};'.format(call))
+        out('}')
+
+    def print_async_struct(self, func):
+        out('/* {0}: marshalled asynchronously */'.format(func.name))
+        out('struct marshal_cmd_{0}'.format(func.name))
+        out('{')
+        with indent():
+            out('struct marshal_cmd_base cmd_base;')
+            for p in func.fixed_params:
+                if p.count:
+                    out('{0} {1}[{2}];'.format(
+                        marshal_XML.element_type(p), p.name,
+                        p.count * p.count_scale))
+                else:
+                    out('{0} {1};'.format(p.type_string(), p.name))
+            for p in func.variable_params:
+                out('bool {0}_null; /* If set, no data follows for "{0}" '
+                    '*/'.format(p.name))
+            for p in func.variable_params:
+                out('/* Next ALIGN({0}, 8) bytes are {1} {2}[{3}] */'.format(
+                    variable_size_string(func, p),
+                    marshal_XML.element_type(p), p.name, p.counter))
+        out('};')
+        out('')
+
+    def print_async_unmarshal(self, func):
+        out('static inline void')
+        out(('_mesa_unmarshal_{0}(struct gl_context *ctx, '
+             'const struct marshal_cmd_{0} *cmd)').format(func.name))
+        out('{')
+        with indent():
+            for p in func.fixed_params:
+                if p.count:
+                    out('const {0} * {1} = cmd->{1};'.format(
+                        marshal_XML.element_type(p), p.name))
+                else:
+                    out('{0} {1} = cmd->{1};'.format(
+                        p.type_string(), p.name))
+            if func.variable_params:
+                for p in func.variable_params:
+                    out('{0} {1};'.format(p.type_string(), p.name))
+                out('const char *variable_data = '
+                    '(const char *) cmd + ALIGN(sizeof(*cmd), 8);')
+                for p in func.variable_params:
+                    out('if (cmd->{0}_null) {{'.format(p.name))
+                    with indent():
+                        out('{0} = NULL;'.format(p.name))
+                    out('} else {')
+                    with indent():
+                        out('{0} = ({1}) variable_data;'.format(
+                            p.name, p.type_string()))
+                        out('variable_data += ALIGN({0}, 8);'.format(
+                            variable_size_string(func, p)))
+                    out('}')
+            out('CALL_{0}(ctx->CurrentServerDispatch, ({1}));'.format(
+                func.name, func.get_called_parameter_string()))
+        out('}')
+        out('')
+
+    def print_async_marshal(self, func):
+        out('static void GLAPIENTRY')
+        out('_mesa_marshal_{0}({1})'.format(
+            func.name, func.get_parameter_string()))
+        out('{')
+        with indent():
+            out('GET_CURRENT_CONTEXT(ctx);')
+            for p in func.variable_params:
+                out('size_t {0}_size;'.format(p.name))
+            out('size_t cmd_size = ALIGN(sizeof(struct marshal_cmd_{0}), '
+                '8);'.format(func.name))
+            if func.fixed_params or func.variable_params:
+                out('struct marshal_cmd_{0} *cmd;'.format(func.name))
+            if func.variable_params:
+                out('char *variable_data;')
+            out('')
+
+            self.print_fail_check(func)
+
+            # Big or invalid sizes are executed synchronously, which also
+            # takes care of setting the GL error.
+            counters = []
+            for p in func.variable_params:
+                if p.counter not in counters:
+                    counters.append(p.counter)
+            for c in counters:
+                out('if (unlikely((GLsizeiptr) {0} < 0 || (GLsizeiptr) {0} > '
+                    'MARSHAL_MAX_CMD_SIZE))'.format(c))
+                with indent():
+                    out('goto fallback_to_sync;')
+            for p in func.variable_params:
+                out('{0}_size = {0} ? {1} : 0;'.format(
+                    p.name, variable_size_string(func, p)))
+                out('cmd_size += ALIGN({0}_size, 8);'.format(p.name))
+
+            conditions = []
+            if func.variable_params:
+                conditions.append('cmd_size > MARSHAL_MAX_CMD_SIZE')
+            if func.marshal_sync:
+                conditions.append(func.marshal_sync)
+            if conditions:
+                out('if (unlikely({0}))'.format(' || '.join(conditions)))
+                with indent():
+                    out('goto fallback_to_sync;')
+                out('')
+
+            if func.fixed_params or func.variable_params:
+                out(('cmd = _mesa_glthread_allocate_command(ctx, '
+                     'DISPATCH_CMD_{0}, cmd_size);').format(func.name))
+            else:
+                out(('_mesa_glthread_allocate_command(ctx, '
+                     'DISPATCH_CMD_{0}, cmd_size);').format(func.name))
+            for p in func.fixed_params:
+                if p.count:
+                    out('memcpy(cmd->{0}, {0}, {1} * {2});'.format(
+                        p.name, p.count * p.count_scale,
+                        marshal_XML.element_size_string(p)))
+                else:
+                    out('cmd->{0} = {0};'.format(p.name))
+            if func.variable_params:
+                out('variable_data = (char *) cmd + '
+                    'ALIGN(sizeof(*cmd), 8);')
+                for p in func.variable_params:
+                    out('cmd->{0}_null = !{0};'.format(p.name))
+                    out('if ({0}) {{'.format(p.name))
+                    with indent():
+                        out('memcpy(variable_data, {0}, {0}_size);'.format(
+                            p.name))
+                        out('variable_data += ALIGN({0}_size, 8);'.format(
+                            p.name))
+                    out('}')
+            if func.marshal_call_after:
+                out(func.marshal_call_after)
+
+            if func.variable_params or func.marshal_sync:
+                out('return;')
+                out('')
+                print 'fallback_to_sync:'
+                self.print_sync_call(func)
+        out('}')
+        out('')
+
+    def print_async_body(self, func):
+        for p in func.variable_params:
+            assert p.counter and not p.count_parameter_list, \
+                '{0}: cannot marshal "{1}" asynchronously'.format(
+                    func.name, p.name)
+        self.print_async_struct(func)
+        self.print_async_unmarshal(func)
+        self.print_async_marshal(func)
+
+    def print_unmarshal_dispatch_cmd(self, api):
+        out('size_t')
+        out('_mesa_unmarshal_dispatch_cmd(struct gl_context *ctx, '
+            'const void *cmd)')
+        out('{')
+        with indent():
+            out('const struct marshal_cmd_base *cmd_base = cmd;')
+            out('switch (cmd_base->cmd_id) {')
+            for func in api.functionIterateAll():
+                if func.marshal_flavor() != 'async':
+                    continue
+                out('case DISPATCH_CMD_{0}:'.format(func.name))
+                with indent():
+                    out(('_mesa_unmarshal_{0}(ctx, (const struct '
+                         'marshal_cmd_{0} *) cmd);').format(func.name))
+                    out('break;')
+            out('default:')
+            with indent():
+                out('assert(!"Unrecognized command ID");')
+                out('break;')
+            out('}')
+            out('')
+            out('return cmd_base->cmd_size;')
+        out('}')
+        out('')
+        out('')
+
+    def print_create_marshal_table(self, api):
+        out('struct _glapi_table *')
+        out('_mesa_create_marshal_table(const struct gl_context *ctx)')
+        out('{')
+        with indent():
+            out('struct _glapi_table *table;')
+            out('')
+            out('table = _mesa_alloc_dispatch_table();')
+            out('if (table == NULL)')
+            with indent():
+                out('return NULL;')
+            out('')
+            for func in api.functionIterateAll():
+                if func.marshal_flavor() == 'skip':
+                    continue
+                out('SET_{0}(table, _mesa_marshal_{0});'.format(func.name))
+            out('')
+            out('return table;')
+        out('}')
+
+    def printBody(self, api):
+        async_funcs = []
+        for func in api.functionIterateAll():
+            if func.marshal_flavor() == 'async':
+                async_funcs.append(func)
+
+        out('enum marshal_dispatch_cmd_id')
+        out('{')
+        with indent():
+            for func in async_funcs:
+                out('DISPATCH_CMD_{0},'.format(func.name))
+        out('};')
+        out('')
+        out('')
+
+        for func in api.functionIterateAll():
+            flavor = func.marshal_flavor()
+            if flavor == 'async':
+                self.print_async_body(func)
+            elif flavor == 'sync':
+                self.print_sync_body(func)
+            elif flavor != 'skip':
+                raise Exception('Unrecognized marshal flavor {0!r} for '
+                                '{1}'.format(flavor, func.name))
+        out('')
+        self.print_unmarshal_dispatch_cmd(api)
+        self.print_create_marshal_table(api)
+
+
+def _parser():
+    """Parse arguments and return a namespace."""
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-f',
+                        dest='filename',
+                        default='gl_and_es_API.xml',
+                        help='an xml file describing an API')
+    return parser.parse_args()
+
+
+def main():
+    """Main function."""
+    args = _parser()
+    printer = PrintCode()
+    api = gl_XML.parse_GL_API(args.filename,
+                              marshal_XML.marshal_item_factory())
+    printer.Print(api)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python
+
+# Copyright (C) 2016 VMware, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# This file contains the subclass of gl_function used by gl_marshal.py,
+# which knows how a function's parameters are marshalled.
+
+import gl_XML
+
+
+class marshal_item_factory(gl_XML.gl_item_factory):
+    """Factory to create objects derived from gl_item containing
+    information necessary to generate thread marshalling code."""
+
+    def create_function(self, element, context):
+        return marshal_function(element, context)
+
+
+class marshal_function(gl_XML.gl_function):
+    def process_element(self, element):
+        # gl_function.__init__ calls this for the first entry point, before
+        # any of our attributes exist.
+        if not hasattr(self, 'marshal'):
+            self.marshal = None
+            self.marshal_sync = None
+            self.marshal_fail = None
+            self.marshal_call_after = None
+
+        super(marshal_function, self).process_element(element)
+
+        # Only the entry point which specifies them sets these, so that
+        # aliases don't have to repeat them.
+        for attr in ('marshal', 'marshal_sync', 'marshal_fail',
+                     'marshal_call_after'):
+            value = element.get(attr)
+            if value:
+                setattr(self, attr, value)
+
+        # Sort the parameters into those which are part of the fixed size
+        # command structure and those which follow it.
+        self.fixed_params = []
+        self.variable_params = []
+        for p in self.parameters:
+            if p.is_padding:
+                continue
+            if p.is_variable_length():
+                self.variable_params.append(p)
+            else:
+                self.fixed_params.append(p)
+
+    def marshal_flavor(self):
+        """Find out how this function should be marshalled.
+
+        One of 'skip' (not in the marshal table), 'sync' (executed on the
+        application's thread after waiting for the worker) or 'async'
+        (recorded into the batch).
+        """
+        if self.marshal is not None:
+            return self.marshal
+        if self.exec_flavor == 'skip':
+            return 'skip'
+        if self.return_type != 'void':
+            return 'sync'
+        for p in self.parameters:
+            if p.is_padding:
+                continue
+            if p.is_output:
+                return 'sync'
+            if p.is_pointer() and not self.pointer_size_known(p):
+                return 'sync'
+        return 'async'
+
+    def pointer_size_known(self, p):
+        """Whether the amount of memory read through pointer parameter p
+        can be computed from the other parameters."""
+        if p.is_image() or p.count_parameter_list:
+            return False
+        if p.type_string().count('*') > 1:
+            return False
+        if p.counter:
+            return p.counter in [q.name for q in self.parameters]
+        return p.count > 0
+
+
+def element_type(p):
+    """The type pointed to by pointer parameter p, without qualifiers on
+    the outermost level."""
+    t = p.type_string().rstrip()
+    assert t.endswith('*')
+    t = t[:-1].rstrip()
+    if t.startswith('const '):
+        t = t[len('const '):]
+    return t
+
+
+def element_size_string(p):
+    t = element_type(p)
+    if t in ('void', 'GLvoid'):
+        return '1'
+    return 'sizeof({0})'.format(t)
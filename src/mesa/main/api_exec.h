@@ -41,6 +41,9 @@ _mesa_initialize_dispatch_tables(struct gl_context *ctx);
 extern struct _glapi_table *
 _mesa_new_nop_table(unsigned numEntries);
 
+extern struct _glapi_table *
+_mesa_alloc_dispatch_table(void);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -35,6 +35,8 @@
 
 #include "glheader.h"
 
+struct blob;
+struct blob_reader;
 struct gl_bitmap_atlas;
 struct gl_buffer_object;
 struct gl_context;
@@ -507,6 +509,26 @@ struct dd_function_table {
     */
    GLboolean (*LinkShader)(struct gl_context *ctx,
                            struct gl_shader_program *shader);
+
+   /**
+    * Save the driver's own state of a linked program for
+    * ARB_get_program_binary and the shader cache.
+    *
+    * Drivers that don't implement this and the function below can't return
+    * program binaries, and don't use the shader cache.
+    */
+   void (*ProgramBinarySerializeDriverBlob)(struct gl_context *ctx,
+                                            struct gl_program *prog,
+                                            struct blob *blob);
+
+   /**
+    * Restore the state saved by ProgramBinarySerializeDriverBlob() into a
+    * program which has its core Mesa state restored.  Return GL_FALSE if
+    * the data can't be used.
+    */
+   GLboolean (*ProgramBinaryDeserializeDriverBlob)(struct gl_context *ctx,
+                                                   struct gl_program *prog,
+                                                   struct blob_reader *blob);
    /*@}*/
 
    /**
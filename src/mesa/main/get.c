@@ -34,6 +34,7 @@
 #include "get.h"
 #include "macros.h"
 #include "mtypes.h"
+#include "program_binary.h"
 #include "state.h"
 #include "texcompress.h"
 #include "texstate.h"
@@ -821,6 +822,13 @@ find_custom_value(struct gl_context *ctx, const struct value_desc *d, union valu
       assert(v->value_int_n.n <= (int) ARRAY_SIZE(v->value_int_n.ints));
       break;
 
+   case GL_PROGRAM_BINARY_FORMATS:
+      v->value_int_n.n = 0;
+      if (ctx->Const.NumProgramBinaryFormats > 0)
+         v->value_int_n.ints[v->value_int_n.n++] =
+            GL_PROGRAM_BINARY_FORMAT_MESA;
+      break;
+
    case GL_MAX_VARYING_FLOATS_ARB:
       v->value_int = ctx->Const.MaxVarying * 4;
       break;
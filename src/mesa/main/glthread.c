@@ -0,0 +1,498 @@
+/*
+ * Copyright © 2016 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file glthread.c
+ * The glthread worker, the command batch queue, and the client-side array
+ * state used to decide whether draws may be marshalled.
+ */
+
+
+#include "main/glheader.h"
+#include "main/bufferobj.h"
+#include "main/context.h"
+#include "main/glthread.h"
+#include "main/hash.h"
+#include "main/imports.h"
+#include "main/marshal.h"
+#include "glapi/glapi.h"
+
+
+static void
+glthread_unmarshal_batch(struct gl_context *ctx, struct glthread_batch *batch)
+{
+   const uint8_t *buffer = (const uint8_t *) batch->buffer;
+   size_t pos = 0;
+
+   /* Begin/End and display lists switch the dispatch table of this thread
+    * only, so start each batch from the current one.
+    */
+   _glapi_set_dispatch(ctx->CurrentServerDispatch);
+
+   while (pos < batch->used)
+      pos += _mesa_unmarshal_dispatch_cmd(ctx, buffer + pos);
+
+   assert(pos == batch->used);
+   batch->used = 0;
+}
+
+
+static int
+glthread_worker(void *data)
+{
+   struct gl_context *ctx = data;
+   struct glthread_state *glthread = ctx->GLThread;
+
+   _glapi_set_context(ctx);
+
+   mtx_lock(&glthread->mutex);
+   for (;;) {
+      struct glthread_batch *batch;
+
+      while (!glthread->queued && !glthread->shutdown)
+         cnd_wait(&glthread->batch_queued, &glthread->mutex);
+
+      if (!glthread->queued)
+         break;
+
+      batch = &glthread->batches[glthread->first];
+      mtx_unlock(&glthread->mutex);
+
+      glthread_unmarshal_batch(ctx, batch);
+
+      mtx_lock(&glthread->mutex);
+      glthread->first = (glthread->first + 1) % MARSHAL_MAX_BATCHES;
+      glthread->queued--;
+      cnd_broadcast(&glthread->batch_done);
+   }
+   mtx_unlock(&glthread->mutex);
+
+   return 0;
+}
+
+
+/**
+ * Start marshalling the context's GL calls to a worker thread.  On failure
+ * the calls keep being executed directly.
+ */
+void
+_mesa_glthread_init(struct gl_context *ctx)
+{
+   struct glthread_state *glthread;
+
+   assert(!ctx->GLThread);
+
+   glthread = calloc(1, sizeof *glthread);
+   if (!glthread)
+      return;
+
+   glthread->VAOs = _mesa_NewHashTable();
+   ctx->MarshalExec = _mesa_create_marshal_table(ctx);
+   if (!glthread->VAOs || !ctx->MarshalExec)
+      goto fail;
+
+   mtx_init(&glthread->mutex, mtx_plain);
+   cnd_init(&glthread->batch_queued);
+   cnd_init(&glthread->batch_done);
+   glthread->next_batch = &glthread->batches[0];
+   glthread->CurrentVAO = &glthread->DefaultVAO;
+
+   ctx->GLThread = glthread;
+   if (thrd_create(&glthread->thread, glthread_worker, ctx) != thrd_success) {
+      ctx->GLThread = NULL;
+      cnd_destroy(&glthread->batch_done);
+      cnd_destroy(&glthread->batch_queued);
+      mtx_destroy(&glthread->mutex);
+      goto fail;
+   }
+
+   ctx->CurrentClientDispatch = ctx->MarshalExec;
+   if (_mesa_get_current_context() == ctx)
+      _glapi_set_dispatch(ctx->CurrentClientDispatch);
+   return;
+
+fail:
+   free(ctx->MarshalExec);
+   ctx->MarshalExec = NULL;
+   if (glthread->VAOs)
+      _mesa_DeleteHashTable(glthread->VAOs);
+   free(glthread);
+}
+
+
+static void
+free_vao(GLuint key, void *data, void *userData)
+{
+   free(data);
+}
+
+
+/**
+ * Execute the pending commands, stop the worker and go back to executing
+ * the context's GL calls directly.
+ */
+void
+_mesa_glthread_destroy(struct gl_context *ctx)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (!glthread)
+      return;
+
+   _mesa_glthread_flush_batch(ctx);
+
+   mtx_lock(&glthread->mutex);
+   glthread->shutdown = true;
+   cnd_signal(&glthread->batch_queued);
+   mtx_unlock(&glthread->mutex);
+
+   thrd_join(glthread->thread, NULL);
+
+   cnd_destroy(&glthread->batch_done);
+   cnd_destroy(&glthread->batch_queued);
+   mtx_destroy(&glthread->mutex);
+
+   _mesa_HashDeleteAll(glthread->VAOs, free_vao, NULL);
+   _mesa_DeleteHashTable(glthread->VAOs);
+
+   free(glthread);
+   ctx->GLThread = NULL;
+
+   /* Don't touch the dispatch of this thread if another context is current
+    * on it, e.g. when the context is destroyed after unbinding it.
+    */
+   if (_glapi_get_dispatch() == ctx->MarshalExec)
+      _glapi_set_dispatch(ctx->CurrentServerDispatch);
+   ctx->CurrentClientDispatch = ctx->CurrentServerDispatch;
+
+   free(ctx->MarshalExec);
+   ctx->MarshalExec = NULL;
+}
+
+
+/**
+ * Called by marshalling functions for calls which glthread can't support,
+ * like enabling synchronous debug output.
+ */
+void
+_mesa_glthread_disable(struct gl_context *ctx, const char *func)
+{
+   if (MESA_VERBOSE & VERBOSE_API)
+      _mesa_debug(ctx, "glthread disabled by %s\n", func);
+
+   _mesa_glthread_destroy(ctx);
+}
+
+
+/**
+ * Queue the batch being recorded for the worker, waiting for a free one if
+ * the worker is MARSHAL_MAX_BATCHES behind.
+ */
+void
+_mesa_glthread_flush_batch(struct gl_context *ctx)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (!glthread || !glthread->next_batch->used)
+      return;
+
+   mtx_lock(&glthread->mutex);
+   glthread->queued++;
+   cnd_signal(&glthread->batch_queued);
+
+   while (glthread->queued == MARSHAL_MAX_BATCHES)
+      cnd_wait(&glthread->batch_done, &glthread->mutex);
+
+   glthread->next_batch =
+      &glthread->batches[(glthread->first + glthread->queued) %
+                         MARSHAL_MAX_BATCHES];
+   mtx_unlock(&glthread->mutex);
+}
+
+
+/**
+ * Wait until the worker executed all the commands recorded so far.  After
+ * this, and until the next marshalled command, the context's state may be
+ * accessed from the application's thread.
+ */
+void
+_mesa_glthread_finish(struct gl_context *ctx)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (!glthread)
+      return;
+
+   /* The worker may call into code which finishes, e.g. the state tracker
+    * flushing, and it must not wait for itself.
+    */
+   if (thrd_equal(thrd_current(), glthread->thread))
+      return;
+
+   _mesa_glthread_flush_batch(ctx);
+
+   mtx_lock(&glthread->mutex);
+   while (glthread->queued)
+      cnd_wait(&glthread->batch_done, &glthread->mutex);
+   mtx_unlock(&glthread->mutex);
+}
+
+
+/**
+ * \name Client-side array state
+ *
+ * These are called by the marshalling functions on the application's thread,
+ * mirroring the effect of the calls on the worker's state.  They assume the
+ * calls succeed; an application causing GL errors may get draws marshalled
+ * which read its memory later than without glthread.
+ */
+/*@{*/
+
+void
+_mesa_glthread_BindBuffer(struct gl_context *ctx, GLenum target,
+                          GLuint buffer)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   switch (target) {
+   case GL_ARRAY_BUFFER:
+      glthread->ArrayBuffer = buffer;
+      break;
+   case GL_ELEMENT_ARRAY_BUFFER:
+      glthread->CurrentVAO->IndexBuffer = buffer;
+      break;
+   }
+}
+
+
+void
+_mesa_glthread_DeleteBuffers(struct gl_context *ctx, GLsizei n,
+                             const GLuint *buffers)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   GLsizei i;
+
+   if (!buffers)
+      return;
+
+   /* Deleting a buffer unbinds it from the current VAO only. */
+   for (i = 0; i < n; i++) {
+      if (!buffers[i])
+         continue;
+      if (buffers[i] == glthread->ArrayBuffer)
+         glthread->ArrayBuffer = 0;
+      if (buffers[i] == glthread->CurrentVAO->IndexBuffer)
+         glthread->CurrentVAO->IndexBuffer = 0;
+   }
+}
+
+
+static struct glthread_vao *
+create_vao(struct glthread_state *glthread, GLuint name)
+{
+   struct glthread_vao *vao = calloc(1, sizeof *vao);
+
+   if (vao) {
+      vao->Name = name;
+      _mesa_HashInsert(glthread->VAOs, name, vao);
+   }
+   return vao;
+}
+
+
+static struct glthread_vao *
+lookup_vao(struct glthread_state *glthread, GLuint name)
+{
+   if (!name)
+      return &glthread->DefaultVAO;
+   return _mesa_HashLookup(glthread->VAOs, name);
+}
+
+
+/** Also used for glCreateVertexArrays */
+void
+_mesa_glthread_GenVertexArrays(struct gl_context *ctx, GLsizei n,
+                               const GLuint *arrays)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   GLsizei i;
+
+   if (!arrays)
+      return;
+
+   for (i = 0; i < n; i++) {
+      if (arrays[i] && !lookup_vao(glthread, arrays[i]))
+         create_vao(glthread, arrays[i]);
+   }
+}
+
+
+/**
+ * \param generate  whether binding an unknown name creates the VAO, as
+ *                  glBindVertexArrayAPPLE does
+ */
+void
+_mesa_glthread_BindVertexArray(struct gl_context *ctx, GLuint array,
+                               bool generate)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   struct glthread_vao *vao = lookup_vao(glthread, array);
+
+   if (!vao && generate)
+      vao = create_vao(glthread, array);
+
+   /* Binding an unknown name is an error, which leaves the binding alone. */
+   if (vao)
+      glthread->CurrentVAO = vao;
+}
+
+
+void
+_mesa_glthread_DeleteVertexArrays(struct gl_context *ctx, GLsizei n,
+                                  const GLuint *arrays)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   GLsizei i;
+
+   if (!arrays)
+      return;
+
+   for (i = 0; i < n; i++) {
+      struct glthread_vao *vao;
+
+      if (!arrays[i])
+         continue;
+
+      vao = _mesa_HashLookup(glthread->VAOs, arrays[i]);
+      if (!vao)
+         continue;
+
+      if (vao == glthread->CurrentVAO)
+         glthread->CurrentVAO = &glthread->DefaultVAO;
+
+      _mesa_HashRemove(glthread->VAOs, arrays[i]);
+      free(vao);
+   }
+}
+
+
+void
+_mesa_glthread_VertexArrayElementBuffer(struct gl_context *ctx,
+                                        GLuint vaobj, GLuint buffer)
+{
+   struct glthread_vao *vao = lookup_vao(ctx->GLThread, vaobj);
+
+   if (vao && vaobj)
+      vao->IndexBuffer = buffer;
+}
+
+
+void
+_mesa_glthread_ClientActiveTexture(struct gl_context *ctx, GLenum texture)
+{
+   GLuint unit = texture - GL_TEXTURE0;
+
+   if (unit < VERT_ATTRIB_TEX_MAX)
+      ctx->GLThread->ClientActiveTexture = unit;
+}
+
+
+/**
+ * Called after gl*Pointer: the array now points into the bound buffer, or
+ * into the application's memory if there's none.
+ */
+void
+_mesa_glthread_AttribPointer(struct gl_context *ctx, gl_vert_attrib attrib)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (attrib >= VERT_ATTRIB_MAX)
+      return;
+
+   if (glthread->ArrayBuffer)
+      glthread->CurrentVAO->UserArrays &= ~VERT_BIT(attrib);
+   else
+      glthread->CurrentVAO->UserArrays |= VERT_BIT(attrib);
+}
+
+
+void
+_mesa_glthread_GenericAttribPointer(struct gl_context *ctx, GLuint index)
+{
+   if (index < VERT_ATTRIB_GENERIC_MAX)
+      _mesa_glthread_AttribPointer(ctx, VERT_ATTRIB_GENERIC(index));
+}
+
+
+void
+_mesa_glthread_TexCoordPointer(struct gl_context *ctx)
+{
+   _mesa_glthread_AttribPointer(ctx,
+      VERT_ATTRIB_TEX(ctx->GLThread->ClientActiveTexture));
+}
+
+
+/**
+ * Re-read the client-side array state from the context, after a call
+ * executed synchronously which changes too much of it to mirror, like
+ * glPopClientAttrib or glInterleavedArrays.
+ */
+void
+_mesa_glthread_sync_client_arrays(struct gl_context *ctx)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   const struct gl_vertex_array_object *vao = ctx->Array.VAO;
+   struct glthread_vao *shadow;
+   GLuint i;
+
+   if (!glthread)
+      return;
+
+   _mesa_glthread_finish(ctx);
+
+   glthread->ArrayBuffer = ctx->Array.ArrayBufferObj->Name;
+   glthread->ClientActiveTexture = ctx->Array.ActiveTexture;
+
+   shadow = lookup_vao(glthread, vao->Name);
+   if (!shadow)
+      shadow = create_vao(glthread, vao->Name);
+   if (!shadow) {
+      /* Out of memory: leave the state alone, but make draws synchronous. */
+      glthread->CurrentVAO->UserArrays = ~(GLbitfield64) 0;
+      return;
+   }
+   glthread->CurrentVAO = shadow;
+
+   shadow->IndexBuffer = vao->IndexBufferObj->Name;
+   shadow->UserArrays = 0;
+   for (i = 0; i < VERT_ATTRIB_MAX; i++) {
+      const struct gl_vertex_attrib_array *array = &vao->VertexAttrib[i];
+      const struct gl_vertex_buffer_binding *binding =
+         &vao->VertexBinding[array->VertexBinding];
+
+      if (array->Ptr && !_mesa_is_bufferobj(binding->BufferObj))
+         shadow->UserArrays |= VERT_BIT(i);
+   }
+}
+
+/*@}*/
@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2016 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file glthread.h
+ * Threaded GL dispatch ("glthread").
+ *
+ * When enabled, the application's GL calls go through ctx->MarshalExec,
+ * which records them into command batches instead of executing them.  A
+ * worker thread executes the batches through ctx->CurrentServerDispatch,
+ * so that validation, shader translation and driver work overlap with the
+ * application's own work.  Calls which return data, write to application
+ * memory or read application memory whose size isn't known are executed
+ * synchronously on the application's thread after waiting for the worker.
+ */
+
+#ifndef GLTHREAD_H
+#define GLTHREAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "c11/threads.h"
+#include "main/mtypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Size of a command batch, and so the largest command which is marshalled.
+ * Bigger commands are executed synchronously.
+ */
+#define MARSHAL_MAX_CMD_SIZE (8 * 1024)
+
+/** Number of batches the worker may be behind the application by */
+#define MARSHAL_MAX_BATCHES 4
+
+
+struct _mesa_HashTable;
+
+
+struct glthread_batch
+{
+   /** Number of bytes of buffer used */
+   size_t used;
+
+   /** The marshalled commands, each one starting on an 8 byte boundary */
+   uint64_t buffer[MARSHAL_MAX_CMD_SIZE / 8];
+};
+
+
+/**
+ * What the application thread knows about a vertex array object: whether
+ * drawing with it may read the application's memory.  The real VAO is only
+ * accessed by the worker.
+ */
+struct glthread_vao
+{
+   GLuint Name;
+
+   /** VERT_BIT_x of the arrays last specified with no buffer bound */
+   GLbitfield64 UserArrays;
+
+   /** Name of the bound index buffer */
+   GLuint IndexBuffer;
+};
+
+
+struct glthread_state
+{
+   thrd_t thread;
+
+   /** Protects queued, first and shutdown */
+   mtx_t mutex;
+
+   /** Signalled when a batch is queued, or on shutdown */
+   cnd_t batch_queued;
+
+   /** Signalled when the worker finished executing a batch */
+   cnd_t batch_done;
+
+   /**
+    * Ring of batches.  The worker executes the queued ones starting at
+    * first, the application fills the one after the last queued one.
+    */
+   struct glthread_batch batches[MARSHAL_MAX_BATCHES];
+   unsigned first;
+   unsigned queued;
+   bool shutdown;
+
+   /** The batch the application records commands into */
+   struct glthread_batch *next_batch;
+
+   /**
+    * \name Client-side state, only accessed by the application's thread
+    */
+   /*@{*/
+   GLuint ArrayBuffer;
+   GLuint ClientActiveTexture;
+   struct glthread_vao DefaultVAO;
+   struct glthread_vao *CurrentVAO;
+   struct _mesa_HashTable *VAOs;
+   /*@}*/
+};
+
+
+extern void
+_mesa_glthread_init(struct gl_context *ctx);
+
+extern void
+_mesa_glthread_destroy(struct gl_context *ctx);
+
+extern void
+_mesa_glthread_disable(struct gl_context *ctx, const char *func);
+
+extern void
+_mesa_glthread_flush_batch(struct gl_context *ctx);
+
+extern void
+_mesa_glthread_finish(struct gl_context *ctx);
+
+
+extern void
+_mesa_glthread_BindBuffer(struct gl_context *ctx, GLenum target,
+                          GLuint buffer);
+
+extern void
+_mesa_glthread_DeleteBuffers(struct gl_context *ctx, GLsizei n,
+                             const GLuint *buffers);
+
+extern void
+_mesa_glthread_GenVertexArrays(struct gl_context *ctx, GLsizei n,
+                               const GLuint *arrays);
+
+extern void
+_mesa_glthread_BindVertexArray(struct gl_context *ctx, GLuint array,
+                               bool generate);
+
+extern void
+_mesa_glthread_DeleteVertexArrays(struct gl_context *ctx, GLsizei n,
+                                  const GLuint *arrays);
+
+extern void
+_mesa_glthread_VertexArrayElementBuffer(struct gl_context *ctx,
+                                        GLuint vaobj, GLuint buffer);
+
+extern void
+_mesa_glthread_ClientActiveTexture(struct gl_context *ctx, GLenum texture);
+
+extern void
+_mesa_glthread_AttribPointer(struct gl_context *ctx, gl_vert_attrib attrib);
+
+extern void
+_mesa_glthread_GenericAttribPointer(struct gl_context *ctx, GLuint index);
+
+extern void
+_mesa_glthread_TexCoordPointer(struct gl_context *ctx);
+
+extern void
+_mesa_glthread_sync_client_arrays(struct gl_context *ctx);
+
+
+/**
+ * Whether glDrawArrays and the like may read arrays from the application's
+ * memory, in which case they must be executed synchronously.
+ */
+static inline bool
+_mesa_glthread_is_non_vbo_draw_arrays(const struct gl_context *ctx)
+{
+   return ctx->GLThread->CurrentVAO->UserArrays != 0;
+}
+
+
+/**
+ * As above, for glDrawElements and the like, which may also read the
+ * indices from the application's memory.
+ */
+static inline bool
+_mesa_glthread_is_non_vbo_draw_elements(const struct gl_context *ctx)
+{
+   const struct glthread_vao *vao = ctx->GLThread->CurrentVAO;
+
+   return vao->UserArrays != 0 || vao->IndexBuffer == 0;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GLTHREAD_H */
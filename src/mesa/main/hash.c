@@ -34,10 +34,29 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdlib.h>
 #include "glheader.h"
 #include "imports.h"
 #include "hash.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
+
+/**
+ * Objects with keys below HASH_DENSE_KEYS live in pages of an array indexed
+ * by key, which _mesa_HashLookup() reads without taking the mutex.  Names
+ * returned by glGen*() are small and contiguous, so almost all objects end
+ * up there.  Other keys go in the struct hash_table, under the mutex.
+ *
+ * Pages are allocated as needed and are only freed with the table, so a
+ * reader never sees one go away.  Stores of pages and entries are single
+ * pointer writes, made while holding the mutex, with release ordering so
+ * that a reader loading them with acquire ordering also sees the cleared
+ * page or the initialized object.
+ */
+#define HASH_PAGE_BITS  8
+#define HASH_PAGE_SIZE  (1 << HASH_PAGE_BITS)
+#define HASH_NUM_PAGES  256
+#define HASH_DENSE_KEYS (HASH_PAGE_SIZE * HASH_NUM_PAGES)
 
 /**
  * Magic GLuint object name that gets stored outside of the struct hash_table.
@@ -45,10 +64,9 @@
  * The hash table needs a particular pointer to be the marker for a key that
  * was deleted from the table, along with NULL for the "never allocated in the
  * table" marker.  Legacy GL allows any GLuint to be used as a GL object name,
- * and we use a 1:1 mapping from GLuints to key pointers, so we need to be
- * able to track a GLuint that happens to match the deleted key outside of
- * struct hash_table.  We tell the hash table to use "1" as the deleted key
- * value, so that we test the deleted-key-in-the-table path as best we can.
+ * and we use a 1:1 mapping from GLuints to key pointers.  We tell the hash
+ * table to use "1" as the deleted key value, which is a dense key, so it
+ * never needs to be stored in the struct hash_table.
  */
 #define DELETED_KEY_VALUE 1
 
@@ -56,13 +74,13 @@
  * The hash table data structure.  
  */
 struct _mesa_HashTable {
-   struct hash_table *ht;
+   void **Pages[HASH_NUM_PAGES];         /**< keys below HASH_DENSE_KEYS */
+   GLuint NumDenseEntries;
+   struct hash_table *ht;                /**< all the other keys */
    GLuint MaxKey;                        /**< highest key inserted so far */
    mtx_t Mutex;                /**< mutual exclusion lock */
    mtx_t WalkMutex;            /**< for _mesa_HashWalk() */
    GLboolean InDeleteAll;                /**< Debug check */
-   /** Value that would be in the table for DELETED_KEY_VALUE. */
-   void *deleted_key_data;
 };
 
 /** @{
@@ -152,12 +170,18 @@ _mesa_NewHashTable(void)
 void
 _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 {
+   GLuint i;
+
    assert(table);
 
-   if (_mesa_hash_table_next_entry(table->ht, NULL) != NULL) {
+   if (table->NumDenseEntries ||
+       _mesa_hash_table_next_entry(table->ht, NULL) != NULL) {
       _mesa_problem(NULL, "In _mesa_DeleteHashTable, found non-freed data");
    }
 
+   for (i = 0; i < HASH_NUM_PAGES; i++)
+      free(table->Pages[i]);
+
    _mesa_hash_table_destroy(table->ht, NULL);
 
    mtx_destroy(&table->Mutex);
@@ -167,6 +191,18 @@ _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 
 
 
+/**
+ * Return the slot of a dense key, or NULL if its page isn't allocated.
+ */
+static inline void **
+dense_slot(const struct _mesa_HashTable *table, GLuint key)
+{
+   void **page = p_atomic_read_acquire(&table->Pages[key >> HASH_PAGE_BITS]);
+
+   return page ? &page[key & (HASH_PAGE_SIZE - 1)] : NULL;
+}
+
+
 /**
  * Lookup an entry in the hash table, without locking.
  * \sa _mesa_HashLookup
@@ -179,8 +215,10 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
    assert(table);
    assert(key);
 
-   if (key == DELETED_KEY_VALUE)
-      return table->deleted_key_data;
+   if (key < HASH_DENSE_KEYS) {
+      void **slot = dense_slot(table, key);
+      return slot ? p_atomic_read_acquire(slot) : NULL;
+   }
 
    entry = _mesa_hash_table_search(table->ht, uint_key(key));
    if (!entry)
@@ -193,6 +231,8 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
 /**
  * Lookup an entry in the hash table.
  * 
+ * Keys below HASH_DENSE_KEYS are looked up without taking the mutex.
+ *
  * \param table the hash table.
  * \param key the key.
  * 
@@ -203,6 +243,10 @@ _mesa_HashLookup(struct _mesa_HashTable *table, GLuint key)
 {
    void *res;
    assert(table);
+
+   if (key < HASH_DENSE_KEYS)
+      return _mesa_HashLookup_unlocked(table, key);
+
    mtx_lock(&table->Mutex);
    res = _mesa_HashLookup_unlocked(table, key);
    mtx_unlock(&table->Mutex);
@@ -258,6 +302,40 @@ _mesa_HashUnlockMutex(struct _mesa_HashTable *table)
 }
 
 
+/**
+ * Store the data of a dense key, allocating its page if needed.
+ */
+static void
+dense_insert(struct _mesa_HashTable *table, GLuint key, void *data)
+{
+   void **slot = dense_slot(table, key);
+
+   if (!slot) {
+      void **page;
+
+      if (!data)
+         return;
+
+      page = calloc(HASH_PAGE_SIZE, sizeof(void *));
+      if (!page) {
+         _mesa_error_no_memory(__func__);
+         return;
+      }
+
+      /* The page must be cleared before readers can see it. */
+      p_atomic_set_release(&table->Pages[key >> HASH_PAGE_BITS], page);
+      slot = &page[key & (HASH_PAGE_SIZE - 1)];
+   }
+
+   if (*slot && !data)
+      table->NumDenseEntries--;
+   else if (!*slot && data)
+      table->NumDenseEntries++;
+
+   p_atomic_set_release(slot, data);
+}
+
+
 static inline void
 _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
 {
@@ -270,8 +348,8 @@ _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
    if (key > table->MaxKey)
       table->MaxKey = key;
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = data;
+   if (key < HASH_DENSE_KEYS) {
+      dense_insert(table, key, data);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht, hash, uint_key(key));
       if (entry) {
@@ -344,8 +422,8 @@ _mesa_HashRemove(struct _mesa_HashTable *table, GLuint key)
    }
 
    mtx_lock(&table->Mutex);
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = NULL;
+   if (key < HASH_DENSE_KEYS) {
+      dense_insert(table, key, NULL);
    } else {
       entry = _mesa_hash_table_search(table->ht, uint_key(key));
       _mesa_hash_table_remove(table->ht, entry);
@@ -370,19 +448,27 @@ _mesa_HashDeleteAll(struct _mesa_HashTable *table,
                     void *userData)
 {
    struct hash_entry *entry;
+   GLuint i, j;
 
    assert(table);
    assert(callback);
    mtx_lock(&table->Mutex);
    table->InDeleteAll = GL_TRUE;
+   for (i = 0; i < HASH_NUM_PAGES; i++) {
+      void **page = table->Pages[i];
+
+      for (j = 0; page && j < HASH_PAGE_SIZE; j++) {
+         if (page[j]) {
+            callback(i * HASH_PAGE_SIZE + j, page[j], userData);
+            p_atomic_set_release(&page[j], NULL);
+         }
+      }
+   }
+   table->NumDenseEntries = 0;
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
       _mesa_hash_table_remove(table->ht, entry);
    }
-   if (table->deleted_key_data) {
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
-      table->deleted_key_data = NULL;
-   }
    table->InDeleteAll = GL_FALSE;
    mtx_unlock(&table->Mutex);
 }
@@ -408,15 +494,23 @@ _mesa_HashWalk(const struct _mesa_HashTable *table,
    /* cast-away const */
    struct _mesa_HashTable *table2 = (struct _mesa_HashTable *) table;
    struct hash_entry *entry;
+   GLuint i, j;
 
    assert(table);
    assert(callback);
    mtx_lock(&table2->WalkMutex);
+   for (i = 0; i < HASH_NUM_PAGES; i++) {
+      void **page = p_atomic_read_acquire(&table->Pages[i]);
+
+      for (j = 0; page && j < HASH_PAGE_SIZE; j++) {
+         void *data = p_atomic_read_acquire(&page[j]);
+         if (data)
+            callback(i * HASH_PAGE_SIZE + j, data, userData);
+      }
+   }
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
    }
-   if (table->deleted_key_data)
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
    mtx_unlock(&table2->WalkMutex);
 }
 
@@ -434,12 +528,78 @@ debug_print_entry(GLuint key, void *data, void *userData)
 void
 _mesa_HashPrint(const struct _mesa_HashTable *table)
 {
-   if (table->deleted_key_data)
-      debug_print_entry(DELETED_KEY_VALUE, table->deleted_key_data, NULL);
    _mesa_HashWalk(table, debug_print_entry, NULL);
 }
 
 
+static int
+compare_keys(const void *a, const void *b)
+{
+   const GLuint ka = *(const GLuint *) a, kb = *(const GLuint *) b;
+
+   return ka < kb ? -1 : ka > kb;
+}
+
+
+/**
+ * Find a block of numKeys unused keys below maxKey by looking at the gaps
+ * between the keys in use, in increasing order.  This is proportional to
+ * the number of entries rather than to the key range.
+ */
+static GLuint
+find_free_key_block_in_gaps(struct _mesa_HashTable *table, GLuint numKeys,
+                            GLuint maxKey)
+{
+   /* Start of the current range of free keys.  64 bits, as the last used
+    * key may be ~0.
+    */
+   uint64_t freeStart = 1;
+   struct hash_entry *entry;
+   GLuint *keys;
+   GLuint numSparseKeys = 0;
+   GLuint i, j;
+
+   for (i = 0; i < HASH_NUM_PAGES; i++) {
+      void **page = table->Pages[i];
+
+      if (!page)
+         continue;
+
+      for (j = 0; j < HASH_PAGE_SIZE; j++) {
+         if (page[j]) {
+            GLuint key = i * HASH_PAGE_SIZE + j;
+
+            if (key - freeStart >= numKeys)
+               return freeStart;
+            freeStart = key + 1;
+         }
+      }
+   }
+
+   keys = malloc((_mesa_hash_table_num_entries(table->ht) + 1) *
+                 sizeof(GLuint));
+   if (!keys)
+      return 0;
+
+   hash_table_foreach(table->ht, entry)
+      keys[numSparseKeys++] = (uintptr_t) entry->key;
+   qsort(keys, numSparseKeys, sizeof(GLuint), compare_keys);
+
+   for (i = 0; i < numSparseKeys; i++) {
+      if (keys[i] - freeStart >= numKeys)
+         break;
+      freeStart = (uint64_t) keys[i] + 1;
+   }
+   free(keys);
+
+   if (freeStart < maxKey && maxKey - freeStart >= numKeys)
+      return freeStart;
+
+   /* cannot allocate a block of numKeys consecutive keys */
+   return 0;
+}
+
+
 /**
  * Find a block of adjacent unused hash keys.
  * 
@@ -450,43 +610,25 @@ _mesa_HashPrint(const struct _mesa_HashTable *table)
  *
  * If there are enough free keys between the maximum key existing in the table
  * (_mesa_HashTable::MaxKey) and the maximum key possible, then simply return
- * the adjacent key. Otherwise do a full search for a free key block in the
- * allowable key range.
+ * the adjacent key. Otherwise search the gaps between the keys in use.
  */
 GLuint
 _mesa_HashFindFreeKeyBlock(struct _mesa_HashTable *table, GLuint numKeys)
 {
    const GLuint maxKey = ~((GLuint) 0) - 1;
+   GLuint key;
+
    mtx_lock(&table->Mutex);
    if (maxKey - numKeys > table->MaxKey) {
       /* the quick solution */
-      mtx_unlock(&table->Mutex);
-      return table->MaxKey + 1;
+      key = table->MaxKey + 1;
    }
    else {
       /* the slow solution */
-      GLuint freeCount = 0;
-      GLuint freeStart = 1;
-      GLuint key;
-      for (key = 1; key != maxKey; key++) {
-	 if (_mesa_HashLookup_unlocked(table, key)) {
-	    /* darn, this key is already in use */
-	    freeCount = 0;
-	    freeStart = key+1;
-	 }
-	 else {
-	    /* this key not in use, check if we've found enough */
-	    freeCount++;
-	    if (freeCount == numKeys) {
-               mtx_unlock(&table->Mutex);
-	       return freeStart;
-	    }
-	 }
-      }
-      /* cannot allocate a block of numKeys consecutive keys */
-      mtx_unlock(&table->Mutex);
-      return 0;
+      key = find_free_key_block_in_gaps(table, numKeys, maxKey);
    }
+   mtx_unlock(&table->Mutex);
+   return key;
 }
 
 
@@ -496,12 +638,5 @@ _mesa_HashFindFreeKeyBlock(struct _mesa_HashTable *table, GLuint numKeys)
 GLuint
 _mesa_HashNumEntries(const struct _mesa_HashTable *table)
 {
-   GLuint count = 0;
-
-   if (table->deleted_key_data)
-      count++;
-
-   count += _mesa_hash_table_num_entries(table->ht);
-
-   return count;
+   return table->NumDenseEntries + _mesa_hash_table_num_entries(table->ht);
 }
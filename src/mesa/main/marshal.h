@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2016 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file marshal.h
+ * Layout of the commands recorded by the glthread marshalling functions.
+ *
+ * The marshalling and unmarshalling functions themselves are generated
+ * from the API XML by src/mapi/glapi/gen/gl_marshal.py into
+ * marshal_generated.c.
+ */
+
+#ifndef MARSHAL_H
+#define MARSHAL_H
+
+#include "main/glthread.h"
+#include "main/macros.h"
+
+
+struct marshal_cmd_base
+{
+   /** The DISPATCH_CMD_x of the command */
+   uint16_t cmd_id;
+
+   /** Size of the command in bytes, including this header */
+   uint16_t cmd_size;
+};
+
+
+/**
+ * Reserve space for a command in the current batch, queueing the batch for
+ * the worker first if the command doesn't fit.  \p size must not be greater
+ * than MARSHAL_MAX_CMD_SIZE.
+ */
+static inline void *
+_mesa_glthread_allocate_command(struct gl_context *ctx,
+                                uint16_t cmd_id, size_t size)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   struct glthread_batch *batch = glthread->next_batch;
+   struct marshal_cmd_base *cmd;
+
+   size = ALIGN(size, 8);
+   assert(size <= MARSHAL_MAX_CMD_SIZE);
+
+   if (unlikely(batch->used + size > MARSHAL_MAX_CMD_SIZE)) {
+      _mesa_glthread_flush_batch(ctx);
+      batch = glthread->next_batch;
+   }
+
+   cmd = (struct marshal_cmd_base *) ((uint8_t *) batch->buffer + batch->used);
+   batch->used += size;
+   cmd->cmd_id = cmd_id;
+   cmd->cmd_size = size;
+   return cmd;
+}
+
+
+extern size_t
+_mesa_unmarshal_dispatch_cmd(struct gl_context *ctx, const void *cmd);
+
+extern struct _glapi_table *
+_mesa_create_marshal_table(const struct gl_context *ctx);
+
+
+#endif /* MARSHAL_H */
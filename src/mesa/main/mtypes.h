@@ -77,6 +77,7 @@ struct gl_attrib_node;
 struct gl_list_extensions;
 struct gl_meta_state;
 struct gl_program_cache;
+struct program_cache;
 struct gl_texture_object;
 struct gl_debug_state;
 struct gl_context;
@@ -2240,9 +2241,18 @@ struct gl_shader
    GLboolean CompileStatus;
    bool IsES;              /**< True if this shader uses GLSL ES */
 
+   /**
+    * True if CompileStatus was taken from the shader cache, in which case
+    * there is no IR until the shader is really compiled at link time.
+    */
+   bool CompileSkipped;
+
    GLuint SourceChecksum;       /**< for debug/logging purposes */
    const GLchar *Source;  /**< Source code string */
 
+   /** SHA-1 of the source and the compile state, for the shader cache */
+   unsigned char sha1[20];
+
    struct gl_program *Program;  /**< Post-compile assembly code */
    GLchar *InfoLog;
 
@@ -2763,6 +2773,15 @@ struct gl_shader_program
    unsigned NumHiddenUniforms;
    struct gl_uniform_storage *UniformStorage;
 
+   /**
+    * The values of all of UniformStorage, which its storage pointers point
+    * into, and a copy of them as they were after linking, which a program
+    * binary restores.
+    */
+   unsigned NumUniformDataSlots;
+   union gl_constant_value *UniformDataSlots;
+   union gl_constant_value *UniformDataDefaults;
+
    /**
     * Mapping from GL uniform locations returned by \c glUniformLocation to
     * UniformStorage entries. Arrays will have multiple contiguous slots
@@ -3757,6 +3776,9 @@ struct gl_constants
    GLuint MaxTessPatchComponents;
    GLuint MaxTessControlTotalOutputComponents;
    bool LowerTessLevel; /**< Lower gl_TessLevel* from float[n] to vecn? */
+
+   /** GL_ARB_get_program_binary */
+   GLuint NumProgramBinaryFormats;
 };
 
 
@@ -4319,10 +4341,34 @@ struct gl_context
     */
    struct _glapi_table *BeginEnd;
    /**
-    * Tracks the current dispatch table out of the 3 above, so that it can be
-    * re-set on glXMakeCurrent().
+    * The dispatch table which marshals API calls into command batches for
+    * the glthread worker, or NULL if glthread isn't enabled.
+    */
+   struct _glapi_table *MarshalExec;
+   /**
+    * The dispatch table the application's calls go through, so that it can
+    * be re-set on glXMakeCurrent().  Either MarshalExec, or the same as
+    * CurrentServerDispatch.
+    */
+   struct _glapi_table *CurrentClientDispatch;
+   /**
+    * Tracks the current dispatch table out of the 3 above (Exec, BeginEnd
+    * and Save) which actually executes the calls, either on the
+    * application's thread or on the glthread worker.
     */
-   struct _glapi_table *CurrentDispatch;
+   struct _glapi_table *CurrentServerDispatch;
+   /*@}*/
+
+   /** Command marshalling state, or NULL if glthread isn't enabled */
+   struct glthread_state *GLThread;
+
+   /**
+    * \name Shader cache
+    */
+   /*@{*/
+   struct program_cache *Cache;   /**< On-disk program cache, or NULL */
+   /** SHA-1 of the driver and the context state affecting compiles */
+   unsigned char ShaderCacheSHA1[20];
    /*@}*/
 
    struct gl_config Visual;
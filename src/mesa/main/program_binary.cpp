@@ -0,0 +1,1487 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file program_binary.cpp
+ * Serialization of linked GLSL programs.
+ *
+ * A program binary holds everything the API needs from a linked program
+ * (uniforms, blocks, atomic buffers, transform feedback, subroutines and the
+ * program resource list) and, for each stage, the gl_program the driver
+ * generated, with the driver's own compiled code appended by the
+ * ProgramBinarySerializeDriverBlob hook.  The GLSL IR is not kept, so a
+ * program loaded from a binary can't be relinked without its sources.
+ *
+ * Pointers between the structures are stored as indices.  The binary starts
+ * with a header holding the SHA-1 of everything that could change the
+ * result of compiling (see _mesa_shader_cache_init()) and of the payload,
+ * and is rejected if either doesn't match.
+ */
+
+#include "main/core.h"
+#include "main/context.h"
+#include "main/program_binary.h"
+#include "main/shaderobj.h"
+#include "main/uniforms.h"
+#include "compiler/glsl/blob.h"
+#include "compiler/glsl/ir.h"
+#include "compiler/glsl/ir_uniform.h"
+#include "compiler/glsl/linker.h"
+#include "compiler/glsl_types.h"
+#include "program/hash_table.h"
+#include "program/ir_to_mesa.h"
+#include "program/prog_parameter.h"
+#include "program/program.h"
+#include "util/mesa-sha1.h"
+#include "util/ralloc.h"
+
+#ifdef ENABLE_SHADER_CACHE
+
+#define PROGRAM_BINARY_MAGIC   0x4e49424d /* "MBIN" */
+#define PROGRAM_BINARY_VERSION 1
+
+struct program_binary_header {
+   uint32_t magic;
+   uint32_t version;
+   uint8_t driver_sha1[20];
+   uint8_t payload_sha1[20];
+   uint32_t payload_size;
+};
+
+/* Index written for a NULL pointer, and for
+ * INACTIVE_UNIFORM_EXPLICIT_LOCATION in the remap tables.
+ */
+#define NULL_INDEX     (~0u)
+#define INACTIVE_INDEX (~1u)
+
+static const GLenum shader_types[MESA_SHADER_STAGES] = {
+   GL_VERTEX_SHADER,
+   GL_TESS_CONTROL_SHADER,
+   GL_TESS_EVALUATION_SHADER,
+   GL_GEOMETRY_SHADER,
+   GL_FRAGMENT_SHADER,
+   GL_COMPUTE_SHADER,
+};
+
+
+static void
+write_nullable_string(struct blob *blob, const char *str)
+{
+   blob_write_uint32(blob, str != NULL);
+   if (str)
+      blob_write_string(blob, str);
+}
+
+static const char *
+read_nullable_string(struct blob_reader *blob)
+{
+   if (!blob_read_uint32(blob))
+      return NULL;
+   return blob_read_string(blob);
+}
+
+static void
+write_array(struct blob *blob, const void *data, size_t size)
+{
+   if (size)
+      blob_write_bytes(blob, data, size);
+}
+
+/**
+ * Read \c size bytes, skipping zero-sized reads which blob_read_bytes()
+ * would treat as an overrun at the end of the blob.
+ */
+static void
+read_array(struct blob_reader *blob, void *data, size_t size)
+{
+   if (size)
+      blob_copy_bytes(blob, (uint8_t *) data, size);
+}
+
+/**
+ * Read an index into an array of \c count elements, flagging the blob as
+ * overrun if it is out of range.
+ */
+static unsigned
+read_index(struct blob_reader *blob, unsigned count)
+{
+   unsigned index = blob_read_uint32(blob);
+
+   if (index >= count) {
+      blob->overrun = true;
+      return 0;
+   }
+   return index;
+}
+
+
+static void
+encode_type(struct blob *blob, const glsl_type *type)
+{
+   if (type == NULL) {
+      blob_write_uint32(blob, GLSL_TYPE_ERROR);
+      return;
+   }
+
+   blob_write_uint32(blob, type->base_type);
+
+   switch (type->base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_BOOL:
+      blob_write_uint32(blob, type->vector_elements);
+      blob_write_uint32(blob, type->matrix_columns);
+      break;
+   case GLSL_TYPE_SAMPLER:
+      blob_write_uint32(blob, type->sampler_dimensionality);
+      blob_write_uint32(blob, type->sampler_shadow);
+      blob_write_uint32(blob, type->sampler_array);
+      blob_write_uint32(blob, type->sampled_type);
+      break;
+   case GLSL_TYPE_IMAGE:
+      blob_write_uint32(blob, type->sampler_dimensionality);
+      blob_write_uint32(blob, type->sampler_array);
+      blob_write_uint32(blob, type->sampled_type);
+      break;
+   case GLSL_TYPE_SUBROUTINE:
+      blob_write_string(blob, type->name);
+      break;
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE:
+      blob_write_string(blob, type->name);
+      blob_write_uint32(blob, type->length);
+      blob_write_uint32(blob, type->interface_packing);
+      for (unsigned i = 0; i < type->length; i++) {
+         const glsl_struct_field *field = &type->fields.structure[i];
+
+         encode_type(blob, field->type);
+         blob_write_string(blob, field->name);
+         blob_write_uint32(blob, field->location);
+         blob_write_uint32(blob, field->interpolation |
+                                 field->centroid << 2 |
+                                 field->sample << 3 |
+                                 field->matrix_layout << 4 |
+                                 field->patch << 6 |
+                                 field->precision << 7 |
+                                 field->image_read_only << 9 |
+                                 field->image_write_only << 10 |
+                                 field->image_coherent << 11 |
+                                 field->image_volatile << 12 |
+                                 field->image_restrict << 13);
+      }
+      break;
+   case GLSL_TYPE_ARRAY:
+      blob_write_uint32(blob, type->length);
+      encode_type(blob, type->fields.array);
+      break;
+   case GLSL_TYPE_ATOMIC_UINT:
+   case GLSL_TYPE_VOID:
+   case GLSL_TYPE_FUNCTION:
+   case GLSL_TYPE_ERROR:
+      break;
+   }
+}
+
+static const glsl_type *
+decode_type(struct blob_reader *blob)
+{
+   const unsigned base_type = blob_read_uint32(blob);
+
+   switch (base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_BOOL: {
+      const unsigned rows = blob_read_uint32(blob);
+      const unsigned columns = blob_read_uint32(blob);
+      return glsl_type::get_instance(base_type, rows, columns);
+   }
+   case GLSL_TYPE_SAMPLER: {
+      const unsigned dim = blob_read_uint32(blob);
+      const unsigned shadow = blob_read_uint32(blob);
+      const unsigned array = blob_read_uint32(blob);
+      const unsigned type = blob_read_uint32(blob);
+      return glsl_type::get_sampler_instance((enum glsl_sampler_dim) dim,
+                                             shadow, array,
+                                             (glsl_base_type) type);
+   }
+   case GLSL_TYPE_IMAGE: {
+      const unsigned dim = blob_read_uint32(blob);
+      const unsigned array = blob_read_uint32(blob);
+      const unsigned type = blob_read_uint32(blob);
+      return glsl_type::get_image_instance((enum glsl_sampler_dim) dim,
+                                           array, (glsl_base_type) type);
+   }
+   case GLSL_TYPE_ATOMIC_UINT:
+      return glsl_type::atomic_uint_type;
+   case GLSL_TYPE_VOID:
+      return glsl_type::void_type;
+   case GLSL_TYPE_SUBROUTINE: {
+      const char *name = blob_read_string(blob);
+      return name ? glsl_type::get_subroutine_instance(name) : NULL;
+   }
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE: {
+      const char *name = blob_read_string(blob);
+      const unsigned length = blob_read_uint32(blob);
+      const unsigned packing = blob_read_uint32(blob);
+      const glsl_type *type = NULL;
+
+      /* Each field takes more than 4 bytes, which bounds the allocation. */
+      if (name == NULL || length > (size_t) (blob->end - blob->current) / 4) {
+         blob->overrun = true;
+         return NULL;
+      }
+
+      glsl_struct_field *fields = new glsl_struct_field[length];
+      for (unsigned i = 0; i < length; i++) {
+         fields[i].type = decode_type(blob);
+         fields[i].name = blob_read_string(blob);
+         fields[i].location = blob_read_uint32(blob);
+
+         const unsigned flags = blob_read_uint32(blob);
+         fields[i].interpolation = flags & 0x3;
+         fields[i].centroid = (flags >> 2) & 0x1;
+         fields[i].sample = (flags >> 3) & 0x1;
+         fields[i].matrix_layout = (flags >> 4) & 0x3;
+         fields[i].patch = (flags >> 6) & 0x1;
+         fields[i].precision = (flags >> 7) & 0x3;
+         fields[i].image_read_only = (flags >> 9) & 0x1;
+         fields[i].image_write_only = (flags >> 10) & 0x1;
+         fields[i].image_coherent = (flags >> 11) & 0x1;
+         fields[i].image_volatile = (flags >> 12) & 0x1;
+         fields[i].image_restrict = (flags >> 13) & 0x1;
+
+         if (fields[i].type == NULL || fields[i].name == NULL)
+            blob->overrun = true;
+         if (blob->overrun)
+            break;
+      }
+
+      if (!blob->overrun) {
+         if (base_type == GLSL_TYPE_STRUCT) {
+            type = glsl_type::get_record_instance(fields, length, name);
+         } else {
+            type = glsl_type::get_interface_instance(
+               fields, length, (enum glsl_interface_packing) packing, name);
+         }
+      }
+      delete [] fields;
+      return type;
+   }
+   case GLSL_TYPE_ARRAY: {
+      const unsigned length = blob_read_uint32(blob);
+      const glsl_type *element = decode_type(blob);
+      return element ? glsl_type::get_array_instance(element, length) : NULL;
+   }
+   case GLSL_TYPE_ERROR:
+      return NULL;
+   default:
+      blob->overrun = true;
+      return NULL;
+   }
+}
+
+
+static void
+write_uniforms(struct blob *blob, struct gl_shader_program *shProg)
+{
+   /* A program binary resets the uniforms to their values after linking. */
+   blob_write_uint32(blob, shProg->NumUniformDataSlots);
+   write_array(blob, shProg->UniformDataDefaults,
+               shProg->NumUniformDataSlots * sizeof(union gl_constant_value));
+
+   blob_write_uint32(blob, shProg->NumUniformStorage);
+   blob_write_uint32(blob, shProg->NumHiddenUniforms);
+   for (unsigned i = 0; i < shProg->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *uni = &shProg->UniformStorage[i];
+
+      blob_write_string(blob, uni->name);
+      encode_type(blob, uni->type);
+      blob_write_uint32(blob, uni->array_elements);
+      blob_write_uint32(blob, uni->initialized |
+                              uni->row_major << 1 |
+                              uni->hidden << 2 |
+                              uni->builtin << 3 |
+                              uni->is_shader_storage << 4);
+      blob_write_bytes(blob, uni->opaque, sizeof(uni->opaque));
+      blob_write_uint32(blob, uni->block_index);
+      blob_write_uint32(blob, uni->offset);
+      blob_write_uint32(blob, uni->matrix_stride);
+      blob_write_uint32(blob, uni->array_stride);
+      blob_write_uint32(blob, uni->atomic_buffer_index);
+      blob_write_uint32(blob, uni->remap_location);
+      blob_write_uint32(blob, uni->num_compatible_subroutines);
+      blob_write_uint32(blob, uni->top_level_array_size);
+      blob_write_uint32(blob, uni->top_level_array_stride);
+      blob_write_uint32(blob, uni->storage ?
+                        uni->storage - shProg->UniformDataSlots : NULL_INDEX);
+   }
+
+   blob_write_uint32(blob, shProg->NumUniformRemapTable);
+   for (unsigned i = 0; i < shProg->NumUniformRemapTable; i++) {
+      const struct gl_uniform_storage *uni = shProg->UniformRemapTable[i];
+
+      if (uni == NULL)
+         blob_write_uint32(blob, NULL_INDEX);
+      else if (uni == INACTIVE_UNIFORM_EXPLICIT_LOCATION)
+         blob_write_uint32(blob, INACTIVE_INDEX);
+      else
+         blob_write_uint32(blob, uni - shProg->UniformStorage);
+   }
+}
+
+static void
+read_uniforms(struct blob_reader *blob, struct gl_shader_program *shProg)
+{
+   const unsigned num_slots = blob_read_uint32(blob);
+   if (num_slots > (size_t) (blob->end - blob->current) /
+                   sizeof(union gl_constant_value)) {
+      blob->overrun = true;
+      return;
+   }
+
+   const unsigned num_uniforms = blob_read_uint32(blob);
+   if (num_uniforms > (size_t) (blob->end - blob->current)) {
+      blob->overrun = true;
+      return;
+   }
+
+   /* The same layout the linker uses: the values hang off the uniform
+    * storage array, so that _mesa_clear_shader_program_data() frees them.
+    */
+   shProg->UniformStorage =
+      rzalloc_array(shProg, struct gl_uniform_storage, num_uniforms);
+   shProg->NumUniformStorage = num_uniforms;
+   shProg->NumHiddenUniforms = blob_read_uint32(blob);
+   shProg->NumUniformDataSlots = num_slots;
+   shProg->UniformDataSlots =
+      rzalloc_array(shProg->UniformStorage, union gl_constant_value,
+                    num_slots);
+   shProg->UniformDataDefaults =
+      ralloc_array(shProg->UniformStorage, union gl_constant_value,
+                   num_slots);
+   read_array(blob, shProg->UniformDataDefaults,
+              num_slots * sizeof(union gl_constant_value));
+   memcpy(shProg->UniformDataSlots, shProg->UniformDataDefaults,
+          num_slots * sizeof(union gl_constant_value));
+
+   for (unsigned i = 0; i < num_uniforms && !blob->overrun; i++) {
+      struct gl_uniform_storage *uni = &shProg->UniformStorage[i];
+
+      uni->name = ralloc_strdup(shProg->UniformStorage,
+                                blob_read_string(blob));
+      uni->type = decode_type(blob);
+      uni->array_elements = blob_read_uint32(blob);
+
+      const unsigned flags = blob_read_uint32(blob);
+      uni->initialized = flags & 0x1;
+      uni->row_major = (flags >> 1) & 0x1;
+      uni->hidden = (flags >> 2) & 0x1;
+      uni->builtin = (flags >> 3) & 0x1;
+      uni->is_shader_storage = (flags >> 4) & 0x1;
+
+      read_array(blob, uni->opaque, sizeof(uni->opaque));
+      uni->block_index = blob_read_uint32(blob);
+      uni->offset = blob_read_uint32(blob);
+      uni->matrix_stride = blob_read_uint32(blob);
+      uni->array_stride = blob_read_uint32(blob);
+      uni->atomic_buffer_index = blob_read_uint32(blob);
+      uni->remap_location = blob_read_uint32(blob);
+      uni->num_compatible_subroutines = blob_read_uint32(blob);
+      uni->top_level_array_size = blob_read_uint32(blob);
+      uni->top_level_array_stride = blob_read_uint32(blob);
+
+      const unsigned offset = blob_read_uint32(blob);
+      if (offset != NULL_INDEX) {
+         if (offset > num_slots)
+            blob->overrun = true;
+         else
+            uni->storage = &shProg->UniformDataSlots[offset];
+      }
+
+      if (uni->name == NULL || uni->type == NULL)
+         blob->overrun = true;
+   }
+
+   if (blob->overrun)
+      return;
+
+   const unsigned num_remap = blob_read_uint32(blob);
+   if (num_remap > (size_t) (blob->end - blob->current) / 4) {
+      blob->overrun = true;
+      return;
+   }
+
+   shProg->UniformRemapTable =
+      rzalloc_array(shProg, struct gl_uniform_storage *, num_remap);
+   shProg->NumUniformRemapTable = num_remap;
+   for (unsigned i = 0; i < num_remap; i++) {
+      const unsigned index = blob_read_uint32(blob);
+
+      if (index == NULL_INDEX)
+         shProg->UniformRemapTable[i] = NULL;
+      else if (index == INACTIVE_INDEX)
+         shProg->UniformRemapTable[i] = INACTIVE_UNIFORM_EXPLICIT_LOCATION;
+      else if (index < num_uniforms)
+         shProg->UniformRemapTable[i] = &shProg->UniformStorage[index];
+      else
+         blob->overrun = true;
+   }
+
+   /* Every uniform name maps to its index in UniformStorage, see
+    * link_assign_uniform_locations().
+    */
+   shProg->UniformHash = new string_to_uint_map;
+   for (unsigned i = 0; i < num_uniforms; i++)
+      shProg->UniformHash->put(i, shProg->UniformStorage[i].name);
+}
+
+
+static void
+write_buffer_blocks(struct blob *blob, const struct gl_uniform_block *blocks,
+                    unsigned num_blocks)
+{
+   blob_write_uint32(blob, num_blocks);
+   for (unsigned i = 0; i < num_blocks; i++) {
+      const struct gl_uniform_block *block = &blocks[i];
+
+      blob_write_string(blob, block->Name);
+      blob_write_uint32(blob, block->Binding);
+      blob_write_uint32(blob, block->UniformBufferSize);
+      blob_write_uint32(blob, block->IsShaderStorage);
+      blob_write_uint32(blob, block->_Packing);
+      blob_write_uint32(blob, block->NumUniforms);
+      for (unsigned j = 0; j < block->NumUniforms; j++) {
+         const struct gl_uniform_buffer_variable *var = &block->Uniforms[j];
+
+         blob_write_string(blob, var->Name);
+         blob_write_uint32(blob, var->IndexName == var->Name);
+         if (var->IndexName != var->Name)
+            blob_write_string(blob, var->IndexName);
+         encode_type(blob, var->Type);
+         blob_write_uint32(blob, var->Offset);
+         blob_write_uint32(blob, var->RowMajor);
+      }
+   }
+}
+
+static struct gl_uniform_block *
+read_buffer_blocks(struct blob_reader *blob, void *mem_ctx,
+                   unsigned *num_blocks)
+{
+   const unsigned num = blob_read_uint32(blob);
+
+   *num_blocks = 0;
+   if (num == 0)
+      return NULL;
+   if (num > (size_t) (blob->end - blob->current)) {
+      blob->overrun = true;
+      return NULL;
+   }
+
+   struct gl_uniform_block *blocks =
+      rzalloc_array(mem_ctx, struct gl_uniform_block, num);
+   *num_blocks = num;
+
+   for (unsigned i = 0; i < num && !blob->overrun; i++) {
+      struct gl_uniform_block *block = &blocks[i];
+
+      block->Name = ralloc_strdup(blocks, blob_read_string(blob));
+      block->Binding = blob_read_uint32(blob);
+      block->UniformBufferSize = blob_read_uint32(blob);
+      block->IsShaderStorage = blob_read_uint32(blob);
+      block->_Packing = (enum gl_uniform_block_packing) blob_read_uint32(blob);
+
+      const unsigned num_uniforms = blob_read_uint32(blob);
+      if (block->Name == NULL ||
+          num_uniforms > (size_t) (blob->end - blob->current)) {
+         blob->overrun = true;
+         break;
+      }
+
+      block->NumUniforms = num_uniforms;
+      block->Uniforms = rzalloc_array(blocks, struct gl_uniform_buffer_variable,
+                                      num_uniforms);
+      for (unsigned j = 0; j < num_uniforms && !blob->overrun; j++) {
+         struct gl_uniform_buffer_variable *var = &block->Uniforms[j];
+
+         var->Name = ralloc_strdup(blocks, blob_read_string(blob));
+         if (blob_read_uint32(blob))
+            var->IndexName = var->Name;
+         else
+            var->IndexName = ralloc_strdup(blocks, blob_read_string(blob));
+         var->Type = decode_type(blob);
+         var->Offset = blob_read_uint32(blob);
+         var->RowMajor = blob_read_uint32(blob);
+
+         if (var->Name == NULL || var->IndexName == NULL || var->Type == NULL)
+            blob->overrun = true;
+      }
+   }
+
+   return blocks;
+}
+
+
+static void
+write_atomic_buffers(struct blob *blob, struct gl_shader_program *shProg)
+{
+   blob_write_uint32(blob, shProg->NumAtomicBuffers);
+   for (unsigned i = 0; i < shProg->NumAtomicBuffers; i++) {
+      const struct gl_active_atomic_buffer *ab = &shProg->AtomicBuffers[i];
+
+      blob_write_uint32(blob, ab->Binding);
+      blob_write_uint32(blob, ab->MinimumSize);
+      blob_write_bytes(blob, ab->StageReferences,
+                       sizeof(ab->StageReferences));
+      blob_write_uint32(blob, ab->NumUniforms);
+      write_array(blob, ab->Uniforms, ab->NumUniforms * sizeof(GLuint));
+   }
+}
+
+static void
+read_atomic_buffers(struct blob_reader *blob, struct gl_shader_program *shProg)
+{
+   const unsigned num = blob_read_uint32(blob);
+
+   if (num == 0)
+      return;
+   if (num > (size_t) (blob->end - blob->current)) {
+      blob->overrun = true;
+      return;
+   }
+
+   shProg->AtomicBuffers =
+      rzalloc_array(shProg, struct gl_active_atomic_buffer, num);
+   shProg->NumAtomicBuffers = num;
+
+   for (unsigned i = 0; i < num && !blob->overrun; i++) {
+      struct gl_active_atomic_buffer *ab = &shProg->AtomicBuffers[i];
+
+      ab->Binding = blob_read_uint32(blob);
+      ab->MinimumSize = blob_read_uint32(blob);
+      read_array(blob, ab->StageReferences, sizeof(ab->StageReferences));
+
+      const unsigned num_uniforms = blob_read_uint32(blob);
+      if (num_uniforms > (size_t) (blob->end - blob->current) / 4) {
+         blob->overrun = true;
+         break;
+      }
+      ab->NumUniforms = num_uniforms;
+      ab->Uniforms = ralloc_array(shProg->AtomicBuffers, GLuint, num_uniforms);
+      for (unsigned j = 0; j < num_uniforms; j++)
+         ab->Uniforms[j] = read_index(blob, shProg->NumUniformStorage);
+   }
+}
+
+
+static void
+write_transform_feedback(struct blob *blob, struct gl_shader_program *shProg)
+{
+   const struct gl_transform_feedback_info *info =
+      &shProg->LinkedTransformFeedback;
+
+   blob_write_uint32(blob, info->NumBuffers);
+   blob_write_bytes(blob, info->BufferStride, sizeof(info->BufferStride));
+   blob_write_bytes(blob, info->BufferStream, sizeof(info->BufferStream));
+
+   blob_write_uint32(blob, info->NumOutputs);
+   write_array(blob, info->Outputs,
+               info->NumOutputs * sizeof(struct gl_transform_feedback_output));
+
+   blob_write_uint32(blob, info->NumVarying);
+   for (int i = 0; i < info->NumVarying; i++) {
+      blob_write_string(blob, info->Varyings[i].Name);
+      blob_write_uint32(blob, info->Varyings[i].Type);
+      blob_write_uint32(blob, info->Varyings[i].Size);
+   }
+}
+
+static void
+read_transform_feedback(struct blob_reader *blob,
+                        struct gl_shader_program *shProg)
+{
+   struct gl_transform_feedback_info *info = &shProg->LinkedTransformFeedback;
+
+   info->NumBuffers = blob_read_uint32(blob);
+   read_array(blob, info->BufferStride, sizeof(info->BufferStride));
+   read_array(blob, info->BufferStream, sizeof(info->BufferStream));
+
+   const unsigned num_outputs = blob_read_uint32(blob);
+   if (num_outputs > (size_t) (blob->end - blob->current) /
+                     sizeof(struct gl_transform_feedback_output)) {
+      blob->overrun = true;
+      return;
+   }
+   if (num_outputs) {
+      info->Outputs = rzalloc_array(shProg, struct gl_transform_feedback_output,
+                                    num_outputs);
+      info->NumOutputs = num_outputs;
+      read_array(blob, info->Outputs,
+                 num_outputs * sizeof(struct gl_transform_feedback_output));
+   }
+
+   const unsigned num_varyings = blob_read_uint32(blob);
+   if (num_varyings > (size_t) (blob->end - blob->current)) {
+      blob->overrun = true;
+      return;
+   }
+   if (num_varyings) {
+      info->Varyings =
+         rzalloc_array(shProg, struct gl_transform_feedback_varying_info,
+                       num_varyings);
+      info->NumVarying = num_varyings;
+      for (unsigned i = 0; i < num_varyings; i++) {
+         info->Varyings[i].Name = ralloc_strdup(info->Varyings,
+                                                blob_read_string(blob));
+         info->Varyings[i].Type = blob_read_uint32(blob);
+         info->Varyings[i].Size = blob_read_uint32(blob);
+         if (info->Varyings[i].Name == NULL)
+            blob->overrun = true;
+      }
+   }
+}
+
+
+static void
+write_uniform_pointers(struct blob *blob, struct gl_shader_program *shProg,
+                       struct gl_uniform_storage **table, unsigned count)
+{
+   blob_write_uint32(blob, count);
+   for (unsigned i = 0; i < count; i++) {
+      if (table[i] == NULL)
+         blob_write_uint32(blob, NULL_INDEX);
+      else if (table[i] == INACTIVE_UNIFORM_EXPLICIT_LOCATION)
+         blob_write_uint32(blob, INACTIVE_INDEX);
+      else
+         blob_write_uint32(blob, table[i] - shProg->UniformStorage);
+   }
+}
+
+static struct gl_uniform_storage **
+read_uniform_pointers(struct blob_reader *blob,
+                      struct gl_shader_program *shProg, void *mem_ctx,
+                      unsigned *count)
+{
+   const unsigned num = blob_read_uint32(blob);
+
+   *count = 0;
+   if (num == 0)
+      return NULL;
+   if (num > (size_t) (blob->end - blob->current) / 4) {
+      blob->overrun = true;
+      return NULL;
+   }
+
+   struct gl_uniform_storage **table =
+      rzalloc_array(mem_ctx, struct gl_uniform_storage *, num);
+   *count = num;
+   for (unsigned i = 0; i < num; i++) {
+      const unsigned index = blob_read_uint32(blob);
+
+      if (index == NULL_INDEX)
+         table[i] = NULL;
+      else if (index == INACTIVE_INDEX)
+         table[i] = INACTIVE_UNIFORM_EXPLICIT_LOCATION;
+      else if (index < shProg->NumUniformStorage)
+         table[i] = &shProg->UniformStorage[index];
+      else
+         blob->overrun = true;
+   }
+   return table;
+}
+
+
+static void
+write_linked_shader(struct blob *blob, struct gl_shader_program *shProg,
+                    struct gl_shader *sh)
+{
+   blob_write_uint32(blob, sh->Version);
+   blob_write_uint32(blob, sh->IsES);
+   blob_write_uint32(blob, sh->num_samplers);
+   blob_write_uint32(blob, sh->active_samplers);
+   blob_write_uint32(blob, sh->shadow_samplers);
+   blob_write_bytes(blob, sh->SamplerTargets, sizeof(sh->SamplerTargets));
+   blob_write_uint32(blob, sh->num_uniform_components);
+   blob_write_uint32(blob, sh->num_combined_uniform_components);
+
+   write_buffer_blocks(blob, sh->BufferInterfaceBlocks,
+                       sh->NumBufferInterfaceBlocks);
+
+   blob_write_uint32(blob, sh->uses_gl_fragcoord |
+                           sh->redeclares_gl_fragcoord << 1 |
+                           sh->ARB_fragment_coord_conventions_enable << 2 |
+                           sh->origin_upper_left << 3 |
+                           sh->pixel_center_integer << 4 |
+                           sh->EarlyFragmentTests << 5);
+   blob_write_bytes(blob, &sh->TessCtrl, sizeof(sh->TessCtrl));
+   blob_write_bytes(blob, &sh->TessEval, sizeof(sh->TessEval));
+   blob_write_bytes(blob, &sh->Geom, sizeof(sh->Geom));
+   blob_write_bytes(blob, &sh->Comp, sizeof(sh->Comp));
+
+   blob_write_uint32(blob, sh->NumImages);
+   blob_write_bytes(blob, sh->ImageAccess, sizeof(sh->ImageAccess));
+
+   blob_write_uint32(blob, sh->NumAtomicBuffers);
+   for (unsigned i = 0; i < sh->NumAtomicBuffers; i++)
+      blob_write_uint32(blob, sh->AtomicBuffers[i] - shProg->AtomicBuffers);
+
+   blob_write_uint32(blob, sh->NumSubroutineUniformTypes);
+   write_uniform_pointers(blob, shProg, sh->SubroutineUniformRemapTable,
+                          sh->NumSubroutineUniformRemapTable);
+
+   blob_write_uint32(blob, sh->NumSubroutineFunctions);
+   for (unsigned i = 0; i < sh->NumSubroutineFunctions; i++) {
+      const struct gl_subroutine_function *fn = &sh->SubroutineFunctions[i];
+
+      blob_write_string(blob, fn->name);
+      blob_write_uint32(blob, fn->index);
+      blob_write_uint32(blob, fn->num_compat_types);
+      for (int j = 0; j < fn->num_compat_types; j++)
+         encode_type(blob, fn->types[j]);
+   }
+}
+
+/**
+ * Set the sampler and image units of \c sh from the uniforms' initial
+ * values, as link_set_uniform_initializers() does.  SamplerUnits and
+ * ImageUnits aren't stored since they may have been changed with
+ * glUniform1i() since linking.
+ */
+static void
+set_opaque_units(struct gl_shader_program *shProg, struct gl_shader *sh)
+{
+   memset(sh->SamplerUnits, 0, sizeof(sh->SamplerUnits));
+   memset(sh->ImageUnits, 0, sizeof(sh->ImageUnits));
+
+   for (unsigned i = 0; i < shProg->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *uni = &shProg->UniformStorage[i];
+
+      if (uni->storage == NULL || !uni->opaque[sh->Stage].active)
+         continue;
+
+      const unsigned index = uni->opaque[sh->Stage].index;
+      const unsigned elements = MAX2(1, uni->array_elements);
+
+      for (unsigned j = 0; j < elements; j++) {
+         if (uni->type->is_sampler() && index + j < MAX_SAMPLERS)
+            sh->SamplerUnits[index + j] = uni->storage[j].i;
+         else if (uni->type->is_image() && index + j < MAX_IMAGE_UNIFORMS)
+            sh->ImageUnits[index + j] = uni->storage[j].i;
+      }
+   }
+}
+
+static void
+read_linked_shader(struct blob_reader *blob, struct gl_shader_program *shProg,
+                   struct gl_shader *sh)
+{
+   sh->Version = blob_read_uint32(blob);
+   sh->IsES = blob_read_uint32(blob);
+   sh->num_samplers = blob_read_uint32(blob);
+   sh->active_samplers = blob_read_uint32(blob);
+   sh->shadow_samplers = blob_read_uint32(blob);
+   read_array(blob, sh->SamplerTargets, sizeof(sh->SamplerTargets));
+   sh->num_uniform_components = blob_read_uint32(blob);
+   sh->num_combined_uniform_components = blob_read_uint32(blob);
+
+   sh->BufferInterfaceBlocks =
+      read_buffer_blocks(blob, sh, &sh->NumBufferInterfaceBlocks);
+
+   const unsigned flags = blob_read_uint32(blob);
+   sh->uses_gl_fragcoord = flags & 0x1;
+   sh->redeclares_gl_fragcoord = (flags >> 1) & 0x1;
+   sh->ARB_fragment_coord_conventions_enable = (flags >> 2) & 0x1;
+   sh->origin_upper_left = (flags >> 3) & 0x1;
+   sh->pixel_center_integer = (flags >> 4) & 0x1;
+   sh->EarlyFragmentTests = (flags >> 5) & 0x1;
+   read_array(blob, &sh->TessCtrl, sizeof(sh->TessCtrl));
+   read_array(blob, &sh->TessEval, sizeof(sh->TessEval));
+   read_array(blob, &sh->Geom, sizeof(sh->Geom));
+   read_array(blob, &sh->Comp, sizeof(sh->Comp));
+
+   sh->NumImages = blob_read_uint32(blob);
+   read_array(blob, sh->ImageAccess, sizeof(sh->ImageAccess));
+
+   const unsigned num_atomic_buffers = blob_read_uint32(blob);
+   if (num_atomic_buffers > shProg->NumAtomicBuffers) {
+      blob->overrun = true;
+      return;
+   }
+   if (num_atomic_buffers) {
+      sh->AtomicBuffers = rzalloc_array(shProg, gl_active_atomic_buffer *,
+                                        num_atomic_buffers);
+      sh->NumAtomicBuffers = num_atomic_buffers;
+      for (unsigned i = 0; i < num_atomic_buffers; i++) {
+         sh->AtomicBuffers[i] =
+            &shProg->AtomicBuffers[read_index(blob, shProg->NumAtomicBuffers)];
+      }
+   }
+
+   sh->NumSubroutineUniformTypes = blob_read_uint32(blob);
+   sh->SubroutineUniformRemapTable =
+      read_uniform_pointers(blob, shProg, sh,
+                            &sh->NumSubroutineUniformRemapTable);
+
+   const unsigned num_functions = blob_read_uint32(blob);
+   if (num_functions > (size_t) (blob->end - blob->current)) {
+      blob->overrun = true;
+      return;
+   }
+   if (num_functions) {
+      sh->SubroutineFunctions =
+         rzalloc_array(sh, struct gl_subroutine_function, num_functions);
+      sh->NumSubroutineFunctions = num_functions;
+   }
+   for (unsigned i = 0; i < num_functions && !blob->overrun; i++) {
+      struct gl_subroutine_function *fn = &sh->SubroutineFunctions[i];
+
+      fn->name = ralloc_strdup(sh, blob_read_string(blob));
+      fn->index = blob_read_uint32(blob);
+
+      const unsigned num_types = blob_read_uint32(blob);
+      if (fn->name == NULL ||
+          num_types > (size_t) (blob->end - blob->current)) {
+         blob->overrun = true;
+         break;
+      }
+      fn->num_compat_types = num_types;
+      fn->types = ralloc_array(sh, const struct glsl_type *, num_types);
+      for (unsigned j = 0; j < num_types; j++) {
+         fn->types[j] = decode_type(blob);
+         if (fn->types[j] == NULL)
+            blob->overrun = true;
+      }
+   }
+
+   if (!blob->overrun)
+      set_opaque_units(shProg, sh);
+}
+
+
+static void
+write_parameters(struct blob *blob,
+                 const struct gl_program_parameter_list *params)
+{
+   blob_write_uint32(blob, params->NumParameters);
+   for (unsigned i = 0; i < params->NumParameters; i++) {
+      const struct gl_program_parameter *param = &params->Parameters[i];
+
+      write_nullable_string(blob, param->Name);
+      blob_write_uint32(blob, param->Type);
+      blob_write_uint32(blob, param->DataType);
+      blob_write_uint32(blob, param->Size);
+      blob_write_uint32(blob, param->Initialized);
+      blob_write_bytes(blob, param->StateIndexes,
+                       sizeof(param->StateIndexes));
+   }
+   write_array(blob, params->ParameterValues,
+               params->NumParameters * sizeof(params->ParameterValues[0]));
+   blob_write_uint32(blob, params->StateFlags);
+}
+
+static struct gl_program_parameter_list *
+read_parameters(struct blob_reader *blob)
+{
+   const unsigned num = blob_read_uint32(blob);
+
+   if (num > (size_t) (blob->end - blob->current) / 4) {
+      blob->overrun = true;
+      return NULL;
+   }
+
+   struct gl_program_parameter_list *params =
+      _mesa_new_parameter_list_sized(num);
+   if (params == NULL) {
+      blob->overrun = true;
+      return NULL;
+   }
+
+   params->NumParameters = num;
+   for (unsigned i = 0; i < num; i++) {
+      struct gl_program_parameter *param = &params->Parameters[i];
+      const char *name = read_nullable_string(blob);
+
+      param->Name = name ? strdup(name) : NULL;
+      param->Type = (gl_register_file) blob_read_uint32(blob);
+      param->DataType = blob_read_uint32(blob);
+      param->Size = blob_read_uint32(blob);
+      param->Initialized = blob_read_uint32(blob);
+      read_array(blob, param->StateIndexes, sizeof(param->StateIndexes));
+   }
+   read_array(blob, params->ParameterValues,
+              num * sizeof(params->ParameterValues[0]));
+   params->StateFlags = blob_read_uint32(blob);
+
+   return params;
+}
+
+
+static size_t
+program_struct_size(gl_shader_stage stage)
+{
+   switch (stage) {
+   case MESA_SHADER_VERTEX:
+      return sizeof(struct gl_vertex_program);
+   case MESA_SHADER_TESS_CTRL:
+      return sizeof(struct gl_tess_ctrl_program);
+   case MESA_SHADER_TESS_EVAL:
+      return sizeof(struct gl_tess_eval_program);
+   case MESA_SHADER_GEOMETRY:
+      return sizeof(struct gl_geometry_program);
+   case MESA_SHADER_FRAGMENT:
+      return sizeof(struct gl_fragment_program);
+   case MESA_SHADER_COMPUTE:
+      return sizeof(struct gl_compute_program);
+   }
+   unreachable("bad shader stage");
+}
+
+/* The parts of gl_program which aren't pointers or set by NewProgram. */
+#define PROGRAM_INOUTS_START  offsetof(struct gl_program, InputsRead)
+#define PROGRAM_INOUTS_END    offsetof(struct gl_program, Parameters)
+#define PROGRAM_COUNTS_START  offsetof(struct gl_program, SamplerUnits)
+
+static void
+write_program(struct gl_context *ctx, struct blob *blob,
+              struct gl_program *prog, gl_shader_stage stage)
+{
+   const uint8_t *base = (const uint8_t *) prog;
+
+   blob_write_bytes(blob, base + PROGRAM_INOUTS_START,
+                    PROGRAM_INOUTS_END - PROGRAM_INOUTS_START);
+   blob_write_bytes(blob, base + PROGRAM_COUNTS_START,
+                    program_struct_size(stage) - PROGRAM_COUNTS_START);
+   write_parameters(blob, prog->Parameters);
+
+   ctx->Driver.ProgramBinarySerializeDriverBlob(ctx, prog, blob);
+}
+
+static bool
+read_program(struct gl_context *ctx, struct blob_reader *blob,
+             struct gl_shader_program *shProg, struct gl_shader *sh)
+{
+   struct gl_program *prog =
+      ctx->Driver.NewProgram(ctx, _mesa_shader_stage_to_program(sh->Stage),
+                             shProg->Name);
+   if (!prog)
+      return false;
+
+   uint8_t *base = (uint8_t *) prog;
+   read_array(blob, base + PROGRAM_INOUTS_START,
+              PROGRAM_INOUTS_END - PROGRAM_INOUTS_START);
+   read_array(blob, base + PROGRAM_COUNTS_START,
+              program_struct_size(sh->Stage) - PROGRAM_COUNTS_START);
+
+   _mesa_free_parameter_list(prog->Parameters);
+   prog->Parameters = read_parameters(blob);
+
+   _mesa_reference_program(ctx, &sh->Program, prog);
+   _mesa_reference_program(ctx, &prog, NULL);
+
+   if (blob->overrun)
+      return false;
+
+   _mesa_update_shader_textures_used(shProg, sh->Program);
+
+   /* The driver reserves what it adds to the parameters at draw time, so
+    * that must happen before the uniform storage is associated with them.
+    */
+   if (!ctx->Driver.ProgramBinaryDeserializeDriverBlob(ctx, sh->Program,
+                                                       blob))
+      return false;
+
+   _mesa_associate_uniform_storage(ctx, shProg, sh->Program->Parameters);
+   return shProg->LinkStatus;
+}
+
+
+static void
+write_program_resources(struct blob *blob, struct gl_shader_program *shProg)
+{
+   blob_write_uint32(blob, shProg->NumProgramResourceList);
+   for (unsigned i = 0; i < shProg->NumProgramResourceList; i++) {
+      const struct gl_program_resource *res = &shProg->ProgramResourceList[i];
+
+      blob_write_uint32(blob, res->Type);
+      blob_write_uint32(blob, res->StageReferences);
+
+      switch (res->Type) {
+      case GL_PROGRAM_INPUT:
+      case GL_PROGRAM_OUTPUT: {
+         const gl_shader_variable *var = (const gl_shader_variable *) res->Data;
+
+         encode_type(blob, var->type);
+         blob_write_string(blob, var->name);
+         blob_write_uint32(blob, var->location);
+         blob_write_uint32(blob, var->index | var->patch << 1 |
+                                 var->mode << 2);
+         break;
+      }
+      case GL_TRANSFORM_FEEDBACK_VARYING:
+         blob_write_uint32(blob, (const gl_transform_feedback_varying_info *)
+                           res->Data -
+                           shProg->LinkedTransformFeedback.Varyings);
+         break;
+      case GL_UNIFORM_BLOCK:
+      case GL_SHADER_STORAGE_BLOCK:
+         blob_write_uint32(blob, (const gl_uniform_block *) res->Data -
+                           shProg->BufferInterfaceBlocks);
+         break;
+      case GL_ATOMIC_COUNTER_BUFFER:
+         blob_write_uint32(blob, (const gl_active_atomic_buffer *) res->Data -
+                           shProg->AtomicBuffers);
+         break;
+      case GL_VERTEX_SUBROUTINE:
+      case GL_TESS_CONTROL_SUBROUTINE:
+      case GL_TESS_EVALUATION_SUBROUTINE:
+      case GL_GEOMETRY_SUBROUTINE:
+      case GL_FRAGMENT_SUBROUTINE:
+      case GL_COMPUTE_SUBROUTINE: {
+         const gl_shader *sh =
+            shProg->_LinkedShaders[_mesa_shader_stage_from_subroutine(res->Type)];
+         blob_write_uint32(blob, (const gl_subroutine_function *) res->Data -
+                           sh->SubroutineFunctions);
+         break;
+      }
+      default:
+         /* Uniforms, buffer variables and subroutine uniforms */
+         blob_write_uint32(blob, (const gl_uniform_storage *) res->Data -
+                           shProg->UniformStorage);
+         break;
+      }
+   }
+}
+
+static void
+read_program_resources(struct blob_reader *blob,
+                       struct gl_shader_program *shProg)
+{
+   const unsigned num = blob_read_uint32(blob);
+
+   if (num > (size_t) (blob->end - blob->current) / 8) {
+      blob->overrun = true;
+      return;
+   }
+   if (num == 0)
+      return;
+
+   shProg->ProgramResourceList =
+      rzalloc_array(shProg, struct gl_program_resource, num);
+   shProg->NumProgramResourceList = num;
+
+   for (unsigned i = 0; i < num && !blob->overrun; i++) {
+      struct gl_program_resource *res = &shProg->ProgramResourceList[i];
+
+      res->Type = blob_read_uint32(blob);
+      res->StageReferences = blob_read_uint32(blob);
+
+      switch (res->Type) {
+      case GL_PROGRAM_INPUT:
+      case GL_PROGRAM_OUTPUT: {
+         gl_shader_variable *var =
+            rzalloc(shProg->ProgramResourceList, struct gl_shader_variable);
+
+         var->type = decode_type(blob);
+         var->name = ralloc_strdup(var, blob_read_string(blob));
+         var->location = blob_read_uint32(blob);
+
+         const unsigned flags = blob_read_uint32(blob);
+         var->index = flags & 0x1;
+         var->patch = (flags >> 1) & 0x1;
+         var->mode = (flags >> 2) & 0xf;
+
+         if (var->type == NULL || var->name == NULL)
+            blob->overrun = true;
+         res->Data = var;
+         break;
+      }
+      case GL_TRANSFORM_FEEDBACK_VARYING:
+         res->Data = &shProg->LinkedTransformFeedback.Varyings[
+            read_index(blob, shProg->LinkedTransformFeedback.NumVarying)];
+         break;
+      case GL_UNIFORM_BLOCK:
+      case GL_SHADER_STORAGE_BLOCK:
+         res->Data = &shProg->BufferInterfaceBlocks[
+            read_index(blob, shProg->NumBufferInterfaceBlocks)];
+         break;
+      case GL_ATOMIC_COUNTER_BUFFER:
+         res->Data = &shProg->AtomicBuffers[
+            read_index(blob, shProg->NumAtomicBuffers)];
+         break;
+      case GL_VERTEX_SUBROUTINE:
+      case GL_TESS_CONTROL_SUBROUTINE:
+      case GL_TESS_EVALUATION_SUBROUTINE:
+      case GL_GEOMETRY_SUBROUTINE:
+      case GL_FRAGMENT_SUBROUTINE:
+      case GL_COMPUTE_SUBROUTINE: {
+         const gl_shader *sh =
+            shProg->_LinkedShaders[_mesa_shader_stage_from_subroutine(res->Type)];
+         if (sh == NULL) {
+            blob->overrun = true;
+            break;
+         }
+         res->Data = &sh->SubroutineFunctions[
+            read_index(blob, sh->NumSubroutineFunctions)];
+         break;
+      }
+      case GL_UNIFORM:
+      case GL_BUFFER_VARIABLE:
+      case GL_VERTEX_SUBROUTINE_UNIFORM:
+      case GL_TESS_CONTROL_SUBROUTINE_UNIFORM:
+      case GL_TESS_EVALUATION_SUBROUTINE_UNIFORM:
+      case GL_GEOMETRY_SUBROUTINE_UNIFORM:
+      case GL_FRAGMENT_SUBROUTINE_UNIFORM:
+      case GL_COMPUTE_SUBROUTINE_UNIFORM:
+         res->Data = &shProg->UniformStorage[
+            read_index(blob, shProg->NumUniformStorage)];
+         break;
+      default:
+         blob->overrun = true;
+         break;
+      }
+   }
+}
+
+
+static void
+write_shader_program(struct gl_context *ctx, struct blob *blob,
+                     struct gl_shader_program *shProg)
+{
+   blob_write_bytes(blob, &shProg->TessCtrl, sizeof(shProg->TessCtrl));
+   blob_write_bytes(blob, &shProg->TessEval, sizeof(shProg->TessEval));
+   blob_write_bytes(blob, &shProg->Geom, sizeof(shProg->Geom));
+   blob_write_bytes(blob, &shProg->Vert, sizeof(shProg->Vert));
+   blob_write_bytes(blob, &shProg->Comp, sizeof(shProg->Comp));
+   blob_write_uint32(blob, shProg->FragDepthLayout);
+   blob_write_uint32(blob, shProg->LastClipDistanceArraySize);
+   blob_write_uint32(blob, shProg->Version);
+   blob_write_uint32(blob, shProg->IsES);
+   blob_write_uint32(blob, shProg->ARB_fragment_coord_conventions_enable);
+
+   write_uniforms(blob, shProg);
+
+   write_buffer_blocks(blob, shProg->BufferInterfaceBlocks,
+                       shProg->NumBufferInterfaceBlocks);
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      blob_write_uint32(blob, shProg->InterfaceBlockStageIndex[i] != NULL);
+      write_array(blob, shProg->InterfaceBlockStageIndex[i],
+                  shProg->InterfaceBlockStageIndex[i] ?
+                  shProg->NumBufferInterfaceBlocks * sizeof(int) : 0);
+   }
+
+   write_atomic_buffers(blob, shProg);
+   write_transform_feedback(blob, shProg);
+
+   unsigned stages = 0;
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (shProg->_LinkedShaders[i])
+         stages |= 1 << i;
+   }
+   blob_write_uint32(blob, stages);
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_shader *sh = shProg->_LinkedShaders[i];
+
+      if (sh == NULL)
+         continue;
+
+      write_linked_shader(blob, shProg, sh);
+      write_program(ctx, blob, sh->Program, sh->Stage);
+   }
+
+   write_program_resources(blob, shProg);
+}
+
+static bool
+read_shader_program(struct gl_context *ctx, struct blob_reader *blob,
+                    struct gl_shader_program *shProg)
+{
+   read_array(blob, &shProg->TessCtrl, sizeof(shProg->TessCtrl));
+   read_array(blob, &shProg->TessEval, sizeof(shProg->TessEval));
+   read_array(blob, &shProg->Geom, sizeof(shProg->Geom));
+   read_array(blob, &shProg->Vert, sizeof(shProg->Vert));
+   read_array(blob, &shProg->Comp, sizeof(shProg->Comp));
+   shProg->FragDepthLayout = (enum gl_frag_depth_layout) blob_read_uint32(blob);
+   shProg->LastClipDistanceArraySize = blob_read_uint32(blob);
+   shProg->Version = blob_read_uint32(blob);
+   shProg->IsES = blob_read_uint32(blob);
+   shProg->ARB_fragment_coord_conventions_enable = blob_read_uint32(blob);
+
+   read_uniforms(blob, shProg);
+   if (blob->overrun)
+      return false;
+
+   shProg->BufferInterfaceBlocks =
+      read_buffer_blocks(blob, shProg, &shProg->NumBufferInterfaceBlocks);
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (!blob_read_uint32(blob))
+         continue;
+
+      shProg->InterfaceBlockStageIndex[i] =
+         ralloc_array(shProg, int, shProg->NumBufferInterfaceBlocks);
+      read_array(blob, shProg->InterfaceBlockStageIndex[i],
+                 shProg->NumBufferInterfaceBlocks * sizeof(int));
+   }
+
+   read_atomic_buffers(blob, shProg);
+   read_transform_feedback(blob, shProg);
+   if (blob->overrun)
+      return false;
+
+   split_ubos_and_ssbos(shProg,
+                        shProg->BufferInterfaceBlocks,
+                        shProg->NumBufferInterfaceBlocks,
+                        &shProg->UniformBlocks,
+                        &shProg->NumUniformBlocks,
+                        &shProg->UboInterfaceBlockIndex,
+                        &shProg->ShaderStorageBlocks,
+                        &shProg->NumShaderStorageBlocks,
+                        &shProg->SsboInterfaceBlockIndex);
+
+   const unsigned stages = blob_read_uint32(blob);
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (!(stages & (1 << i)))
+         continue;
+
+      struct gl_shader *sh = ctx->Driver.NewShader(NULL, 0, shader_types[i]);
+      if (sh == NULL)
+         return false;
+      shProg->_LinkedShaders[i] = sh;
+
+      read_linked_shader(blob, shProg, sh);
+      if (blob->overrun)
+         return false;
+
+      split_ubos_and_ssbos(sh,
+                           sh->BufferInterfaceBlocks,
+                           sh->NumBufferInterfaceBlocks,
+                           &sh->UniformBlocks,
+                           &sh->NumUniformBlocks,
+                           NULL,
+                           &sh->ShaderStorageBlocks,
+                           &sh->NumShaderStorageBlocks,
+                           NULL);
+
+      if (!read_program(ctx, blob, shProg, sh))
+         return false;
+   }
+
+   read_program_resources(blob, shProg);
+
+   return !blob->overrun && blob->current == blob->end;
+}
+
+
+struct blob *
+_mesa_create_program_binary(struct gl_context *ctx, void *mem_ctx,
+                            struct gl_shader_program *shProg)
+{
+   struct program_binary_header header;
+   struct blob *blob;
+
+   if (!ctx->Driver.ProgramBinarySerializeDriverBlob || !shProg->LinkStatus)
+      return NULL;
+
+   blob = blob_create(mem_ctx);
+   if (blob == NULL)
+      return NULL;
+
+   /* Write a placeholder for the header, filled in once the payload is. */
+   memset(&header, 0, sizeof(header));
+   blob_write_bytes(blob, &header, sizeof(header));
+
+   write_shader_program(ctx, blob, shProg);
+
+   header.magic = PROGRAM_BINARY_MAGIC;
+   header.version = PROGRAM_BINARY_VERSION;
+   memcpy(header.driver_sha1, ctx->ShaderCacheSHA1,
+          sizeof(header.driver_sha1));
+   header.payload_size = blob->size - sizeof(header);
+   _mesa_sha1_compute(blob->data + sizeof(header), header.payload_size,
+                      header.payload_sha1);
+
+   if (!blob_overwrite_bytes(blob, 0, &header, sizeof(header))) {
+      ralloc_free(blob);
+      return NULL;
+   }
+
+   return blob;
+}
+
+
+bool
+_mesa_load_program_binary(struct gl_context *ctx,
+                          struct gl_shader_program *shProg,
+                          const void *binary, size_t length)
+{
+   struct program_binary_header header;
+   struct blob_reader blob;
+   unsigned char sha1[20];
+   bool ok;
+
+   if (!ctx->Driver.ProgramBinaryDeserializeDriverBlob ||
+       length < sizeof(header))
+      return false;
+
+   memcpy(&header, binary, sizeof(header));
+   if (header.magic != PROGRAM_BINARY_MAGIC ||
+       header.version != PROGRAM_BINARY_VERSION ||
+       header.payload_size != length - sizeof(header) ||
+       memcmp(header.driver_sha1, ctx->ShaderCacheSHA1, sizeof(sha1)) != 0)
+      return false;
+
+   _mesa_sha1_compute((const uint8_t *) binary + sizeof(header),
+                      header.payload_size, sha1);
+   if (memcmp(header.payload_sha1, sha1, sizeof(sha1)) != 0)
+      return false;
+
+   /* Throw away the previous link, like link_shaders() does. */
+   _mesa_clear_shader_program_data(shProg);
+   ralloc_free(shProg->LinkedTransformFeedback.Outputs);
+   ralloc_free(shProg->LinkedTransformFeedback.Varyings);
+   memset(&shProg->LinkedTransformFeedback, 0,
+          sizeof(shProg->LinkedTransformFeedback));
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (shProg->_LinkedShaders[i] != NULL) {
+         _mesa_delete_shader(ctx, shProg->_LinkedShaders[i]);
+         shProg->_LinkedShaders[i] = NULL;
+      }
+   }
+
+   shProg->LinkStatus = GL_TRUE;
+
+   /* The binary is only read with 4-byte aligned accesses relative to its
+    * start, which malloc'ed memory satisfies.
+    */
+   blob_reader_init(&blob, (uint8_t *) binary, length);
+   blob_read_bytes(&blob, sizeof(header));
+
+   ok = read_shader_program(ctx, &blob, shProg);
+   if (!ok) {
+      _mesa_clear_shader_program_data(shProg);
+      for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+         if (shProg->_LinkedShaders[i] != NULL) {
+            _mesa_delete_shader(ctx, shProg->_LinkedShaders[i]);
+            shProg->_LinkedShaders[i] = NULL;
+         }
+      }
+   }
+
+   shProg->LinkStatus = ok;
+   shProg->Validated = GL_FALSE;
+   shProg->_Used = GL_FALSE;
+
+   return ok;
+}
+
+
+GLint
+_mesa_get_program_binary_length(struct gl_context *ctx,
+                                struct gl_shader_program *shProg)
+{
+   struct blob *blob = _mesa_create_program_binary(ctx, NULL, shProg);
+   GLint length = blob ? blob->size : 0;
+
+   ralloc_free(blob);
+   return length;
+}
+
+
+void
+_mesa_get_program_binary(struct gl_context *ctx,
+                         struct gl_shader_program *shProg,
+                         GLsizei bufSize, GLsizei *length,
+                         GLenum *binaryFormat, GLvoid *binary)
+{
+   struct blob *blob = _mesa_create_program_binary(ctx, NULL, shProg);
+
+   *length = 0;
+
+   if (blob == NULL) {
+      _mesa_error(ctx, GL_OUT_OF_MEMORY, "glGetProgramBinary");
+      return;
+   }
+
+   /* The ARB_get_program_binary spec says:
+    *
+    *     "If <bufSize> is less than the number of bytes that would be written
+    *     to <binary>, an INVALID_OPERATION error is generated."
+    */
+   if (blob->size > (size_t) bufSize) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(bufSize too small)");
+      ralloc_free(blob);
+      return;
+   }
+
+   memcpy(binary, blob->data, blob->size);
+   *length = blob->size;
+   *binaryFormat = GL_PROGRAM_BINARY_FORMAT_MESA;
+
+   ralloc_free(blob);
+}
+
+
+void
+_mesa_program_binary(struct gl_context *ctx,
+                     struct gl_shader_program *shProg,
+                     GLenum binaryFormat, const GLvoid *binary,
+                     GLsizei length)
+{
+   void *copy;
+
+   if (binaryFormat != GL_PROGRAM_BINARY_FORMAT_MESA) {
+      shProg->LinkStatus = GL_FALSE;
+      _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+      return;
+   }
+
+   if ((size_t) length < sizeof(struct program_binary_header)) {
+      shProg->LinkStatus = GL_FALSE;
+      return;
+   }
+
+   /* The application's buffer may not be suitably aligned. */
+   copy = malloc(length);
+   if (copy == NULL) {
+      _mesa_error(ctx, GL_OUT_OF_MEMORY, "glProgramBinary");
+      return;
+   }
+   memcpy(copy, binary, length);
+
+   /* A binary which doesn't load, because it is corrupt or from another
+    * driver or version, isn't an error: the spec says LINK_STATUS is set to
+    * FALSE and the application is expected to fall back to the sources.
+    */
+   if (!_mesa_load_program_binary(ctx, shProg, copy, length))
+      shProg->LinkStatus = GL_FALSE;
+
+   free(copy);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
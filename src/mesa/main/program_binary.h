@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file program_binary.h
+ * Serialization of linked GLSL programs, for GL_ARB_get_program_binary and
+ * the on-disk shader cache.
+ */
+
+#ifndef PROGRAM_BINARY_H
+#define PROGRAM_BINARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "main/glheader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct blob;
+struct gl_context;
+struct gl_shader_program;
+
+/** The only binary format Mesa exposes. */
+#ifndef GL_PROGRAM_BINARY_FORMAT_MESA
+#define GL_PROGRAM_BINARY_FORMAT_MESA 0x875F
+#endif
+
+#ifdef ENABLE_SHADER_CACHE
+
+/**
+ * Serialize the linked state of \c shProg, including the driver's compiled
+ * code, into a new blob allocated with \c mem_ctx.  Returns NULL if the
+ * driver can't serialize its programs.
+ *
+ * The binary only loads back into a context with the same driver, Mesa
+ * build and GL state that matters to the compiler.
+ */
+extern struct blob *
+_mesa_create_program_binary(struct gl_context *ctx, void *mem_ctx,
+                            struct gl_shader_program *shProg);
+
+/**
+ * Replace the linked state of \c shProg with the one from a binary made by
+ * _mesa_create_program_binary().  On failure \c shProg is left unlinked, with
+ * no linked shaders, and false is returned.
+ */
+extern bool
+_mesa_load_program_binary(struct gl_context *ctx,
+                          struct gl_shader_program *shProg,
+                          const void *binary, size_t length);
+
+extern GLint
+_mesa_get_program_binary_length(struct gl_context *ctx,
+                                struct gl_shader_program *shProg);
+
+extern void
+_mesa_get_program_binary(struct gl_context *ctx,
+                         struct gl_shader_program *shProg,
+                         GLsizei bufSize, GLsizei *length,
+                         GLenum *binaryFormat, GLvoid *binary);
+
+extern void
+_mesa_program_binary(struct gl_context *ctx,
+                     struct gl_shader_program *shProg,
+                     GLenum binaryFormat, const GLvoid *binary,
+                     GLsizei length);
+
+#else
+
+static inline GLint
+_mesa_get_program_binary_length(struct gl_context *ctx,
+                                struct gl_shader_program *shProg)
+{
+   return 0;
+}
+
+static inline void
+_mesa_get_program_binary(struct gl_context *ctx,
+                         struct gl_shader_program *shProg,
+                         GLsizei bufSize, GLsizei *length,
+                         GLenum *binaryFormat, GLvoid *binary)
+{
+   *length = 0;
+}
+
+static inline void
+_mesa_program_binary(struct gl_context *ctx,
+                     struct gl_shader_program *shProg,
+                     GLenum binaryFormat, const GLvoid *binary,
+                     GLsizei length)
+{
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROGRAM_BINARY_H */
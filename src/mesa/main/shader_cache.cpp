@@ -0,0 +1,292 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file shader_cache.cpp
+ * Automatic on-disk caching of linked GLSL programs.
+ */
+
+#include "main/core.h"
+#include "main/context.h"
+#include "main/program_binary.h"
+#include "main/shader_cache.h"
+#include "compiler/glsl/blob.h"
+#include "compiler/glsl/cache.h"
+#include "program/hash_table.h"
+#include "util/mesa-sha1.h"
+#include "util/ralloc.h"
+#include "git_sha1.h"
+
+#ifdef ENABLE_SHADER_CACHE
+
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+
+
+void
+_mesa_shader_cache_init(struct gl_context *ctx)
+{
+   struct mesa_sha1 *sha1 = _mesa_sha1_init();
+   struct gl_extensions extensions;
+   struct gl_constants consts;
+   const char *str;
+
+   if (sha1 == NULL)
+      return;
+
+   /* The build of Mesa.  A developer rebuilding the same version is caught
+    * by the library's timestamp.
+    */
+   _mesa_sha1_update(sha1, PACKAGE_VERSION, sizeof(PACKAGE_VERSION));
+#ifdef MESA_GIT_SHA1
+   _mesa_sha1_update(sha1, MESA_GIT_SHA1, sizeof(MESA_GIT_SHA1));
+#endif
+#ifdef HAVE_DLADDR
+   {
+      Dl_info info;
+      struct stat st;
+
+      if (dladdr((void *) _mesa_shader_cache_init, &info) &&
+          info.dli_fname && stat(info.dli_fname, &st) == 0)
+         _mesa_sha1_update(sha1, &st.st_mtime, sizeof(st.st_mtime));
+   }
+#endif
+
+   /* The driver and the hardware it runs on */
+   str = (const char *) ctx->Driver.GetString(ctx, GL_VENDOR);
+   if (str)
+      _mesa_sha1_update(sha1, str, strlen(str) + 1);
+   str = (const char *) ctx->Driver.GetString(ctx, GL_RENDERER);
+   if (str)
+      _mesa_sha1_update(sha1, str, strlen(str) + 1);
+
+   /* The context state the compiler and linker look at.  Pointers are
+    * cleared since they differ between runs.
+    */
+   _mesa_sha1_update(sha1, &ctx->API, sizeof(ctx->API));
+   _mesa_sha1_update(sha1, &ctx->Version, sizeof(ctx->Version));
+
+   memcpy(&extensions, &ctx->Extensions, sizeof(extensions));
+   extensions.String = NULL;
+   _mesa_sha1_update(sha1, &extensions, sizeof(extensions));
+
+   memcpy(&consts, &ctx->Const, sizeof(consts));
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++)
+      consts.ShaderCompilerOptions[i].NirOptions = NULL;
+   _mesa_sha1_update(sha1, &consts, sizeof(consts));
+
+   _mesa_sha1_final(sha1, ctx->ShaderCacheSHA1);
+
+   if (ctx->Driver.ProgramBinarySerializeDriverBlob &&
+       ctx->Driver.ProgramBinaryDeserializeDriverBlob)
+      ctx->Cache = cache_create();
+}
+
+
+void
+_mesa_shader_cache_free(struct gl_context *ctx)
+{
+   if (ctx->Cache) {
+      cache_destroy(ctx->Cache);
+      ctx->Cache = NULL;
+   }
+}
+
+
+/** Debug output needs the compiler and linker to really run. */
+static bool
+cache_usable(struct gl_context *ctx)
+{
+   return ctx->Cache && !(ctx->_Shader->Flags & (GLSL_DUMP | GLSL_LOG));
+}
+
+
+bool
+_mesa_shader_cache_skip_compile(struct gl_context *ctx, struct gl_shader *sh)
+{
+   struct mesa_sha1 *sha1;
+
+   sh->CompileSkipped = false;
+
+   if (ctx->Cache == NULL || sh->Source == NULL)
+      return false;
+
+   sha1 = _mesa_sha1_init();
+   if (sha1 == NULL)
+      return false;
+   _mesa_sha1_update(sha1, ctx->ShaderCacheSHA1,
+                     sizeof(ctx->ShaderCacheSHA1));
+   _mesa_sha1_update(sha1, &ctx->_Shader->Flags,
+                     sizeof(ctx->_Shader->Flags));
+   _mesa_sha1_update(sha1, &sh->Stage, sizeof(sh->Stage));
+   _mesa_sha1_update(sha1, sh->Source, strlen(sh->Source));
+   _mesa_sha1_final(sha1, sh->sha1);
+
+   if (!cache_usable(ctx) || !cache_has_key(ctx->Cache, sh->sha1))
+      return false;
+
+   /* The shader compiled before, so it will again.  The program it's
+    * linked into is most likely in the cache too, and if not,
+    * _mesa_glsl_link_shader() compiles it first.
+    */
+   sh->CompileStatus = GL_TRUE;
+   sh->CompileSkipped = true;
+   ralloc_free(sh->InfoLog);
+   sh->InfoLog = ralloc_strdup(sh, "");
+
+   return true;
+}
+
+
+struct bindings_closure {
+   unsigned char digest[20];
+};
+
+/**
+ * Fold one binding into the digest, independently of the order the hash
+ * table is walked in.
+ */
+static void
+hash_binding(const char *name, unsigned value, void *closure)
+{
+   struct bindings_closure *bindings = (struct bindings_closure *) closure;
+   struct mesa_sha1 *sha1 = _mesa_sha1_init();
+   unsigned char digest[20];
+
+   if (sha1 == NULL)
+      return;
+
+   _mesa_sha1_update(sha1, name, strlen(name) + 1);
+   _mesa_sha1_update(sha1, &value, sizeof(value));
+   _mesa_sha1_final(sha1, digest);
+
+   for (unsigned i = 0; i < sizeof(digest); i++)
+      bindings->digest[i] ^= digest[i];
+}
+
+static void
+hash_bindings(struct mesa_sha1 *sha1, struct string_to_uint_map *map)
+{
+   struct bindings_closure bindings;
+
+   memset(&bindings, 0, sizeof(bindings));
+   map->iterate(hash_binding, &bindings);
+   _mesa_sha1_update(sha1, bindings.digest, sizeof(bindings.digest));
+}
+
+/**
+ * The key of a program is made from its shaders and the state set by the
+ * application which affects linking.
+ */
+static bool
+program_key(struct gl_context *ctx, struct gl_shader_program *prog,
+            cache_key key)
+{
+   struct mesa_sha1 *sha1 = _mesa_sha1_init();
+
+   if (sha1 == NULL)
+      return false;
+
+   _mesa_sha1_update(sha1, ctx->ShaderCacheSHA1,
+                     sizeof(ctx->ShaderCacheSHA1));
+   _mesa_sha1_update(sha1, &ctx->_Shader->Flags,
+                     sizeof(ctx->_Shader->Flags));
+
+   for (unsigned i = 0; i < prog->NumShaders; i++)
+      _mesa_sha1_update(sha1, prog->Shaders[i]->sha1,
+                        sizeof(prog->Shaders[i]->sha1));
+
+   hash_bindings(sha1, prog->AttributeBindings);
+   hash_bindings(sha1, prog->FragDataBindings);
+   hash_bindings(sha1, prog->FragDataIndexBindings);
+
+   _mesa_sha1_update(sha1, &prog->TransformFeedback.BufferMode,
+                     sizeof(prog->TransformFeedback.BufferMode));
+   _mesa_sha1_update(sha1, &prog->TransformFeedback.NumVarying,
+                     sizeof(prog->TransformFeedback.NumVarying));
+   for (unsigned i = 0; i < prog->TransformFeedback.NumVarying; i++) {
+      const char *name = prog->TransformFeedback.VaryingNames[i];
+      _mesa_sha1_update(sha1, name, strlen(name) + 1);
+   }
+
+   _mesa_sha1_update(sha1, &prog->SeparateShader,
+                     sizeof(prog->SeparateShader));
+
+   _mesa_sha1_final(sha1, key);
+   return true;
+}
+
+
+bool
+_mesa_shader_cache_load_program(struct gl_context *ctx,
+                                struct gl_shader_program *prog)
+{
+   cache_key key;
+   void *binary;
+   size_t size;
+   bool ok;
+
+   if (!cache_usable(ctx) || !program_key(ctx, prog, key))
+      return false;
+
+   binary = cache_get(ctx->Cache, key, &size);
+   if (binary == NULL)
+      return false;
+
+   ok = _mesa_load_program_binary(ctx, prog, binary, size);
+   free(binary);
+
+   /* A stale or corrupt entry leaves the program cleared, ready to be
+    * linked as if it hadn't been found.
+    */
+   if (!ok)
+      prog->LinkStatus = GL_TRUE;
+
+   return ok;
+}
+
+
+void
+_mesa_shader_cache_store_program(struct gl_context *ctx,
+                                 struct gl_shader_program *prog)
+{
+   struct blob *blob;
+   cache_key key;
+
+   if (!cache_usable(ctx) || !program_key(ctx, prog, key))
+      return;
+
+   blob = _mesa_create_program_binary(ctx, NULL, prog);
+   if (blob == NULL)
+      return;
+
+   cache_put(ctx->Cache, key, blob->data, blob->size);
+   ralloc_free(blob);
+
+   for (unsigned i = 0; i < prog->NumShaders; i++)
+      cache_put_key(ctx->Cache, prog->Shaders[i]->sha1);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file shader_cache.h
+ * Automatic on-disk caching of linked GLSL programs.
+ *
+ * A linked program is stored as a program binary keyed by the SHA-1 of its
+ * shaders' sources and of the state that affects linking.  Compiling a
+ * shader whose source was seen before is deferred, since the program it is
+ * linked into is likely to be in the cache as well; it is only compiled for
+ * real if that program has to be linked from scratch.
+ */
+
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gl_context;
+struct gl_shader;
+struct gl_shader_program;
+
+#ifdef ENABLE_SHADER_CACHE
+
+/**
+ * Open the cache and compute the SHA-1 of the driver and context state
+ * that program binaries depend on.  Called once the context's version and
+ * extensions are known.
+ */
+extern void
+_mesa_shader_cache_init(struct gl_context *ctx);
+
+extern void
+_mesa_shader_cache_free(struct gl_context *ctx);
+
+/**
+ * Compute \c sh->sha1 and, if the shader was compiled successfully before,
+ * mark it compiled without compiling it.  Returns true if the compile was
+ * skipped.
+ */
+extern bool
+_mesa_shader_cache_skip_compile(struct gl_context *ctx, struct gl_shader *sh);
+
+/**
+ * Load \c prog from the cache instead of linking it.  Returns false if it
+ * isn't in the cache, in which case \c prog is unchanged.
+ */
+extern bool
+_mesa_shader_cache_load_program(struct gl_context *ctx,
+                                struct gl_shader_program *prog);
+
+/** Store a successfully linked \c prog in the cache. */
+extern void
+_mesa_shader_cache_store_program(struct gl_context *ctx,
+                                 struct gl_shader_program *prog);
+
+#else
+
+static inline void
+_mesa_shader_cache_init(struct gl_context *ctx)
+{
+}
+
+static inline void
+_mesa_shader_cache_free(struct gl_context *ctx)
+{
+}
+
+static inline bool
+_mesa_shader_cache_skip_compile(struct gl_context *ctx, struct gl_shader *sh)
+{
+   return false;
+}
+
+static inline bool
+_mesa_shader_cache_load_program(struct gl_context *ctx,
+                                struct gl_shader_program *prog)
+{
+   return false;
+}
+
+static inline void
+_mesa_shader_cache_store_program(struct gl_context *ctx,
+                                 struct gl_shader_program *prog)
+{
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADER_CACHE_H */
@@ -45,6 +45,8 @@
 #include "main/hash.h"
 #include "main/mtypes.h"
 #include "main/pipelineobj.h"
+#include "main/program_binary.h"
+#include "main/shader_cache.h"
 #include "main/shaderapi.h"
 #include "main/shaderobj.h"
 #include "main/transformfeedback.h"
@@ -755,7 +757,10 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname,
       *params = shProg->BinaryRetreivableHint;
       return;
    case GL_PROGRAM_BINARY_LENGTH:
-      *params = 0;
+      if (ctx->Const.NumProgramBinaryFormats == 0 || !shProg->LinkStatus)
+         *params = 0;
+      else
+         *params = _mesa_get_program_binary_length(ctx, shProg);
       return;
    case GL_ACTIVE_ATOMIC_COUNTER_BUFFERS:
       if (!ctx->Extensions.ARB_shader_atomic_counters)
@@ -981,9 +986,11 @@ compile_shader(struct gl_context *ctx, GLuint shaderObj)
       }
 
       /* this call will set the shader->CompileStatus field to indicate if
-       * compilation was successful.
+       * compilation was successful.  A shader found in the shader cache is
+       * only compiled if the program it's linked into isn't.
        */
-      _mesa_glsl_compile_shader(ctx, sh, false, false);
+      if (!_mesa_shader_cache_skip_compile(ctx, sh))
+         _mesa_glsl_compile_shader(ctx, sh, false, false);
 
       if (ctx->_Shader->Flags & GLSL_LOG) {
          _mesa_write_shader_to_file(sh);
@@ -1933,12 +1940,15 @@ _mesa_GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length,
       return;
    }
 
-   *length = 0;
-   _mesa_error(ctx, GL_INVALID_OPERATION,
-               "glGetProgramBinary(driver supports zero binary formats)");
+   if (ctx->Const.NumProgramBinaryFormats == 0) {
+      *length = 0;
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(driver supports zero binary formats)");
+      return;
+   }
 
-   (void) binaryFormat;
-   (void) binary;
+   _mesa_get_program_binary(ctx, shProg, bufSize, length, binaryFormat,
+                            binary);
 }
 
 void GLAPIENTRY
@@ -1952,9 +1962,6 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
    if (!shProg)
       return;
 
-   (void) binaryFormat;
-   (void) binary;
-
    /* Section 2.3.1 (Errors) of the OpenGL 4.5 spec says:
     *
     *     "If a negative number is provided where an argument of type sizei or
@@ -1974,11 +1981,30 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
     *     setting the LINK_STATUS of <program> to FALSE, if these conditions
     *     are not met."
     *
-    * Since any value of binaryFormat passed "is not one of those specified as
-    * allowable for [this] command, an INVALID_ENUM error is generated."
+    * When the driver supports zero binary formats, any value of
+    * binaryFormat passed "is not one of those specified as allowable for
+    * [this] command, an INVALID_ENUM error is generated."
     */
-   shProg->LinkStatus = GL_FALSE;
-   _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+   if (ctx->Const.NumProgramBinaryFormats == 0) {
+      shProg->LinkStatus = GL_FALSE;
+      _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+      return;
+   }
+
+   /* As for glLinkProgram, from the ARB_transform_feedback2 specification:
+    * "The error INVALID_OPERATION is generated by LinkProgram if <program> is
+    *  the name of a program being used by one or more transform feedback
+    *  objects, even if the objects are not currently bound or are paused."
+    */
+   if (_mesa_transform_feedback_is_using_program(ctx, shProg)) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glProgramBinary(transform feedback is using the program)");
+      return;
+   }
+
+   FLUSH_VERTICES(ctx, _NEW_PROGRAM);
+
+   _mesa_program_binary(ctx, shProg, binaryFormat, binary, length);
 }
 
 
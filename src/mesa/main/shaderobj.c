@@ -275,6 +275,9 @@ _mesa_clear_shader_program_data(struct gl_shader_program *shProg)
       ralloc_free(shProg->UniformStorage);
       shProg->NumUniformStorage = 0;
       shProg->UniformStorage = NULL;
+      shProg->NumUniformDataSlots = 0;
+      shProg->UniformDataSlots = NULL;
+      shProg->UniformDataDefaults = NULL;
    }
 
    if (shProg->UniformRemapTable) {
@@ -0,0 +1,246 @@
+/*
+ * Copyright © 2016 VMware, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file glthread.cpp
+ * Tests of the glthread marshalling, with a dispatch table of fake GL
+ * functions standing in for Mesa's, and a draw call rate benchmark.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "main/api_exec.h"
+#include "main/context.h"
+#include "main/glthread.h"
+#include "glapi/glapi.h"
+
+extern "C" {
+#include "main/remap.h"
+}
+
+#include "main/dispatch.h"
+
+/* What the fake GL functions saw. */
+static std::vector<GLfloat> vertices;
+static std::vector<GLuint> deleted_textures;
+static unsigned draws;
+static unsigned sync_draws;
+static thrd_t app_thread;
+
+static void
+record_draw(void)
+{
+   draws++;
+   if (thrd_equal(thrd_current(), app_thread))
+      sync_draws++;
+}
+
+static void GLAPIENTRY
+fake_Vertex3f(GLfloat x, GLfloat y, GLfloat z)
+{
+   vertices.push_back(x);
+}
+
+static void GLAPIENTRY
+fake_DeleteTextures(GLsizei n, const GLuint *textures)
+{
+   if (!textures) {
+      deleted_textures.push_back(~0u);
+      return;
+   }
+   deleted_textures.insert(deleted_textures.end(), textures, textures + n);
+}
+
+static GLenum GLAPIENTRY
+fake_GetError(void)
+{
+   return draws + vertices.size();
+}
+
+static void GLAPIENTRY
+fake_DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+   record_draw();
+}
+
+static void GLAPIENTRY
+fake_DrawElements(GLenum mode, GLsizei count, GLenum type,
+                  const GLvoid *indices)
+{
+   record_draw();
+}
+
+static void GLAPIENTRY
+fake_BindBuffer(GLenum target, GLuint buffer)
+{
+}
+
+static void GLAPIENTRY
+fake_VertexPointer(GLint size, GLenum type, GLsizei stride,
+                   const GLvoid *pointer)
+{
+}
+
+static void GLAPIENTRY
+fake_Finish(void)
+{
+}
+
+
+class Glthread_test : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   struct gl_context ctx;
+   struct _glapi_table *server;
+};
+
+void
+Glthread_test::SetUp()
+{
+   memset(&ctx, 0, sizeof(ctx));
+
+   /* Done by context creation, which this test doesn't need. */
+   _mesa_init_remap_table();
+
+   server = _mesa_alloc_dispatch_table();
+   SET_Vertex3f(server, fake_Vertex3f);
+   SET_DeleteTextures(server, fake_DeleteTextures);
+   SET_GetError(server, fake_GetError);
+   SET_DrawArrays(server, fake_DrawArrays);
+   SET_DrawElements(server, fake_DrawElements);
+   SET_BindBuffer(server, fake_BindBuffer);
+   SET_VertexPointer(server, fake_VertexPointer);
+   SET_Finish(server, fake_Finish);
+   ctx.CurrentServerDispatch = server;
+   ctx.CurrentClientDispatch = server;
+
+   _glapi_set_context(&ctx);
+   _glapi_set_dispatch(server);
+
+   vertices.clear();
+   deleted_textures.clear();
+   draws = 0;
+   sync_draws = 0;
+   app_thread = thrd_current();
+}
+
+void
+Glthread_test::TearDown()
+{
+   _mesa_glthread_destroy(&ctx);
+   _glapi_set_dispatch(NULL);
+   _glapi_set_context(NULL);
+   free(server);
+}
+
+
+TEST_F(Glthread_test, commands_execute_in_order)
+{
+   /* Enough commands for several batches */
+   const unsigned n = 20 * MARSHAL_MAX_CMD_SIZE / 16;
+
+   _mesa_glthread_init(&ctx);
+   ASSERT_TRUE(ctx.GLThread != NULL);
+   EXPECT_EQ(ctx.MarshalExec, _glapi_get_dispatch());
+
+   for (unsigned i = 0; i < n; i++)
+      CALL_Vertex3f(_glapi_get_dispatch(), ((GLfloat) i, 0.0f, 0.0f));
+
+   /* Returns data, so it has to wait for the commands before it. */
+   EXPECT_EQ(n, CALL_GetError(_glapi_get_dispatch(), ()));
+
+   ASSERT_EQ(n, vertices.size());
+   for (unsigned i = 0; i < n; i++)
+      EXPECT_EQ((GLfloat) i, vertices[i]);
+}
+
+TEST_F(Glthread_test, variable_size_data_is_copied)
+{
+   std::vector<GLuint> names(2 * MARSHAL_MAX_CMD_SIZE / sizeof(GLuint));
+
+   for (unsigned i = 0; i < names.size(); i++)
+      names[i] = i + 1;
+
+   _mesa_glthread_init(&ctx);
+   ASSERT_TRUE(ctx.GLThread != NULL);
+
+   /* Small arrays are copied into the batch, big ones are executed
+    * synchronously, which must not reorder them.
+    */
+   CALL_DeleteTextures(_glapi_get_dispatch(), (3, &names[0]));
+   CALL_DeleteTextures(_glapi_get_dispatch(), (0, &names[0]));
+   CALL_DeleteTextures(_glapi_get_dispatch(), (1, NULL));
+   CALL_DeleteTextures(_glapi_get_dispatch(), (names.size(), &names[0]));
+   names[0] = 42;
+   CALL_DeleteTextures(_glapi_get_dispatch(), (1, &names[0]));
+   names[0] = 0;
+   _mesa_glthread_finish(&ctx);
+
+   ASSERT_EQ(3 + 1 + names.size() + 1, deleted_textures.size());
+   EXPECT_EQ(1u, deleted_textures[0]);
+   EXPECT_EQ(3u, deleted_textures[2]);
+   EXPECT_EQ(~0u, deleted_textures[3]);
+   EXPECT_EQ(1u, deleted_textures[4]);
+   EXPECT_EQ(names.size(), deleted_textures[3 + names.size()]);
+   EXPECT_EQ(42u, deleted_textures.back());
+}
+
+TEST_F(Glthread_test, draws_from_user_arrays_are_synchronous)
+{
+   _mesa_glthread_init(&ctx);
+   ASSERT_TRUE(ctx.GLThread != NULL);
+
+   /* Arrays in buffer objects */
+   CALL_BindBuffer(_glapi_get_dispatch(), (GL_ARRAY_BUFFER, 1));
+   CALL_VertexPointer(_glapi_get_dispatch(), (3, GL_FLOAT, 0, NULL));
+   CALL_DrawArrays(_glapi_get_dispatch(), (GL_TRIANGLES, 0, 3));
+   _mesa_glthread_finish(&ctx);
+   EXPECT_EQ(1u, draws);
+   EXPECT_EQ(0u, sync_draws);
+
+   /* Indices from the application's memory */
+   CALL_DrawElements(_glapi_get_dispatch(),
+                     (GL_TRIANGLES, 3, GL_UNSIGNED_INT, NULL));
+   EXPECT_EQ(2u, draws);
+   EXPECT_EQ(1u, sync_draws);
+
+   CALL_BindBuffer(_glapi_get_dispatch(), (GL_ELEMENT_ARRAY_BUFFER, 2));
+   CALL_DrawElements(_glapi_get_dispatch(),
+                     (GL_TRIANGLES, 3, GL_UNSIGNED_INT, NULL));
+   _mesa_glthread_finish(&ctx);
+   EXPECT_EQ(3u, draws);
+   EXPECT_EQ(1u, sync_draws);
+
+   /* Vertices from the application's memory */
+   static const GLfloat verts[9] = { 0 };
+   CALL_BindBuffer(_glapi_get_dispatch(), (GL_ARRAY_BUFFER, 0));
+   CALL_VertexPointer(_glapi_get_dispatch(), (3, GL_FLOAT, 0, verts));
+   CALL_DrawArrays(_glapi_get_dispatch(), (GL_TRIANGLES, 0, 3));
+   CALL_DrawElements(_glapi_get_dispatch(),
+                     (GL_TRIANGLES, 3, GL_UNSIGNED_INT, NULL));
+   EXPECT_EQ(5u, draws);
+   EXPECT_EQ(3u, sync_draws);
+}
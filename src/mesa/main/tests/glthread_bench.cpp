@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file glthread_bench.cpp
+ * Draw call rate with and without glthread, against a fake driver whose
+ * draws cost as much as the application's own work between them.  On a
+ * multi-core CPU the driver's share moves to the glthread worker.
+ *
+ * Not part of "make check": build with "make glthread-bench" and run
+ *
+ *    glthread-bench [draws [cost]]
+ *
+ * where cost is the number of busy-wait iterations of each draw, and of
+ * the application's work before it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "main/api_exec.h"
+#include "main/context.h"
+#include "main/glthread.h"
+#include "glapi/glapi.h"
+
+extern "C" {
+#include "main/remap.h"
+}
+
+#include "main/dispatch.h"
+
+static unsigned draws;
+static unsigned draw_cost = 1000;
+
+static void
+spin(unsigned iterations)
+{
+   for (volatile unsigned i = 0; i < iterations; i++)
+      ;
+}
+
+static void GLAPIENTRY
+fake_DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+   draws++;
+
+   /* Stand-in for validation and driver work. */
+   spin(draw_cost);
+}
+
+static void GLAPIENTRY
+fake_Finish(void)
+{
+}
+
+static double
+seconds(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Issue n draws, each after some work of the application's own, and return
+ * the rate of draw calls for the time spent in them.  The total rate,
+ * including the application's work, is returned in total_rate.
+ */
+static double
+draw_rate(unsigned n, double *total_rate)
+{
+   double start = seconds(), in_gl = 0.0;
+
+   for (unsigned i = 0; i < n; i++) {
+      double t;
+
+      spin(draw_cost);
+
+      t = seconds();
+      CALL_DrawArrays(_glapi_get_dispatch(), (GL_TRIANGLES, 0, 3));
+      in_gl += seconds() - t;
+   }
+   CALL_Finish(_glapi_get_dispatch(), ());
+
+   *total_rate = n / (seconds() - start);
+   return n / in_gl;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned n = 100000;
+   double direct, direct_total, threaded, threaded_total;
+   struct gl_context ctx;
+   struct _glapi_table *server;
+
+   if (argc > 1)
+      n = atoi(argv[1]);
+   if (argc > 2)
+      draw_cost = atoi(argv[2]);
+
+   memset(&ctx, 0, sizeof(ctx));
+
+   /* Done by context creation, which isn't needed here. */
+   _mesa_init_remap_table();
+
+   server = _mesa_alloc_dispatch_table();
+   SET_DrawArrays(server, fake_DrawArrays);
+   SET_Finish(server, fake_Finish);
+   ctx.CurrentServerDispatch = server;
+   ctx.CurrentClientDispatch = server;
+
+   _glapi_set_context(&ctx);
+   _glapi_set_dispatch(server);
+
+   direct = draw_rate(n, &direct_total);
+
+   _mesa_glthread_init(&ctx);
+   if (!ctx.GLThread) {
+      fprintf(stderr, "glthread-bench: couldn't start glthread\n");
+      return 1;
+   }
+
+   threaded = draw_rate(n, &threaded_total);
+
+   _mesa_glthread_destroy(&ctx);
+   _glapi_set_dispatch(NULL);
+   _glapi_set_context(NULL);
+   free(server);
+
+   if (draws != 2 * n) {
+      fprintf(stderr, "glthread-bench: %u draws executed, expected %u\n",
+              draws, 2 * n);
+      return 1;
+   }
+
+   printf("draw calls/sec on the application's thread "
+          "(in GL calls / overall):\n"
+          "  direct:   %10.0f / %10.0f\n"
+          "  glthread: %10.0f / %10.0f\n",
+          direct, direct_total, threaded, threaded_total);
+
+   return 0;
+}
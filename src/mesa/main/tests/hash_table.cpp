@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file hash_table.cpp
+ * Tests of the GL object name hash table, with keys both inside and outside
+ * of the range that's looked up without locking.
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <vector>
+
+#include "c11/threads.h"
+#include "util/u_atomic.h"
+
+extern "C" {
+#include "main/hash.h"
+#include "util/macros.h"
+}
+
+static void *
+data_for(GLuint key)
+{
+   return (void *) (uintptr_t) (key * 2 + 1);
+}
+
+static void
+collect_key(GLuint key, void *data, void *userData)
+{
+   std::vector<GLuint> *keys = (std::vector<GLuint> *) userData;
+
+   EXPECT_EQ(data_for(key), data);
+   keys->push_back(key);
+}
+
+class hash_table : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   struct _mesa_HashTable *table;
+};
+
+void
+hash_table::SetUp()
+{
+   table = _mesa_NewHashTable();
+   ASSERT_NE((struct _mesa_HashTable *) NULL, table);
+}
+
+void
+hash_table::TearDown()
+{
+   std::vector<GLuint> keys;
+
+   _mesa_HashDeleteAll(table, collect_key, &keys);
+   EXPECT_EQ(0u, _mesa_HashNumEntries(table));
+   _mesa_DeleteHashTable(table);
+}
+
+static const GLuint test_keys[] = {
+   1, 2, 255, 256, 257, 1000, 65535, 65536, 65537, 1000000, 0xfffffffe,
+};
+
+TEST_F(hash_table, insert_lookup_remove)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(test_keys); i++) {
+      EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, test_keys[i]));
+      _mesa_HashInsert(table, test_keys[i], data_for(test_keys[i]));
+   }
+   EXPECT_EQ(ARRAY_SIZE(test_keys), _mesa_HashNumEntries(table));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(test_keys); i++)
+      EXPECT_EQ(data_for(test_keys[i]), _mesa_HashLookup(table, test_keys[i]));
+
+   EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, 3));
+   EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, 70000));
+
+   /* Replacing an entry doesn't add one. */
+   _mesa_HashInsert(table, 2, data_for(2));
+   _mesa_HashInsert(table, 65536, data_for(65536));
+   EXPECT_EQ(ARRAY_SIZE(test_keys), _mesa_HashNumEntries(table));
+
+   _mesa_HashRemove(table, 2);
+   _mesa_HashRemove(table, 65536);
+   EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, 2));
+   EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, 65536));
+   EXPECT_EQ(data_for(1), _mesa_HashLookup(table, 1));
+   EXPECT_EQ(data_for(65537), _mesa_HashLookup(table, 65537));
+   EXPECT_EQ(ARRAY_SIZE(test_keys) - 2, _mesa_HashNumEntries(table));
+
+   _mesa_HashLockMutex(table);
+   EXPECT_EQ(data_for(255), _mesa_HashLookupLocked(table, 255));
+   EXPECT_EQ(data_for(1000000), _mesa_HashLookupLocked(table, 1000000));
+   _mesa_HashUnlockMutex(table);
+}
+
+TEST_F(hash_table, walk)
+{
+   std::vector<GLuint> keys;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(test_keys); i++)
+      _mesa_HashInsert(table, test_keys[i], data_for(test_keys[i]));
+
+   _mesa_HashWalk(table, collect_key, &keys);
+   EXPECT_EQ(ARRAY_SIZE(test_keys), keys.size());
+
+   keys.clear();
+   _mesa_HashDeleteAll(table, collect_key, &keys);
+   EXPECT_EQ(ARRAY_SIZE(test_keys), keys.size());
+   EXPECT_EQ(0u, _mesa_HashNumEntries(table));
+   EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, 1));
+   EXPECT_EQ((void *) NULL, _mesa_HashLookup(table, 1000000));
+}
+
+TEST_F(hash_table, find_free_key_block)
+{
+   EXPECT_EQ(1u, _mesa_HashFindFreeKeyBlock(table, 10));
+
+   for (GLuint key = 1; key <= 10; key++)
+      _mesa_HashInsert(table, key, data_for(key));
+   EXPECT_EQ(11u, _mesa_HashFindFreeKeyBlock(table, 10));
+
+   /* Once the maximum key is near the end of the range, the block has to
+    * come from the gaps between the keys in use.
+    */
+   _mesa_HashInsert(table, 0xfffffffd, data_for(0xfffffffd));
+   EXPECT_EQ(11u, _mesa_HashFindFreeKeyBlock(table, 100));
+
+   _mesa_HashInsert(table, 20, data_for(20));
+   EXPECT_EQ(21u, _mesa_HashFindFreeKeyBlock(table, 10));
+   EXPECT_EQ(11u, _mesa_HashFindFreeKeyBlock(table, 9));
+
+   /* A block that has to go past the dense keys. */
+   _mesa_HashInsert(table, 60000, data_for(60000));
+   _mesa_HashInsert(table, 70000, data_for(70000));
+   EXPECT_EQ(70001u, _mesa_HashFindFreeKeyBlock(table, 100000));
+
+   /* Nothing fits past the last key. */
+   EXPECT_EQ(0u, _mesa_HashFindFreeKeyBlock(table, 0xfffffff0));
+}
+
+/* Spans several pages of the dense keys, and a few sparse ones. */
+#define CONCURRENT_KEYS 4096
+
+struct concurrent_insert {
+   struct _mesa_HashTable *table;
+   GLuint objects[CONCURRENT_KEYS];
+   int done;
+};
+
+static GLuint
+concurrent_key(unsigned i)
+{
+   return i % 16 == 15 ? 100000 + i : i + 1;
+}
+
+static int
+insert_thread(void *arg)
+{
+   struct concurrent_insert *ci = (struct concurrent_insert *) arg;
+
+   for (unsigned i = 0; i < CONCURRENT_KEYS; i++) {
+      ci->objects[i] = concurrent_key(i);
+      _mesa_HashInsert(ci->table, concurrent_key(i), &ci->objects[i]);
+   }
+   p_atomic_set_release(&ci->done, 1);
+
+   return 0;
+}
+
+/* An object found by a lookup racing with its insertion must be seen
+ * initialized.
+ */
+static void
+check_lookups(struct concurrent_insert *ci)
+{
+   for (unsigned i = 0; i < CONCURRENT_KEYS; i++) {
+      GLuint *obj = (GLuint *) _mesa_HashLookup(ci->table, concurrent_key(i));
+      if (obj) {
+         ASSERT_EQ(concurrent_key(i), *obj);
+      }
+   }
+}
+
+TEST_F(hash_table, concurrent_insert_lookup)
+{
+   struct concurrent_insert *ci = new concurrent_insert();
+   thrd_t thread;
+
+   ci->table = table;
+   ci->done = 0;
+   ASSERT_EQ(thrd_success, thrd_create(&thread, insert_thread, ci));
+
+   while (!p_atomic_read_acquire(&ci->done))
+      check_lookups(ci);
+   thrd_join(thread, NULL);
+
+   for (unsigned i = 0; i < CONCURRENT_KEYS; i++) {
+      EXPECT_EQ(&ci->objects[i],
+                _mesa_HashLookup(table, concurrent_key(i)));
+      _mesa_HashRemove(table, concurrent_key(i));
+   }
+
+   delete ci;
+}
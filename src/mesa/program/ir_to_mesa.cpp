@@ -33,6 +33,7 @@
 #include "main/compiler.h"
 #include "main/macros.h"
 #include "main/mtypes.h"
+#include "main/shader_cache.h"
 #include "main/shaderapi.h"
 #include "main/shaderobj.h"
 #include "main/uniforms.h"
@@ -3032,6 +3033,23 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       }
    }
 
+   if (prog->LinkStatus && _mesa_shader_cache_load_program(ctx, prog))
+      return;
+
+   /* Compile the shaders whose compile was skipped in the hope of finding
+    * this program in the shader cache.
+    */
+   for (i = 0; i < prog->NumShaders && prog->LinkStatus; i++) {
+      struct gl_shader *sh = prog->Shaders[i];
+
+      if (sh->CompileSkipped) {
+         _mesa_glsl_compile_shader(ctx, sh, false, false);
+         sh->CompileSkipped = false;
+         if (!sh->CompileStatus)
+            linker_error(prog, "linking with uncompiled shader");
+      }
+   }
+
    if (prog->LinkStatus) {
       link_shaders(ctx, prog);
    }
@@ -3042,6 +3060,9 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       }
    }
 
+   if (prog->LinkStatus)
+      _mesa_shader_cache_store_program(ctx, prog);
+
    if (ctx->_Shader->Flags & GLSL_DUMP) {
       if (!prog->LinkStatus) {
 	 fprintf(stderr, "GLSL shader program %d failed to link\n", prog->Name);
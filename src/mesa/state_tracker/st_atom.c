@@ -29,10 +29,13 @@
 #include <stdio.h>
 #include "main/glheader.h"
 #include "main/context.h"
+#include "main/imports.h"
 
 #include "pipe/p_defines.h"
+#include "os/os_time.h"
 #include "st_context.h"
 #include "st_atom.h"
+#include "st_debug.h"
 #include "st_program.h"
 #include "st_manager.h"
 
@@ -114,41 +117,120 @@ static const struct st_tracked_state *compute_atoms[] =
 };
 
 
-void st_init_atoms( struct st_context *st )
+static const struct st_tracked_state **
+get_atoms(enum st_pipeline pipeline, GLuint *num_atoms)
 {
-   /* no-op */
+   STATIC_ASSERT(ARRAY_SIZE(render_atoms) <= ST_MAX_ATOMS);
+   STATIC_ASSERT(ARRAY_SIZE(compute_atoms) <= ST_MAX_ATOMS);
+
+   switch (pipeline) {
+   case ST_PIPELINE_RENDER:
+      *num_atoms = ARRAY_SIZE(render_atoms);
+      return render_atoms;
+   case ST_PIPELINE_COMPUTE:
+      *num_atoms = ARRAY_SIZE(compute_atoms);
+      return compute_atoms;
+   default:
+      unreachable("Invalid pipeline specified");
+   }
 }
 
 
-void st_destroy_atoms( struct st_context *st )
+void st_init_atoms( struct st_context *st )
 {
-   /* no-op */
-}
+   unsigned pipeline;
+
+   for (pipeline = 0; pipeline < ST_NUM_PIPELINES; pipeline++) {
+      struct st_atom_dispatch *dispatch = &st->atom_dispatch[pipeline];
+      const struct st_tracked_state **atoms;
+      GLuint num_atoms;
+      GLuint i;
 
+      atoms = get_atoms(pipeline, &num_atoms);
+      memset(dispatch, 0, sizeof(*dispatch));
+
+      for (i = 0; i < num_atoms; i++) {
+         GLbitfield mesa = atoms[i]->dirty.mesa;
+         uint64_t flags = atoms[i]->dirty.st;
+
+         if (!(mesa || flags) || !atoms[i]->update) {
+            _mesa_problem(NULL, "malformed atom %s", atoms[i]->name);
+            assert(0);
+         }
+
+         while (mesa) {
+            dispatch->mesa[ffs(mesa) - 1] |= BITFIELD64_BIT(i);
+            mesa &= mesa - 1;
+         }
+         while (flags) {
+            dispatch->st[ffsll(flags) - 1] |= BITFIELD64_BIT(i);
+            flags &= flags - 1;
+         }
+      }
+   }
+
+   memset(st->atom_stats, 0, sizeof(st->atom_stats));
+}
 
 
-static bool
-check_state(const struct st_state_flags *a, const struct st_state_flags *b)
+void st_destroy_atoms( struct st_context *st )
 {
-   return (a->mesa & b->mesa) || (a->st & b->st);
+   if (ST_DEBUG & DEBUG_ATOMS)
+      st_print_atom_stats(st);
 }
 
 
-static void
-accumulate_state(struct st_state_flags *a, const struct st_state_flags *b)
+/**
+ * Print how often each atom was updated and, with ST_DEBUG=atoms, how
+ * long it took.  Can also be called from a debugger.
+ */
+void st_print_atom_stats( struct st_context *st )
 {
-   a->mesa |= b->mesa;
-   a->st |= b->st;
+   unsigned pipeline;
+
+   for (pipeline = 0; pipeline < ST_NUM_PIPELINES; pipeline++) {
+      const struct st_tracked_state **atoms;
+      GLuint num_atoms;
+      GLuint i;
+
+      atoms = get_atoms(pipeline, &num_atoms);
+
+      for (i = 0; i < num_atoms; i++) {
+         const struct st_atom_stats *stats = &st->atom_stats[pipeline][i];
+
+         if (!stats->calls)
+            continue;
+
+         debug_printf("st: %-24s %9u calls, %10.3f ms, %8.3f us/call\n",
+                      atoms[i]->name, stats->calls,
+                      stats->time / 1000000.0,
+                      stats->time / 1000.0 / stats->calls);
+      }
+   }
 }
 
 
-static void
-xor_states(struct st_state_flags *result,
-           const struct st_state_flags *a,
-           const struct st_state_flags *b)
+/**
+ * Return the mask of the atoms which check any of the given flags.
+ */
+static inline uint64_t
+get_dirty_atoms(const struct st_atom_dispatch *dispatch,
+                const struct st_state_flags *state)
 {
-   result->mesa = a->mesa ^ b->mesa;
-   result->st = a->st ^ b->st;
+   GLbitfield mesa = state->mesa;
+   uint64_t flags = state->st;
+   uint64_t dirty_atoms = 0;
+
+   while (mesa) {
+      dirty_atoms |= dispatch->mesa[ffs(mesa) - 1];
+      mesa &= mesa - 1;
+   }
+   while (flags) {
+      dirty_atoms |= dispatch->st[ffsll(flags) - 1];
+      flags &= flags - 1;
+   }
+
+   return dirty_atoms;
 }
 
 
@@ -201,22 +283,21 @@ static void check_attrib_edgeflag(struct st_context *st)
 
 void st_validate_state( struct st_context *st, enum st_pipeline pipeline )
 {
+   const struct st_atom_dispatch *dispatch = &st->atom_dispatch[pipeline];
+   struct st_atom_stats *atom_stats = st->atom_stats[pipeline];
    const struct st_tracked_state **atoms;
    struct st_state_flags *state;
+   uint64_t dirty_atoms;
    GLuint num_atoms;
-   GLuint i;
 
    /* Get pipeline state. */
+   atoms = get_atoms(pipeline, &num_atoms);
    switch (pipeline) {
-    case ST_PIPELINE_RENDER:
-      atoms     = render_atoms;
-      num_atoms = ARRAY_SIZE(render_atoms);
-      state     = &st->dirty;
+   case ST_PIPELINE_RENDER:
+      state = &st->dirty;
       break;
    case ST_PIPELINE_COMPUTE:
-      atoms     = compute_atoms;
-      num_atoms = ARRAY_SIZE(compute_atoms);
-      state     = &st->dirty_cp;
+      state = &st->dirty_cp;
       break;
    default:
       unreachable("Invalid pipeline specified");
@@ -240,53 +321,41 @@ void st_validate_state( struct st_context *st, enum st_pipeline pipeline )
 
    /*printf("%s %x/%x\n", __func__, state->mesa, state->st);*/
 
-#ifdef DEBUG
-   if (1) {
-#else
-   if (0) {
-#endif
-      /* Debug version which enforces various sanity checks on the
-       * state flags which are generated and checked to help ensure
-       * state atoms are ordered correctly in the list.
-       */
-      struct st_state_flags examined, prev;      
-      memset(&examined, 0, sizeof(examined));
-      prev = *state;
+   /* Visit the atoms of the dirty flags only, in list order.  Atoms may
+    * dirty more state, which must only be checked by atoms later in the
+    * list.
+    */
+   dirty_atoms = get_dirty_atoms(dispatch, state);
 
-      for (i = 0; i < num_atoms; i++) {
-	 const struct st_tracked_state *atom = atoms[i];
-	 struct st_state_flags generated;
-	 
-	 /*printf("atom %s %x/%x\n", atom->name, atom->dirty.mesa, atom->dirty.st);*/
-
-	 if (!(atom->dirty.mesa || atom->dirty.st) ||
-	     !atom->update) {
-	    printf("malformed atom %s\n", atom->name);
-	    assert(0);
-	 }
-
-	 if (check_state(state, &atom->dirty)) {
-	    atoms[i]->update( st );
-	    /*printf("after: %x\n", atom->dirty.mesa);*/
-	 }
-
-	 accumulate_state(&examined, &atom->dirty);
-
-	 /* generated = (prev ^ state)
-	  * if (examined & generated)
-	  *     fail;
-	  */
-	 xor_states(&generated, &prev, state);
-	 assert(!check_state(&examined, &generated));
-	 prev = *state;
+   while (dirty_atoms) {
+      const GLuint i = ffsll(dirty_atoms) - 1;
+      const uint64_t examined = BITFIELD64_MASK(i + 1);
+      struct st_state_flags prev = *state;
+
+      dirty_atoms &= ~examined;
+
+      if (unlikely(ST_DEBUG & DEBUG_ATOMS)) {
+         int64_t t0 = os_time_get_nano();
+         atoms[i]->update( st );
+         atom_stats[i].time += os_time_get_nano() - t0;
+      }
+      else {
+         atoms[i]->update( st );
       }
-      /*printf("\n");*/
+      atom_stats[i].calls++;
 
-   }
-   else {
-      for (i = 0; i < num_atoms; i++) {
-	 if (check_state(state, &atoms[i]->dirty))
-	    atoms[i]->update( st );
+      if (state->mesa != prev.mesa || state->st != prev.st) {
+         struct st_state_flags generated;
+         uint64_t generated_atoms;
+
+         generated.mesa = state->mesa ^ prev.mesa;
+         generated.st = state->st ^ prev.st;
+         generated_atoms = get_dirty_atoms(dispatch, &generated);
+
+         /* Catch atoms which are ordered incorrectly in the list. */
+         assert(!(generated_atoms & examined));
+
+         dirty_atoms |= generated_atoms & ~examined;
       }
    }
 
@@ -44,6 +44,7 @@ struct st_tracked_state;
 
 void st_init_atoms( struct st_context *st );
 void st_destroy_atoms( struct st_context *st );
+void st_print_atom_stats( struct st_context *st );
 
 
 void st_validate_state( struct st_context *st, enum st_pipeline pipeline );
@@ -173,7 +173,8 @@ update_gp( struct st_context *st )
    assert(stgp->Base.Base.Target == GL_GEOMETRY_PROGRAM_NV);
 
    st->gp_variant = st_get_basic_variant(st, PIPE_SHADER_GEOMETRY,
-                                         &stgp->tgsi, &stgp->variants);
+                                         &stgp->tgsi, &stgp->variants,
+                                         &stgp->variant_cache);
 
    st_reference_geomprog(st, &st->gp, stgp);
 
@@ -206,7 +207,8 @@ update_tcp( struct st_context *st )
    assert(sttcp->Base.Base.Target == GL_TESS_CONTROL_PROGRAM_NV);
 
    st->tcp_variant = st_get_basic_variant(st, PIPE_SHADER_TESS_CTRL,
-                                          &sttcp->tgsi, &sttcp->variants);
+                                          &sttcp->tgsi, &sttcp->variants,
+                                          &sttcp->variant_cache);
 
    st_reference_tesscprog(st, &st->tcp, sttcp);
 
@@ -239,7 +241,8 @@ update_tep( struct st_context *st )
    assert(sttep->Base.Base.Target == GL_TESS_EVALUATION_PROGRAM_NV);
 
    st->tep_variant = st_get_basic_variant(st, PIPE_SHADER_TESS_EVAL,
-                                          &sttep->tgsi, &sttep->variants);
+                                          &sttep->tgsi, &sttep->variants,
+                                          &sttep->variant_cache);
 
    st_reference_tesseprog(st, &st->tep, sttep);
 
@@ -271,7 +274,8 @@ update_cp( struct st_context *st )
    stcp = st_compute_program(st->ctx->ComputeProgram._Current);
    assert(stcp->Base.Base.Target == GL_COMPUTE_PROGRAM_NV);
 
-   st->cp_variant = st_get_cp_variant(st, &stcp->tgsi, &stcp->variants);
+   st->cp_variant = st_get_cp_variant(st, &stcp->tgsi, &stcp->variants,
+                                      &stcp->variant_cache);
 
    st_reference_compprog(st, &st->cp, stcp);
 
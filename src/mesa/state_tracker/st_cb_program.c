@@ -162,7 +162,8 @@ st_delete_program(struct gl_context *ctx, struct gl_program *prog)
             (struct st_geometry_program *) prog;
 
          st_release_basic_variants(st, stgp->Base.Base.Target,
-                                   &stgp->variants, &stgp->tgsi);
+                                   &stgp->variants,
+                                   &stgp->variant_cache, &stgp->tgsi);
          
          if (stgp->glsl_to_tgsi)
             free_glsl_to_tgsi_visitor(stgp->glsl_to_tgsi);
@@ -185,7 +186,8 @@ st_delete_program(struct gl_context *ctx, struct gl_program *prog)
             (struct st_tessctrl_program *) prog;
 
          st_release_basic_variants(st, sttcp->Base.Base.Target,
-                                   &sttcp->variants, &sttcp->tgsi);
+                                   &sttcp->variants,
+                                   &sttcp->variant_cache, &sttcp->tgsi);
 
          if (sttcp->glsl_to_tgsi)
             free_glsl_to_tgsi_visitor(sttcp->glsl_to_tgsi);
@@ -197,7 +199,8 @@ st_delete_program(struct gl_context *ctx, struct gl_program *prog)
             (struct st_tesseval_program *) prog;
 
          st_release_basic_variants(st, sttep->Base.Base.Target,
-                                   &sttep->variants, &sttep->tgsi);
+                                   &sttep->variants,
+                                   &sttep->variant_cache, &sttep->tgsi);
 
          if (sttep->glsl_to_tgsi)
             free_glsl_to_tgsi_visitor(sttep->glsl_to_tgsi);
@@ -250,7 +253,8 @@ st_program_string_notify( struct gl_context *ctx,
       struct st_geometry_program *stgp = (struct st_geometry_program *) prog;
 
       st_release_basic_variants(st, stgp->Base.Base.Target,
-                                &stgp->variants, &stgp->tgsi);
+                                &stgp->variants,
+                                &stgp->variant_cache, &stgp->tgsi);
       if (!st_translate_geometry_program(st, stgp))
          return false;
 
@@ -272,7 +276,8 @@ st_program_string_notify( struct gl_context *ctx,
          (struct st_tessctrl_program *) prog;
 
       st_release_basic_variants(st, sttcp->Base.Base.Target,
-                                &sttcp->variants, &sttcp->tgsi);
+                                &sttcp->variants,
+                                &sttcp->variant_cache, &sttcp->tgsi);
       if (!st_translate_tessctrl_program(st, sttcp))
          return false;
 
@@ -284,7 +289,8 @@ st_program_string_notify( struct gl_context *ctx,
          (struct st_tesseval_program *) prog;
 
       st_release_basic_variants(st, sttep->Base.Base.Target,
-                                &sttep->variants, &sttep->tgsi);
+                                &sttep->variants,
+                                &sttep->variant_cache, &sttep->tgsi);
       if (!st_translate_tesseval_program(st, sttep))
          return false;
 
@@ -86,6 +86,27 @@ struct st_tracked_state {
 enum st_pipeline {
    ST_PIPELINE_RENDER,
    ST_PIPELINE_COMPUTE,
+   ST_NUM_PIPELINES
+};
+
+
+/** Maximum number of atoms in a pipeline's atom list */
+#define ST_MAX_ATOMS 64
+
+/**
+ * For each dirty flag, the mask of the atoms of a pipeline which check it,
+ * so that validation only visits the atoms of the flags which are set.
+ * Built from the atom lists by st_init_atoms().
+ */
+struct st_atom_dispatch {
+   uint64_t mesa[32];   /**< indexed by _NEW_x bit */
+   uint64_t st[64];     /**< indexed by ST_NEW_x bit */
+};
+
+/** Per-atom statistics, see st_print_atom_stats() */
+struct st_atom_stats {
+   unsigned calls;
+   uint64_t time;       /**< in nanoseconds, only kept with ST_DEBUG=atoms */
 };
 
 
@@ -174,6 +195,9 @@ struct st_context
    struct st_state_flags dirty;
    struct st_state_flags dirty_cp;
 
+   struct st_atom_dispatch atom_dispatch[ST_NUM_PIPELINES];
+   struct st_atom_stats atom_stats[ST_NUM_PIPELINES][ST_MAX_ATOMS];
+
    GLboolean vertdata_edgeflags;
    GLboolean edgeflag_culls_prims;
 
@@ -58,6 +58,8 @@ static const struct debug_named_value st_debug_flags[] = {
    { "wf",       DEBUG_WIREFRAME, NULL },
    { "precompile",  DEBUG_PRECOMPILE, NULL },
    { "gremedy",  DEBUG_GREMEDY, "Enable GREMEDY debug extensions" },
+   { "variants", DEBUG_VARIANTS, "Print shader variant lookup statistics" },
+   { "atoms",    DEBUG_ATOMS, "Time state atoms, print their statistics" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -335,6 +335,11 @@ void st_init_limits(struct pipe_screen *screen,
 
    c->StripTextureBorder = GL_TRUE;
 
+#ifdef ENABLE_SHADER_CACHE
+   /* Programs are saved as TGSI, see st_shader_cache.c */
+   c->NumProgramBinaryFormats = 1;
+#endif
+
    c->GLSLSkipStrictMaxUniformLimitCheck =
       screen->get_param(screen, PIPE_CAP_TGSI_CAN_COMPACT_CONSTANTS);
 
@@ -34,6 +34,7 @@
 #include "main/texstate.h"
 #include "main/errors.h"
 #include "main/framebuffer.h"
+#include "main/glthread.h"
 #include "main/fbobject.h"
 #include "main/renderbuffer.h"
 #include "main/version.h"
@@ -499,6 +500,9 @@ st_context_flush(struct st_context_iface *stctxi, unsigned flags,
    struct st_context *st = (struct st_context *) stctxi;
    unsigned pipe_flags = 0;
 
+   /* The worker may still have commands to submit. */
+   _mesa_glthread_finish(st->ctx);
+
    if (flags & ST_FLUSH_END_OF_FRAME) {
       pipe_flags |= PIPE_FLUSH_END_OF_FRAME;
    }
@@ -541,6 +545,8 @@ st_context_teximage(struct st_context_iface *stctxi,
       return FALSE;
    }
 
+   _mesa_glthread_finish(ctx);
+
    texObj = _mesa_get_current_tex_object(ctx, target);
 
    _mesa_lock_texture(ctx, texObj);
@@ -605,6 +611,8 @@ st_context_copy(struct st_context_iface *stctxi,
    struct st_context *st = (struct st_context *) stctxi;
    struct st_context *src = (struct st_context *) stsrci;
 
+   _mesa_glthread_finish(src->ctx);
+   _mesa_glthread_finish(st->ctx);
    _mesa_copy_context(src->ctx, st->ctx, mask);
 }
 
@@ -622,6 +630,9 @@ static void
 st_context_destroy(struct st_context_iface *stctxi)
 {
    struct st_context *st = (struct st_context *) stctxi;
+
+   /* Stop the worker before tearing down the state it uses. */
+   _mesa_glthread_destroy(st->ctx);
    st_destroy_context(st);
 }
 
@@ -718,6 +729,13 @@ st_api_create_context(struct st_api *stapi, struct st_manager *smapi,
    st->iface.cso_context = st->cso_context;
    st->iface.pipe = st->pipe;
 
+   /* Synchronous debug output needs the calls to happen on the application's
+    * thread, so debug contexts don't get glthread.
+    */
+   if (attribs->options.mesa_glthread &&
+       !(attribs->flags & ST_CONTEXT_FLAG_DEBUG))
+      _mesa_glthread_init(st->ctx);
+
    *error = ST_CONTEXT_SUCCESS;
    return &st->iface;
 }
@@ -32,6 +32,7 @@
 
 
 #include "main/imports.h"
+#include "main/enums.h"
 #include "main/hash.h"
 #include "main/mtypes.h"
 #include "program/prog_parameter.h"
@@ -46,6 +47,7 @@
 #include "tgsi/tgsi_emulate.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_ureg.h"
+#include "util/hash_table.h"
 
 #include "st_debug.h"
 #include "st_cb_bitmap.h"
@@ -57,6 +59,133 @@
 
 
 
+static uint32_t
+vp_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct st_vp_variant_key));
+}
+
+static bool
+vp_key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct st_vp_variant_key)) == 0;
+}
+
+static uint32_t
+fp_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct st_fp_variant_key));
+}
+
+static bool
+fp_key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct st_fp_variant_key)) == 0;
+}
+
+static uint32_t
+basic_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct st_basic_variant_key));
+}
+
+static bool
+basic_key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct st_basic_variant_key)) == 0;
+}
+
+
+/**
+ * Look up the variant with the given key and precomputed hash.
+ * Returns NULL if there's none yet.
+ */
+static void *
+lookup_variant(struct st_variant_cache *cache,
+               const void *key, size_t key_size, uint32_t hash)
+{
+   struct hash_entry *entry;
+
+   cache->lookups++;
+
+   if (cache->last_variant && memcmp(cache->last_key, key, key_size) == 0) {
+      cache->hits++;
+      return cache->last_variant;
+   }
+
+   if (!cache->table)
+      return NULL;
+
+   entry = _mesa_hash_table_search_pre_hashed(cache->table, hash, key);
+   if (!entry)
+      return NULL;
+
+   cache->hits++;
+   cache->last_key = entry->key;
+   cache->last_variant = entry->data;
+   return entry->data;
+}
+
+
+/**
+ * Add a newly created variant.  \p key must point into the variant.
+ */
+static void
+insert_variant(struct st_variant_cache *cache,
+               uint32_t (*key_hash)(const void *key),
+               bool (*key_equals)(const void *a, const void *b),
+               const void *key, uint32_t hash, void *variant)
+{
+   cache->creations++;
+   cache->last_key = key;
+   cache->last_variant = variant;
+
+   if (!cache->table) {
+      cache->table = _mesa_hash_table_create(NULL, key_hash, key_equals);
+      if (!cache->table)
+         return;
+   }
+
+   _mesa_hash_table_insert_pre_hashed(cache->table, hash, key, variant);
+}
+
+
+/**
+ * Forget a variant which is about to be deleted.
+ */
+static void
+remove_variant(struct st_variant_cache *cache, const void *key)
+{
+   if (cache->table) {
+      struct hash_entry *entry = _mesa_hash_table_search(cache->table, key);
+      if (entry)
+         _mesa_hash_table_remove(cache->table, entry);
+   }
+
+   if (cache->last_key == key) {
+      cache->last_key = NULL;
+      cache->last_variant = NULL;
+   }
+}
+
+
+/**
+ * Forget all the variants of a program, which are about to be deleted.
+ */
+static void
+release_variant_cache(struct st_variant_cache *cache, GLenum target)
+{
+   if ((ST_DEBUG & DEBUG_VARIANTS) && cache->lookups) {
+      debug_printf("st: %s: %u variant lookups, %u hits, %u variants "
+                   "created\n", _mesa_enum_to_string(target),
+                   cache->lookups, cache->hits, cache->creations);
+   }
+
+   _mesa_hash_table_destroy(cache->table, NULL);
+   memset(cache, 0, sizeof(*cache));
+}
+
+
 /**
  * Delete a vertex program variant.  Note the caller must unlink
  * the variant from the linked list.
@@ -94,6 +223,7 @@ st_release_vp_variants( struct st_context *st,
    }
 
    stvp->variants = NULL;
+   release_variant_cache(&stvp->variant_cache, stvp->Base.Base.Target);
 
    if (stvp->tgsi.tokens) {
       tgsi_free_tokens(stvp->tgsi.tokens);
@@ -131,6 +261,7 @@ st_release_fp_variants(struct st_context *st, struct st_fragment_program *stfp)
    }
 
    stfp->variants = NULL;
+   release_variant_cache(&stfp->variant_cache, stfp->Base.Base.Target);
 
    if (stfp->tgsi.tokens) {
       ureg_free_tokens(stfp->tgsi.tokens);
@@ -176,6 +307,7 @@ delete_basic_variant(struct st_context *st, struct st_basic_variant *v,
 void
 st_release_basic_variants(struct st_context *st, GLenum target,
                           struct st_basic_variant **variants,
+                          struct st_variant_cache *cache,
                           struct pipe_shader_state *tgsi)
 {
    struct st_basic_variant *v;
@@ -187,6 +319,7 @@ st_release_basic_variants(struct st_context *st, GLenum target,
    }
 
    *variants = NULL;
+   release_variant_cache(cache, target);
 
    if (tgsi->tokens) {
       ureg_free_tokens(tgsi->tokens);
@@ -211,6 +344,7 @@ st_release_cp_variants(struct st_context *st, struct st_compute_program *stcp)
    }
 
    *variants = NULL;
+   release_variant_cache(&stcp->variant_cache, stcp->Base.Base.Target);
 
    if (stcp->tgsi.prog) {
       ureg_free_tokens(stcp->tgsi.prog);
@@ -478,14 +612,11 @@ st_get_vp_variant(struct st_context *st,
                   struct st_vertex_program *stvp,
                   const struct st_vp_variant_key *key)
 {
+   uint32_t hash = vp_key_hash(key);
    struct st_vp_variant *vpv;
 
    /* Search for existing variant */
-   for (vpv = stvp->variants; vpv; vpv = vpv->next) {
-      if (memcmp(&vpv->key, key, sizeof(*key)) == 0) {
-         break;
-      }
-   }
+   vpv = lookup_variant(&stvp->variant_cache, key, sizeof(*key), hash);
 
    if (!vpv) {
       /* create now */
@@ -494,6 +625,8 @@ st_get_vp_variant(struct st_context *st,
          /* insert into list */
          vpv->next = stvp->variants;
          stvp->variants = vpv;
+         insert_variant(&stvp->variant_cache, vp_key_hash, vp_key_equals,
+                        &vpv->key, hash, vpv);
       }
    }
 
@@ -959,14 +1092,11 @@ st_get_fp_variant(struct st_context *st,
                   struct st_fragment_program *stfp,
                   const struct st_fp_variant_key *key)
 {
+   uint32_t hash = fp_key_hash(key);
    struct st_fp_variant *fpv;
 
    /* Search for existing variant */
-   for (fpv = stfp->variants; fpv; fpv = fpv->next) {
-      if (memcmp(&fpv->key, key, sizeof(*key)) == 0) {
-         break;
-      }
-   }
+   fpv = lookup_variant(&stfp->variant_cache, key, sizeof(*key), hash);
 
    if (!fpv) {
       /* create new */
@@ -975,6 +1105,8 @@ st_get_fp_variant(struct st_context *st,
          /* insert into list */
          fpv->next = stfp->variants;
          stfp->variants = fpv;
+         insert_variant(&stfp->variant_cache, fp_key_hash, fp_key_equals,
+                        &fpv->key, hash, fpv);
       }
    }
 
@@ -1300,21 +1432,20 @@ struct st_basic_variant *
 st_get_basic_variant(struct st_context *st,
                      unsigned pipe_shader,
                      struct pipe_shader_state *tgsi,
-                     struct st_basic_variant **variants)
+                     struct st_basic_variant **variants,
+                     struct st_variant_cache *cache)
 {
    struct pipe_context *pipe = st->pipe;
    struct st_basic_variant *v;
    struct st_basic_variant_key key;
+   uint32_t hash;
 
    memset(&key, 0, sizeof(key));
    key.st = st->has_shareable_shaders ? NULL : st;
+   hash = basic_key_hash(&key);
 
    /* Search for existing variant */
-   for (v = *variants; v; v = v->next) {
-      if (memcmp(&v->key, &key, sizeof(key)) == 0) {
-         break;
-      }
-   }
+   v = lookup_variant(cache, &key, sizeof(key), hash);
 
    if (!v) {
       /* create new */
@@ -1342,6 +1473,8 @@ st_get_basic_variant(struct st_context *st,
          /* insert into list */
          v->next = *variants;
          *variants = v;
+         insert_variant(cache, basic_key_hash, basic_key_equals,
+                        &v->key, hash, v);
       }
    }
 
@@ -1455,21 +1588,20 @@ st_translate_compute_program(struct st_context *st,
 struct st_basic_variant *
 st_get_cp_variant(struct st_context *st,
                   struct pipe_compute_state *tgsi,
-                  struct st_basic_variant **variants)
+                  struct st_basic_variant **variants,
+                  struct st_variant_cache *cache)
 {
    struct pipe_context *pipe = st->pipe;
    struct st_basic_variant *v;
    struct st_basic_variant_key key;
+   uint32_t hash;
 
    memset(&key, 0, sizeof(key));
    key.st = st->has_shareable_shaders ? NULL : st;
+   hash = basic_key_hash(&key);
 
    /* Search for existing variant */
-   for (v = *variants; v; v = v->next) {
-      if (memcmp(&v->key, &key, sizeof(key)) == 0) {
-         break;
-      }
-   }
+   v = lookup_variant(cache, &key, sizeof(key), hash);
 
    if (!v) {
       /* create new */
@@ -1482,6 +1614,8 @@ st_get_cp_variant(struct st_context *st,
          /* insert into list */
          v->next = *variants;
          *variants = v;
+         insert_variant(cache, basic_key_hash, basic_key_equals,
+                        &v->key, hash, v);
       }
    }
 
@@ -1510,6 +1644,7 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             if (vpv->key.st == st) {
                /* unlink from list */
                *prevPtr = next;
+               remove_variant(&stvp->variant_cache, &vpv->key);
                /* destroy this variant */
                delete_vp_variant(st, vpv);
             }
@@ -1531,6 +1666,7 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             if (fpv->key.st == st) {
                /* unlink from list */
                *prevPtr = next;
+               remove_variant(&stfp->variant_cache, &fpv->key);
                /* destroy this variant */
                delete_fp_variant(st, fpv);
             }
@@ -1556,6 +1692,12 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             target->Target == GL_TESS_EVALUATION_PROGRAM_NV ? &tep->variants :
             target->Target == GL_COMPUTE_PROGRAM_NV ? &cp->variants :
             NULL;
+         struct st_variant_cache *cache =
+            target->Target == GL_GEOMETRY_PROGRAM_NV ? &gp->variant_cache :
+            target->Target == GL_TESS_CONTROL_PROGRAM_NV ? &tcp->variant_cache :
+            target->Target == GL_TESS_EVALUATION_PROGRAM_NV ? &tep->variant_cache :
+            target->Target == GL_COMPUTE_PROGRAM_NV ? &cp->variant_cache :
+            NULL;
          struct st_basic_variant *v, **prevPtr = variants;
 
          for (v = *variants; v; ) {
@@ -1563,6 +1705,7 @@ destroy_program_variants(struct st_context *st, struct gl_program *target)
             if (v->key.st == st) {
                /* unlink from list */
                *prevPtr = next;
+               remove_variant(cache, &v->key);
                /* destroy this variant */
                delete_basic_variant(st, v, target->Target);
             }
@@ -1702,19 +1845,22 @@ st_precompile_shader_variant(struct st_context *st,
 
    case GL_TESS_CONTROL_PROGRAM_NV: {
       struct st_tessctrl_program *p = (struct st_tessctrl_program *)prog;
-      st_get_basic_variant(st, PIPE_SHADER_TESS_CTRL, &p->tgsi, &p->variants);
+      st_get_basic_variant(st, PIPE_SHADER_TESS_CTRL, &p->tgsi, &p->variants,
+                           &p->variant_cache);
       break;
    }
 
    case GL_TESS_EVALUATION_PROGRAM_NV: {
       struct st_tesseval_program *p = (struct st_tesseval_program *)prog;
-      st_get_basic_variant(st, PIPE_SHADER_TESS_EVAL, &p->tgsi, &p->variants);
+      st_get_basic_variant(st, PIPE_SHADER_TESS_EVAL, &p->tgsi, &p->variants,
+                           &p->variant_cache);
       break;
    }
 
    case GL_GEOMETRY_PROGRAM_NV: {
       struct st_geometry_program *p = (struct st_geometry_program *)prog;
-      st_get_basic_variant(st, PIPE_SHADER_GEOMETRY, &p->tgsi, &p->variants);
+      st_get_basic_variant(st, PIPE_SHADER_GEOMETRY, &p->tgsi, &p->variants,
+                           &p->variant_cache);
       break;
    }
 
@@ -1730,7 +1876,7 @@ st_precompile_shader_variant(struct st_context *st,
 
    case GL_COMPUTE_PROGRAM_NV: {
       struct st_compute_program *p = (struct st_compute_program *)prog;
-      st_get_cp_variant(st, &p->tgsi, &p->variants);
+      st_get_cp_variant(st, &p->tgsi, &p->variants, &p->variant_cache);
       break;
    }
 
@@ -47,6 +47,25 @@ extern "C" {
 
 #define ST_DOUBLE_ATTRIB_PLACEHOLDER 0xffffffff
 
+struct hash_table;
+
+/**
+ * Index of a program's variants by key, to avoid walking the variant list.
+ * The variant returned last is checked first, as consecutive lookups
+ * usually want the same one.
+ */
+struct st_variant_cache
+{
+   struct hash_table *table;    /**< variant key -> variant */
+   const void *last_key;        /**< key of last_variant */
+   void *last_variant;
+
+   /** Statistics, printed with ST_DEBUG=variants */
+   unsigned lookups;
+   unsigned hits;
+   unsigned creations;
+};
+
 /** Fragment program variant key */
 struct st_fp_variant_key
 {
@@ -101,6 +120,7 @@ struct st_fragment_program
    struct glsl_to_tgsi_visitor* glsl_to_tgsi;
 
    struct st_fp_variant *variants;
+   struct st_variant_cache variant_cache;
 };
 
 
@@ -167,6 +187,7 @@ struct st_vertex_program
    /** List of translated variants of this vertex program.
     */
    struct st_vp_variant *variants;
+   struct st_variant_cache variant_cache;
 };
 
 
@@ -202,6 +223,7 @@ struct st_geometry_program
    struct glsl_to_tgsi_visitor* glsl_to_tgsi;
 
    struct st_basic_variant *variants;
+   struct st_variant_cache variant_cache;
 };
 
 
@@ -215,6 +237,7 @@ struct st_tessctrl_program
    struct glsl_to_tgsi_visitor* glsl_to_tgsi;
 
    struct st_basic_variant *variants;
+   struct st_variant_cache variant_cache;
 };
 
 
@@ -228,6 +251,7 @@ struct st_tesseval_program
    struct glsl_to_tgsi_visitor* glsl_to_tgsi;
 
    struct st_basic_variant *variants;
+   struct st_variant_cache variant_cache;
 };
 
 
@@ -241,6 +265,7 @@ struct st_compute_program
    struct glsl_to_tgsi_visitor* glsl_to_tgsi;
 
    struct st_basic_variant *variants;
+   struct st_variant_cache variant_cache;
 };
 
 
@@ -381,13 +406,15 @@ st_get_fp_variant(struct st_context *st,
 extern struct st_basic_variant *
 st_get_cp_variant(struct st_context *st,
                   struct pipe_compute_state *tgsi,
-                  struct st_basic_variant **variants);
+                  struct st_basic_variant **variants,
+                  struct st_variant_cache *cache);
 
 extern struct st_basic_variant *
 st_get_basic_variant(struct st_context *st,
                      unsigned pipe_shader,
                      struct pipe_shader_state *tgsi,
-                     struct st_basic_variant **variants);
+                     struct st_basic_variant **variants,
+                     struct st_variant_cache *cache);
 
 extern void
 st_release_vp_variants( struct st_context *st,
@@ -404,6 +431,7 @@ st_release_cp_variants(struct st_context *st,
 extern void
 st_release_basic_variants(struct st_context *st, GLenum target,
                           struct st_basic_variant **variants,
+                          struct st_variant_cache *cache,
                           struct pipe_shader_state *tgsi);
 
 extern void
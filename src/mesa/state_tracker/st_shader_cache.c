@@ -0,0 +1,229 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * \file st_shader_cache.c
+ * Saving and restoring the TGSI of linked programs, for program binaries
+ * and the shader cache.
+ *
+ * Only the translated TGSI and the state derived along with it are stored.
+ * Variants are created from them as usual when the program is used.
+ */
+
+#include "main/mtypes.h"
+#include "main/shaderapi.h"
+#include "program/prog_parameter.h"
+#include "compiler/glsl/blob.h"
+#include "tgsi/tgsi_parse.h"
+#include "util/u_memory.h"
+#include "st_context.h"
+#include "st_debug.h"
+#include "st_program.h"
+#include "st_shader_cache.h"
+
+
+#ifdef ENABLE_SHADER_CACHE
+
+static void
+write_tgsi_tokens(struct blob *blob, const struct tgsi_token *tokens)
+{
+   unsigned num_tokens = tgsi_num_tokens(tokens);
+
+   blob_write_uint32(blob, num_tokens);
+   blob_write_bytes(blob, tokens, num_tokens * sizeof(struct tgsi_token));
+}
+
+static const struct tgsi_token *
+read_tgsi_tokens(struct blob_reader *blob)
+{
+   unsigned num_tokens = blob_read_uint32(blob);
+   struct tgsi_token *tokens;
+
+   if (blob->overrun || num_tokens == 0 ||
+       num_tokens > (blob->end - blob->current) / sizeof(struct tgsi_token))
+      return NULL;
+
+   tokens = tgsi_alloc_tokens(num_tokens);
+   if (tokens)
+      blob_copy_bytes(blob, (uint8_t *) tokens,
+                      num_tokens * sizeof(struct tgsi_token));
+   return tokens;
+}
+
+static void
+write_shader_state(struct blob *blob, const struct pipe_shader_state *tgsi)
+{
+   write_tgsi_tokens(blob, tgsi->tokens);
+   blob_write_bytes(blob, &tgsi->stream_output,
+                    sizeof(tgsi->stream_output));
+}
+
+static bool
+read_shader_state(struct blob_reader *blob, struct pipe_shader_state *tgsi)
+{
+   tgsi->tokens = read_tgsi_tokens(blob);
+   blob_copy_bytes(blob, (uint8_t *) &tgsi->stream_output,
+                   sizeof(tgsi->stream_output));
+   return tgsi->tokens != NULL && !blob->overrun;
+}
+
+
+/**
+ * Called via ctx->Driver.ProgramBinarySerializeDriverBlob()
+ */
+void
+st_serialize_program_binary(struct gl_context *ctx, struct gl_program *prog,
+                            struct blob *blob)
+{
+   switch (prog->Target) {
+   case GL_VERTEX_PROGRAM_ARB: {
+      struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
+
+      write_shader_state(blob, &stvp->tgsi);
+      blob_write_uint32(blob, stvp->num_inputs);
+      blob_write_bytes(blob, stvp->index_to_input,
+                       sizeof(stvp->index_to_input));
+      blob_write_bytes(blob, stvp->result_to_output,
+                       sizeof(stvp->result_to_output));
+      break;
+   }
+   case GL_TESS_CONTROL_PROGRAM_NV:
+      write_shader_state(blob, &((struct st_tessctrl_program *) prog)->tgsi);
+      break;
+   case GL_TESS_EVALUATION_PROGRAM_NV:
+      write_shader_state(blob, &((struct st_tesseval_program *) prog)->tgsi);
+      break;
+   case GL_GEOMETRY_PROGRAM_NV:
+      write_shader_state(blob, &((struct st_geometry_program *) prog)->tgsi);
+      break;
+   case GL_FRAGMENT_PROGRAM_ARB:
+      write_shader_state(blob, &((struct st_fragment_program *) prog)->tgsi);
+      break;
+   case GL_COMPUTE_PROGRAM_NV: {
+      struct st_compute_program *stcp = (struct st_compute_program *) prog;
+
+      write_tgsi_tokens(blob, stcp->tgsi.prog);
+      blob_write_uint32(blob, stcp->tgsi.req_local_mem);
+      blob_write_uint32(blob, stcp->tgsi.req_private_mem);
+      blob_write_uint32(blob, stcp->tgsi.req_input_mem);
+      break;
+   }
+   default:
+      unreachable("unexpected program target");
+   }
+}
+
+
+/**
+ * Called via ctx->Driver.ProgramBinaryDeserializeDriverBlob()
+ */
+GLboolean
+st_deserialize_program_binary(struct gl_context *ctx, struct gl_program *prog,
+                              struct blob_reader *blob)
+{
+   struct st_context *st = st_context(ctx);
+   gl_shader_stage stage = _mesa_program_enum_to_shader_stage(prog->Target);
+   bool ok;
+
+   switch (prog->Target) {
+   case GL_VERTEX_PROGRAM_ARB: {
+      struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
+
+      ok = read_shader_state(blob, &stvp->tgsi);
+      stvp->num_inputs = blob_read_uint32(blob);
+      blob_copy_bytes(blob, (uint8_t *) stvp->index_to_input,
+                      sizeof(stvp->index_to_input));
+      blob_copy_bytes(blob, (uint8_t *) stvp->result_to_output,
+                      sizeof(stvp->result_to_output));
+      ok = ok && stvp->num_inputs <= PIPE_MAX_SHADER_INPUTS;
+      break;
+   }
+   case GL_TESS_CONTROL_PROGRAM_NV:
+      ok = read_shader_state(blob,
+                             &((struct st_tessctrl_program *) prog)->tgsi);
+      break;
+   case GL_TESS_EVALUATION_PROGRAM_NV:
+      ok = read_shader_state(blob,
+                             &((struct st_tesseval_program *) prog)->tgsi);
+      break;
+   case GL_GEOMETRY_PROGRAM_NV:
+      ok = read_shader_state(blob,
+                             &((struct st_geometry_program *) prog)->tgsi);
+      break;
+   case GL_FRAGMENT_PROGRAM_ARB:
+      ok = read_shader_state(blob,
+                             &((struct st_fragment_program *) prog)->tgsi);
+      break;
+   case GL_COMPUTE_PROGRAM_NV: {
+      struct st_compute_program *stcp = (struct st_compute_program *) prog;
+
+      stcp->tgsi.prog = read_tgsi_tokens(blob);
+      stcp->tgsi.req_local_mem = blob_read_uint32(blob);
+      stcp->tgsi.req_private_mem = blob_read_uint32(blob);
+      stcp->tgsi.req_input_mem = blob_read_uint32(blob);
+      ok = stcp->tgsi.prog != NULL;
+      break;
+   }
+   default:
+      return GL_FALSE;
+   }
+
+   if (!ok || blob->overrun)
+      return GL_FALSE;
+
+   /* Same as get_mesa_program(): make room for the state parameters added
+    * when variants are created, before uniform storage is associated.
+    */
+   _mesa_reserve_parameter_storage(prog->Parameters, 8);
+
+   if (ST_DEBUG & DEBUG_PRECOMPILE ||
+       st->shader_has_one_variant[stage])
+      st_precompile_shader_variant(st, prog);
+
+   return GL_TRUE;
+}
+
+
+/**
+ * Plug in the program binary driver functions.
+ */
+void
+st_init_shader_cache_functions(struct dd_function_table *functions)
+{
+   functions->ProgramBinarySerializeDriverBlob = st_serialize_program_binary;
+   functions->ProgramBinaryDeserializeDriverBlob =
+      st_deserialize_program_binary;
+}
+
+#else
+
+void
+st_init_shader_cache_functions(struct dd_function_table *functions)
+{
+}
+
+#endif /* ENABLE_SHADER_CACHE */
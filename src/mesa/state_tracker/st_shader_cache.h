@@ -0,0 +1,50 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#ifndef ST_SHADER_CACHE_H
+#define ST_SHADER_CACHE_H
+
+#include "main/compiler.h"
+
+struct blob;
+struct blob_reader;
+struct dd_function_table;
+struct gl_context;
+struct gl_program;
+
+extern void
+st_serialize_program_binary(struct gl_context *ctx, struct gl_program *prog,
+                            struct blob *blob);
+
+extern GLboolean
+st_deserialize_program_binary(struct gl_context *ctx, struct gl_program *prog,
+                              struct blob_reader *blob);
+
+extern void
+st_init_shader_cache_functions(struct dd_function_table *functions);
+
+#endif /* ST_SHADER_CACHE_H */
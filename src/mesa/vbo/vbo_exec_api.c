@@ -779,11 +779,13 @@ static void GLAPIENTRY vbo_exec_Begin( GLenum mode )
    /* We may have been called from a display list, in which case we should
     * leave dlist.c's dispatch table in place.
     */
-   if (ctx->CurrentDispatch == ctx->OutsideBeginEnd) {
-      ctx->CurrentDispatch = ctx->BeginEnd;
-      _glapi_set_dispatch(ctx->CurrentDispatch);
+   if (ctx->CurrentServerDispatch == ctx->OutsideBeginEnd) {
+      ctx->CurrentServerDispatch = ctx->BeginEnd;
+      _glapi_set_dispatch(ctx->CurrentServerDispatch);
+      if (!ctx->MarshalExec)
+         ctx->CurrentClientDispatch = ctx->CurrentServerDispatch;
    } else {
-      assert(ctx->CurrentDispatch == ctx->Save);
+      assert(ctx->CurrentServerDispatch == ctx->Save);
    }
 }
 
@@ -830,9 +832,11 @@ static void GLAPIENTRY vbo_exec_End( void )
    }
 
    ctx->Exec = ctx->OutsideBeginEnd;
-   if (ctx->CurrentDispatch == ctx->BeginEnd) {
-      ctx->CurrentDispatch = ctx->OutsideBeginEnd;
-      _glapi_set_dispatch(ctx->CurrentDispatch);
+   if (ctx->CurrentServerDispatch == ctx->BeginEnd) {
+      ctx->CurrentServerDispatch = ctx->OutsideBeginEnd;
+      _glapi_set_dispatch(ctx->CurrentServerDispatch);
+      if (!ctx->MarshalExec)
+         ctx->CurrentClientDispatch = ctx->CurrentServerDispatch;
    }
 
    if (exec->vtx.prim_count > 0) {
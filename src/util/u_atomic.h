@@ -47,6 +47,17 @@
 #define p_atomic_cmpxchg(v, old, _new) \
    __sync_val_compare_and_swap((v), (old), (_new))
 
+#if defined(__ATOMIC_ACQUIRE)
+#define p_atomic_set_release(_v, _i) __atomic_store_n((_v), (_i), __ATOMIC_RELEASE)
+#define p_atomic_read_acquire(_v) __atomic_load_n((_v), __ATOMIC_ACQUIRE)
+#else
+#define p_atomic_set_release(_v, _i) (__sync_synchronize(), *(_v) = (_i))
+#define p_atomic_read_acquire(_v) __extension__ ({ \
+   __typeof__(*(_v)) _r = *(volatile __typeof__(*(_v)) *) (_v); \
+   __sync_synchronize(); \
+   _r; })
+#endif
+
 #endif
 
 
@@ -60,6 +71,8 @@
 
 #define p_atomic_set(_v, _i) (*(_v) = (_i))
 #define p_atomic_read(_v) (*(_v))
+#define p_atomic_set_release(_v, _i) (*(_v) = (_i))
+#define p_atomic_read_acquire(_v) (*(_v))
 #define p_atomic_dec_zero(_v) (p_atomic_dec_return(_v) == 0)
 #define p_atomic_inc(_v) ((void) p_atomic_inc_return(_v))
 #define p_atomic_dec(_v) ((void) p_atomic_dec_return(_v))
@@ -97,6 +110,14 @@
 #define p_atomic_set(_v, _i) (*(_v) = (_i))
 #define p_atomic_read(_v) (*(_v))
 
+/* Only x86 and x64 are targeted with MSVC.  Their loads already have
+ * acquire semantics, and stores release semantics, in hardware.
+ * XXX: the load isn't a compiler barrier, which needs typeof or C11
+ * atomics to express.
+ */
+#define p_atomic_set_release(_v, _i) (_ReadWriteBarrier(), *(_v) = (_i))
+#define p_atomic_read_acquire(_v) (*(_v))
+
 #define p_atomic_dec_zero(_v) \
    (p_atomic_dec_return(_v) == 0)
 
@@ -143,6 +164,11 @@
 
 #define p_atomic_set(_v, _i) (*(_v) = (_i))
 #define p_atomic_read(_v) (*(_v))
+#define p_atomic_set_release(_v, _i) (membar_producer(), *(_v) = (_i))
+#define p_atomic_read_acquire(_v) ({ \
+   __typeof(*(_v)) _r = *(volatile __typeof(*(_v)) *) (_v); \
+   membar_consumer(); \
+   _r; })
 
 #define p_atomic_dec_zero(v) (\
    sizeof(*v) == sizeof(uint8_t)  ? atomic_dec_8_nv ((uint8_t  *)(v)) == 0 : \